@@ -660,6 +660,14 @@ SOURCE=.\strmatch\apr_strmatch.c
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=.\tables\apr_chash.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\tables\apr_cskiplist.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\tables\apr_hash.c
 # End Source File
 # Begin Source File
@@ -728,6 +736,10 @@ SOURCE=.\user\win32\userinfo.c
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=.\util-misc\apr_counter.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\util-misc\apr_date.c
 # End Source File
 # Begin Source File
@@ -748,8 +760,16 @@ SOURCE=.\util-misc\apr_rmm.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\util-misc\apr_spsc_queue.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\util-misc\apr_thread_pool.c
 # End Source File
+# Begin Source File
+
+SOURCE=.\util-misc\apr_timer_wheel.c
+# End Source File
 # End Group
 # Begin Group "xlate"
 
@@ -999,6 +1019,18 @@ SOURCE=.\include\apr_global_mutex.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_chash.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\apr_counter.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\include\apr_cskiplist.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_hash.h
 # End Source File
 # Begin Source File
@@ -1055,6 +1087,10 @@ SOURCE=.\include\apr_skiplist.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_spsc_queue.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_strings.h
 # End Source File
 # Begin Source File
@@ -1087,6 +1123,10 @@ SOURCE=.\include\apr_time.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_timer_wheel.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_user.h
 # End Source File
 # Begin Source File
@@ -73,3 +73,287 @@ APR_DECLARE(void*) apr_atomic_xchgptr(void *volatile *mem, void *with)
 {
     return (void*)atomic_xchg((unsigned long *)mem,(unsigned long)with);
 }
+
+APR_DECLARE(void*) apr_atomic_readptr(void *volatile *mem)
+{
+    return *mem;
+}
+
+APR_DECLARE(void) apr_atomic_setptr(void *volatile *mem, void *with)
+{
+    *mem = with;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_and32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t prev = *mem, seen;
+
+    while ((seen = apr_atomic_cas32(mem, prev & val, prev)) != prev) {
+        prev = seen;
+    }
+    return prev;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_or32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t prev = *mem, seen;
+
+    while ((seen = apr_atomic_cas32(mem, prev | val, prev)) != prev) {
+        prev = seen;
+    }
+    return prev;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_xor32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t prev = *mem, seen;
+
+    while ((seen = apr_atomic_cas32(mem, prev ^ val, prev)) != prev) {
+        prev = seen;
+    }
+    return prev;
+}
+
+/* The 64-bit operations are serialized by a spinlock */
+static volatile unsigned long lock64;
+
+#define LOCK64() \
+    while (atomic_xchg((unsigned long *)&lock64, 1)) { \
+        NXThreadYield(); \
+    }
+#define UNLOCK64() \
+    atomic_xchg((unsigned long *)&lock64, 0)
+
+APR_DECLARE(apr_uint64_t) apr_atomic_read64(volatile apr_uint64_t *mem)
+{
+    apr_uint64_t val;
+
+    LOCK64();
+    val = *mem;
+    UNLOCK64();
+
+    return val;
+}
+
+APR_DECLARE(void) apr_atomic_set64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    LOCK64();
+    *mem = val;
+    UNLOCK64();
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_add64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_uint64_t prev;
+
+    LOCK64();
+    prev = *mem;
+    *mem += val;
+    UNLOCK64();
+
+    return prev;
+}
+
+APR_DECLARE(void) apr_atomic_sub64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    LOCK64();
+    *mem -= val;
+    UNLOCK64();
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_inc64(volatile apr_uint64_t *mem)
+{
+    return apr_atomic_add64(mem, 1);
+}
+
+APR_DECLARE(int) apr_atomic_dec64(volatile apr_uint64_t *mem)
+{
+    apr_uint64_t new;
+
+    LOCK64();
+    new = --(*mem);
+    UNLOCK64();
+
+    return new != 0;
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_cas64(volatile apr_uint64_t *mem, apr_uint64_t with,
+                                           apr_uint64_t cmp)
+{
+    apr_uint64_t prev;
+
+    LOCK64();
+    prev = *mem;
+    if (prev == cmp) {
+        *mem = with;
+    }
+    UNLOCK64();
+
+    return prev;
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_xchg64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_uint64_t prev;
+
+    LOCK64();
+    prev = *mem;
+    *mem = val;
+    UNLOCK64();
+
+    return prev;
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_and64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_uint64_t prev;
+
+    LOCK64();
+    prev = *mem;
+    *mem &= val;
+    UNLOCK64();
+
+    return prev;
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_or64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_uint64_t prev;
+
+    LOCK64();
+    prev = *mem;
+    *mem |= val;
+    UNLOCK64();
+
+    return prev;
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_xor64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_uint64_t prev;
+
+    LOCK64();
+    prev = *mem;
+    *mem ^= val;
+    UNLOCK64();
+
+    return prev;
+}
+
+/* atomic_xchg() is a full barrier, so all the orders are made SEQ_CST */
+
+APR_DECLARE(void) apr_atomic_fence(apr_atomic_order_e order)
+{
+    static volatile unsigned long dummy;
+
+    if (order != APR_ATOMIC_RELAXED) {
+        atomic_xchg((unsigned long *)&dummy, 0);
+    }
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_ex(volatile apr_uint32_t *mem,
+                                               apr_atomic_order_e order)
+{
+    apr_atomic_fence(order);
+    return *mem;
+}
+
+APR_DECLARE(void) apr_atomic_set32_ex(volatile apr_uint32_t *mem,
+                                      apr_uint32_t val,
+                                      apr_atomic_order_e order)
+{
+    if (order == APR_ATOMIC_RELAXED) {
+        *mem = val;
+    }
+    else {
+        apr_atomic_xchg32(mem, val);
+    }
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_add32_ex(volatile apr_uint32_t *mem,
+                                              apr_uint32_t val,
+                                              apr_atomic_order_e order)
+{
+    return apr_atomic_add32(mem, val);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_cas32_ex(volatile apr_uint32_t *mem,
+                                              apr_uint32_t with,
+                                              apr_uint32_t cmp,
+                                              apr_atomic_order_e order)
+{
+    return apr_atomic_cas32(mem, with, cmp);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_xchg32_ex(volatile apr_uint32_t *mem,
+                                               apr_uint32_t val,
+                                               apr_atomic_order_e order)
+{
+    return apr_atomic_xchg32(mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_read64_ex(volatile apr_uint64_t *mem,
+                                               apr_atomic_order_e order)
+{
+    return apr_atomic_read64(mem);
+}
+
+APR_DECLARE(void) apr_atomic_set64_ex(volatile apr_uint64_t *mem,
+                                      apr_uint64_t val,
+                                      apr_atomic_order_e order)
+{
+    apr_atomic_set64(mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_add64_ex(volatile apr_uint64_t *mem,
+                                              apr_uint64_t val,
+                                              apr_atomic_order_e order)
+{
+    return apr_atomic_add64(mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_cas64_ex(volatile apr_uint64_t *mem,
+                                              apr_uint64_t with,
+                                              apr_uint64_t cmp,
+                                              apr_atomic_order_e order)
+{
+    return apr_atomic_cas64(mem, with, cmp);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_xchg64_ex(volatile apr_uint64_t *mem,
+                                               apr_uint64_t val,
+                                               apr_atomic_order_e order)
+{
+    return apr_atomic_xchg64(mem, val);
+}
+
+APR_DECLARE(void*) apr_atomic_readptr_ex(void *volatile *mem,
+                                         apr_atomic_order_e order)
+{
+    apr_atomic_fence(order);
+    return *mem;
+}
+
+APR_DECLARE(void) apr_atomic_setptr_ex(void *volatile *mem, void *with,
+                                       apr_atomic_order_e order)
+{
+    if (order == APR_ATOMIC_RELAXED) {
+        *mem = with;
+    }
+    else {
+        apr_atomic_xchgptr(mem, with);
+    }
+}
+
+APR_DECLARE(void*) apr_atomic_casptr_ex(void *volatile *mem, void *with,
+                                        const void *cmp,
+                                        apr_atomic_order_e order)
+{
+    return apr_atomic_casptr(mem, with, cmp);
+}
+
+APR_DECLARE(void*) apr_atomic_xchgptr_ex(void *volatile *mem, void *with,
+                                         apr_atomic_order_e order)
+{
+    return apr_atomic_xchgptr(mem, with);
+}
@@ -135,3 +135,267 @@ APR_DECLARE(void*) apr_atomic_xchgptr(void *volatile *mem_ptr, void *new_ptr)
 
     return old_ptr;
 }
+
+void *apr_atomic_readptr(void *volatile *mem)
+{
+    return *mem;
+}
+
+void apr_atomic_setptr(void *volatile *mem, void *with)
+{
+    *mem = with;
+}
+
+apr_uint32_t apr_atomic_and32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t old, new_val;
+
+    old = *mem;   /* old is automatically updated on cs failure */
+    do {
+        new_val = old & val;
+    } while (__cs(&old, (cs_t *)mem, new_val));
+
+    return old;
+}
+
+apr_uint32_t apr_atomic_or32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t old, new_val;
+
+    old = *mem;   /* old is automatically updated on cs failure */
+    do {
+        new_val = old | val;
+    } while (__cs(&old, (cs_t *)mem, new_val));
+
+    return old;
+}
+
+apr_uint32_t apr_atomic_xor32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t old, new_val;
+
+    old = *mem;   /* old is automatically updated on cs failure */
+    do {
+        new_val = old ^ val;
+    } while (__cs(&old, (cs_t *)mem, new_val));
+
+    return old;
+}
+
+apr_uint64_t apr_atomic_read64(volatile apr_uint64_t *mem)
+{
+    apr_uint64_t old = 0, new_val = 0;
+
+    /* old is updated from mem on csg failure, which doesn't store then */
+    __csg(&old, (void *)mem, &new_val);
+    return old;
+}
+
+apr_uint64_t apr_atomic_cas64(volatile apr_uint64_t *mem, apr_uint64_t swap,
+                              apr_uint64_t cmp)
+{
+    apr_uint64_t old = cmp;
+
+    __csg(&old, (void *)mem, &swap);
+    return old; /* old is automatically updated from mem on csg failure */
+}
+
+apr_uint64_t apr_atomic_add64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_uint64_t old, new_val;
+
+    old = apr_atomic_read64(mem);   /* updated on csg failure */
+    do {
+        new_val = old + val;
+    } while (__csg(&old, (void *)mem, &new_val));
+
+    return old;
+}
+
+void apr_atomic_sub64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_atomic_add64(mem, -val);
+}
+
+apr_uint64_t apr_atomic_inc64(volatile apr_uint64_t *mem)
+{
+    return apr_atomic_add64(mem, 1);
+}
+
+int apr_atomic_dec64(volatile apr_uint64_t *mem)
+{
+    return apr_atomic_add64(mem, (apr_uint64_t)-1) != 1;
+}
+
+apr_uint64_t apr_atomic_xchg64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_uint64_t old;
+
+    old = apr_atomic_read64(mem);   /* updated on csg failure */
+    do {
+    } while (__csg(&old, (void *)mem, &val));
+
+    return old;
+}
+
+void apr_atomic_set64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_atomic_xchg64(mem, val);
+}
+
+apr_uint64_t apr_atomic_and64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_uint64_t old, new_val;
+
+    old = apr_atomic_read64(mem);   /* updated on csg failure */
+    do {
+        new_val = old & val;
+    } while (__csg(&old, (void *)mem, &new_val));
+
+    return old;
+}
+
+apr_uint64_t apr_atomic_or64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_uint64_t old, new_val;
+
+    old = apr_atomic_read64(mem);   /* updated on csg failure */
+    do {
+        new_val = old | val;
+    } while (__csg(&old, (void *)mem, &new_val));
+
+    return old;
+}
+
+apr_uint64_t apr_atomic_xor64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_uint64_t old, new_val;
+
+    old = apr_atomic_read64(mem);   /* updated on csg failure */
+    do {
+        new_val = old ^ val;
+    } while (__csg(&old, (void *)mem, &new_val));
+
+    return old;
+}
+
+/* Compare and swap serializes, so all the orders are made SEQ_CST */
+
+void apr_atomic_fence(apr_atomic_order_e order)
+{
+    static volatile apr_uint32_t dummy;
+    apr_uint32_t old = 0;
+
+    if (order != APR_ATOMIC_RELAXED) {
+        __cs(&old, (cs_t *)&dummy, 0);
+    }
+}
+
+apr_uint32_t apr_atomic_read32_ex(volatile apr_uint32_t *mem,
+                                  apr_atomic_order_e order)
+{
+    apr_uint32_t val;
+
+    apr_atomic_fence(order);
+    val = *mem;
+    apr_atomic_fence(order);
+
+    return val;
+}
+
+void apr_atomic_set32_ex(volatile apr_uint32_t *mem, apr_uint32_t val,
+                         apr_atomic_order_e order)
+{
+    if (order == APR_ATOMIC_RELAXED) {
+        *mem = val;
+    }
+    else {
+        apr_atomic_xchg32(mem, val);
+    }
+}
+
+apr_uint32_t apr_atomic_add32_ex(volatile apr_uint32_t *mem, apr_uint32_t val,
+                                 apr_atomic_order_e order)
+{
+    return apr_atomic_add32(mem, val);
+}
+
+apr_uint32_t apr_atomic_cas32_ex(volatile apr_uint32_t *mem,
+                                 apr_uint32_t swap, apr_uint32_t cmp,
+                                 apr_atomic_order_e order)
+{
+    return apr_atomic_cas32(mem, swap, cmp);
+}
+
+apr_uint32_t apr_atomic_xchg32_ex(volatile apr_uint32_t *mem,
+                                  apr_uint32_t val,
+                                  apr_atomic_order_e order)
+{
+    return apr_atomic_xchg32(mem, val);
+}
+
+apr_uint64_t apr_atomic_read64_ex(volatile apr_uint64_t *mem,
+                                  apr_atomic_order_e order)
+{
+    return apr_atomic_read64(mem);
+}
+
+void apr_atomic_set64_ex(volatile apr_uint64_t *mem, apr_uint64_t val,
+                         apr_atomic_order_e order)
+{
+    apr_atomic_set64(mem, val);
+}
+
+apr_uint64_t apr_atomic_add64_ex(volatile apr_uint64_t *mem, apr_uint64_t val,
+                                 apr_atomic_order_e order)
+{
+    return apr_atomic_add64(mem, val);
+}
+
+apr_uint64_t apr_atomic_cas64_ex(volatile apr_uint64_t *mem,
+                                 apr_uint64_t swap, apr_uint64_t cmp,
+                                 apr_atomic_order_e order)
+{
+    return apr_atomic_cas64(mem, swap, cmp);
+}
+
+apr_uint64_t apr_atomic_xchg64_ex(volatile apr_uint64_t *mem,
+                                  apr_uint64_t val,
+                                  apr_atomic_order_e order)
+{
+    return apr_atomic_xchg64(mem, val);
+}
+
+void *apr_atomic_readptr_ex(void *volatile *mem, apr_atomic_order_e order)
+{
+    void *ptr;
+
+    apr_atomic_fence(order);
+    ptr = *mem;
+    apr_atomic_fence(order);
+
+    return ptr;
+}
+
+void apr_atomic_setptr_ex(void *volatile *mem, void *with,
+                          apr_atomic_order_e order)
+{
+    if (order == APR_ATOMIC_RELAXED) {
+        *mem = with;
+    }
+    else {
+        apr_atomic_xchgptr(mem, with);
+    }
+}
+
+void *apr_atomic_casptr_ex(void *volatile *mem, void *with, const void *cmp,
+                           apr_atomic_order_e order)
+{
+    return apr_atomic_casptr(mem, with, cmp);
+}
+
+void *apr_atomic_xchgptr_ex(void *volatile *mem, void *with,
+                            apr_atomic_order_e order)
+{
+    return apr_atomic_xchgptr(mem, with);
+}
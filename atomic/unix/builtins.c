@@ -20,7 +20,11 @@
 
 APR_DECLARE(apr_status_t) apr_atomic_init(apr_pool_t *p)
 {
+#if defined(USE_ATOMICS_GENERIC64)
+    return apr__atomic_generic64_init(p);
+#else
     return APR_SUCCESS;
+#endif
 }
 
 APR_DECLARE(apr_uint32_t) apr_atomic_read32(volatile apr_uint32_t *mem)
@@ -78,4 +82,216 @@ APR_DECLARE(void*) apr_atomic_xchgptr(void *volatile *mem, void *with)
     return (void*) __sync_lock_test_and_set(mem, with);
 }
 
+APR_DECLARE(void*) apr_atomic_readptr(void *volatile *mem)
+{
+    return *mem;
+}
+
+APR_DECLARE(void) apr_atomic_setptr(void *volatile *mem, void *with)
+{
+    *mem = with;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_and32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    return __sync_fetch_and_and(mem, val);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_or32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    return __sync_fetch_and_or(mem, val);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_xor32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    return __sync_fetch_and_xor(mem, val);
+}
+
+#if defined(__ATOMIC_ACQUIRE)
+
+APR_DECLARE(void) apr_atomic_fence(apr_atomic_order_e order)
+{
+    switch (order) {
+    case APR_ATOMIC_RELAXED:
+        break;
+    case APR_ATOMIC_ACQUIRE:
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        break;
+    case APR_ATOMIC_RELEASE:
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        break;
+    case APR_ATOMIC_ACQ_REL:
+        __atomic_thread_fence(__ATOMIC_ACQ_REL);
+        break;
+    default:
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        break;
+    }
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_ex(volatile apr_uint32_t *mem,
+                                               apr_atomic_order_e order)
+{
+    ATOMIC_LOAD(mem, order);
+}
+
+APR_DECLARE(void) apr_atomic_set32_ex(volatile apr_uint32_t *mem,
+                                      apr_uint32_t val,
+                                      apr_atomic_order_e order)
+{
+    ATOMIC_STORE(mem, val, order);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_add32_ex(volatile apr_uint32_t *mem,
+                                              apr_uint32_t val,
+                                              apr_atomic_order_e order)
+{
+    ATOMIC_RMW(__atomic_fetch_add, mem, val, order);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_cas32_ex(volatile apr_uint32_t *mem,
+                                              apr_uint32_t with,
+                                              apr_uint32_t cmp,
+                                              apr_atomic_order_e order)
+{
+    ATOMIC_CAS(mem, cmp, with, order);
+    return cmp;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_xchg32_ex(volatile apr_uint32_t *mem,
+                                               apr_uint32_t val,
+                                               apr_atomic_order_e order)
+{
+    ATOMIC_RMW(__atomic_exchange_n, mem, val, order);
+}
+
+APR_DECLARE(void*) apr_atomic_readptr_ex(void *volatile *mem,
+                                         apr_atomic_order_e order)
+{
+    ATOMIC_LOAD(mem, order);
+}
+
+APR_DECLARE(void) apr_atomic_setptr_ex(void *volatile *mem, void *with,
+                                       apr_atomic_order_e order)
+{
+    ATOMIC_STORE(mem, with, order);
+}
+
+APR_DECLARE(void*) apr_atomic_casptr_ex(void *volatile *mem, void *with,
+                                        const void *cmp,
+                                        apr_atomic_order_e order)
+{
+    void *prev = (void *)cmp;
+
+    ATOMIC_CAS(mem, prev, with, order);
+    return prev;
+}
+
+APR_DECLARE(void*) apr_atomic_xchgptr_ex(void *volatile *mem, void *with,
+                                         apr_atomic_order_e order)
+{
+    ATOMIC_RMW(__atomic_exchange_n, mem, with, order);
+}
+
+#else /* !__ATOMIC_ACQUIRE */
+
+/* Only the __sync builtins, which are full barriers */
+
+APR_DECLARE(void) apr_atomic_fence(apr_atomic_order_e order)
+{
+    if (order != APR_ATOMIC_RELAXED) {
+        __sync_synchronize();
+    }
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_ex(volatile apr_uint32_t *mem,
+                                               apr_atomic_order_e order)
+{
+    apr_uint32_t val;
+
+    if (order == APR_ATOMIC_RELAXED) {
+        return *mem;
+    }
+    __sync_synchronize();
+    val = *mem;
+    __sync_synchronize();
+    return val;
+}
+
+APR_DECLARE(void) apr_atomic_set32_ex(volatile apr_uint32_t *mem,
+                                      apr_uint32_t val,
+                                      apr_atomic_order_e order)
+{
+    if (order == APR_ATOMIC_RELAXED) {
+        *mem = val;
+        return;
+    }
+    __sync_synchronize();
+    *mem = val;
+    __sync_synchronize();
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_add32_ex(volatile apr_uint32_t *mem,
+                                              apr_uint32_t val,
+                                              apr_atomic_order_e order)
+{
+    return __sync_fetch_and_add(mem, val);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_cas32_ex(volatile apr_uint32_t *mem,
+                                              apr_uint32_t with,
+                                              apr_uint32_t cmp,
+                                              apr_atomic_order_e order)
+{
+    return __sync_val_compare_and_swap(mem, cmp, with);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_xchg32_ex(volatile apr_uint32_t *mem,
+                                               apr_uint32_t val,
+                                               apr_atomic_order_e order)
+{
+    return apr_atomic_xchg32(mem, val);
+}
+
+APR_DECLARE(void*) apr_atomic_readptr_ex(void *volatile *mem,
+                                         apr_atomic_order_e order)
+{
+    void *ptr;
+
+    if (order == APR_ATOMIC_RELAXED) {
+        return *mem;
+    }
+    __sync_synchronize();
+    ptr = *mem;
+    __sync_synchronize();
+    return ptr;
+}
+
+APR_DECLARE(void) apr_atomic_setptr_ex(void *volatile *mem, void *with,
+                                       apr_atomic_order_e order)
+{
+    if (order == APR_ATOMIC_RELAXED) {
+        *mem = with;
+        return;
+    }
+    __sync_synchronize();
+    *mem = with;
+    __sync_synchronize();
+}
+
+APR_DECLARE(void*) apr_atomic_casptr_ex(void *volatile *mem, void *with,
+                                        const void *cmp,
+                                        apr_atomic_order_e order)
+{
+    return apr_atomic_casptr(mem, with, cmp);
+}
+
+APR_DECLARE(void*) apr_atomic_xchgptr_ex(void *volatile *mem, void *with,
+                                         apr_atomic_order_e order)
+{
+    return apr_atomic_xchgptr(mem, with);
+}
+
+#endif /* __ATOMIC_ACQUIRE */
+
 #endif /* USE_ATOMICS_BUILTINS */
@@ -0,0 +1,178 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_arch_atomic.h"
+
+#ifdef USE_ATOMICS_BUILTINS64
+
+APR_DECLARE(apr_uint64_t) apr_atomic_add64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return __sync_fetch_and_add(mem, val);
+}
+
+APR_DECLARE(void) apr_atomic_sub64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    __sync_fetch_and_sub(mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_inc64(volatile apr_uint64_t *mem)
+{
+    return __sync_fetch_and_add(mem, 1);
+}
+
+APR_DECLARE(int) apr_atomic_dec64(volatile apr_uint64_t *mem)
+{
+    return __sync_sub_and_fetch(mem, 1) != 0;
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_cas64(volatile apr_uint64_t *mem, apr_uint64_t with,
+                                           apr_uint64_t cmp)
+{
+    return __sync_val_compare_and_swap(mem, cmp, with);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_and64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return __sync_fetch_and_and(mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_or64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return __sync_fetch_and_or(mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_xor64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return __sync_fetch_and_xor(mem, val);
+}
+
+#if defined(__ATOMIC_ACQUIRE)
+
+APR_DECLARE(apr_uint64_t) apr_atomic_read64(volatile apr_uint64_t *mem)
+{
+    return __atomic_load_n(mem, __ATOMIC_SEQ_CST);
+}
+
+APR_DECLARE(void) apr_atomic_set64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    __atomic_store_n(mem, val, __ATOMIC_SEQ_CST);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_xchg64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return __atomic_exchange_n(mem, val, __ATOMIC_SEQ_CST);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_read64_ex(volatile apr_uint64_t *mem,
+                                               apr_atomic_order_e order)
+{
+    ATOMIC_LOAD(mem, order);
+}
+
+APR_DECLARE(void) apr_atomic_set64_ex(volatile apr_uint64_t *mem,
+                                      apr_uint64_t val,
+                                      apr_atomic_order_e order)
+{
+    ATOMIC_STORE(mem, val, order);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_add64_ex(volatile apr_uint64_t *mem,
+                                              apr_uint64_t val,
+                                              apr_atomic_order_e order)
+{
+    ATOMIC_RMW(__atomic_fetch_add, mem, val, order);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_cas64_ex(volatile apr_uint64_t *mem,
+                                              apr_uint64_t with,
+                                              apr_uint64_t cmp,
+                                              apr_atomic_order_e order)
+{
+    ATOMIC_CAS(mem, cmp, with, order);
+    return cmp;
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_xchg64_ex(volatile apr_uint64_t *mem,
+                                               apr_uint64_t val,
+                                               apr_atomic_order_e order)
+{
+    ATOMIC_RMW(__atomic_exchange_n, mem, val, order);
+}
+
+#else /* !__ATOMIC_ACQUIRE */
+
+/* Only the __sync builtins: the loads and stores may not be atomic on
+ * 32-bit platforms, so they are compare and swaps.
+ */
+
+APR_DECLARE(apr_uint64_t) apr_atomic_read64(volatile apr_uint64_t *mem)
+{
+    return __sync_val_compare_and_swap(mem, 0, 0);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_xchg64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_uint64_t prev = *mem, seen;
+
+    while ((seen = __sync_val_compare_and_swap(mem, prev, val)) != prev) {
+        prev = seen;
+    }
+    return prev;
+}
+
+APR_DECLARE(void) apr_atomic_set64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    apr_atomic_xchg64(mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_read64_ex(volatile apr_uint64_t *mem,
+                                               apr_atomic_order_e order)
+{
+    return apr_atomic_read64(mem);
+}
+
+APR_DECLARE(void) apr_atomic_set64_ex(volatile apr_uint64_t *mem,
+                                      apr_uint64_t val,
+                                      apr_atomic_order_e order)
+{
+    apr_atomic_xchg64(mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_add64_ex(volatile apr_uint64_t *mem,
+                                              apr_uint64_t val,
+                                              apr_atomic_order_e order)
+{
+    return __sync_fetch_and_add(mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_cas64_ex(volatile apr_uint64_t *mem,
+                                              apr_uint64_t with,
+                                              apr_uint64_t cmp,
+                                              apr_atomic_order_e order)
+{
+    return __sync_val_compare_and_swap(mem, cmp, with);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_xchg64_ex(volatile apr_uint64_t *mem,
+                                               apr_uint64_t val,
+                                               apr_atomic_order_e order)
+{
+    return apr_atomic_xchg64(mem, val);
+}
+
+#endif /* __ATOMIC_ACQUIRE */
+
+#endif /* USE_ATOMICS_BUILTINS64 */
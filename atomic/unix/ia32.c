@@ -20,7 +20,11 @@
 
 APR_DECLARE(apr_status_t) apr_atomic_init(apr_pool_t *p)
 {
+#if defined(USE_ATOMICS_GENERIC64)
+    return apr__atomic_generic64_init(p);
+#else
     return APR_SUCCESS;
+#endif
 }
 
 APR_DECLARE(apr_uint32_t) apr_atomic_read32(volatile apr_uint32_t *mem)
@@ -124,4 +128,25 @@ APR_DECLARE(void*) apr_atomic_xchgptr(void *volatile *mem, void *with)
     return prev;
 }
 
+APR_DECLARE(void) apr_atomic_fence(apr_atomic_order_e order)
+{
+    switch (order) {
+    case APR_ATOMIC_RELAXED:
+        break;
+    case APR_ATOMIC_ACQUIRE:
+    case APR_ATOMIC_RELEASE:
+    case APR_ATOMIC_ACQ_REL:
+        /* x86 only reorders later loads before earlier stores */
+        asm volatile ("" : : : "memory");
+        break;
+    default:
+#if defined(__x86_64__)
+        asm volatile ("lock; orq $0,(%%rsp)" : : : "cc", "memory");
+#else
+        asm volatile ("lock; orl $0,(%%esp)" : : : "cc", "memory");
+#endif
+        break;
+    }
+}
+
 #endif /* USE_ATOMICS_IA32 */
@@ -70,7 +70,11 @@ APR_DECLARE(apr_status_t) apr_atomic_init(apr_pool_t *p)
         }
     }
 
+#if defined(USE_ATOMICS_GENERIC64)
+    return apr__atomic_generic64_init(p);
+#else
     return APR_SUCCESS;
+#endif
 }
 
 static APR_INLINE apr_thread_mutex_t *mutex_hash(volatile apr_uint32_t *mem)
@@ -88,7 +92,11 @@ static APR_INLINE apr_thread_mutex_t *mutex_hash(volatile apr_uint32_t *mem)
 
 APR_DECLARE(apr_status_t) apr_atomic_init(apr_pool_t *p)
 {
+#if defined(USE_ATOMICS_GENERIC64)
+    return apr__atomic_generic64_init(p);
+#else
     return APR_SUCCESS;
+#endif
 }
 
 #endif /* APR_HAS_THREADS */
@@ -202,4 +210,13 @@ APR_DECLARE(void*) apr_atomic_xchgptr(void *volatile *mem, void *with)
     return prev;
 }
 
+APR_DECLARE(void) apr_atomic_fence(apr_atomic_order_e order)
+{
+    if (order != APR_ATOMIC_RELAXED) {
+        /* locking and unlocking a mutex is a full barrier */
+        DECLARE_MUTEX_LOCKED(mutex, NULL);
+        MUTEX_UNLOCK(mutex);
+    }
+}
+
 #endif /* USE_ATOMICS_GENERIC */
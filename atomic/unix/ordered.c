@@ -0,0 +1,178 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_arch_atomic.h"
+
+/* The operations which the non-builtins backends implement on top of
+ * their own primitives and apr_atomic_fence().
+ */
+
+#ifndef USE_ATOMICS_BUILTINS
+
+APR_DECLARE(void*) apr_atomic_readptr(void *volatile *mem)
+{
+    return *mem;
+}
+
+APR_DECLARE(void) apr_atomic_setptr(void *volatile *mem, void *with)
+{
+#if defined(USE_ATOMICS_GENERIC)
+    /* don't race with the locked ones */
+    apr_atomic_xchgptr(mem, with);
+#else
+    *mem = with;
+#endif
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_and32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t prev = *mem, seen;
+
+    while ((seen = apr_atomic_cas32(mem, prev & val, prev)) != prev) {
+        prev = seen;
+    }
+    return prev;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_or32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t prev = *mem, seen;
+
+    while ((seen = apr_atomic_cas32(mem, prev | val, prev)) != prev) {
+        prev = seen;
+    }
+    return prev;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_xor32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    apr_uint32_t prev = *mem, seen;
+
+    while ((seen = apr_atomic_cas32(mem, prev ^ val, prev)) != prev) {
+        prev = seen;
+    }
+    return prev;
+}
+
+/* Loads and stores are plain accesses with fences around them as needed,
+ * the read-modify-write operations are full barriers already.
+ */
+
+static APR_INLINE void fence_before_load(apr_atomic_order_e order)
+{
+    if (order != APR_ATOMIC_RELAXED && order != APR_ATOMIC_ACQUIRE) {
+        apr_atomic_fence(APR_ATOMIC_SEQ_CST);
+    }
+}
+
+static APR_INLINE void fence_after_load(apr_atomic_order_e order)
+{
+    if (order != APR_ATOMIC_RELAXED) {
+        apr_atomic_fence(APR_ATOMIC_ACQUIRE);
+    }
+}
+
+static APR_INLINE void fence_before_store(apr_atomic_order_e order)
+{
+    if (order != APR_ATOMIC_RELAXED) {
+        apr_atomic_fence(APR_ATOMIC_RELEASE);
+    }
+}
+
+static APR_INLINE void fence_after_store(apr_atomic_order_e order)
+{
+    if (order != APR_ATOMIC_RELAXED && order != APR_ATOMIC_RELEASE) {
+        apr_atomic_fence(APR_ATOMIC_SEQ_CST);
+    }
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_ex(volatile apr_uint32_t *mem,
+                                               apr_atomic_order_e order)
+{
+    apr_uint32_t val;
+
+    fence_before_load(order);
+    val = apr_atomic_read32(mem);
+    fence_after_load(order);
+
+    return val;
+}
+
+APR_DECLARE(void) apr_atomic_set32_ex(volatile apr_uint32_t *mem,
+                                      apr_uint32_t val,
+                                      apr_atomic_order_e order)
+{
+    fence_before_store(order);
+    apr_atomic_set32(mem, val);
+    fence_after_store(order);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_add32_ex(volatile apr_uint32_t *mem,
+                                              apr_uint32_t val,
+                                              apr_atomic_order_e order)
+{
+    return apr_atomic_add32(mem, val);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_cas32_ex(volatile apr_uint32_t *mem,
+                                              apr_uint32_t with,
+                                              apr_uint32_t cmp,
+                                              apr_atomic_order_e order)
+{
+    return apr_atomic_cas32(mem, with, cmp);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_xchg32_ex(volatile apr_uint32_t *mem,
+                                               apr_uint32_t val,
+                                               apr_atomic_order_e order)
+{
+    return apr_atomic_xchg32(mem, val);
+}
+
+APR_DECLARE(void*) apr_atomic_readptr_ex(void *volatile *mem,
+                                         apr_atomic_order_e order)
+{
+    void *ptr;
+
+    fence_before_load(order);
+    ptr = apr_atomic_readptr(mem);
+    fence_after_load(order);
+
+    return ptr;
+}
+
+APR_DECLARE(void) apr_atomic_setptr_ex(void *volatile *mem, void *with,
+                                       apr_atomic_order_e order)
+{
+    fence_before_store(order);
+    apr_atomic_setptr(mem, with);
+    fence_after_store(order);
+}
+
+APR_DECLARE(void*) apr_atomic_casptr_ex(void *volatile *mem, void *with,
+                                        const void *cmp,
+                                        apr_atomic_order_e order)
+{
+    return apr_atomic_casptr(mem, with, cmp);
+}
+
+APR_DECLARE(void*) apr_atomic_xchgptr_ex(void *volatile *mem, void *with,
+                                         apr_atomic_order_e order)
+{
+    return apr_atomic_xchgptr(mem, with);
+}
+
+#endif /* !USE_ATOMICS_BUILTINS */
@@ -26,7 +26,11 @@
 
 APR_DECLARE(apr_status_t) apr_atomic_init(apr_pool_t *p)
 {
+#if defined(USE_ATOMICS_GENERIC64)
+    return apr__atomic_generic64_init(p);
+#else
     return APR_SUCCESS;
+#endif
 }
 
 APR_DECLARE(apr_uint32_t) apr_atomic_read32(volatile apr_uint32_t *mem)
@@ -204,4 +208,26 @@ APR_DECLARE(void*) apr_atomic_xchgptr(void *volatile *mem, void *with)
     return prev;
 }
 
+#ifdef __NO_LWSYNC__
+#   define PPC_LWSYNC  "    sync\n"
+#else
+#   define PPC_LWSYNC  "    lwsync\n"
+#endif
+
+APR_DECLARE(void) apr_atomic_fence(apr_atomic_order_e order)
+{
+    switch (order) {
+    case APR_ATOMIC_RELAXED:
+        break;
+    case APR_ATOMIC_ACQUIRE:
+    case APR_ATOMIC_RELEASE:
+    case APR_ATOMIC_ACQ_REL:
+        asm volatile (PPC_LWSYNC : : : "memory");
+        break;
+    default:
+        asm volatile ("    sync\n" : : : "memory");
+        break;
+    }
+}
+
 #endif /* USE_ATOMICS_PPC */
@@ -20,7 +20,11 @@
 
 APR_DECLARE(apr_status_t) apr_atomic_init(apr_pool_t *p)
 {
+#if defined(USE_ATOMICS_GENERIC64)
+    return apr__atomic_generic64_init(p);
+#else
     return APR_SUCCESS;
+#endif
 }
 
 APR_DECLARE(apr_uint32_t) apr_atomic_read32(volatile apr_uint32_t *mem)
@@ -152,4 +156,21 @@ APR_DECLARE(void*) apr_atomic_xchgptr(void *volatile *mem, void *with)
     return prev;
 }
 
+APR_DECLARE(void) apr_atomic_fence(apr_atomic_order_e order)
+{
+    switch (order) {
+    case APR_ATOMIC_RELAXED:
+        break;
+    case APR_ATOMIC_ACQUIRE:
+    case APR_ATOMIC_RELEASE:
+    case APR_ATOMIC_ACQ_REL:
+        /* s390 only reorders later loads before earlier stores */
+        asm volatile ("" : : : "memory");
+        break;
+    default:
+        asm volatile ("    bcr 15,0\n" : : : "memory");
+        break;
+    }
+}
+
 #endif /* USE_ATOMICS_S390 */
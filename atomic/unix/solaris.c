@@ -22,7 +22,11 @@
 
 APR_DECLARE(apr_status_t) apr_atomic_init(apr_pool_t *p)
 {
+#if defined(USE_ATOMICS_GENERIC64)
+    return apr__atomic_generic64_init(p);
+#else
     return APR_SUCCESS;
+#endif
 }
 
 APR_DECLARE(apr_uint32_t) apr_atomic_read32(volatile apr_uint32_t *mem)
@@ -76,4 +80,25 @@ APR_DECLARE(void*) apr_atomic_xchgptr(void *volatile *mem, void *with)
     return atomic_swap_ptr(mem, with);
 }
 
+APR_DECLARE(void) apr_atomic_fence(apr_atomic_order_e order)
+{
+    switch (order) {
+    case APR_ATOMIC_RELAXED:
+        break;
+    case APR_ATOMIC_RELEASE:
+        membar_exit();      /* #LoadStore|#StoreStore */
+        break;
+    case APR_ATOMIC_ACQUIRE:
+    case APR_ATOMIC_ACQ_REL:
+        membar_consumer();  /* #LoadLoad */
+        membar_exit();
+        break;
+    default:
+        membar_consumer();
+        membar_exit();
+        membar_enter();     /* #StoreLoad|#StoreStore */
+        break;
+    }
+}
+
 #endif /* USE_ATOMICS_SOLARIS */
@@ -111,3 +111,280 @@ APR_DECLARE(void*) apr_atomic_xchgptr(void *volatile *mem, void *with)
 {
     return InterlockedExchangePointer((void**)mem, with);
 }
+
+APR_DECLARE(void*) apr_atomic_readptr(void *volatile *mem)
+{
+    return *mem;
+}
+
+APR_DECLARE(void) apr_atomic_setptr(void *volatile *mem, void *with)
+{
+    *mem = with;
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_and32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    return InterlockedAnd((volatile long *)mem, val);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_or32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    return InterlockedOr((volatile long *)mem, val);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_xor32(volatile apr_uint32_t *mem, apr_uint32_t val)
+{
+    return InterlockedXor((volatile long *)mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_read64(volatile apr_uint64_t *mem)
+{
+#if defined(_WIN64)
+    return *mem;
+#else
+    /* 64-bit loads may not be atomic */
+    return InterlockedCompareExchange64((volatile LONGLONG *)mem, 0, 0);
+#endif
+}
+
+APR_DECLARE(void) apr_atomic_set64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    InterlockedExchange64((volatile LONGLONG *)mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_add64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return InterlockedExchangeAdd64((volatile LONGLONG *)mem, val);
+}
+
+APR_DECLARE(void) apr_atomic_sub64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    InterlockedExchangeAdd64((volatile LONGLONG *)mem, -val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_inc64(volatile apr_uint64_t *mem)
+{
+    /* we return old value, win32 returns new value :( */
+    return InterlockedIncrement64((volatile LONGLONG *)mem) - 1;
+}
+
+APR_DECLARE(int) apr_atomic_dec64(volatile apr_uint64_t *mem)
+{
+    return InterlockedDecrement64((volatile LONGLONG *)mem) != 0;
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_cas64(volatile apr_uint64_t *mem, apr_uint64_t with,
+                                           apr_uint64_t cmp)
+{
+    return InterlockedCompareExchange64((volatile LONGLONG *)mem, with, cmp);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_xchg64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return InterlockedExchange64((volatile LONGLONG *)mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_and64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return InterlockedAnd64((volatile LONGLONG *)mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_or64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return InterlockedOr64((volatile LONGLONG *)mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_xor64(volatile apr_uint64_t *mem, apr_uint64_t val)
+{
+    return InterlockedXor64((volatile LONGLONG *)mem, val);
+}
+
+/* The Interlocked functions are full barriers, so only the loads and
+ * stores take the order into account.
+ */
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_AMD64))
+#include <intrin.h>
+/* x86 only reorders later loads before earlier stores */
+#define ACQ_REL_BARRIER() _ReadWriteBarrier()
+#else
+#define ACQ_REL_BARRIER() MemoryBarrier()
+#endif
+
+APR_DECLARE(void) apr_atomic_fence(apr_atomic_order_e order)
+{
+    switch (order) {
+    case APR_ATOMIC_RELAXED:
+        break;
+    case APR_ATOMIC_ACQUIRE:
+    case APR_ATOMIC_RELEASE:
+    case APR_ATOMIC_ACQ_REL:
+        ACQ_REL_BARRIER();
+        break;
+    default:
+        MemoryBarrier();
+        break;
+    }
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_ex(volatile apr_uint32_t *mem,
+                                               apr_atomic_order_e order)
+{
+    apr_uint32_t val;
+
+    if (order != APR_ATOMIC_RELAXED && order != APR_ATOMIC_ACQUIRE) {
+        MemoryBarrier();
+    }
+    val = *mem;
+    if (order != APR_ATOMIC_RELAXED) {
+        ACQ_REL_BARRIER();
+    }
+    return val;
+}
+
+APR_DECLARE(void) apr_atomic_set32_ex(volatile apr_uint32_t *mem,
+                                      apr_uint32_t val,
+                                      apr_atomic_order_e order)
+{
+    switch (order) {
+    case APR_ATOMIC_RELAXED:
+        *mem = val;
+        break;
+    case APR_ATOMIC_RELEASE:
+        ACQ_REL_BARRIER();
+        *mem = val;
+        break;
+    default:
+        apr_atomic_set32(mem, val);
+        break;
+    }
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_add32_ex(volatile apr_uint32_t *mem,
+                                              apr_uint32_t val,
+                                              apr_atomic_order_e order)
+{
+    return apr_atomic_add32(mem, val);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_cas32_ex(volatile apr_uint32_t *mem,
+                                              apr_uint32_t with,
+                                              apr_uint32_t cmp,
+                                              apr_atomic_order_e order)
+{
+    return apr_atomic_cas32(mem, with, cmp);
+}
+
+APR_DECLARE(apr_uint32_t) apr_atomic_xchg32_ex(volatile apr_uint32_t *mem,
+                                               apr_uint32_t val,
+                                               apr_atomic_order_e order)
+{
+    return apr_atomic_xchg32(mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_read64_ex(volatile apr_uint64_t *mem,
+                                               apr_atomic_order_e order)
+{
+#if defined(_WIN64)
+    apr_uint64_t val;
+
+    if (order != APR_ATOMIC_RELAXED && order != APR_ATOMIC_ACQUIRE) {
+        MemoryBarrier();
+    }
+    val = *mem;
+    if (order != APR_ATOMIC_RELAXED) {
+        ACQ_REL_BARRIER();
+    }
+    return val;
+#else
+    return apr_atomic_read64(mem);
+#endif
+}
+
+APR_DECLARE(void) apr_atomic_set64_ex(volatile apr_uint64_t *mem,
+                                      apr_uint64_t val,
+                                      apr_atomic_order_e order)
+{
+#if defined(_WIN64)
+    switch (order) {
+    case APR_ATOMIC_RELAXED:
+        *mem = val;
+        break;
+    case APR_ATOMIC_RELEASE:
+        ACQ_REL_BARRIER();
+        *mem = val;
+        break;
+    default:
+        apr_atomic_set64(mem, val);
+        break;
+    }
+#else
+    apr_atomic_set64(mem, val);
+#endif
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_add64_ex(volatile apr_uint64_t *mem,
+                                              apr_uint64_t val,
+                                              apr_atomic_order_e order)
+{
+    return apr_atomic_add64(mem, val);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_cas64_ex(volatile apr_uint64_t *mem,
+                                              apr_uint64_t with,
+                                              apr_uint64_t cmp,
+                                              apr_atomic_order_e order)
+{
+    return apr_atomic_cas64(mem, with, cmp);
+}
+
+APR_DECLARE(apr_uint64_t) apr_atomic_xchg64_ex(volatile apr_uint64_t *mem,
+                                               apr_uint64_t val,
+                                               apr_atomic_order_e order)
+{
+    return apr_atomic_xchg64(mem, val);
+}
+
+APR_DECLARE(void*) apr_atomic_readptr_ex(void *volatile *mem,
+                                         apr_atomic_order_e order)
+{
+    void *ptr;
+
+    if (order != APR_ATOMIC_RELAXED && order != APR_ATOMIC_ACQUIRE) {
+        MemoryBarrier();
+    }
+    ptr = *mem;
+    if (order != APR_ATOMIC_RELAXED) {
+        ACQ_REL_BARRIER();
+    }
+    return ptr;
+}
+
+APR_DECLARE(void) apr_atomic_setptr_ex(void *volatile *mem, void *with,
+                                       apr_atomic_order_e order)
+{
+    switch (order) {
+    case APR_ATOMIC_RELAXED:
+        *mem = with;
+        break;
+    case APR_ATOMIC_RELEASE:
+        ACQ_REL_BARRIER();
+        *mem = with;
+        break;
+    default:
+        apr_atomic_xchgptr(mem, with);
+        break;
+    }
+}
+
+APR_DECLARE(void*) apr_atomic_casptr_ex(void *volatile *mem, void *with,
+                                        const void *cmp,
+                                        apr_atomic_order_e order)
+{
+    return apr_atomic_casptr(mem, with, cmp);
+}
+
+APR_DECLARE(void*) apr_atomic_xchgptr_ex(void *volatile *mem, void *with,
+                                         apr_atomic_order_e order)
+{
+    return apr_atomic_xchgptr(mem, with);
+}
@@ -15,6 +15,7 @@
 #include "apr_atomic.h"
 #include "apr_base64.h"
 #include "apr_buckets.h"
+#include "apr_counter.h"
 #include "apr_date.h"
 #include "apr_dbd.h"
 #include "apr_dbm.h"
@@ -29,6 +30,8 @@
 #include "apr_general.h"
 #include "apr_getopt.h"
 #include "apr_global_mutex.h"
+#include "apr_chash.h"
+#include "apr_cskiplist.h"
 #include "apr_hash.h"
 #include "apr_hooks.h"
 #include "apr_inherit.h"
@@ -55,6 +58,7 @@
 #include "apr_signal.h"
 #include "apr_siphash.h"
 #include "apr_skiplist.h"
+#include "apr_spsc_queue.h"
 #include "apr_strings.h"
 #include "apr_strmatch.h"
 #include "apr_support.h"
@@ -65,6 +69,7 @@
 #include "apr_thread_proc.h"
 #include "apr_thread_rwlock.h"
 #include "apr_time.h"
+#include "apr_timer_wheel.h"
 #include "apr_uri.h"
 #include "apr_user.h"
 #include "apr_uuid.h"
@@ -66,6 +66,41 @@ struct apr_memnode_t {
 /** Symbolic constants */
 #define APR_ALLOCATOR_MAX_FREE_UNLIMITED 0
 
+/**
+ * @defgroup apr_allocator_flags Allocator creation flags
+ * @see apr_allocator_create_ex()
+ * @{
+ */
+/** Carve the nodes from (transparent) huge pages */
+#define APR_ALLOCATOR_HUGE_PAGES    0x01
+/** Carve the nodes from memory local to the NUMA node of the thread
+ * which first allocates them */
+#define APR_ALLOCATOR_NUMA_LOCAL    0x02
+/** @} */
+
+/**
+ * Allocator statistics
+ * @see apr_allocator_stats_get()
+ */
+typedef struct apr_allocator_stats_t {
+    /** Number of nodes handed out by apr_allocator_alloc() */
+    apr_size_t nodes_alloc;
+    /** Number of nodes given back with apr_allocator_free() */
+    apr_size_t nodes_free;
+    /** Number of nodes obtained from the system */
+    apr_size_t nodes_sys_alloc;
+    /** Number of nodes given back to the system */
+    apr_size_t nodes_sys_free;
+    /** Bytes currently obtained from the system */
+    apr_size_t bytes_total;
+    /** Bytes currently held on the free lists (and thread caches) */
+    apr_size_t bytes_free;
+    /** Bytes currently handed out, i.e. bytes_total - bytes_free */
+    apr_size_t bytes_used;
+    /** High-water mark of bytes_total */
+    apr_size_t bytes_total_max;
+} apr_allocator_stats_t;
+
 /**
  * Create a new allocator
  * @param allocator The allocator we have just created.
@@ -74,6 +109,30 @@ struct apr_memnode_t {
 APR_DECLARE(apr_status_t) apr_allocator_create(apr_allocator_t **allocator)
                           __attribute__((nonnull(1)));
 
+/**
+ * Create a new allocator with special backing memory
+ * @param allocator The allocator we have just created.
+ * @param flags A bitmask of APR_ALLOCATOR_HUGE_PAGES and/or
+ *        APR_ALLOCATOR_NUMA_LOCAL
+ * @return APR_SUCCESS, or APR_ENOTIMPL if one of the @a flags is not
+ *         supported on this platform.
+ * @remark With these flags, nodes of up to 20 pages (the sizes pools
+ *         mostly use) are carved from 2MB regions mapped from the system,
+ *         using explicit huge pages when reserved, otherwise regions
+ *         eligible for transparent huge pages.  With NUMA_LOCAL, each
+ *         NUMA node carves from its own regions bound to the node of
+ *         the thread allocating them, and the nodes are recycled only
+ *         by the threads running on the same NUMA node (the threads on
+ *         nodes above 63, if any, share regions bound to no node).
+ * @remark The carved nodes are recycled but never given back to the
+ *         system before the allocator is destroyed, regardless of
+ *         apr_allocator_max_free_set().  This suits large long-lived
+ *         pools best.
+ */
+APR_DECLARE(apr_status_t) apr_allocator_create_ex(apr_allocator_t **allocator,
+                                                  apr_uint32_t flags)
+                          __attribute__((nonnull(1)));
+
 /**
  * Destroy an allocator
  * @param allocator The allocator to be destroyed
@@ -129,6 +188,21 @@ APR_DECLARE(apr_status_t) apr_allocator_min_order_set(unsigned int order);
 APR_DECLARE(apr_size_t) apr_allocator_align(apr_allocator_t *allocator,
                                             apr_size_t size);
 
+/**
+ * Get the statistics of an allocator
+ * @param allocator The allocator
+ * @param stats Where to store the statistics
+ * @remark The statistics are always maintained, at the cost of taking the
+ *         allocator's mutex (if any) once more when a node is obtained
+ *         from the system.  The values are a consistent snapshot, but
+ *         for the counters of the per-thread caches which are read as is.
+ * @remark bytes_free versus bytes_total helps sizing
+ *         apr_allocator_max_free_set().
+ */
+APR_DECLARE(void) apr_allocator_stats_get(apr_allocator_t *allocator,
+                                          apr_allocator_stats_t *stats)
+                  __attribute__((nonnull(1,2)));
+
 #include "apr_pools.h"
 
 /**
@@ -183,6 +257,37 @@ APR_DECLARE(apr_thread_mutex_t *) apr_allocator_mutex_get(
                                           apr_allocator_t *allocator)
                                   __attribute__((nonnull(1)));
 
+/**
+ * Enable per-thread caching of memnodes for an allocator shared by
+ * several threads
+ * @param allocator The allocator
+ * @param max_nodes The number of nodes each thread may keep per size
+ *        class, before handing half of them back to the allocator
+ * @param pool The pool used to allocate the thread key and to disable
+ *        the caching when it gets cleared or destroyed
+ * @return APR_SUCCESS, APR_EINVAL if @a max_nodes is zero, APR_ENOTIMPL
+ *         if the allocator was created with APR_ALLOCATOR_NUMA_LOCAL, or
+ *         the error returned by apr_threadkey_private_create().
+ * @remark Once enabled, nodes of up to 20 pages are recycled from the
+ *         calling thread's cache without taking the allocator's mutex,
+ *         which is only needed to move batches of nodes from and to the
+ *         shared free lists.  Calling this function again only changes
+ *         @a max_nodes.
+ * @remark Cached nodes are not accounted by apr_allocator_max_free_set().
+ *         They are given back to the allocator on thread exit where the
+ *         platform supports thread key destructors, otherwise when
+ *         @a pool is cleaned up.
+ * @remark Should be done at initialization time, after the mutex is set
+ *         with apr_allocator_mutex_set() and before the allocator is
+ *         used concurrently.  @a pool must not outlive the allocator,
+ *         typically it is the owner.
+ */
+APR_DECLARE(apr_status_t) apr_allocator_thread_cache_set(
+                                          apr_allocator_t *allocator,
+                                          apr_uint32_t max_nodes,
+                                          apr_pool_t *pool)
+                          __attribute__((nonnull(1,3)));
+
 #endif /* APR_HAS_THREADS */
 
 /** @} */
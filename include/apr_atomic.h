@@ -131,6 +131,337 @@ APR_DECLARE(void*) apr_atomic_casptr(void *volatile *mem, void *with, const void
  */
 APR_DECLARE(void*) apr_atomic_xchgptr(void *volatile *mem, void *with);
 
+/**
+ * atomically read a pointer from memory
+ * @param mem pointer to the pointer
+ * @return the value of the pointer
+ */
+APR_DECLARE(void*) apr_atomic_readptr(void *volatile *mem);
+
+/**
+ * atomically set a pointer in memory
+ * @param mem pointer to the pointer
+ * @param with what to set it to
+ */
+APR_DECLARE(void) apr_atomic_setptr(void *volatile *mem, void *with);
+
+/*
+ * Bitwise operations on 32-bit values
+ */
+
+/**
+ * atomically AND 'val' into an apr_uint32_t
+ * @param mem pointer to the object
+ * @param val the mask
+ * @return old value pointed to by mem
+ */
+APR_DECLARE(apr_uint32_t) apr_atomic_and32(volatile apr_uint32_t *mem,
+                                           apr_uint32_t val);
+
+/**
+ * atomically OR 'val' into an apr_uint32_t
+ * @param mem pointer to the object
+ * @param val the bits to set
+ * @return old value pointed to by mem
+ */
+APR_DECLARE(apr_uint32_t) apr_atomic_or32(volatile apr_uint32_t *mem,
+                                          apr_uint32_t val);
+
+/**
+ * atomically XOR 'val' into an apr_uint32_t
+ * @param mem pointer to the object
+ * @param val the bits to flip
+ * @return old value pointed to by mem
+ */
+APR_DECLARE(apr_uint32_t) apr_atomic_xor32(volatile apr_uint32_t *mem,
+                                           apr_uint32_t val);
+
+/*
+ * Atomic operations on 64-bit values
+ * Note: Each of these functions internally implements a memory barrier
+ * on platforms that require it, and they are atomic on 32-bit platforms
+ * too (with a mutex if the processor can't do it)
+ */
+
+/**
+ * atomically read an apr_uint64_t from memory
+ * @param mem the pointer
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_read64(volatile apr_uint64_t *mem);
+
+/**
+ * atomically set an apr_uint64_t in memory
+ * @param mem pointer to the object
+ * @param val value that the object will assume
+ */
+APR_DECLARE(void) apr_atomic_set64(volatile apr_uint64_t *mem,
+                                   apr_uint64_t val);
+
+/**
+ * atomically add 'val' to an apr_uint64_t
+ * @param mem pointer to the object
+ * @param val amount to add
+ * @return old value pointed to by mem
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_add64(volatile apr_uint64_t *mem,
+                                           apr_uint64_t val);
+
+/**
+ * atomically subtract 'val' from an apr_uint64_t
+ * @param mem pointer to the object
+ * @param val amount to subtract
+ */
+APR_DECLARE(void) apr_atomic_sub64(volatile apr_uint64_t *mem,
+                                   apr_uint64_t val);
+
+/**
+ * atomically increment an apr_uint64_t by 1
+ * @param mem pointer to the object
+ * @return old value pointed to by mem
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_inc64(volatile apr_uint64_t *mem);
+
+/**
+ * atomically decrement an apr_uint64_t by 1
+ * @param mem pointer to the atomic value
+ * @return zero if the value becomes zero on decrement, otherwise non-zero
+ */
+APR_DECLARE(int) apr_atomic_dec64(volatile apr_uint64_t *mem);
+
+/**
+ * compare an apr_uint64_t's value with 'cmp'.
+ * If they are the same swap the value with 'with'
+ * @param mem pointer to the value
+ * @param with what to swap it with
+ * @param cmp the value to compare it to
+ * @return the old value of *mem
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_cas64(volatile apr_uint64_t *mem,
+                                           apr_uint64_t with,
+                                           apr_uint64_t cmp);
+
+/**
+ * exchange an apr_uint64_t's value with 'val'.
+ * @param mem pointer to the value
+ * @param val what to swap it with
+ * @return the old value of *mem
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_xchg64(volatile apr_uint64_t *mem,
+                                            apr_uint64_t val);
+
+/**
+ * atomically AND 'val' into an apr_uint64_t
+ * @param mem pointer to the object
+ * @param val the mask
+ * @return old value pointed to by mem
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_and64(volatile apr_uint64_t *mem,
+                                           apr_uint64_t val);
+
+/**
+ * atomically OR 'val' into an apr_uint64_t
+ * @param mem pointer to the object
+ * @param val the bits to set
+ * @return old value pointed to by mem
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_or64(volatile apr_uint64_t *mem,
+                                          apr_uint64_t val);
+
+/**
+ * atomically XOR 'val' into an apr_uint64_t
+ * @param mem pointer to the object
+ * @param val the bits to flip
+ * @return old value pointed to by mem
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_xor64(volatile apr_uint64_t *mem,
+                                           apr_uint64_t val);
+
+/*
+ * Atomic operations with an explicit memory order
+ */
+
+/**
+ * The memory orders of the _ex atomic operations and apr_atomic_fence(),
+ * as defined by C11.
+ * @remark The operations without an explicit order are APR_ATOMIC_SEQ_CST,
+ * except apr_atomic_read32(), apr_atomic_set32(), apr_atomic_readptr() and
+ * apr_atomic_setptr() which are only guaranteed to be atomic.  Weaker
+ * orders allow the backends to omit some or all of the memory barriers,
+ * those which can't just use stronger ones.
+ */
+typedef enum {
+    APR_ATOMIC_RELAXED, /**< atomicity only, no ordering */
+    APR_ATOMIC_ACQUIRE, /**< later accesses are not moved before this one */
+    APR_ATOMIC_RELEASE, /**< earlier accesses are not moved after this one */
+    APR_ATOMIC_ACQ_REL, /**< both APR_ATOMIC_ACQUIRE and APR_ATOMIC_RELEASE */
+    APR_ATOMIC_SEQ_CST  /**< APR_ATOMIC_ACQ_REL plus a single total order */
+} apr_atomic_order_e;
+
+/**
+ * issue a memory barrier
+ * @param order APR_ATOMIC_ACQUIRE, APR_ATOMIC_RELEASE, APR_ATOMIC_ACQ_REL or
+ *        APR_ATOMIC_SEQ_CST (APR_ATOMIC_RELAXED is a no-op)
+ */
+APR_DECLARE(void) apr_atomic_fence(apr_atomic_order_e order);
+
+/**
+ * atomically read an apr_uint32_t from memory, with the given order
+ * @param mem the pointer
+ * @param order APR_ATOMIC_RELAXED, APR_ATOMIC_ACQUIRE or APR_ATOMIC_SEQ_CST
+ *        (the other orders are taken as APR_ATOMIC_SEQ_CST)
+ */
+APR_DECLARE(apr_uint32_t) apr_atomic_read32_ex(volatile apr_uint32_t *mem,
+                                               apr_atomic_order_e order);
+
+/**
+ * atomically set an apr_uint32_t in memory, with the given order
+ * @param mem pointer to the object
+ * @param val value that the object will assume
+ * @param order APR_ATOMIC_RELAXED, APR_ATOMIC_RELEASE or APR_ATOMIC_SEQ_CST
+ *        (the other orders are taken as APR_ATOMIC_SEQ_CST)
+ */
+APR_DECLARE(void) apr_atomic_set32_ex(volatile apr_uint32_t *mem,
+                                      apr_uint32_t val,
+                                      apr_atomic_order_e order);
+
+/**
+ * atomically add 'val' to an apr_uint32_t, with the given order
+ * @param mem pointer to the object
+ * @param val amount to add
+ * @param order the memory order
+ * @return old value pointed to by mem
+ */
+APR_DECLARE(apr_uint32_t) apr_atomic_add32_ex(volatile apr_uint32_t *mem,
+                                              apr_uint32_t val,
+                                              apr_atomic_order_e order);
+
+/**
+ * compare an apr_uint32_t's value with 'cmp', with the given order.
+ * If they are the same swap the value with 'with'
+ * @param mem pointer to the value
+ * @param with what to swap it with
+ * @param cmp the value to compare it to
+ * @param order the memory order (a failed comparison is at most
+ *        APR_ATOMIC_ACQUIRE)
+ * @return the old value of *mem
+ */
+APR_DECLARE(apr_uint32_t) apr_atomic_cas32_ex(volatile apr_uint32_t *mem,
+                                              apr_uint32_t with,
+                                              apr_uint32_t cmp,
+                                              apr_atomic_order_e order);
+
+/**
+ * exchange an apr_uint32_t's value with 'val', with the given order
+ * @param mem pointer to the value
+ * @param val what to swap it with
+ * @param order the memory order
+ * @return the old value of *mem
+ */
+APR_DECLARE(apr_uint32_t) apr_atomic_xchg32_ex(volatile apr_uint32_t *mem,
+                                               apr_uint32_t val,
+                                               apr_atomic_order_e order);
+
+/**
+ * atomically read an apr_uint64_t from memory, with the given order
+ * @param mem the pointer
+ * @param order APR_ATOMIC_RELAXED, APR_ATOMIC_ACQUIRE or APR_ATOMIC_SEQ_CST
+ *        (the other orders are taken as APR_ATOMIC_SEQ_CST)
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_read64_ex(volatile apr_uint64_t *mem,
+                                               apr_atomic_order_e order);
+
+/**
+ * atomically set an apr_uint64_t in memory, with the given order
+ * @param mem pointer to the object
+ * @param val value that the object will assume
+ * @param order APR_ATOMIC_RELAXED, APR_ATOMIC_RELEASE or APR_ATOMIC_SEQ_CST
+ *        (the other orders are taken as APR_ATOMIC_SEQ_CST)
+ */
+APR_DECLARE(void) apr_atomic_set64_ex(volatile apr_uint64_t *mem,
+                                      apr_uint64_t val,
+                                      apr_atomic_order_e order);
+
+/**
+ * atomically add 'val' to an apr_uint64_t, with the given order
+ * @param mem pointer to the object
+ * @param val amount to add
+ * @param order the memory order
+ * @return old value pointed to by mem
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_add64_ex(volatile apr_uint64_t *mem,
+                                              apr_uint64_t val,
+                                              apr_atomic_order_e order);
+
+/**
+ * compare an apr_uint64_t's value with 'cmp', with the given order.
+ * If they are the same swap the value with 'with'
+ * @param mem pointer to the value
+ * @param with what to swap it with
+ * @param cmp the value to compare it to
+ * @param order the memory order (a failed comparison is at most
+ *        APR_ATOMIC_ACQUIRE)
+ * @return the old value of *mem
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_cas64_ex(volatile apr_uint64_t *mem,
+                                              apr_uint64_t with,
+                                              apr_uint64_t cmp,
+                                              apr_atomic_order_e order);
+
+/**
+ * exchange an apr_uint64_t's value with 'val', with the given order
+ * @param mem pointer to the value
+ * @param val what to swap it with
+ * @param order the memory order
+ * @return the old value of *mem
+ */
+APR_DECLARE(apr_uint64_t) apr_atomic_xchg64_ex(volatile apr_uint64_t *mem,
+                                               apr_uint64_t val,
+                                               apr_atomic_order_e order);
+
+/**
+ * atomically read a pointer from memory, with the given order
+ * @param mem pointer to the pointer
+ * @param order APR_ATOMIC_RELAXED, APR_ATOMIC_ACQUIRE or APR_ATOMIC_SEQ_CST
+ *        (the other orders are taken as APR_ATOMIC_SEQ_CST)
+ * @return the value of the pointer
+ */
+APR_DECLARE(void*) apr_atomic_readptr_ex(void *volatile *mem,
+                                         apr_atomic_order_e order);
+
+/**
+ * atomically set a pointer in memory, with the given order
+ * @param mem pointer to the pointer
+ * @param with what to set it to
+ * @param order APR_ATOMIC_RELAXED, APR_ATOMIC_RELEASE or APR_ATOMIC_SEQ_CST
+ *        (the other orders are taken as APR_ATOMIC_SEQ_CST)
+ */
+APR_DECLARE(void) apr_atomic_setptr_ex(void *volatile *mem, void *with,
+                                       apr_atomic_order_e order);
+
+/**
+ * compare the pointer's value with cmp, with the given order.
+ * If they are the same swap the value with 'with'
+ * @param mem pointer to the pointer
+ * @param with what to swap it with
+ * @param cmp the value to compare it to
+ * @param order the memory order (a failed comparison is at most
+ *        APR_ATOMIC_ACQUIRE)
+ * @return the old value of the pointer
+ */
+APR_DECLARE(void*) apr_atomic_casptr_ex(void *volatile *mem, void *with,
+                                        const void *cmp,
+                                        apr_atomic_order_e order);
+
+/**
+ * exchange a pair of pointer values, with the given order
+ * @param mem pointer to the pointer
+ * @param with what to swap it with
+ * @param order the memory order
+ * @return the old value of the pointer
+ */
+APR_DECLARE(void*) apr_atomic_xchgptr_ex(void *volatile *mem, void *with,
+                                         apr_atomic_order_e order);
+
 /** @} */
 
 #ifdef __cplusplus
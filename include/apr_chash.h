@@ -0,0 +1,147 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_CHASH_H
+#define APR_CHASH_H
+
+/**
+ * @file apr_chash.h
+ * @brief APR Concurrent Hash Tables
+ */
+
+#include "apr.h"
+#include "apr_pools.h"
+#include "apr_hash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup apr_chash Concurrent Hash Tables
+ * @ingroup APR
+ * @{
+ */
+
+/**
+ * Abstract type for concurrent hash tables.
+ */
+typedef struct apr_chash_t apr_chash_t;
+
+/**
+ * Create a concurrent hash table.
+ * @param ht The hash table just created
+ * @param stripes The number of stripes (independently locked parts) of the
+ *        table, rounded up to a power of two, or zero for the default (64)
+ * @param hash_func A custom hash function, or NULL for apr_hashfunc_fast().
+ * @param pool The pool to allocate the hash table out of
+ * @return APR_SUCCESS, or the error returned by the creation of the
+ *         allocator, pools or mutexes.
+ * @remark The table can be used by several threads concurrently without any
+ *         external locking.  Each stripe is a chained hash table with its
+ *         own mutex, taken by the writers only: the readers validate what
+ *         they read against a sequence number bumped by the writers, and
+ *         retry (eventually taking the mutex) if it changed meanwhile.
+ *         So lookups scale with the number of threads, and modifications
+ *         with the number of stripes.
+ * @remark Unlike apr_hash_t, the keys are copied in the table.  The entries
+ *         are allocated from a pool per stripe, sharing an allocator of
+ *         their own which is thread-safe, and are recycled by the stripe
+ *         when deleted.  All the memory is given back when @a pool is
+ *         cleaned up, the table must not be used anymore then.
+ * @remark The values are not copied nor referenced counted, a value removed
+ *         or replaced may still be returned to (and used by) a concurrent
+ *         reader.
+ */
+APR_DECLARE(apr_status_t) apr_chash_create(apr_chash_t **ht,
+                                           unsigned int stripes,
+                                           apr_hashfunc_t hash_func,
+                                           apr_pool_t *pool);
+
+/**
+ * Associate a value with a key in a concurrent hash table.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the string length.
+ * @param val Value to associate with the key
+ * @remark If the value is NULL the hash entry is deleted.
+ */
+APR_DECLARE(void) apr_chash_set(apr_chash_t *ht, const void *key,
+                                apr_ssize_t klen, const void *val);
+
+/**
+ * Look up the value associated with a key in a concurrent hash table.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the string length.
+ * @return Returns NULL if the key is not present.
+ */
+APR_DECLARE(void *) apr_chash_get(apr_chash_t *ht, const void *key,
+                                  apr_ssize_t klen);
+
+/**
+ * Look up the value associated with a key in a concurrent hash table, or if
+ * none exists associate a value.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the string
+ *             length.
+ * @param val Value to associate with the key (if none exists).
+ * @return Returns the existing value if any, the given value otherwise.
+ * @remark If the given value is NULL and a hash entry exists, nothing is done.
+ */
+APR_DECLARE(void *) apr_chash_get_or_set(apr_chash_t *ht, const void *key,
+                                         apr_ssize_t klen, const void *val);
+
+/**
+ * Get the number of key/value pairs in a concurrent hash table.
+ * @param ht The hash table
+ * @return The number of key/value pairs in the hash table.
+ * @remark The count is exact only if the table is not modified
+ *         concurrently.
+ */
+APR_DECLARE(unsigned int) apr_chash_count(apr_chash_t *ht);
+
+/**
+ * Clear any key/value pairs in a concurrent hash table.
+ * @param ht The hash table
+ */
+APR_DECLARE(void) apr_chash_clear(apr_chash_t *ht);
+
+/**
+ * Iterate over a concurrent hash table running the provided function once
+ * for every element in the hash table. The @a comp function will be invoked
+ * for every element in the hash table.
+ *
+ * @param comp The function to run
+ * @param rec The data to pass as the first argument to the function
+ * @param ht The hash table to iterate over
+ * @return FALSE if one of the comp() iterations returned zero; TRUE if all
+ *            iterations returned non-zero
+ * @remark The function is called with the mutex of the stripe held, so
+ *         it must not modify the table.  The entries are consistent per
+ *         stripe, not for the whole table.
+ */
+APR_DECLARE(int) apr_chash_do(apr_hash_do_callback_fn_t *comp,
+                              void *rec, apr_chash_t *ht);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* !APR_CHASH_H */
@@ -0,0 +1,116 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_COUNTER_H
+#define APR_COUNTER_H
+
+/**
+ * @file apr_counter.h
+ * @brief APR Sharded Counters
+ */
+
+#include "apr.h"
+#include "apr_errno.h"
+#include "apr_pools.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup apr_counter Sharded Counters
+ * @ingroup APR
+ * @{
+ */
+
+/**
+ * Abstract type for sharded counters.
+ */
+typedef struct apr_counter_t apr_counter_t;
+
+/**
+ * Flag for apr_counter_create(), to pick the slot of the calling thread
+ * rather than the one of the current CPU.
+ */
+#define APR_COUNTER_PER_THREAD 0x1
+
+/**
+ * Create a counter split into slots, each in its own cache line, which
+ * the threads update concurrently without sharing a cache line.
+ * @param counter The counter just created (initially zero)
+ * @param slots The number of slots, rounded up to a power of two (at most
+ *        1024), or zero for the number of CPUs
+ * @param flags Zero or APR_COUNTER_PER_THREAD
+ * @param pool The pool to allocate the counter out of
+ * @return APR_SUCCESS
+ * @remark By default a thread updates the slot of the CPU it runs on, as
+ *         given by sched_getcpu() on Linux or GetCurrentProcessorNumber()
+ *         on Windows, so that a slot is mostly written by one CPU whatever
+ *         the number of threads.  Otherwise, or with APR_COUNTER_PER_THREAD,
+ *         the slot is picked from the address of the thread's stack.
+ * @remark An update is a relaxed atomic addition to the slot, and a read
+ *         sums all the slots, so the counter suits statistics which are
+ *         updated much more often than they are read.
+ */
+APR_DECLARE(apr_status_t) apr_counter_create(apr_counter_t **counter,
+                                             apr_uint32_t slots,
+                                             apr_uint32_t flags,
+                                             apr_pool_t *pool);
+
+/**
+ * Add a value to the counter.
+ * @param counter The counter
+ * @param val The value to add
+ */
+APR_DECLARE(void) apr_counter_add(apr_counter_t *counter, apr_uint64_t val);
+
+/**
+ * Subtract a value from the counter.
+ * @param counter The counter
+ * @param val The value to subtract
+ */
+APR_DECLARE(void) apr_counter_sub(apr_counter_t *counter, apr_uint64_t val);
+
+/**
+ * Increment the counter by 1.
+ * @param counter The counter
+ */
+APR_DECLARE(void) apr_counter_inc(apr_counter_t *counter);
+
+/**
+ * Read the counter.
+ * @param counter The counter
+ * @return The sum of the slots, modulo 2^64
+ * @remark The slots are read one after the other, so the sum may miss
+ *         (or include) the updates made concurrently.
+ */
+APR_DECLARE(apr_uint64_t) apr_counter_read(apr_counter_t *counter);
+
+/**
+ * Set the counter.
+ * @param counter The counter
+ * @param val The value that the counter will assume
+ * @remark The updates made concurrently may or may not be lost.
+ */
+APR_DECLARE(void) apr_counter_set(apr_counter_t *counter, apr_uint64_t val);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ! APR_COUNTER_H */
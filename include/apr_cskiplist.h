@@ -0,0 +1,149 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_CSKIPLIST_H
+#define APR_CSKIPLIST_H
+
+/**
+ * @file apr_cskiplist.h
+ * @brief APR Concurrent Skip Lists
+ */
+
+#include "apr.h"
+#include "apr_pools.h"
+#include "apr_skiplist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup apr_cskiplist Concurrent Skip Lists
+ * @ingroup APR
+ * @{
+ */
+
+/**
+ * Abstract type for concurrent skip lists.
+ */
+typedef struct apr_cskiplist_t apr_cskiplist_t;
+
+/**
+ * Callback functions for calling apr_cskiplist_do() on each element.
+ * @param rec The data passed as the first argument to apr_cskiplist_do()
+ * @param data The element
+ * @return Non-zero to continue the iteration, zero to stop it
+ */
+typedef int (apr_cskiplist_do_callback_fn_t)(void *rec, void *data);
+
+/**
+ * Create a concurrent skip list.
+ * @param sl The skip list just created
+ * @param comp The function comparing two elements, as the compare function
+ *        of apr_skiplist_set_compare() (negative, zero or positive if the
+ *        first element is respectively lower than, equal to or greater
+ *        than the second one)
+ * @param pool The pool to allocate the skip list out of
+ * @return APR_SUCCESS, or the error returned by the creation of the
+ *         allocator, pools or mutexes.
+ * @remark The skip list can be used by several threads concurrently
+ *         without any external locking.  Elements are inserted and removed
+ *         by linking and unlinking their nodes with atomic compare and
+ *         swap operations, and looked up without writing anything shared
+ *         but a per-thread (approximately) counter of the operations in
+ *         progress, so lookups never wait for modifications nor the other
+ *         way around.  Only the allocation of the nodes takes a mutex,
+ *         which is striped too.
+ * @remark The removed nodes are reclaimed (and their elements freed, see
+ *         apr_cskiplist_remove()) once all the operations that were in
+ *         progress when they were removed have completed.  The memory of
+ *         the nodes is recycled by the skip list and given back when
+ *         @a pool is cleaned up, the skip list must not be used anymore
+ *         then.
+ * @remark Lock-free operations need the compiler's __atomic builtins,
+ *         otherwise each operation takes a mutex for the whole skip list.
+ */
+APR_DECLARE(apr_status_t) apr_cskiplist_create(apr_cskiplist_t **sl,
+                                               apr_skiplist_compare comp,
+                                               apr_pool_t *pool);
+
+/**
+ * Insert an element in a concurrent skip list, unless an equal element is
+ * there already.
+ * @param sl The skip list
+ * @param data The element to insert
+ * @return The element equal to @a data in the skip list if any, @a data
+ *         otherwise (i.e. if it has been inserted).
+ */
+APR_DECLARE(void *) apr_cskiplist_insert(apr_cskiplist_t *sl, void *data);
+
+/**
+ * Find an element in a concurrent skip list.
+ * @param sl The skip list
+ * @param data The value to search for
+ * @return The element equal to @a data, or NULL if there is none.
+ * @remark The element may be removed by another thread meanwhile, it is
+ *         up to the caller to ensure that it is still valid after the
+ *         call.
+ */
+APR_DECLARE(void *) apr_cskiplist_find(apr_cskiplist_t *sl, void *data);
+
+/**
+ * Remove an element from a concurrent skip list.
+ * @param sl The skip list
+ * @param data The value to remove
+ * @param myfree A function to free the removed element, or NULL
+ * @return 1 if an element was removed, 0 otherwise.
+ * @remark The removed element is not freed immediately since concurrent
+ *         operations may still be comparing it, but when its node is
+ *         reclaimed, or when the pool of the skip list is cleaned up at
+ *         the latest.  @a myfree is called from any thread then, and must
+ *         not use the skip list.
+ */
+APR_DECLARE(int) apr_cskiplist_remove(apr_cskiplist_t *sl, void *data,
+                                      apr_skiplist_freefunc myfree);
+
+/**
+ * Get the number of elements in a concurrent skip list.
+ * @param sl The skip list
+ * @return The number of elements in the skip list.
+ * @remark The size is exact only if the skip list is not modified
+ *         concurrently.
+ */
+APR_DECLARE(apr_size_t) apr_cskiplist_size(apr_cskiplist_t *sl);
+
+/**
+ * Iterate over a concurrent skip list, in order, running the provided
+ * function once for every element.
+ * @param comp The function to run
+ * @param rec The data to pass as the first argument to the function
+ * @param sl The skip list to iterate over
+ * @return FALSE if one of the comp() iterations returned zero; TRUE if all
+ *            iterations returned non-zero
+ * @remark The elements inserted or removed concurrently may or may not be
+ *         iterated.  No removed node can be reclaimed until the iteration
+ *         completes, so it should not last too long.
+ */
+APR_DECLARE(int) apr_cskiplist_do(apr_cskiplist_do_callback_fn_t *comp,
+                                  void *rec, apr_cskiplist_t *sl);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* !APR_CSKIPLIST_H */
@@ -70,10 +70,36 @@ typedef unsigned int (*apr_hashfunc_t)(const char *key, apr_ssize_t *klen);
 APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_default(const char *key,
                                                       apr_ssize_t *klen);
 
+/**
+ * A faster hash function, consuming the key a word at a time.
+ * @remark This is the function used (with a per-table seed) by the tables
+ *         created without a custom hash function, it is much faster than
+ *         apr_hashfunc_default() on long keys and distributes better
+ *         structured keys.  The seed is not secret though, see
+ *         APR_HASH_SIPHASH for tables indexed by untrusted input.
+ */
+APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_fast(const char *key,
+                                                   apr_ssize_t *klen);
+
+/**
+ * @defgroup apr_hash_flags Hash table creation flags
+ * @see apr_hash_make_ex()
+ * @{
+ */
+/** Use open addressing, see apr_hash_make_flat() */
+#define APR_HASH_FLAT       0x01
+/** Hash the keys with SipHash-1-3 and a random key per table, for tables
+ * indexed by untrusted input (e.g. request headers) */
+#define APR_HASH_SIPHASH    0x02
+/** @} */
+
 /**
  * Create a hash table.
  * @param pool The pool to allocate the hash table out of
  * @return The hash table just created
+ * @remark The keys are hashed with the apr_hashfunc_fast() function and a
+ *         per-table seed, which can be guessed: use apr_hash_make_ex() with
+ *         APR_HASH_SIPHASH for tables indexed by untrusted input.
   */
 APR_DECLARE(apr_hash_t *) apr_hash_make(apr_pool_t *pool);
 
@@ -86,6 +112,43 @@ APR_DECLARE(apr_hash_t *) apr_hash_make(apr_pool_t *pool);
 APR_DECLARE(apr_hash_t *) apr_hash_make_custom(apr_pool_t *pool, 
                                                apr_hashfunc_t hash_func);
 
+/**
+ * Create a hash table using open addressing
+ * @param pool The pool to allocate the hash table out of
+ * @param hash_func A custom hash function, or NULL for the default one.
+ * @return The hash table just created
+ * @remark The entries are stored inline in a flat array probed a group
+ *         of slots at a time, which avoids an allocation per entry and
+ *         makes lookups and iterations more cache friendly than with
+ *         apr_hash_make().  All the apr_hash functions work with both
+ *         kinds of tables, apr_hash_copy() and apr_hash_merge() return a
+ *         table of the same kind as the (base) table.
+ * @remark The array is malloc()ed, then reallocated when it grows (which
+ *         costs more than growing a chained table, all the entries being
+ *         moved) and freed when @a pool is cleaned up.  Setting entries
+ *         invalidates the iterators of the table (replacing or deleting
+ *         entries does not).
+ */
+APR_DECLARE(apr_hash_t *) apr_hash_make_flat(apr_pool_t *pool,
+                                             apr_hashfunc_t hash_func);
+
+/**
+ * Create a hash table with the given kind and hash function
+ * @param pool The pool to allocate the hash table out of
+ * @param flags A bitmask of APR_HASH_FLAT and/or APR_HASH_SIPHASH
+ * @return The hash table just created, or NULL with APR_HASH_SIPHASH if
+ *         no random key could be obtained (!APR_HAS_RANDOM, or failure of
+ *         apr_generate_random_bytes()).
+ * @remark The seed of the fast hash function can be guessed from the
+ *         creation time and addresses of the table, which lets an attacker
+ *         choose colliding keys.  With APR_HASH_SIPHASH the SipHash key
+ *         is obtained from apr_generate_random_bytes(), which makes
+ *         creating the table more expensive, and hashing about twice as
+ *         slow.
+ */
+APR_DECLARE(apr_hash_t *) apr_hash_make_ex(apr_pool_t *pool,
+                                           unsigned int flags);
+
 /**
  * Make a copy of a hash table
  * @param pool The pool from which to allocate the new hash table
@@ -96,6 +159,31 @@ APR_DECLARE(apr_hash_t *) apr_hash_make_custom(apr_pool_t *pool,
 APR_DECLARE(apr_hash_t *) apr_hash_copy(apr_pool_t *pool,
                                         const apr_hash_t *h);
 
+/**
+ * Make a frozen (read-only) copy of a hash table
+ * @param pool The pool from which to allocate the new hash table
+ * @param h The hash table to freeze
+ * @return The hash table just created
+ * @remark The frozen table is allocated as a single block holding the
+ *         entries sorted by bucket, with their precomputed hashes and a
+ *         copy of their keys inline (not of the values), so it does not
+ *         depend on @a h nor its pool.  Building a table in a temporary
+ *         pool, then freezing it into the long lived one and destroying
+ *         the temporary pool gives back the memory of the chains or
+ *         arrays.
+ * @remark Lookups in a frozen table scan a short contiguous run of
+ *         entries only, and like iterations (with a pool) do not write
+ *         anything, so they can be done by several threads concurrently.
+ *         Modifying it would break those readers, so it's a programming
+ *         error: apr_hash_set(), apr_hash_clear() and apr_hash_get_or_set()
+ *         adding a key leave a frozen table unchanged (or abort() the
+ *         process with APR_POOL_DEBUG).  apr_hash_copy() and
+ *         apr_hash_merge() of a frozen table are not frozen, so they can
+ *         be used to get a modifiable table.
+ */
+APR_DECLARE(apr_hash_t *) apr_hash_freeze(apr_pool_t *pool,
+                                          const apr_hash_t *h);
+
 /**
  * Associate a value with a key in a hash table.
  * @param ht The hash table
@@ -454,6 +454,136 @@ APR_DECLARE(void *) apr_pcalloc_debug(apr_pool_t *p, apr_size_t size,
     apr_pcalloc_debug(p, size, APR_POOL__FILE_LINE__)
 #endif
 
+/**
+ * Allocate an aligned block of memory from a pool
+ * @param p The pool to allocate from
+ * @param size The amount of memory to allocate
+ * @param alignment The alignment of the memory, a power of two
+ *        (e.g. 64 for a cache line)
+ * @return The allocated memory, or NULL if @a alignment is not a power
+ *         of two (or on allocation failure, see apr_palloc()).
+ * @remark The memory is taken from the current block of the pool when
+ *         it fits, so only the padding (less than @a alignment) is lost.
+ */
+APR_DECLARE(void *) apr_palloc_aligned(apr_pool_t *p, apr_size_t size,
+                                       apr_size_t alignment)
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 4))
+                    __attribute__((alloc_size(2)))
+#endif
+                    __attribute__((nonnull(1)));
+
+/**
+ * A region of memory reserved from a pool, for bulk allocations
+ * @see apr_pool_bump_reserve()
+ */
+typedef struct apr_pool_bump_t {
+    /** Where the next allocation starts */
+    char *first_avail;
+    /** The end of the reserved memory */
+    char *endp;
+} apr_pool_bump_t;
+
+/**
+ * Reserve a region of memory from a pool, for many small allocations
+ * to be done with apr_pool_bump_alloc() without further checks.
+ * @param p The pool to reserve the memory from
+ * @param size The size to reserve, covering all the (aligned) sizes
+ *        that will be allocated from @a bump
+ * @param bump The region to initialize
+ * @return APR_SUCCESS, or APR_ENOMEM on allocation failure (after
+ *         calling the pool's abort function, if any).
+ * @remark The memory allocated from @a bump has the lifetime of @a p.
+ *         Call apr_pool_bump_release() once done, to give the unused
+ *         part back to @a p.
+ */
+APR_DECLARE(apr_status_t) apr_pool_bump_reserve(apr_pool_t *p,
+                                                apr_size_t size,
+                                                apr_pool_bump_t *bump)
+                          __attribute__((nonnull(1,3)));
+
+/**
+ * Allocate a block of memory from a reserved region.
+ * @param bump The region, see apr_pool_bump_reserve()
+ * @param size The amount of memory to allocate
+ * @return The allocated memory, aligned like with apr_palloc()
+ * @warning No bounds checking is done: the sizes allocated (aligned with
+ *          APR_ALIGN_DEFAULT) must add up to at most the reserved size.
+ *          The @a size argument is evaluated twice.
+ */
+#define apr_pool_bump_alloc(bump, size) \
+    ((void *)(((bump)->first_avail += APR_ALIGN_DEFAULT(size)) \
+              - APR_ALIGN_DEFAULT(size)))
+
+/**
+ * Give the unused memory of a reserved region back to its pool.
+ * @param p The pool the region was reserved from
+ * @param bump The region, which should not be used anymore
+ * @remark The memory is given back only if nothing else was allocated
+ *         from @a p since apr_pool_bump_reserve(), otherwise it is
+ *         simply left unused until @a p is cleared.
+ */
+APR_DECLARE(void) apr_pool_bump_release(apr_pool_t *p,
+                                        apr_pool_bump_t *bump)
+                  __attribute__((nonnull(1,2)));
+
+/** @see apr_pool_mark() */
+typedef struct apr_pool_mark_t apr_pool_mark_t;
+
+/**
+ * A position in a pool to rewind to, the fields are private.
+ * @see apr_pool_mark()
+ */
+struct apr_pool_mark_t {
+    /** The enclosing mark, if any */
+    apr_pool_mark_t *prev;
+    /** The node being allocated from */
+    void *node;
+    /** The position in the node */
+    void *pos;
+    /** The other nodes, kept aside */
+    apr_memnode_t *ring;
+    /** Where the other nodes link back to the node */
+    apr_memnode_t **ring_ref;
+    /** The node's free index */
+    apr_uint32_t index;
+    /** The pool's user data */
+    void *user_data;
+    /** The pool's subprocesses */
+    void *subprocesses;
+};
+
+/**
+ * Mark the current position of a pool, to release everything allocated
+ * afterwards with apr_pool_rewind(), as a cheap alternative to a subpool
+ * for scratch memory.
+ * @param p The pool to mark
+ * @param mark The mark to initialize
+ * @remark Marks nest: they must be rewound in the reverse order, or the
+ *         inner ones get rewound by apr_pool_rewind() of an outer one.
+ *         A mark must be rewound before it goes out of scope, since it is
+ *         also rewound by apr_pool_clear() and apr_pool_destroy().
+ * @remark While a mark is outstanding, the allocations don't use the free
+ *         space left in the pool's blocks other than the current one.
+ */
+APR_DECLARE(void) apr_pool_mark(apr_pool_t *p, apr_pool_mark_t *mark)
+                  __attribute__((nonnull(1,2)));
+
+/**
+ * Rewind a pool to a mark: run the cleanups registered after the mark in
+ * LIFO order, then release the memory allocated after the mark.
+ * @param p The pool to rewind
+ * @param mark The mark set by apr_pool_mark(), which can't be used
+ *        anymore (unless set again)
+ * @remark The subprocesses noted after the mark are freed like with
+ *         apr_pool_clear(), but the subpools created after the mark are
+ *         left alone.
+ * @warning The user data associated with the pool after the mark is
+ *          forgotten only if the pool had none at the mark.  Otherwise no
+ *          user data should be set between the mark and the rewind.
+ */
+APR_DECLARE(void) apr_pool_rewind(apr_pool_t *p, apr_pool_mark_t *mark)
+                  __attribute__((nonnull(1,2)));
+
 
 /*
  * Pool Properties
@@ -509,6 +639,90 @@ APR_DECLARE(void) apr_pool_tag(apr_pool_t *pool, const char *tag)
                   __attribute__((nonnull(1)));
 
 
+/*
+ * Statistics
+ */
+
+/** Number of size buckets of apr_pool_stats_t palloc counts */
+#define APR_POOL_STATS_BUCKETS 10
+
+/**
+ * Pool statistics, either of a single pool or accumulated for all the
+ * pools of the same tag.
+ * @see apr_pool_stats_get(), apr_pool_stats_do()
+ */
+typedef struct apr_pool_stats_t {
+    /** The tag of the pool(s), possibly NULL */
+    const char *tag;
+    /** Number of times pools were cleared or destroyed (zero for a
+     *  single pool) */
+    apr_size_t cycles;
+    /** Number of memnodes obtained from the allocator */
+    apr_size_t nodes;
+    /** Number of bytes allocated (aligned) */
+    apr_size_t bytes;
+    /** Size of the memnodes currently held by the pool (for a single
+     *  pool), or held when the pools were cleared or destroyed (the sum,
+     *  divide by cycles for the average) */
+    apr_size_t bytes_held;
+    /** High-water mark of the size of the memnodes held by a pool */
+    apr_size_t bytes_max;
+    /** Number of allocations by size: bucket i counts the sizes up to
+     *  16 << i bytes, and the last bucket the larger ones */
+    apr_size_t palloc[APR_POOL_STATS_BUCKETS];
+} apr_pool_stats_t;
+
+/**
+ * Declaration prototype for the iterator callback function of
+ * apr_pool_stats_do().
+ * @param rec The data passed as the first argument to apr_pool_stats_do()
+ * @param stats The statistics of the pools of a tag
+ * @return Iteration continues while this callback function returns non-zero.
+ */
+typedef int (apr_pool_stats_do_callback_fn_t)(void *rec,
+                                              const apr_pool_stats_t *stats);
+
+/**
+ * Enable or disable the statistics of the pools created from now on.
+ * @param on Non-zero to enable
+ * @remark Tracked pools account for their allocations in apr_palloc() and
+ *         apr_psprintf(), which is cheap, and account for them per tag
+ *         with atomic operations when they are cleared or destroyed.  The
+ *         tag's entry is looked up under a global lock by apr_pool_tag()
+ *         (or the first clear of an untagged pool) only.
+ * @remark Not available with APR_POOL_DEBUG, where the pools keep their
+ *         own (slower) statistics.
+ */
+APR_DECLARE(void) apr_pool_stats_enable(int on);
+
+/**
+ * Get the statistics of a pool since it was created or last cleared.
+ * @param pool The pool
+ * @param stats Where to store the statistics
+ * @return APR_SUCCESS, or APR_ENOTIMPL if @a pool was not created with
+ *         statistics enabled.
+ */
+APR_DECLARE(apr_status_t) apr_pool_stats_get(apr_pool_t *pool,
+                                             apr_pool_stats_t *stats)
+                          __attribute__((nonnull(1,2)));
+
+/**
+ * Iterate over the statistics accumulated for each pool tag, in no
+ * particular order.
+ * @param comp The function to run for each tag
+ * @param rec The data to pass as the first argument to the function
+ * @return FALSE if one of the comp() iterations returned zero; TRUE if all
+ *            iterations returned non-zero
+ * @remark The statistics of a pool are accounted for its tag when it is
+ *         cleared or destroyed.
+ * @remark The function is called with a global lock held, so it must not
+ *         clear or destroy tracked pools.
+ */
+APR_DECLARE(int) apr_pool_stats_do(apr_pool_stats_do_callback_fn_t *comp,
+                                   void *rec)
+                 __attribute__((nonnull(1)));
+
+
 /*
  * User data management
  */
@@ -28,6 +28,7 @@
 #include "apu.h"
 #include "apr_errno.h"
 #include "apr_pools.h"
+#include "apr_tables.h"
 #include "apr_time.h"
 
 #if APR_HAS_THREADS
@@ -57,6 +58,32 @@ APR_DECLARE(apr_status_t) apr_queue_create(apr_queue_t **queue,
                                            unsigned int queue_capacity, 
                                            apr_pool_t *a);
 
+/**
+ * Flag for apr_queue_create_ex(), to create a lock-free queue.
+ */
+#define APR_QUEUE_LOCKFREE 0x1
+
+/**
+ * create a FIFO queue, with the given flags
+ * @param queue The new queue
+ * @param queue_capacity maximum size of the queue
+ * @param flags Zero for a queue like apr_queue_create(), or
+ * APR_QUEUE_LOCKFREE
+ * @param a pool to allocate queue from
+ * @remark A lock-free queue is a ring of cells with sequence numbers, where
+ * the producers and the consumers claim their cells with a compare and
+ * swap, without locking.  The threads block (and are woken up) only when
+ * the queue is empty or full, so the other operations cost no system call.
+ * All the functions work the same, but the capacity is rounded up to a
+ * power of two (at least 2).
+ * @remark The lock-free queue needs the compiler's atomic builtins, the flag
+ * is ignored on the platforms without them.
+ */
+APR_DECLARE(apr_status_t) apr_queue_create_ex(apr_queue_t **queue,
+                                              unsigned int queue_capacity,
+                                              apr_uint32_t flags,
+                                              apr_pool_t *a);
+
 /**
  * push/add an object to the queue, blocking if the queue is already full
  *
@@ -135,6 +162,68 @@ APR_DECLARE(apr_status_t) apr_queue_timedpush(apr_queue_t *queue, void *data,
 APR_DECLARE(apr_status_t) apr_queue_timedpop(apr_queue_t *queue, void **data,
                                              apr_interval_time_t timeout);
 
+/**
+ * push/add up to n objects to the queue, waiting a maximum of timeout
+ * microseconds before returning if the queue is full
+ *
+ * @param queue the queue
+ * @param data the array of data to push, in order
+ * @param n the number of elements in data
+ * @param pushed the number of objects pushed (may be NULL)
+ * @param timeout the timeout, negative to wait forever or 0 to not block
+ * @returns APR_EINTR the blocking operation was interrupted (try again)
+ * @returns APR_EAGAIN the queue is full and timeout is 0
+ * @returns APR_TIMEUP the queue is full and the timeout expired
+ * @returns APR_EOF the queue has been terminated
+ * @returns APR_SUCCESS on a successful push of at least one object
+ * @remark The objects that fit in the queue are pushed at once, so the lock
+ * (if any) is taken and the waiting consumers are woken up only once for
+ * the batch.  This blocks only until the first object can be pushed, the
+ * caller should push the remaining objects (data + *pushed) if needed.
+ */
+APR_DECLARE(apr_status_t) apr_queue_push_n(apr_queue_t *queue,
+                                           void * const *data,
+                                           unsigned int n,
+                                           unsigned int *pushed,
+                                           apr_interval_time_t timeout);
+
+/**
+ * pop/get up to n objects from the queue, waiting a maximum of timeout
+ * microseconds before returning if the queue is empty
+ *
+ * @param queue the queue
+ * @param data the array where to store the objects, in order
+ * @param n the number of elements in data
+ * @param popped the number of objects popped (may be NULL)
+ * @param timeout the timeout, negative to wait forever or 0 to not block
+ * @returns APR_EINTR the blocking operation was interrupted (try again)
+ * @returns APR_EAGAIN the queue is empty and timeout is 0
+ * @returns APR_TIMEUP the queue is empty and the timeout expired
+ * @returns APR_EOF the queue has been terminated
+ * @returns APR_SUCCESS on a successful pop of at least one object
+ * @remark This blocks only until the first object is available, then pops
+ * the ones already in the queue (up to n) at once.
+ */
+APR_DECLARE(apr_status_t) apr_queue_pop_n(apr_queue_t *queue, void **data,
+                                          unsigned int n,
+                                          unsigned int *popped,
+                                          apr_interval_time_t timeout);
+
+/**
+ * pop/get all the objects from the queue without blocking, appending them
+ * to the given array of (void *)
+ *
+ * @param queue the queue
+ * @param items the array to append the objects to
+ * @returns APR_SUCCESS, whether or not some objects were popped
+ * @remark This works also once the queue is terminated, so that the objects
+ * still queued can be released on shutdown.
+ * @remark For a lock-free queue, the objects pushed concurrently may or may
+ * not be popped.
+ */
+APR_DECLARE(apr_status_t) apr_queue_drain(apr_queue_t *queue,
+                                          apr_array_header_t *items);
+
 /**
  * returns the size of the queue.
  *
@@ -176,6 +176,72 @@ APR_DECLARE(void *) apr_skiplist_last_compare(apr_skiplist *sli, void *data,
 APR_DECLARE(void *) apr_skiplist_last(apr_skiplist *sl, void *data,
                                       apr_skiplistnode **iter);
 
+/**
+ * Return the rank of a value in the skip list, i.e. the number of elements
+ * lower than the value, using the specified comparison function.
+ * @param sl The skip list
+ * @param data The value to search for
+ * @param comp The comparison function to use
+ * @return The number of elements lower than @a data, which is also the
+ *         (0-based) index of the first element equal to @a data if any.
+ * @remark This takes O(log n) time, like a lookup.
+ */
+APR_DECLARE(size_t) apr_skiplist_rank_compare(apr_skiplist *sl, void *data,
+                                              apr_skiplist_compare comp);
+
+/**
+ * Return the rank of a value in the skip list, i.e. the number of elements
+ * lower than the value, using the current comparison function.
+ * @param sl The skip list
+ * @param data The value to search for
+ * @return The number of elements lower than @a data.
+ */
+APR_DECLARE(size_t) apr_skiplist_rank(apr_skiplist *sl, void *data);
+
+/**
+ * Return the number of elements of the skip list in the range
+ * [@a lo, @a hi), using the current comparison function.
+ * @param sl The skip list
+ * @param lo The lower bound value (included)
+ * @param hi The upper bound value (excluded)
+ * @return The number of elements greater than or equal to @a lo and lower
+ *         than @a hi.
+ * @remark This takes O(log n) time, whatever the number of elements in
+ *         the range.
+ */
+APR_DECLARE(size_t) apr_skiplist_range_count(apr_skiplist *sl, void *lo,
+                                             void *hi);
+
+/**
+ * Return the element at the given position in the skip list ordered by
+ * the specified comparison function.
+ * @param sl The skip list
+ * @param index The (0-based) position of the element
+ * @param iter A pointer to the returned skip list node representing the element
+ * found
+ * @param comp The comparison function to use
+ * @return The element, or NULL if @a index is not lower than the size of
+ *         the skip list.
+ * @remark This takes O(log n) time.
+ */
+APR_DECLARE(void *) apr_skiplist_select_compare(apr_skiplist *sl,
+                                                size_t index,
+                                                apr_skiplistnode **iter,
+                                                apr_skiplist_compare comp);
+
+/**
+ * Return the element at the given position in the skip list ordered by
+ * the current comparison function.
+ * @param sl The skip list
+ * @param index The (0-based) position of the element
+ * @param iter A pointer to the returned skip list node representing the element
+ * found
+ * @return The element, or NULL if @a index is not lower than the size of
+ *         the skip list.
+ */
+APR_DECLARE(void *) apr_skiplist_select(apr_skiplist *sl, size_t index,
+                                        apr_skiplistnode **iter);
+
 /**
  * Return the next element in the skip list.
  * @param sl The skip list
@@ -266,6 +332,23 @@ APR_DECLARE(apr_skiplistnode *) apr_skiplist_replace_compare(apr_skiplist *sl,
 APR_DECLARE(apr_skiplistnode *) apr_skiplist_replace(apr_skiplist *sl,
                                     void *data, apr_skiplist_freefunc myfree);
 
+/**
+ * Add the elements of a sorted array into the skip list, allowing for
+ * duplicates.
+ * @param sl The skip list
+ * @param elts The elements to add, sorted according to the current
+ *        comparison function
+ * @param nelts The number of elements
+ * @return APR_SUCCESS, APR_EINVAL if no comparison function has been set
+ *         for the skip list or if @a elts is not sorted (nothing is added
+ *         then), or APR_ENOMEM.
+ * @remark If the skip list is empty, it is built in O(n) time by appending
+ *         each element to the levels of its height, otherwise the elements
+ *         are added one by one as with apr_skiplist_add().
+ */
+APR_DECLARE(apr_status_t) apr_skiplist_build(apr_skiplist *sl,
+                                             void *const *elts, size_t nelts);
+
 /**
  * Remove a node from the skip list.
  * @param sl The skip list
@@ -0,0 +1,261 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_SPSC_QUEUE_H
+#define APR_SPSC_QUEUE_H
+
+/**
+ * @file apr_spsc_queue.h
+ * @brief APR Single Producer Single Consumer queues
+ */
+
+#include "apr.h"
+#include "apr_errno.h"
+#include "apr_pools.h"
+#include "apr_poll.h"
+#include "apr_time.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup apr_spsc_queue Single Producer Single Consumer queues
+ * @ingroup APR
+ * @{
+ */
+
+/**
+ * Abstract type for single producer single consumer queues.
+ */
+typedef struct apr_spsc_queue_t apr_spsc_queue_t;
+
+/**
+ * Flag for apr_spsc_queue_create() and apr_spsc_queue_create_at(), to
+ * create a queue whose producer and consumer can wait for each other
+ * (see apr_spsc_queue_wait() and apr_spsc_queue_arm()).
+ */
+#define APR_SPSC_QUEUE_NOTIFY 0x1
+
+/**
+ * Get the size of the memory needed by a queue, for
+ * apr_spsc_queue_create_at().
+ * @param capacity The maximum number of elements in the queue
+ * @param elt_size The size of each element
+ * @return The size in bytes, or zero if the arguments are invalid
+ */
+APR_DECLARE(apr_size_t) apr_spsc_queue_memsize(apr_uint32_t capacity,
+                                               apr_size_t elt_size);
+
+/**
+ * Create a single producer single consumer queue.
+ * @param queue The queue just created
+ * @param capacity The maximum number of elements in the queue, rounded up
+ *        to a power of two (at least 2)
+ * @param elt_size The size of each element, which are copied in and out of
+ *        the queue (e.g. sizeof(void *) for pointers)
+ * @param flags Zero or APR_SPSC_QUEUE_NOTIFY
+ * @param pool The pool to allocate the queue out of
+ * @return APR_SUCCESS, APR_EINVAL for a zero @a elt_size or a too large
+ *         queue, or the error returned by the creation of the
+ *         notification files.
+ * @remark One thread (or process) may push while another one pops, without
+ *         any locking: each side writes its own cursor only, and reads the
+ *         other side's cursor only when its cached copy says that the
+ *         queue is full (or empty), so pushes and pops are wait-free and
+ *         the cursors live in their own cache lines.  apr_spsc_queue_push_n()
+ *         and apr_spsc_queue_pop_n() publish their cursor once per batch.
+ * @remark More than one producer (or consumer) needs external locking.
+ * @remark The cursors are ordered with the apr_atomic _ex functions, so
+ *         sharing the queue between processes needs a lock-free apr_atomic
+ *         implementation (not the generic one, based on mutexes).
+ */
+APR_DECLARE(apr_status_t) apr_spsc_queue_create(apr_spsc_queue_t **queue,
+                                                apr_uint32_t capacity,
+                                                apr_size_t elt_size,
+                                                apr_uint32_t flags,
+                                                apr_pool_t *pool);
+
+/**
+ * Create a single producer single consumer queue in the given memory,
+ * typically an apr_shm_t segment shared by the producer and consumer
+ * processes.
+ * @param queue The queue just created
+ * @param mem The memory where to put the queue, aligned at least like
+ *        APR_ALIGN_DEFAULT
+ * @param memsize The size of @a mem, at least apr_spsc_queue_memsize()
+ * @param capacity The maximum number of elements in the queue, rounded up
+ *        to a power of two (at least 2)
+ * @param elt_size The size of each element
+ * @param flags Zero or APR_SPSC_QUEUE_NOTIFY
+ * @param pool The pool to allocate the process local handle (and the
+ *        notification files) out of
+ * @return APR_SUCCESS, APR_EINVAL for invalid arguments or a too small
+ *         @a memsize, or the error returned by the creation of the
+ *         notification files.
+ * @remark The other process can use the queue either by inheriting the
+ *         returned handle through apr_proc_fork(), or by calling
+ *         apr_spsc_queue_attach() on the same memory.  Since the
+ *         notification files can only be inherited, the latter is not
+ *         possible with APR_SPSC_QUEUE_NOTIFY.
+ * @remark The elements are copied bytewise between the processes, so they
+ *         should not contain pointers.
+ */
+APR_DECLARE(apr_status_t) apr_spsc_queue_create_at(apr_spsc_queue_t **queue,
+                                                   void *mem,
+                                                   apr_size_t memsize,
+                                                   apr_uint32_t capacity,
+                                                   apr_size_t elt_size,
+                                                   apr_uint32_t flags,
+                                                   apr_pool_t *pool);
+
+/**
+ * Attach to a single producer single consumer queue created by
+ * apr_spsc_queue_create_at() in some (shared) memory.
+ * @param queue The queue attached
+ * @param mem The memory given to apr_spsc_queue_create_at()
+ * @param memsize The size of @a mem
+ * @param pool The pool to allocate the process local handle out of
+ * @return APR_SUCCESS, APR_EINVAL if @a mem does not contain a queue, or
+ *         APR_ENOTIMPL if the queue was created with APR_SPSC_QUEUE_NOTIFY.
+ */
+APR_DECLARE(apr_status_t) apr_spsc_queue_attach(apr_spsc_queue_t **queue,
+                                                void *mem,
+                                                apr_size_t memsize,
+                                                apr_pool_t *pool);
+
+/**
+ * Push an element to the queue, from the producer.
+ * @param queue The queue
+ * @param elt The element to copy into the queue
+ * @return APR_SUCCESS, or APR_EAGAIN if the queue is full
+ */
+APR_DECLARE(apr_status_t) apr_spsc_queue_push(apr_spsc_queue_t *queue,
+                                              const void *elt);
+
+/**
+ * Push up to n elements to the queue, from the producer, publishing them
+ * to the consumer at once.
+ * @param queue The queue
+ * @param elts The array of elements to copy into the queue
+ * @param n The number of elements in @a elts
+ * @param pushed The number of elements pushed (may be NULL)
+ * @return APR_SUCCESS if at least one element was pushed (or @a n is
+ *         zero), or APR_EAGAIN if the queue is full
+ */
+APR_DECLARE(apr_status_t) apr_spsc_queue_push_n(apr_spsc_queue_t *queue,
+                                                const void *elts,
+                                                apr_uint32_t n,
+                                                apr_uint32_t *pushed);
+
+/**
+ * Pop an element from the queue, from the consumer.
+ * @param queue The queue
+ * @param elt Where to copy the element
+ * @return APR_SUCCESS, or APR_EAGAIN if the queue is empty
+ */
+APR_DECLARE(apr_status_t) apr_spsc_queue_pop(apr_spsc_queue_t *queue,
+                                             void *elt);
+
+/**
+ * Pop up to n elements from the queue, from the consumer, releasing their
+ * room to the producer at once.
+ * @param queue The queue
+ * @param elts The array where to copy the elements
+ * @param n The number of elements in @a elts
+ * @param popped The number of elements popped (may be NULL)
+ * @return APR_SUCCESS if at least one element was popped (or @a n is
+ *         zero), or APR_EAGAIN if the queue is empty
+ */
+APR_DECLARE(apr_status_t) apr_spsc_queue_pop_n(apr_spsc_queue_t *queue,
+                                               void *elts,
+                                               apr_uint32_t n,
+                                               apr_uint32_t *popped);
+
+/**
+ * Get the number of elements in the queue.
+ * @param queue The queue
+ * @return The number of elements, which may be outdated as soon as it is
+ *         returned if called from neither the producer nor the consumer.
+ */
+APR_DECLARE(apr_uint32_t) apr_spsc_queue_size(apr_spsc_queue_t *queue);
+
+/**
+ * Get the capacity of the queue.
+ * @param queue The queue
+ * @return The maximum number of elements in the queue
+ */
+APR_DECLARE(apr_uint32_t) apr_spsc_queue_capacity(apr_spsc_queue_t *queue);
+
+/**
+ * Wait until the queue can be popped from (by the consumer) or pushed to
+ * (by the producer).
+ * @param queue The queue
+ * @param event APR_POLLIN for the consumer to wait for an element, or
+ *        APR_POLLOUT for the producer to wait for some room
+ * @param timeout The maximum time to wait, negative to wait forever
+ * @return APR_SUCCESS, APR_TIMEUP if the timeout expired, APR_EINTR if the
+ *         wait was interrupted by a signal, APR_EINVAL for an invalid
+ *         @a event, or APR_ENOTIMPL if the queue was not created with
+ *         APR_SPSC_QUEUE_NOTIFY.
+ * @remark The other side signals a file (an eventfd on Linux, a pipe
+ *         otherwise) only if this side is waiting, so pushes and pops
+ *         that do not make the queue ready cost no system call.
+ */
+APR_DECLARE(apr_status_t) apr_spsc_queue_wait(apr_spsc_queue_t *queue,
+                                              apr_int16_t event,
+                                              apr_interval_time_t timeout);
+
+/**
+ * Get the descriptor to add to an apr_pollset_t, to be notified when the
+ * queue can be popped from (by the consumer) or pushed to (by the
+ * producer).
+ * @param queue The queue
+ * @param event APR_POLLIN for the consumer, APR_POLLOUT for the producer
+ * @param pfd The descriptor to fill in, the file is always to be polled
+ *        for APR_POLLIN (the client_data is left untouched)
+ * @return APR_SUCCESS, APR_EINVAL for an invalid @a event, or APR_ENOTIMPL
+ *         if the queue was not created with APR_SPSC_QUEUE_NOTIFY.
+ * @remark The notification must be armed with apr_spsc_queue_arm() before
+ *         each poll.
+ */
+APR_DECLARE(apr_status_t) apr_spsc_queue_pollfd_get(apr_spsc_queue_t *queue,
+                                                    apr_int16_t event,
+                                                    apr_pollfd_t *pfd);
+
+/**
+ * Arm the notification of the descriptor returned by
+ * apr_spsc_queue_pollfd_get(), before polling it.
+ * @param queue The queue
+ * @param event APR_POLLIN for the consumer, APR_POLLOUT for the producer
+ * @return APR_SUCCESS, APR_EINVAL for an invalid @a event, or APR_ENOTIMPL
+ *         if the queue was not created with APR_SPSC_QUEUE_NOTIFY.
+ * @remark This consumes the previous notification, and makes the
+ *         descriptor readable as soon as the queue can be popped from (or
+ *         pushed to), including right away.  Once polled, the queue should
+ *         be popped from (or pushed to) until APR_EAGAIN before arming it
+ *         again, since the notification may be early.
+ */
+APR_DECLARE(apr_status_t) apr_spsc_queue_arm(apr_spsc_queue_t *queue,
+                                             apr_int16_t event);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ! APR_SPSC_QUEUE_H */
@@ -130,6 +130,30 @@ APR_DECLARE(apr_array_header_t *) apr_array_make(apr_pool_t *p,
  */
 APR_DECLARE(void *) apr_array_push(apr_array_header_t *arr);
 
+/**
+ * Add several new elements to an array at once.
+ * @param arr The array to add the elements to.
+ * @param nelts The number of elements to add.
+ * @return Location of the first new element in the array, the others
+ *         following contiguously.
+ * @remark The array grows at most once, by doubling its size until the new
+ *         elements fit, like apr_array_push() does for a single element.
+ */
+APR_DECLARE(void *) apr_array_push_n(apr_array_header_t *arr, int nelts);
+
+/**
+ * Make room in an array for a given number of elements.
+ * @param arr The array to make room in.
+ * @param nelts The total number of elements the array should hold.
+ * @remark The array is grown to exactly @a nelts elements, if it holds
+ *         less, so that pushing up to that many elements later does not
+ *         allocate.  Since the storage is allocated from a pool, the old
+ *         storage is only given back when the pool is cleared: reserving
+ *         the final size upfront avoids the memory of the successive
+ *         doublings.
+ */
+APR_DECLARE(void) apr_array_reserve(apr_array_header_t *arr, int nelts);
+
 /** A helper macro for accessing a member of an APR array.
  *
  * @param ary the array
@@ -222,6 +246,76 @@ APR_DECLARE(char *) apr_array_pstrcat(apr_pool_t *p,
 				      const apr_array_header_t *arr,
 				      const char sep);
 
+/**
+ * Declaration prototype for the comparison function of apr_array_sort(),
+ * apr_array_bsearch() and apr_array_dedup(), as for qsort().
+ * @param a The first element (or the key for apr_array_bsearch())
+ * @param b The second element
+ * @return A negative, zero or positive value if @a a is respectively less
+ *         than, equal to or greater than @a b.
+ */
+typedef int (apr_array_compare_fn_t)(const void *a, const void *b);
+
+/**
+ * Sort the elements of an array in place.
+ * @param arr The array to sort
+ * @param cmp The comparison function
+ * @remark The sort is not stable.
+ */
+APR_DECLARE(void) apr_array_sort(apr_array_header_t *arr,
+                                 apr_array_compare_fn_t *cmp);
+
+/** @see apr_thread_pool_t */
+struct apr_thread_pool;
+
+/**
+ * Sort the elements of a (large) array in place, using the threads of a
+ * thread pool.
+ * @param arr The array to sort
+ * @param cmp The comparison function, called concurrently
+ * @param tp The thread pool to run the sort on, or NULL
+ * @return APR_SUCCESS, or the error returned by the creation of the
+ *         subpool or the synchronization objects.
+ * @remark The array is split into one chunk per thread of @a tp (plus one
+ *         for the calling thread), sorted concurrently and then merged
+ *         pairwise, concurrently too.  The merges need a buffer the size
+ *         of the array, allocated from a subpool of the array's pool and
+ *         destroyed on return.
+ * @remark Small arrays, or without @a tp or threads, are sorted with
+ *         apr_array_sort() only.
+ * @remark The calling thread takes its part of the work, then runs the
+ *         tasks pushed to @a tp that no thread has taken yet, and waits
+ *         for the others only.  So it can be one of the threads of @a tp
+ *         (the sort runs there if all the others are busy).
+ * @remark The sort is not stable.
+ */
+APR_DECLARE(apr_status_t) apr_array_sort_parallel(apr_array_header_t *arr,
+                                                  apr_array_compare_fn_t *cmp,
+                                                  struct apr_thread_pool *tp);
+
+/**
+ * Search a sorted array for an element.
+ * @param arr The array, sorted according to @a cmp
+ * @param key The key to search for, passed as the first argument of
+ *            @a cmp
+ * @param cmp The comparison function
+ * @return The location of a matching element in the array, or NULL if
+ *         none matches.
+ */
+APR_DECLARE(void *) apr_array_bsearch(const apr_array_header_t *arr,
+                                      const void *key,
+                                      apr_array_compare_fn_t *cmp);
+
+/**
+ * Remove the consecutive duplicate elements of an array in place.
+ * @param arr The array, usually sorted according to @a cmp
+ * @param cmp The comparison function
+ * @remark The first element of each run of equal elements is kept, the
+ *         others are removed by moving the next elements down.
+ */
+APR_DECLARE(void) apr_array_dedup(apr_array_header_t *arr,
+                                  apr_array_compare_fn_t *cmp);
+
 /**
  * Make a new table.
  * @param p The pool to allocate the pool out of
@@ -252,6 +346,31 @@ APR_DECLARE(apr_table_t *) apr_table_copy(apr_pool_t *p,
 APR_DECLARE(apr_table_t *) apr_table_clone(apr_pool_t *p,
                                            const apr_table_t *t);
 
+/**
+ * Create a frozen (read-only) copy of a table, for lookups only.
+ * @param p The pool to allocate the new table out of
+ * @param t The table to freeze
+ * @return A compact deep copy of the table passed in
+ * @remark The frozen table, its entries, its (full hash) index and a copy
+ *         of the keys and values are allocated as a single block, so it
+ *         does not depend on @a t nor its pool.  Building a table in a
+ *         temporary pool, then freezing it into the long lived one and
+ *         destroying the temporary pool gives back the memory of the
+ *         array growths and index rebuilds.
+ * @remark Lookups with apr_table_get(), apr_table_getm(), apr_table_do()
+ *         and apr_table_elts() do not write anything, so they can be
+ *         done by several threads concurrently.  Modifying the frozen
+ *         table would break those readers, so it's a programming error:
+ *         the functions modifying a table (apr_table_set(),
+ *         apr_table_add(), apr_table_unset(), apr_table_clear(), ...)
+ *         leave it unchanged (or abort() the process with
+ *         APR_POOL_DEBUG).  apr_table_copy(), apr_table_clone() and
+ *         apr_table_overlay() of a frozen table are not frozen, so they
+ *         can be used to get a modifiable table.
+ */
+APR_DECLARE(apr_table_t *) apr_table_freeze(apr_pool_t *p,
+                                            const apr_table_t *t);
+
 /**
  * Delete all of the elements from a table.
  * @param t The table to clear
@@ -57,6 +57,9 @@ extern "C" {
 /** Opaque Thread Pool structure. */
 typedef struct apr_thread_pool apr_thread_pool_t;
 
+/** Opaque structure for waiting on a group of tasks. */
+typedef struct apr_thread_pool_group apr_thread_pool_group_t;
+
 #define APR_THREAD_TASK_PRIORITY_LOWEST 0
 #define APR_THREAD_TASK_PRIORITY_LOW 63
 #define APR_THREAD_TASK_PRIORITY_NORMAL 127
@@ -79,6 +82,52 @@ APR_DECLARE(apr_status_t) apr_thread_pool_create(apr_thread_pool_t **me,
                                                  apr_size_t max_threads,
                                                  apr_pool_t *pool);
 
+/**
+ * Flag for apr_thread_pool_create_ex(), to create a work stealing thread
+ * pool.
+ */
+#define APR_THREAD_POOL_WORK_STEALING 0x1
+
+/**
+ * Flag for apr_thread_pool_create_ex(), to keep the histograms of the time
+ * the tasks wait in the queue and of the time they run (see
+ * apr_thread_pool_latency_get()).
+ */
+#define APR_THREAD_POOL_HISTOGRAMS 0x2
+
+/**
+ * Create a thread pool, with the given flags
+ * @param me The pointer in which to return the newly created apr_thread_pool
+ * object, or NULL if thread pool creation fails.
+ * @param init_threads The number of threads to be created initially, this number
+ * will also be used as the initial value for the maximum number of idle threads.
+ * @param max_threads The maximum number of threads that can be created
+ * @param flags Zero for a thread pool like apr_thread_pool_create(), or
+ * APR_THREAD_POOL_WORK_STEALING and/or APR_THREAD_POOL_HISTOGRAMS
+ * @param pool The pool to use
+ * @return APR_SUCCESS if the thread pool was created successfully. Otherwise,
+ * the error code.
+ * @remark In work stealing mode, each thread has its own queues where the
+ * tasks it pushes are added and taken without locking (last in first out),
+ * and the idle threads take the oldest tasks of the others.  The tasks
+ * pushed from outside the pool are given to the threads in turn.  This
+ * avoids contending on the pool's lock for each task, at the cost of:
+ * - a fixed number of threads (@a max_threads, or @a init_threads if
+ *   greater), all created upfront, so apr_thread_pool_idle_max_set() and
+ *   apr_thread_pool_thread_max_set() have no effect;
+ * - priorities honored approximately, by segments of 64 levels and per
+ *   thread only, and apr_thread_pool_top() differing from
+ *   apr_thread_pool_push() only for the tasks pushed from outside the pool;
+ * - apr_thread_pool_tasks_high_count() not being maintained.
+ * @remark Work stealing needs the compiler's atomic builtins, the flag is
+ * ignored on the platforms without them.
+ */
+APR_DECLARE(apr_status_t) apr_thread_pool_create_ex(apr_thread_pool_t **me,
+                                                    apr_size_t init_threads,
+                                                    apr_size_t max_threads,
+                                                    apr_uint32_t flags,
+                                                    apr_pool_t *pool);
+
 /**
  * Destroy the thread pool and stop all the threads
  * @return APR_SUCCESS if all threads are stopped.
@@ -99,6 +148,64 @@ APR_DECLARE(apr_status_t) apr_thread_pool_push(apr_thread_pool_t *me,
                                                void *param,
                                                apr_byte_t priority,
                                                void *owner);
+
+/**
+ * Schedule tasks to the bottom of the tasks of same priority, all at once.
+ * @param me The thread pool
+ * @param func The task function
+ * @param params The parameters of the tasks, one per task
+ * @param n The number of tasks
+ * @param priority The priority of the tasks.
+ * @param owner Owner of these tasks.
+ * @param group The group to add the tasks to, or NULL
+ * @return APR_SUCCESS if the tasks had been scheduled successfully
+ * @remark The tasks are queued under a single acquisition of the pool's
+ * lock, and the idle threads are woken up once.  On failure, the first
+ * tasks may have been scheduled already (and removed from @a group
+ * otherwise).
+ */
+APR_DECLARE(apr_status_t)
+    apr_thread_pool_push_batch(apr_thread_pool_t *me,
+                               apr_thread_start_t func,
+                               void * const *params, apr_size_t n,
+                               apr_byte_t priority, void *owner,
+                               apr_thread_pool_group_t *group);
+
+/**
+ * Create a group of tasks, to wait for the tasks pushed in it.
+ * @param group The group just created
+ * @param pool The pool to allocate the group out of
+ * @return APR_SUCCESS, or the error creating the group's mutex or
+ * condition variable.
+ * @remark A group can be used with several thread pools, and reused once
+ * its tasks are done.  The pool must not be destroyed while the group has
+ * tasks pending.
+ */
+APR_DECLARE(apr_status_t)
+    apr_thread_pool_group_create(apr_thread_pool_group_t **group,
+                                 apr_pool_t *pool);
+
+/**
+ * Wait for the tasks of a group to be done, either run or cancelled.
+ * @param group The group
+ * @param timeout The maximum time to wait, in microseconds, or a negative
+ * value to wait indefinitely
+ * @return APR_SUCCESS if all the tasks are done, or APR_TIMEUP.
+ * @remark The tasks still queued when their thread pool is destroyed are
+ * never done.
+ */
+APR_DECLARE(apr_status_t)
+    apr_thread_pool_group_wait(apr_thread_pool_group_t *group,
+                               apr_interval_time_t timeout);
+
+/**
+ * Get the number of tasks of a group not done yet
+ * @param group The group
+ * @return Number of tasks pending
+ */
+APR_DECLARE(apr_size_t)
+    apr_thread_pool_group_count(apr_thread_pool_group_t *group);
+
 /**
  * Schedule a task to be run after a delay
  * @param me The thread pool
@@ -107,6 +214,9 @@ APR_DECLARE(apr_status_t) apr_thread_pool_push(apr_thread_pool_t *me,
  * @param time Time in microseconds
  * @param owner Owner of this task.
  * @return APR_SUCCESS if the task had been scheduled successfully
+ * @remark The scheduled tasks are kept in a timer wheel of one millisecond
+ * resolution (see apr_timer_wheel.h), a task runs no sooner than @a time
+ * but possibly up to a millisecond later.
  */
 APR_DECLARE(apr_status_t) apr_thread_pool_schedule(apr_thread_pool_t *me,
                                                    apr_thread_start_t func,
@@ -280,6 +390,75 @@ APR_DECLARE(apr_size_t) apr_thread_pool_threshold_set(apr_thread_pool_t *me,
  */
 APR_DECLARE(apr_size_t) apr_thread_pool_threshold_get(apr_thread_pool_t * me);
 
+/**
+ * Placement for apr_thread_pool_affinity_set(), filling the NUMA nodes one
+ * after the other so that the threads share their caches and memory.
+ */
+#define APR_THREAD_POOL_AFFINITY_COMPACT 0
+/**
+ * Placement for apr_thread_pool_affinity_set(), alternating the NUMA nodes
+ * so that the threads use all their memory bandwidth.
+ */
+#define APR_THREAD_POOL_AFFINITY_SPREAD  1
+
+/**
+ * Pin each thread of the pool to one of the given CPUs.
+ * @param me The thread pool
+ * @param cpus The numbers of the CPUs (from zero)
+ * @param ncpus The number of CPUs, or zero to stop placing the threads
+ * @param placement APR_THREAD_POOL_AFFINITY_COMPACT or
+ * APR_THREAD_POOL_AFFINITY_SPREAD
+ * @return APR_SUCCESS, APR_EINVAL for an unknown placement, or APR_ENOTIMPL
+ * if the platform does not support thread affinity.
+ * @remark The CPUs are ordered by NUMA node (see apr_cpu_node_get()) as
+ * asked by @a placement, and given in turn to the threads, which pin
+ * themselves before taking their next task.  There can be more threads than
+ * CPUs, several threads then share a CPU.
+ * @remark With zero CPUs the threads already pinned stay so, but the new
+ * ones run on any CPU.
+ */
+APR_DECLARE(apr_status_t)
+    apr_thread_pool_affinity_set(apr_thread_pool_t *me,
+                                 const apr_uint32_t *cpus, apr_size_t ncpus,
+                                 int placement);
+
+/** The time the tasks waited, for apr_thread_pool_latency_get() */
+#define APR_THREAD_POOL_WAIT_TIME 0
+/** The time the tasks ran, for apr_thread_pool_latency_get() */
+#define APR_THREAD_POOL_RUN_TIME  1
+/** All the priorities, for apr_thread_pool_latency_get() */
+#define APR_THREAD_POOL_ALL_PRIORITIES (-1)
+
+/**
+ * Get a percentile of the time the tasks waited in the queue or ran.
+ * @param me The thread pool, created with APR_THREAD_POOL_HISTOGRAMS
+ * @param which APR_THREAD_POOL_WAIT_TIME or APR_THREAD_POOL_RUN_TIME
+ * @param priority A priority of the tasks to account for, or
+ * APR_THREAD_POOL_ALL_PRIORITIES
+ * @param percentile The percentile, from 0 to 100 (e.g. 50 for the median,
+ * 99.9 for the tail)
+ * @param latency The time under which @a percentile percent of the tasks
+ * waited or ran
+ * @param count The number of tasks accounted for (can be NULL)
+ * @return APR_SUCCESS, APR_ENOENT if no task was accounted for (or the
+ * thread pool keeps no histograms), or APR_EINVAL for a wrong @a which or
+ * @a percentile.
+ * @remark The priorities are accounted for by segments of 64 levels
+ * (0-63, 64-127, 128-191 and 192-255), @a priority selects its segment.
+ * The scheduled tasks are accounted for with the lowest priorities, their
+ * waiting time counting from the time they were scheduled to run.
+ * @remark The times are kept with a precision of 12.5% (a few microseconds
+ * for the shortest ones), the latency returned is the upper bound of the
+ * range the percentile falls into.
+ * @remark Each thread keeps its own histograms, they are merged on each
+ * call.
+ */
+APR_DECLARE(apr_status_t)
+    apr_thread_pool_latency_get(apr_thread_pool_t *me, int which,
+                                int priority, double percentile,
+                                apr_interval_time_t *latency,
+                                apr_uint64_t *count);
+
 /**
  * Get owner of the task currently been executed by the thread.
  * @param thd The thread is executing a task
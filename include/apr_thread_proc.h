@@ -256,6 +256,20 @@ APR_DECLARE(apr_status_t) apr_threadattr_stacksize_set(apr_threadattr_t *attr,
 APR_DECLARE(apr_status_t) apr_threadattr_guardsize_set(apr_threadattr_t *attr,
                                                        apr_size_t guardsize);
 
+/**
+ * Set the CPUs which newly created threads can run on.
+ * @param attr The threadattr to affect
+ * @param cpus The numbers of the CPUs (from zero)
+ * @param ncpus The number of CPUs, or zero to let the threads run on any
+ * CPU (the default)
+ * @return APR_SUCCESS, APR_EINVAL if a CPU number is out of the range
+ * supported by the system, or APR_ENOTIMPL if the platform does not
+ * support thread affinity.
+ */
+APR_DECLARE(apr_status_t) apr_threadattr_affinity_set(apr_threadattr_t *attr,
+                                                      const apr_uint32_t *cpus,
+                                                      apr_size_t ncpus);
+
 /**
  * Create a new thread of execution
  * @param new_thread The newly created thread handle.
@@ -290,6 +304,42 @@ APR_DECLARE(apr_status_t) apr_thread_join(apr_status_t *retval,
  */
 APR_DECLARE(void) apr_thread_yield(void);
 
+/**
+ * Set the CPUs which a running thread can run on.
+ * @param thd The thread
+ * @param cpus The numbers of the CPUs (from zero)
+ * @param ncpus The number of CPUs, not zero
+ * @return APR_SUCCESS, APR_EINVAL if no CPU is given or one is out of the
+ * range supported by the system, or APR_ENOTIMPL if the platform does not
+ * support thread affinity.
+ */
+APR_DECLARE(apr_status_t) apr_thread_affinity_set(apr_thread_t *thd,
+                                                  const apr_uint32_t *cpus,
+                                                  apr_size_t ncpus);
+
+/**
+ * Get the CPU the current thread is running on, and its NUMA node.
+ * @param cpu The number of the CPU
+ * @param node The number of the NUMA node of the CPU (can be NULL), zero
+ * if the system does not tell it
+ * @return APR_SUCCESS, or APR_ENOTIMPL if the platform does not tell the
+ * current CPU.
+ * @remark The thread may be moved to another CPU as soon as the function
+ * returns, unless its affinity is a single CPU.
+ */
+APR_DECLARE(apr_status_t) apr_thread_cpu_get(apr_uint32_t *cpu,
+                                             apr_uint32_t *node);
+
+/**
+ * Get the NUMA node of a CPU.
+ * @param cpu The number of the CPU
+ * @param node The number of the NUMA node of the CPU
+ * @return APR_SUCCESS, APR_ENOENT if the CPU is unknown, or APR_ENOTIMPL if
+ * the platform does not tell the NUMA topology.
+ */
+APR_DECLARE(apr_status_t) apr_cpu_node_get(apr_uint32_t cpu,
+                                           apr_uint32_t *node);
+
 /**
  * Initialize the control variable for apr_thread_once.  If this isn't
  * called, apr_initialize won't work.
@@ -0,0 +1,178 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_TIMER_WHEEL_H
+#define APR_TIMER_WHEEL_H
+
+/**
+ * @file apr_timer_wheel.h
+ * @brief APR Timer Wheels
+ */
+
+#include "apr.h"
+#include "apr_errno.h"
+#include "apr_pools.h"
+#include "apr_time.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup apr_timer_wheel Timer Wheels
+ * @ingroup APR
+ * @{
+ */
+
+/**
+ * Abstract type for timer wheels.
+ */
+typedef struct apr_timer_wheel_t apr_timer_wheel_t;
+
+/**
+ * Abstract type for the timers of a timer wheel.
+ */
+typedef struct apr_timer_t apr_timer_t;
+
+/**
+ * Callback functions for calling apr_timer_wheel_expire() on each expired
+ * timer, or apr_timer_wheel_do() on each pending timer.
+ * @param rec The data passed as the first argument to the calling function
+ * @param timer The timer, which apr_timer_wheel_do() callbacks can cancel
+ * @param data The data of the timer
+ * @return Non-zero to continue the iteration, zero to stop it
+ */
+typedef int (apr_timer_callback_fn_t)(void *rec, apr_timer_t *timer,
+                                      void *data);
+
+/**
+ * Create a timer wheel.
+ * @param tw The timer wheel just created
+ * @param resolution The granularity of the expiry times, in microseconds
+ *        (one millisecond if zero or negative)
+ * @param now The current time, before which no timer expires
+ * @param pool The pool to allocate the timer wheel and its timers out of
+ * @return APR_SUCCESS, or APR_ENOMEM.
+ * @remark The timers are kept in a hierarchy of wheels of 64 slots, each
+ *         slot of a wheel covering a whole turn of the wheel below, so
+ *         that adding or cancelling a timer takes O(1) time whatever the
+ *         number of timers.  Expiring them cascades the timers of the upper
+ *         wheels to the lower ones as time goes by, and a whole slot of the
+ *         lowest wheel expires at once.
+ * @remark Timers expire no earlier than their time, and no later than the
+ *         next multiple of @a resolution.  The timers of the same slot
+ *         expire in no particular order.
+ * @remark Timer wheels are not thread-safe, the caller must serialize the
+ *         calls for the same timer wheel.
+ */
+APR_DECLARE(apr_status_t) apr_timer_wheel_create(apr_timer_wheel_t **tw,
+                                                 apr_interval_time_t resolution,
+                                                 apr_time_t now,
+                                                 apr_pool_t *pool);
+
+/**
+ * Add a timer to a timer wheel.
+ * @param tw The timer wheel
+ * @param when The time at which the timer expires
+ * @param data The data of the timer
+ * @param timer The timer added, to cancel it (can be NULL)
+ * @return APR_SUCCESS, or APR_ENOMEM.
+ * @remark A timer whose time has passed already expires with the next call
+ *         to apr_timer_wheel_expire() or apr_timer_wheel_pop().
+ */
+APR_DECLARE(apr_status_t) apr_timer_wheel_add(apr_timer_wheel_t *tw,
+                                              apr_time_t when, void *data,
+                                              apr_timer_t **timer);
+
+/**
+ * Cancel a pending timer.
+ * @param tw The timer wheel
+ * @param timer The timer, not expired yet
+ * @return The data of the timer.
+ * @remark The timer is recycled by the timer wheel, it must not be used
+ *         anymore.
+ */
+APR_DECLARE(void *) apr_timer_wheel_cancel(apr_timer_wheel_t *tw,
+                                           apr_timer_t *timer);
+
+/**
+ * Expire the timers of a timer wheel up to the given time.
+ * @param tw The timer wheel
+ * @param now The current time
+ * @param func The function to call for each expired timer
+ * @param rec The data to pass as the first argument to the function
+ * @return The number of timers expired.
+ * @remark The timers are recycled after @a func returns, the iteration
+ *         stops when it returns zero (the remaining expired timers are
+ *         left for the next call).  @a func can add timers, but not
+ *         call apr_timer_wheel_expire() nor apr_timer_wheel_pop().
+ */
+APR_DECLARE(apr_size_t) apr_timer_wheel_expire(apr_timer_wheel_t *tw,
+                                               apr_time_t now,
+                                               apr_timer_callback_fn_t *func,
+                                               void *rec);
+
+/**
+ * Expire the next timer of a timer wheel up to the given time.
+ * @param tw The timer wheel
+ * @param now The current time
+ * @param data The data of the timer expired
+ * @return APR_SUCCESS if a timer expired, APR_EAGAIN if none has expired
+ *         by @a now.
+ */
+APR_DECLARE(apr_status_t) apr_timer_wheel_pop(apr_timer_wheel_t *tw,
+                                              apr_time_t now, void **data);
+
+/**
+ * Get the time until which the timers of a timer wheel can be left alone.
+ * @param tw The timer wheel
+ * @param when The time of the next expiry, or an earlier time at which
+ *        the timers must be expired (or popped) again to know it
+ * @return APR_SUCCESS, or APR_EAGAIN if there is no pending timer.
+ * @remark The time returned may be in the past if some timers have
+ *         expired already.
+ */
+APR_DECLARE(apr_status_t) apr_timer_wheel_next(apr_timer_wheel_t *tw,
+                                               apr_time_t *when);
+
+/**
+ * Iterate over the pending (including expired but not popped yet) timers
+ * of a timer wheel.
+ * @param func The function to call for each timer
+ * @param rec The data to pass as the first argument to the function
+ * @param tw The timer wheel
+ * @return FALSE if one of the func() iterations returned zero; TRUE if all
+ *            iterations returned non-zero
+ * @remark @a func can cancel the timer it is called for, but not add any.
+ */
+APR_DECLARE(int) apr_timer_wheel_do(apr_timer_callback_fn_t *func,
+                                    void *rec, apr_timer_wheel_t *tw);
+
+/**
+ * Get the number of pending (including expired but not popped yet) timers
+ * of a timer wheel.
+ * @param tw The timer wheel
+ * @return The number of timers.
+ */
+APR_DECLARE(apr_size_t) apr_timer_wheel_count(apr_timer_wheel_t *tw);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* !APR_TIMER_WHEEL_H */
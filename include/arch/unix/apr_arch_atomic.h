@@ -42,4 +42,88 @@
 #   define USE_ATOMICS_GENERIC
 #endif
 
+#if defined(USE_ATOMICS_GENERIC64)
+/* noop */
+#elif defined(USE_ATOMICS_GENERIC)
+/* generic atomics were requested (or no others are available) */
+#   define USE_ATOMICS_GENERIC64
+#elif HAVE_ATOMIC_BUILTINS64
+#   define USE_ATOMICS_BUILTINS64
+#else
+#   define USE_ATOMICS_GENERIC64
+#endif
+
+#if (defined(USE_ATOMICS_BUILTINS) || defined(USE_ATOMICS_BUILTINS64)) \
+    && defined(__ATOMIC_ACQUIRE)
+/* The __atomic builtins need a constant memory order (otherwise it's
+ * taken as __ATOMIC_SEQ_CST), so switch on the one given.
+ */
+#define ATOMIC_LOAD(mem, order) \
+    switch (order) { \
+    case APR_ATOMIC_RELAXED: \
+        return __atomic_load_n(mem, __ATOMIC_RELAXED); \
+    case APR_ATOMIC_ACQUIRE: \
+        return __atomic_load_n(mem, __ATOMIC_ACQUIRE); \
+    default: \
+        return __atomic_load_n(mem, __ATOMIC_SEQ_CST); \
+    }
+
+#define ATOMIC_STORE(mem, val, order) \
+    switch (order) { \
+    case APR_ATOMIC_RELAXED: \
+        __atomic_store_n(mem, val, __ATOMIC_RELAXED); \
+        break; \
+    case APR_ATOMIC_RELEASE: \
+        __atomic_store_n(mem, val, __ATOMIC_RELEASE); \
+        break; \
+    default: \
+        __atomic_store_n(mem, val, __ATOMIC_SEQ_CST); \
+        break; \
+    }
+
+#define ATOMIC_RMW(op, mem, val, order) \
+    switch (order) { \
+    case APR_ATOMIC_RELAXED: \
+        return op(mem, val, __ATOMIC_RELAXED); \
+    case APR_ATOMIC_ACQUIRE: \
+        return op(mem, val, __ATOMIC_ACQUIRE); \
+    case APR_ATOMIC_RELEASE: \
+        return op(mem, val, __ATOMIC_RELEASE); \
+    case APR_ATOMIC_ACQ_REL: \
+        return op(mem, val, __ATOMIC_ACQ_REL); \
+    default: \
+        return op(mem, val, __ATOMIC_SEQ_CST); \
+    }
+
+/* cmp is updated with the old value */
+#define ATOMIC_CAS(mem, cmp, with, order) \
+    switch (order) { \
+    case APR_ATOMIC_RELAXED: \
+        __atomic_compare_exchange_n(mem, &cmp, with, 0, __ATOMIC_RELAXED, \
+                                    __ATOMIC_RELAXED); \
+        break; \
+    case APR_ATOMIC_ACQUIRE: \
+        __atomic_compare_exchange_n(mem, &cmp, with, 0, __ATOMIC_ACQUIRE, \
+                                    __ATOMIC_ACQUIRE); \
+        break; \
+    case APR_ATOMIC_RELEASE: \
+        __atomic_compare_exchange_n(mem, &cmp, with, 0, __ATOMIC_RELEASE, \
+                                    __ATOMIC_RELAXED); \
+        break; \
+    case APR_ATOMIC_ACQ_REL: \
+        __atomic_compare_exchange_n(mem, &cmp, with, 0, __ATOMIC_ACQ_REL, \
+                                    __ATOMIC_ACQUIRE); \
+        break; \
+    default: \
+        __atomic_compare_exchange_n(mem, &cmp, with, 0, __ATOMIC_SEQ_CST, \
+                                    __ATOMIC_SEQ_CST); \
+        break; \
+    }
+#endif
+
+#if defined(USE_ATOMICS_GENERIC64)
+/* Called by apr_atomic_init() to set up the mutexes of the 64-bit ops */
+apr_status_t apr__atomic_generic64_init(apr_pool_t *p);
+#endif
+
 #endif /* ATOMIC_H */
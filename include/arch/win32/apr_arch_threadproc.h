@@ -31,12 +31,14 @@ struct apr_thread_t {
     void *data;
     apr_thread_start_t func;
     apr_status_t exitval;
+    DWORD_PTR affinity;
 };
 
 struct apr_threadattr_t {
     apr_pool_t *pool;
     apr_int32_t detach;
     apr_size_t stacksize;
+    DWORD_PTR affinity;
 };
 
 struct apr_threadkey_t {
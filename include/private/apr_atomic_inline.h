@@ -0,0 +1,60 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_ATOMIC_INLINE_H
+#define APR_ATOMIC_INLINE_H
+
+/*
+ * Inline atomic operations on any integer or pointer type, for the
+ * lock-free structures whose hot paths can't afford (or type) the calls
+ * to the apr_atomic functions.  The order is the suffix of the memory
+ * order of apr_atomic_order_e, e.g. apr__atomic_load(p, ACQUIRE), and
+ * apr__atomic_add() and apr__atomic_sub() return the new value.
+ *
+ * APR_ATOMIC_INLINE is 1 if the compiler has the __atomic builtins.
+ * Otherwise it's 0 and the operations are plain accesses, which the
+ * callers must serialize by other means (a mutex, usually).
+ */
+#if defined(__ATOMIC_ACQUIRE)
+#define APR_ATOMIC_INLINE 1
+#define apr__atomic_load(p, o)      __atomic_load_n((p), __ATOMIC_##o)
+#define apr__atomic_store(p, v, o)  __atomic_store_n((p), (v), __ATOMIC_##o)
+#define apr__atomic_add(p, v, o)    __atomic_add_fetch((p), (v), __ATOMIC_##o)
+#define apr__atomic_sub(p, v, o)    __atomic_sub_fetch((p), (v), __ATOMIC_##o)
+#define apr__atomic_fence(o)        __atomic_thread_fence(__ATOMIC_##o)
+/* Not available as plain accesses */
+#define apr__atomic_xchg(p, v, o) \
+    __atomic_exchange_n((p), (v), __ATOMIC_##o)
+/* Compare *p with *c and swap it with v if equal, or else update *c and
+ * fail with the order f, which can't be stronger than o.  The weak form
+ * can fail spuriously.
+ */
+#define apr__atomic_cas(p, c, v, o, f) \
+    __atomic_compare_exchange_n((p), (c), (v), 0, \
+                                __ATOMIC_##o, __ATOMIC_##f)
+#define apr__atomic_cas_weak(p, c, v, o, f) \
+    __atomic_compare_exchange_n((p), (c), (v), 1, \
+                                __ATOMIC_##o, __ATOMIC_##f)
+#else
+#define APR_ATOMIC_INLINE 0
+#define apr__atomic_load(p, o)      (*(p))
+#define apr__atomic_store(p, v, o)  (*(p) = (v))
+#define apr__atomic_add(p, v, o)    (*(p) += (v))
+#define apr__atomic_sub(p, v, o)    (*(p) -= (v))
+#define apr__atomic_fence(o)        ((void)0)
+#endif
+
+#endif /* APR_ATOMIC_INLINE_H */
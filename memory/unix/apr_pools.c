@@ -44,7 +44,17 @@
 #define APR_ALLOCATOR_USES_MMAP   1
 #endif
 
-#if APR_ALLOCATOR_USES_MMAP
+#if HAVE_MMAP && HAVE_MUNMAP && HAVE_MAP_ANON && !APR_ALLOCATOR_GUARD_PAGES
+#define ALLOCATOR_HAS_ARENAS 1
+#if defined(__linux__) && HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#if defined(SYS_mbind) && defined(SYS_getcpu)
+#define ALLOCATOR_HAS_NUMA 1
+#endif
+#endif
+#endif
+
+#if APR_ALLOCATOR_USES_MMAP || ALLOCATOR_HAS_ARENAS
 #include <sys/mman.h>
 #endif
 
@@ -105,6 +115,19 @@ static unsigned int boundary_size;
 #define TIMEOUT_USECS    3000000
 #define TIMEOUT_INTERVAL   46875
 
+#if ALLOCATOR_HAS_ARENAS
+/*
+ * Size (and alignment) of the regions which nodes are carved from with
+ * APR_ALLOCATOR_HUGE_PAGES or APR_ALLOCATOR_NUMA_LOCAL, that is a
+ * (transparent) huge page on most systems.  With NUMA_LOCAL, a region
+ * is carved for each of up to ARENA_MAX_NODES memory nodes, the threads
+ * running on higher nodes (if any) share an extra region not bound to
+ * any node.
+ */
+#define ARENA_SIZE          (2 * 1024 * 1024)
+#define ARENA_MAX_NODES     64
+#endif /* ALLOCATOR_HAS_ARENAS */
+
 /*
  * Allocator
  *
@@ -112,6 +135,16 @@ static unsigned int boundary_size;
  * indices, but quantities of BOUNDARY_SIZE big memory blocks.
  */
 
+#if APR_HAS_THREADS
+typedef struct allocator_tcache_t allocator_tcache_t;
+#endif /* APR_HAS_THREADS */
+#if ALLOCATOR_HAS_ARENAS
+typedef struct allocator_arena_t allocator_arena_t;
+#endif /* ALLOCATOR_HAS_ARENAS */
+#if ALLOCATOR_HAS_NUMA
+typedef struct allocator_numa_t allocator_numa_t;
+#endif /* ALLOCATOR_HAS_NUMA */
+
 struct apr_allocator_t {
     /** largest used index into free[], always < MAX_INDEX */
     apr_size_t        max_index;
@@ -126,10 +159,36 @@ struct apr_allocator_t {
      * before blocks are given back. Range: 0..max_free_index
      */
     apr_size_t        current_free_index;
+    /** Statistics, protected by the mutex (the thread caches account
+     * for their own nodes) @see apr_allocator_stats_get().
+     */
+    apr_allocator_stats_t stats;
 #if APR_HAS_THREADS
     apr_thread_mutex_t *mutex;
+    /** Key of the per-thread node caches, NULL unless enabled.
+     * @see apr_allocator_thread_cache_set().
+     */
+    apr_threadkey_t    *tcache_key;
+    /** List of the per-thread caches, protected by the mutex */
+    allocator_tcache_t *tcaches;
+    /** Number of nodes each thread may cache per size class */
+    apr_uint32_t        tcache_max;
 #endif /* APR_HAS_THREADS */
     apr_pool_t         *owner;
+#if ALLOCATOR_HAS_ARENAS
+    /** The APR_ALLOCATOR_* creation flags */
+    apr_uint32_t        flags;
+    /** All the regions that (sub-MAX_INDEX) nodes are carved from */
+    allocator_arena_t  *arenas;
+    /** The region currently carved (without NUMA_LOCAL) */
+    allocator_arena_t  *arena;
+#endif /* ALLOCATOR_HAS_ARENAS */
+#if ALLOCATOR_HAS_NUMA
+    /** The regions and free lists of each memory node, NULL unless
+     * APR_ALLOCATOR_NUMA_LOCAL (ARENA_MAX_NODES + 1 entries).
+     */
+    allocator_numa_t   *numa;
+#endif /* ALLOCATOR_HAS_NUMA */
     /**
      * Lists of free nodes. Slot MAX_INDEX is used for oversized nodes,
      * and the slots 0..MAX_INDEX-1 contain nodes of sizes
@@ -146,6 +205,90 @@ struct apr_allocator_t {
 
 #define SIZEOF_ALLOCATOR_T  APR_ALIGN_DEFAULT(sizeof(apr_allocator_t))
 
+/* The size of a node, including the memnode structure */
+#define NODE_SIZE(node) (((apr_size_t)(node)->index + 1) << BOUNDARY_INDEX)
+
+#if APR_HAS_THREADS
+/*
+ * Per-thread node caches
+ *
+ * When enabled (apr_allocator_thread_cache_set), each thread recycles up
+ * to tcache_max nodes per size class (slots 0..MAX_INDEX-1) by itself.
+ * Nodes move from/to the shared free lists in batches of half that much,
+ * only when the cache runs dry or overflows, so that the allocator mutex
+ * is taken once per batch rather than once per node.
+ */
+struct allocator_tcache_t {
+    apr_allocator_t     *allocator;
+    allocator_tcache_t  *next;
+    allocator_tcache_t **ref;
+    apr_uint32_t         count[MAX_INDEX];
+    apr_memnode_t       *free[MAX_INDEX];
+    /* Statistics of the nodes going through the cache; the nodes_free
+     * of the ones handed back to the allocator are subtracted since the
+     * allocator accounts for them, hence it may wrap around (harmlessly).
+     */
+    apr_size_t           nodes_alloc;
+    apr_size_t           nodes_free;
+    apr_size_t           bytes_free;
+};
+
+#define TCACHE_BATCH(allocator) \
+    ((allocator)->tcache_max > 1 ? (allocator)->tcache_max / 2 : 1)
+#endif /* APR_HAS_THREADS */
+
+#if ALLOCATOR_HAS_ARENAS
+/*
+ * Arenas
+ *
+ * With APR_ALLOCATOR_HUGE_PAGES or APR_ALLOCATOR_NUMA_LOCAL, the nodes
+ * of sizes up to MAX_INDEX are carved from ARENA_SIZE regions instead of
+ * being malloc()ed.  They are recycled through the free lists as usual,
+ * but never given back to the system individually: the regions are only
+ * unmapped when the allocator is destroyed.
+ *
+ * The regions are aligned on ARENA_SIZE and start with their descriptor,
+ * so that the region of any carved node is found by masking its address.
+ * With NUMA_LOCAL, the carved nodes are recycled through free lists of
+ * the memory node of their region (bypassing the shared free lists and
+ * the thread caches), so that they are only ever reused on that node.
+ */
+struct allocator_arena_t {
+    allocator_arena_t *next;
+    char              *first_avail;
+    char              *endp;
+    /** Index of the memory node in allocator->numa */
+    apr_uint32_t       numa_node;
+};
+
+#define SIZEOF_ARENA_T  APR_ALIGN_DEFAULT(sizeof(allocator_arena_t))
+
+#define ARENA_OF(node) \
+    ((allocator_arena_t *)((apr_uintptr_t)(node) & ~(apr_uintptr_t) \
+                                                   (ARENA_SIZE - 1)))
+
+#define ARENA_FLAGS (APR_ALLOCATOR_HUGE_PAGES | APR_ALLOCATOR_NUMA_LOCAL)
+
+#define ARENA_NODE(allocator, index) \
+    (((allocator)->flags & ARENA_FLAGS) && (index) < MAX_INDEX)
+
+#if ALLOCATOR_HAS_NUMA
+struct allocator_numa_t {
+    /** The region currently carved for this memory node */
+    allocator_arena_t *arena;
+    /** Lists of free nodes carved for this memory node, by size */
+    apr_memnode_t     *free[MAX_INDEX];
+};
+
+#define NUMA_NODE(allocator, index) \
+    ((allocator)->numa && (index) < MAX_INDEX)
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#endif /* ALLOCATOR_HAS_NUMA */
+#endif /* ALLOCATOR_HAS_ARENAS */
+
 
 /*
  * Allocator
@@ -169,6 +312,201 @@ void allocator_unlock(apr_allocator_t *allocator)
 #endif /* APR_HAS_THREADS */
 }
 
+/* Must be called with the allocator locked */
+static APR_INLINE
+void allocator_stats_sys_alloc(apr_allocator_t *allocator, apr_size_t size)
+{
+    allocator->stats.nodes_alloc++;
+    allocator->stats.nodes_sys_alloc++;
+    allocator->stats.bytes_total += size;
+    if (allocator->stats.bytes_total > allocator->stats.bytes_total_max)
+        allocator->stats.bytes_total_max = allocator->stats.bytes_total;
+}
+
+#if ALLOCATOR_HAS_ARENAS
+/* Index of the calling thread's memory node in allocator->numa, or 0
+ * without NUMA_LOCAL.  The nodes above ARENA_MAX_NODES share the last
+ * entry, whose regions are not bound to any node.
+ */
+static unsigned int arena_numa_node(apr_allocator_t *allocator)
+{
+#if ALLOCATOR_HAS_NUMA
+    unsigned int cpu, node;
+
+    if (allocator->numa) {
+        if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0
+                && node < ARENA_MAX_NODES) {
+            return node;
+        }
+        return ARENA_MAX_NODES;
+    }
+#endif /* ALLOCATOR_HAS_NUMA */
+    return 0;
+}
+
+static allocator_arena_t *arena_create(apr_allocator_t *allocator,
+                                       unsigned int numa_node)
+{
+    allocator_arena_t *arena;
+    char *base = MAP_FAILED, *p;
+
+#ifdef MAP_HUGETLB
+    if (allocator->flags & APR_ALLOCATOR_HUGE_PAGES) {
+        /* Explicit huge pages first, if any are reserved */
+        base = mmap(NULL, ARENA_SIZE, PROT_READ|PROT_WRITE,
+                    MAP_PRIVATE|MAP_ANON|MAP_HUGETLB, -1, 0);
+        if (base != MAP_FAILED
+                && ((apr_uintptr_t)base & (ARENA_SIZE - 1)) != 0) {
+            /* Smaller huge pages, ARENA_OF() would not work */
+            munmap(base, ARENA_SIZE);
+            base = MAP_FAILED;
+        }
+    }
+#endif
+    if (base == MAP_FAILED) {
+        /* Map twice the size and trim, so that the region is aligned
+         * on ARENA_SIZE as needed by transparent huge pages (and by
+         * ARENA_OF()).
+         */
+        if ((p = mmap(NULL, 2 * ARENA_SIZE, PROT_READ|PROT_WRITE,
+                      MAP_PRIVATE|MAP_ANON, -1, 0)) == MAP_FAILED) {
+            return NULL;
+        }
+        base = (char *)APR_ALIGN((apr_uintptr_t)p, ARENA_SIZE);
+        if (base != p) {
+            munmap(p, base - p);
+        }
+        munmap(base + ARENA_SIZE, p + ARENA_SIZE - base);
+
+#if HAVE_MADVISE && defined(MADV_HUGEPAGE)
+        if (allocator->flags & APR_ALLOCATOR_HUGE_PAGES) {
+            madvise(base, ARENA_SIZE, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+#if ALLOCATOR_HAS_NUMA
+    if (allocator->numa && numa_node < ARENA_MAX_NODES) {
+        /* Prefer the memory node of the calling thread, before
+         * any page is touched (mbind() wants one more than the bits
+         * of the mask).
+         */
+        unsigned long nodemask[(ARENA_MAX_NODES + sizeof(unsigned long) * 8
+                                - 1) / (sizeof(unsigned long) * 8)];
+
+        memset(nodemask, 0, sizeof(nodemask));
+        nodemask[numa_node / (sizeof(unsigned long) * 8)] =
+            1UL << (numa_node % (sizeof(unsigned long) * 8));
+        syscall(SYS_mbind, base, ARENA_SIZE, MPOL_PREFERRED,
+                nodemask, sizeof(nodemask) * 8 + 1, 0);
+    }
+#endif /* ALLOCATOR_HAS_NUMA */
+
+    arena = (allocator_arena_t *)base;
+    arena->first_avail = base + SIZEOF_ARENA_T;
+    arena->endp = base + ARENA_SIZE;
+    arena->numa_node = numa_node;
+    arena->next = allocator->arenas;
+    allocator->arenas = arena;
+
+    return arena;
+}
+
+/* Must be called with the allocator locked */
+static apr_memnode_t *arena_alloc(apr_allocator_t *allocator,
+                                  apr_size_t size, unsigned int numa_node)
+{
+    allocator_arena_t **slot = &allocator->arena;
+    apr_memnode_t **freelist = allocator->free;
+    allocator_arena_t *arena;
+    apr_memnode_t *node;
+    apr_size_t rest = 0;
+
+#if ALLOCATOR_HAS_NUMA
+    if (allocator->numa) {
+        slot = &allocator->numa[numa_node].arena;
+        freelist = allocator->numa[numa_node].free;
+    }
+#endif /* ALLOCATOR_HAS_NUMA */
+    arena = *slot;
+
+    if (arena == NULL
+            || (rest = arena->endp - arena->first_avail) < size) {
+        rest &= ~(apr_size_t)(BOUNDARY_SIZE - 1);
+        if (arena && rest >= MIN_ALLOC) {
+            /* Don't waste the tail of the region, make it a free node
+             * (unless it's smaller than any allocation, then it would
+             * never be reused)
+             */
+            node = (apr_memnode_t *)arena->first_avail;
+            node->index = (apr_uint32_t)(rest >> BOUNDARY_INDEX) - 1;
+            node->endp = arena->first_avail + rest;
+            node->next = freelist[node->index];
+            freelist[node->index] = node;
+            if (freelist == allocator->free
+                    && node->index > allocator->max_index)
+                allocator->max_index = node->index;
+            arena->first_avail = arena->endp;
+            allocator->stats.nodes_sys_alloc++;
+            allocator->stats.bytes_total += rest;
+            allocator->stats.bytes_free += rest;
+        }
+        if ((arena = arena_create(allocator, numa_node)) == NULL) {
+            return NULL;
+        }
+        *slot = arena;
+    }
+
+    node = (apr_memnode_t *)arena->first_avail;
+    arena->first_avail += size;
+    node->index = (apr_uint32_t)(size >> BOUNDARY_INDEX) - 1;
+    node->endp = (char *)node + size;
+
+    return node;
+}
+
+#if ALLOCATOR_HAS_NUMA
+/* Allocates a node of the given size class from the free lists of the
+ * calling thread's memory node, or carves it from its region.
+ */
+static apr_memnode_t *numa_alloc(apr_allocator_t *allocator,
+                                 apr_size_t size, apr_size_t index)
+{
+    unsigned int numa_node = arena_numa_node(allocator);
+    apr_memnode_t **freelist = allocator->numa[numa_node].free;
+    apr_memnode_t *node;
+    apr_size_t i, upper_index;
+
+    allocator_lock(allocator);
+
+    /* Like allocator_alloc(), accept nodes of up to twice the size */
+    upper_index = 2 * index < MAX_INDEX - 1 ? 2 * index : MAX_INDEX - 1;
+    for (i = index; i <= upper_index; i++) {
+        if ((node = freelist[i]) != NULL) {
+            freelist[i] = node->next;
+
+            allocator->current_free_index += node->index + 1;
+            if (allocator->current_free_index > allocator->max_free_index)
+                allocator->current_free_index = allocator->max_free_index;
+
+            allocator->stats.nodes_alloc++;
+            allocator->stats.bytes_free -= NODE_SIZE(node);
+
+            allocator_unlock(allocator);
+            return node;
+        }
+    }
+
+    if ((node = arena_alloc(allocator, size, numa_node)) != NULL) {
+        allocator_stats_sys_alloc(allocator, size);
+    }
+
+    allocator_unlock(allocator);
+    return node;
+}
+#endif /* ALLOCATOR_HAS_NUMA */
+#endif /* ALLOCATOR_HAS_ARENAS */
+
 APR_DECLARE(apr_status_t) apr_allocator_create(apr_allocator_t **allocator)
 {
     apr_allocator_t *new_allocator;
@@ -186,15 +524,79 @@ APR_DECLARE(apr_status_t) apr_allocator_create(apr_allocator_t **allocator)
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_allocator_create_ex(apr_allocator_t **allocator,
+                                                  apr_uint32_t flags)
+{
+    apr_status_t rv;
+
+    *allocator = NULL;
+
+#if ALLOCATOR_HAS_ARENAS
+#if !defined(MAP_HUGETLB) && !(HAVE_MADVISE && defined(MADV_HUGEPAGE))
+    if (flags & APR_ALLOCATOR_HUGE_PAGES)
+        return APR_ENOTIMPL;
+#endif
+#if !ALLOCATOR_HAS_NUMA
+    if (flags & APR_ALLOCATOR_NUMA_LOCAL)
+        return APR_ENOTIMPL;
+#endif
+#else  /* !ALLOCATOR_HAS_ARENAS */
+    if (flags & (APR_ALLOCATOR_HUGE_PAGES | APR_ALLOCATOR_NUMA_LOCAL))
+        return APR_ENOTIMPL;
+#endif /* !ALLOCATOR_HAS_ARENAS */
+
+    if ((rv = apr_allocator_create(allocator)) != APR_SUCCESS)
+        return rv;
+
+#if ALLOCATOR_HAS_NUMA
+    if ((flags & APR_ALLOCATOR_NUMA_LOCAL)
+            && ((*allocator)->numa = calloc(ARENA_MAX_NODES + 1,
+                                            sizeof(allocator_numa_t)))
+               == NULL) {
+        apr_allocator_destroy(*allocator);
+        *allocator = NULL;
+        return APR_ENOMEM;
+    }
+#endif
+#if ALLOCATOR_HAS_ARENAS
+    (*allocator)->flags = flags;
+#endif
+
+    return APR_SUCCESS;
+}
+
 APR_DECLARE(void) apr_allocator_destroy(apr_allocator_t *allocator)
 {
     apr_uint32_t index;
     apr_memnode_t *node, **ref;
 
+#if APR_HAS_THREADS
+    /* Hand the nodes of the per-thread caches (if any is still alive)
+     * to the free lists, so that they are freed below.
+     */
+    while (allocator->tcaches) {
+        allocator_tcache_t *tcache = allocator->tcaches;
+
+        for (index = 0; index < MAX_INDEX; index++) {
+            while ((node = tcache->free[index]) != NULL) {
+                tcache->free[index] = node->next;
+                node->next = allocator->free[index];
+                allocator->free[index] = node;
+            }
+        }
+        allocator->tcaches = tcache->next;
+        free(tcache);
+    }
+#endif /* APR_HAS_THREADS */
+
     for (index = 0; index <= MAX_INDEX; index++) {
         ref = &allocator->free[index];
         while ((node = *ref) != NULL) {
             *ref = node->next;
+#if ALLOCATOR_HAS_ARENAS
+            if (ARENA_NODE(allocator, node->index))
+                continue;
+#endif
 #if APR_ALLOCATOR_USES_MMAP
             munmap((char *)node - GUARDPAGE_SIZE,
                    2 * GUARDPAGE_SIZE + ((node->index+1) << BOUNDARY_INDEX));
@@ -204,6 +606,19 @@ APR_DECLARE(void) apr_allocator_destroy(apr_allocator_t *allocator)
         }
     }
 
+#if ALLOCATOR_HAS_ARENAS
+    while (allocator->arenas) {
+        allocator_arena_t *arena = allocator->arenas;
+
+        /* The descriptor lives in the region */
+        allocator->arenas = arena->next;
+        munmap(arena, ARENA_SIZE);
+    }
+#endif /* ALLOCATOR_HAS_ARENAS */
+#if ALLOCATOR_HAS_NUMA
+    free(allocator->numa);
+#endif
+
     free(allocator);
 }
 
@@ -276,6 +691,146 @@ APR_DECLARE(apr_size_t) apr_allocator_align(apr_allocator_t *allocator,
     return allocator_align(size);
 }
 
+#if APR_HAS_THREADS
+
+static allocator_tcache_t *tcache_get(apr_allocator_t *allocator, int create)
+{
+    allocator_tcache_t *tcache;
+    void *data = NULL;
+
+    apr_threadkey_private_get(&data, allocator->tcache_key);
+    if (data || !create) {
+        return data;
+    }
+
+    if ((tcache = calloc(1, sizeof(*tcache))) == NULL) {
+        return NULL;
+    }
+    if (apr_threadkey_private_set(tcache, allocator->tcache_key)) {
+        free(tcache);
+        return NULL;
+    }
+    tcache->allocator = allocator;
+
+    allocator_lock(allocator);
+    if ((tcache->next = allocator->tcaches) != NULL)
+        tcache->next->ref = &tcache->next;
+    allocator->tcaches = tcache;
+    tcache->ref = &allocator->tcaches;
+    allocator_unlock(allocator);
+
+    return tcache;
+}
+
+static APR_INLINE
+apr_memnode_t *tcache_alloc(apr_allocator_t *allocator, apr_size_t index)
+{
+    allocator_tcache_t *tcache;
+    apr_memnode_t *node;
+    apr_uint32_t n;
+
+    if ((tcache = tcache_get(allocator, 1)) == NULL) {
+        return NULL;
+    }
+
+    if (tcache->free[index] == NULL) {
+        /* Refill a batch from the shared free list of this size,
+         * if there is anything to take there.
+         */
+        if (allocator->free[index] == NULL) {
+            return NULL;
+        }
+
+        allocator_lock(allocator);
+
+        n = TCACHE_BATCH(allocator);
+        while (n-- && (node = allocator->free[index]) != NULL) {
+            allocator->free[index] = node->next;
+            node->next = tcache->free[index];
+            tcache->free[index] = node;
+            tcache->count[index]++;
+            tcache->bytes_free += NODE_SIZE(node);
+            allocator->stats.bytes_free -= NODE_SIZE(node);
+            allocator->current_free_index += index + 1;
+        }
+        if (allocator->current_free_index > allocator->max_free_index)
+            allocator->current_free_index = allocator->max_free_index;
+
+        /* Find the new highest available index if we emptied it */
+        if (index == allocator->max_index) {
+            while (allocator->max_index > 0
+                   && allocator->free[allocator->max_index] == NULL)
+                allocator->max_index--;
+        }
+
+        allocator_unlock(allocator);
+
+        if (tcache->free[index] == NULL) {
+            return NULL;
+        }
+    }
+
+    node = tcache->free[index];
+    tcache->free[index] = node->next;
+    tcache->count[index]--;
+    tcache->nodes_alloc++;
+    tcache->bytes_free -= NODE_SIZE(node);
+
+    return node;
+}
+
+static APR_INLINE
+apr_memnode_t *tcache_free(apr_allocator_t *allocator, apr_memnode_t *node)
+{
+    allocator_tcache_t *tcache;
+    apr_memnode_t *next, *rest = NULL;
+    apr_uint32_t index, n;
+
+    /* Nodes freed by a thread which never allocated (or which is
+     * exiting) go straight to the shared free lists.
+     */
+    if ((tcache = tcache_get(allocator, 0)) == NULL) {
+        return node;
+    }
+
+    do {
+        next = node->next;
+        index = node->index;
+
+        if (index >= MAX_INDEX) {
+            node->next = rest;
+            rest = node;
+            continue;
+        }
+
+        APR_VALGRIND_NOACCESS((char *)node + APR_MEMNODE_T_SIZE,
+                              (node->index+1) << BOUNDARY_INDEX);
+
+        node->next = tcache->free[index];
+        tcache->free[index] = node;
+        tcache->nodes_free++;
+        tcache->bytes_free += NODE_SIZE(node);
+        if (++tcache->count[index] <= allocator->tcache_max) {
+            continue;
+        }
+
+        /* Overflow, give a batch back to the shared free lists */
+        n = TCACHE_BATCH(allocator);
+        tcache->count[index] -= n;
+        tcache->nodes_free -= n;
+        while (n--) {
+            node = tcache->free[index];
+            tcache->free[index] = node->next;
+            tcache->bytes_free -= NODE_SIZE(node);
+            node->next = rest;
+            rest = node;
+        }
+    } while ((node = next) != NULL);
+
+    return rest;
+}
+#endif /* APR_HAS_THREADS */
+
 static APR_INLINE
 apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
 {
@@ -300,6 +855,26 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
         return NULL;
     }
 
+#if ALLOCATOR_HAS_NUMA
+    /* Nodes local to a memory node have their own free lists */
+    if (NUMA_NODE(allocator, index)) {
+        if ((node = numa_alloc(allocator, size, index)) == NULL)
+            return NULL;
+
+        goto have_node;
+    }
+#endif /* ALLOCATOR_HAS_NUMA */
+
+#if APR_HAS_THREADS
+    /* Try this thread's cache first, it does not need the lock
+     * (but for refilling a batch).
+     */
+    if (allocator->tcache_key && index < MAX_INDEX
+            && (node = tcache_alloc(allocator, index)) != NULL) {
+        goto have_node;
+    }
+#endif /* APR_HAS_THREADS */
+
     /* First see if there are any nodes in the area we know
      * our node will fit into.
      */
@@ -350,6 +925,9 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
             if (allocator->current_free_index > allocator->max_free_index)
                 allocator->current_free_index = allocator->max_free_index;
 
+            allocator->stats.nodes_alloc++;
+            allocator->stats.bytes_free -= NODE_SIZE(node);
+
             allocator_unlock(allocator);
 
             goto have_node;
@@ -378,6 +956,9 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
             if (allocator->current_free_index > allocator->max_free_index)
                 allocator->current_free_index = allocator->max_free_index;
 
+            allocator->stats.nodes_alloc++;
+            allocator->stats.bytes_free -= NODE_SIZE(node);
+
             allocator_unlock(allocator);
 
             goto have_node;
@@ -386,6 +967,21 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
         allocator_unlock(allocator);
     }
 
+#if ALLOCATOR_HAS_ARENAS
+    /* Carve it from an arena when asked to */
+    if (ARENA_NODE(allocator, index)) {
+        allocator_lock(allocator);
+        if ((node = arena_alloc(allocator, size, 0)) != NULL) {
+            allocator_stats_sys_alloc(allocator, size);
+        }
+        allocator_unlock(allocator);
+        if (node == NULL)
+            return NULL;
+
+        goto have_node;
+    }
+#endif /* ALLOCATOR_HAS_ARENAS */
+
     /* If we haven't got a suitable node, malloc a new one
      * and initialize it.
      */
@@ -410,6 +1006,10 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
     node->index = index;
     node->endp = (char *)node + size;
 
+    allocator_lock(allocator);
+    allocator_stats_sys_alloc(allocator, size);
+    allocator_unlock(allocator);
+
 have_node:
     node->next = NULL;
     node->first_avail = (char *)node + APR_MEMNODE_T_SIZE;
@@ -426,6 +1026,16 @@ void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
     apr_uint32_t index, max_index;
     apr_uint32_t max_free_index, current_free_index;
 
+#if APR_HAS_THREADS
+    /* Keep what fits in this thread's cache, the remaining nodes
+     * (oversized or overflowing ones) go to the shared free lists.
+     */
+    if (allocator->tcache_key
+            && (node = tcache_free(allocator, node)) == NULL) {
+        return;
+    }
+#endif /* APR_HAS_THREADS */
+
     allocator_lock(allocator);
 
     max_index = allocator->max_index;
@@ -442,12 +1052,39 @@ void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
         APR_VALGRIND_NOACCESS((char *)node + APR_MEMNODE_T_SIZE,
                               (node->index+1) << BOUNDARY_INDEX);
 
+        allocator->stats.nodes_free++;
         if (max_free_index != APR_ALLOCATOR_MAX_FREE_UNLIMITED
-            && index + 1 > current_free_index) {
+            && index + 1 > current_free_index
+#if ALLOCATOR_HAS_ARENAS
+            && !ARENA_NODE(allocator, index)
+#endif
+            ) {
             node->next = freelist;
             freelist = node;
+            allocator->stats.nodes_sys_free++;
+            allocator->stats.bytes_total -= NODE_SIZE(node);
+            continue;
+        }
+
+        allocator->stats.bytes_free += NODE_SIZE(node);
+#if ALLOCATOR_HAS_NUMA
+        if (NUMA_NODE(allocator, index)) {
+            /* Back to the free list of the memory node it was
+             * carved for.
+             */
+            apr_memnode_t **freelist =
+                allocator->numa[ARENA_OF(node)->numa_node].free;
+
+            node->next = freelist[index];
+            freelist[index] = node;
+            if (current_free_index >= index + 1)
+                current_free_index -= index + 1;
+            else
+                current_free_index = 0;
+            continue;
         }
-        else if (index < MAX_INDEX) {
+#endif /* ALLOCATOR_HAS_NUMA */
+        if (index < MAX_INDEX) {
             /* Add the node to the appropriate 'size' bucket.  Adjust
              * the max_index when appropriate.
              */
@@ -503,6 +1140,156 @@ APR_DECLARE(void) apr_allocator_free(apr_allocator_t *allocator,
     allocator_free(allocator, node);
 }
 
+#if APR_HAS_THREADS
+/* Empty the cache, and account for its statistics in the allocator's
+ * (which must be locked), except for the returned nodes that are about
+ * to be given back with allocator_free().
+ */
+static apr_memnode_t *tcache_drain(allocator_tcache_t *tcache)
+{
+    apr_allocator_t *allocator = tcache->allocator;
+    apr_memnode_t *node, *nodes = NULL;
+    apr_uint32_t index;
+
+    for (index = 0; index < MAX_INDEX; index++) {
+        while ((node = tcache->free[index]) != NULL) {
+            tcache->free[index] = node->next;
+            node->next = nodes;
+            nodes = node;
+            tcache->nodes_free--;
+        }
+        tcache->count[index] = 0;
+    }
+
+    allocator->stats.nodes_alloc += tcache->nodes_alloc;
+    allocator->stats.nodes_free += tcache->nodes_free;
+    tcache->nodes_alloc = tcache->nodes_free = tcache->bytes_free = 0;
+
+    return nodes;
+}
+
+/* Called on thread exit (where supported) to give the nodes of the
+ * thread's cache back to the allocator.
+ */
+static void tcache_destructor(void *data)
+{
+    allocator_tcache_t *tcache = data;
+    apr_allocator_t *allocator = tcache->allocator;
+    apr_memnode_t *nodes;
+
+    allocator_lock(allocator);
+    if ((*tcache->ref = tcache->next) != NULL)
+        tcache->next->ref = tcache->ref;
+    nodes = tcache_drain(tcache);
+    allocator_unlock(allocator);
+
+    /* The thread's key value is NULL by now, so this won't recurse */
+    if (nodes != NULL)
+        allocator_free(allocator, nodes);
+
+    free(tcache);
+}
+
+static apr_status_t tcache_cleanup(void *data)
+{
+    apr_allocator_t *allocator = data;
+    allocator_tcache_t *tcache;
+    apr_threadkey_t *key;
+    apr_memnode_t *node, *nodes = NULL;
+
+    /* Delete the key first, so that no thread exiting from now on runs
+     * tcache_destructor().
+     */
+    allocator_lock(allocator);
+    key = allocator->tcache_key;
+    allocator->tcache_key = NULL;
+    allocator_unlock(allocator);
+    if (key) {
+        apr_threadkey_private_delete(key);
+    }
+
+    /* Only drain the caches, the threads exiting concurrently may still
+     * run tcache_destructor() on theirs, which unlinks and frees it.  The
+     * others are freed by apr_allocator_destroy().
+     */
+    allocator_lock(allocator);
+    for (tcache = allocator->tcaches; tcache; tcache = tcache->next) {
+        if ((node = tcache_drain(tcache)) != NULL) {
+            apr_memnode_t *last = node;
+
+            while (last->next)
+                last = last->next;
+            last->next = nodes;
+            nodes = node;
+        }
+    }
+    allocator_unlock(allocator);
+
+    if (nodes != NULL)
+        allocator_free(allocator, nodes);
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_allocator_thread_cache_set(
+                                      apr_allocator_t *allocator,
+                                      apr_uint32_t max_nodes,
+                                      apr_pool_t *pool)
+{
+    apr_threadkey_t *key;
+    apr_status_t rv;
+
+    if (!max_nodes) {
+        return APR_EINVAL;
+    }
+#if ALLOCATOR_HAS_NUMA
+    if (allocator->numa) {
+        /* The nodes must stay on the free lists of their memory node */
+        return APR_ENOTIMPL;
+    }
+#endif
+    if (allocator->tcache_key) {
+        allocator->tcache_max = max_nodes;
+        return APR_SUCCESS;
+    }
+
+    rv = apr_threadkey_private_create(&key, tcache_destructor, pool);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    apr_pool_cleanup_register(pool, allocator, tcache_cleanup,
+                              apr_pool_cleanup_null);
+
+    allocator->tcache_max = max_nodes;
+    allocator->tcache_key = key;
+
+    return APR_SUCCESS;
+}
+#endif /* APR_HAS_THREADS */
+
+APR_DECLARE(void) apr_allocator_stats_get(apr_allocator_t *allocator,
+                                          apr_allocator_stats_t *stats)
+{
+#if APR_HAS_THREADS
+    allocator_tcache_t *tcache;
+#endif
+
+    allocator_lock(allocator);
+
+    *stats = allocator->stats;
+#if APR_HAS_THREADS
+    for (tcache = allocator->tcaches; tcache; tcache = tcache->next) {
+        stats->nodes_alloc += tcache->nodes_alloc;
+        stats->nodes_free += tcache->nodes_free;
+        stats->bytes_free += tcache->bytes_free;
+    }
+#endif /* APR_HAS_THREADS */
+
+    allocator_unlock(allocator);
+
+    stats->bytes_used = stats->bytes_total - stats->bytes_free;
+}
+
 APR_DECLARE(apr_size_t) apr_allocator_page_size(void)
 {
     return boundary_size;
@@ -581,11 +1368,15 @@ struct apr_pool_t {
     apr_abortfunc_t       abort_fn;
     apr_hash_t           *user_data;
     const char           *tag;
+    apr_pool_mark_t      *marks; /* The innermost outstanding mark */
 
 #if !APR_POOL_DEBUG
     apr_memnode_t        *active;
     apr_memnode_t        *self; /* The node containing the pool itself */
     char                 *self_first_avail;
+    apr_pool_stats_t     *stats; /* Following the pool struct, if enabled */
+    struct pool_stats_entry_t *stats_entry; /* Of the tag, once looked up */
+    apr_uint32_t          stats_gen; /* pool_stats_gen of stats_entry */
 
 #else /* APR_POOL_DEBUG */
     apr_pool_t           *joined; /* the caller has guaranteed that this pool
@@ -627,6 +1418,28 @@ static apr_pool_t  *global_pool = NULL;
 
 #if !APR_POOL_DEBUG
 static apr_allocator_t *global_allocator = NULL;
+
+/* Statistics of the pools, accumulated per tag.  The entries are only
+ * created (and linked) with pool_stats_mutex held, the pools cache the
+ * entry of their tag and accumulate in it with atomic operations.
+ */
+typedef struct pool_stats_entry_t pool_stats_entry_t;
+struct pool_stats_entry_t {
+    pool_stats_entry_t *next;
+    apr_pool_stats_t    stats;
+};
+
+#define SIZEOF_POOL_STATS_T APR_ALIGN_DEFAULT(sizeof(apr_pool_stats_t))
+
+static int pool_stats_enabled = 0;
+static pool_stats_entry_t *pool_stats_list = NULL;
+/* Bumped when the entries are freed by apr_pool_terminate(), so that
+ * the (unmanaged) pools which survive don't use their cached entry.
+ */
+static apr_uint32_t pool_stats_gen = 0;
+#if APR_HAS_THREADS
+static apr_thread_mutex_t *pool_stats_mutex = NULL;
+#endif /* APR_HAS_THREADS */
 #endif /* !APR_POOL_DEBUG */
 
 #if (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALL)
@@ -645,6 +1458,8 @@ static apr_status_t apr_pool_cleanup_file_stderr(void *data)
 
 static void run_cleanups(cleanup_t **c);
 static void free_proc_chain(struct process_chain *procs);
+static void pool_mark_memory(apr_pool_t *pool, apr_pool_mark_t *mark);
+static void pool_rewind_memory(apr_pool_t *pool, apr_pool_mark_t *mark);
 
 #if APR_POOL_DEBUG
 static void pool_destroy_debug(apr_pool_t *pool, const char *file_line);
@@ -716,6 +1531,12 @@ APR_DECLARE(apr_status_t) apr_pool_initialize(void)
         }
 
         apr_allocator_mutex_set(global_allocator, mutex);
+
+        if ((rv = apr_thread_mutex_create(&pool_stats_mutex,
+                                          APR_THREAD_MUTEX_DEFAULT,
+                                          global_pool)) != APR_SUCCESS) {
+            return rv;
+        }
     }
 #endif /* APR_HAS_THREADS */
 
@@ -735,7 +1556,20 @@ APR_DECLARE(void) apr_pool_terminate(void)
     apr_pool_destroy(global_pool); /* This will also destroy the mutex */
     global_pool = NULL;
 
-    global_allocator = NULL;
+    global_allocator = NULL;
+
+    while (pool_stats_list) {
+        pool_stats_entry_t *entry = pool_stats_list;
+
+        pool_stats_list = entry->next;
+        free((char *)entry->stats.tag);
+        free(entry);
+    }
+    pool_stats_gen++;
+    pool_stats_enabled = 0;
+#if APR_HAS_THREADS
+    pool_stats_mutex = NULL;
+#endif /* APR_HAS_THREADS */
 }
 
 
@@ -819,6 +1653,155 @@ static APR_INLINE void pool_concurrency_set_idle(apr_pool_t *pool)      { }
 static APR_INLINE void pool_concurrency_set_destroyed(apr_pool_t *pool) { }
 #endif /* APR_POOL_CONCURRENCY_CHECK */
 
+/*
+ * Statistics helpers, see apr_pool_stats_enable().
+ */
+
+/* Place the statistics after the pool struct, in its own node */
+static APR_INLINE void pool_stats_init(apr_pool_t *pool, apr_memnode_t *node)
+{
+    pool->stats_entry = NULL;
+    if (!pool_stats_enabled) {
+        pool->stats = NULL;
+        return;
+    }
+
+    pool->stats = (apr_pool_stats_t *)pool->self_first_avail;
+    pool->self_first_avail += SIZEOF_POOL_STATS_T;
+    APR_VALGRIND_UNDEFINED(pool->stats, SIZEOF_POOL_STATS_T);
+    memset(pool->stats, 0, sizeof(apr_pool_stats_t));
+    pool->stats->bytes_held = pool->stats->bytes_max = NODE_SIZE(node);
+}
+
+static APR_INLINE void pool_stats_palloc(apr_pool_stats_t *stats,
+                                         apr_size_t size)
+{
+    unsigned int i = 0;
+
+    while (i < APR_POOL_STATS_BUCKETS - 1 && size > ((apr_size_t)16 << i))
+        i++;
+    stats->palloc[i]++;
+    stats->bytes += size;
+}
+
+static APR_INLINE void pool_stats_node(apr_pool_stats_t *stats,
+                                       apr_memnode_t *node)
+{
+    stats->nodes++;
+    stats->bytes_held += NODE_SIZE(node);
+    if (stats->bytes_held > stats->bytes_max)
+        stats->bytes_max = stats->bytes_held;
+}
+
+/* Atomic accumulation in (and reads of) the apr_size_t fields of the
+ * tags' entries.
+ */
+#if APR_SIZEOF_VOIDP == 8
+#define POOL_STATS_ADD(mem, val) \
+    apr_atomic_add64((volatile apr_uint64_t *)(mem), (val))
+#define POOL_STATS_READ(mem) \
+    ((apr_size_t)apr_atomic_read64((volatile apr_uint64_t *)(mem)))
+#define POOL_STATS_CAS(mem, val, cmp) \
+    ((apr_size_t)apr_atomic_cas64((volatile apr_uint64_t *)(mem), \
+                                  (val), (cmp)))
+#else
+#define POOL_STATS_ADD(mem, val) \
+    apr_atomic_add32((volatile apr_uint32_t *)(mem), (apr_uint32_t)(val))
+#define POOL_STATS_READ(mem) \
+    ((apr_size_t)apr_atomic_read32((volatile apr_uint32_t *)(mem)))
+#define POOL_STATS_CAS(mem, val, cmp) \
+    ((apr_size_t)apr_atomic_cas32((volatile apr_uint32_t *)(mem), \
+                                  (apr_uint32_t)(val), (apr_uint32_t)(cmp)))
+#endif
+
+/* Find or create the entry of a tag, NULL on allocation failure */
+static pool_stats_entry_t *pool_stats_entry(const char *tag)
+{
+    pool_stats_entry_t *entry;
+
+#if APR_HAS_THREADS
+    if (pool_stats_mutex)
+        apr_thread_mutex_lock(pool_stats_mutex);
+#endif /* APR_HAS_THREADS */
+
+    for (entry = pool_stats_list; entry; entry = entry->next) {
+        if (entry->stats.tag == tag
+                || (entry->stats.tag && tag
+                    && strcmp(entry->stats.tag, tag) == 0))
+            break;
+    }
+    if (entry == NULL && (entry = calloc(1, sizeof(*entry))) != NULL) {
+        /* The tag may not outlive the pool, copy it */
+        if (tag) {
+            apr_size_t len = strlen(tag) + 1;
+            char *copy;
+
+            if ((copy = malloc(len)) != NULL) {
+                memcpy(copy, tag, len);
+            }
+            entry->stats.tag = copy;
+        }
+        if (tag && !entry->stats.tag) {
+            free(entry);
+            entry = NULL;
+        }
+        else {
+            entry->next = pool_stats_list;
+            pool_stats_list = entry;
+        }
+    }
+
+#if APR_HAS_THREADS
+    if (pool_stats_mutex)
+        apr_thread_mutex_unlock(pool_stats_mutex);
+#endif /* APR_HAS_THREADS */
+
+    return entry;
+}
+
+/* Account for the pool's statistics in its tag's entry, when the pool
+ * gets cleared or destroyed, and start over.  Only the first fold of an
+ * untagged pool (or one after apr_pool_terminate()) looks the entry up,
+ * apr_pool_tag() does it otherwise.
+ */
+static void pool_stats_fold(apr_pool_t *pool)
+{
+    apr_pool_stats_t *stats = pool->stats;
+    pool_stats_entry_t *entry = pool->stats_entry;
+    apr_size_t max;
+    unsigned int i;
+
+    /* Nothing to account for after apr_pool_terminate() */
+    if (!apr_pools_initialized)
+        return;
+
+    if (entry == NULL || pool->stats_gen != pool_stats_gen) {
+        pool->stats_gen = pool_stats_gen;
+        entry = pool->stats_entry = pool_stats_entry(pool->tag);
+    }
+    if (entry) {
+        POOL_STATS_ADD(&entry->stats.cycles, 1);
+        POOL_STATS_ADD(&entry->stats.nodes, stats->nodes);
+        POOL_STATS_ADD(&entry->stats.bytes, stats->bytes);
+        POOL_STATS_ADD(&entry->stats.bytes_held, stats->bytes_held);
+        max = POOL_STATS_READ(&entry->stats.bytes_max);
+        while (max < stats->bytes_max) {
+            apr_size_t prev = POOL_STATS_CAS(&entry->stats.bytes_max,
+                                             stats->bytes_max, max);
+            if (prev == max)
+                break;
+            max = prev;
+        }
+        for (i = 0; i < APR_POOL_STATS_BUCKETS; i++) {
+            if (stats->palloc[i])
+                POOL_STATS_ADD(&entry->stats.palloc[i], stats->palloc[i]);
+        }
+    }
+
+    stats->nodes = stats->bytes = 0;
+    memset(stats->palloc, 0, sizeof(stats->palloc));
+}
+
 /*
  * Memory allocation
  */
@@ -842,6 +1825,8 @@ APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
 
         return NULL;
     }
+    if (pool->stats)
+        pool_stats_palloc(pool->stats, size);
     active = pool->active;
 
     /* If the active node has enough bytes left, use it. */
@@ -863,6 +1848,8 @@ APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
 
             return NULL;
         }
+        if (pool->stats)
+            pool_stats_node(pool->stats, node);
     }
 
     node->free_index = 0;
@@ -928,6 +1915,75 @@ APR_DECLARE(void *) apr_pcalloc(apr_pool_t *pool, apr_size_t size)
     return mem;
 }
 
+APR_DECLARE(void *) apr_palloc_aligned(apr_pool_t *pool, apr_size_t size,
+                                       apr_size_t alignment)
+{
+    apr_memnode_t *active;
+    apr_size_t pad;
+    char *mem;
+
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+        return NULL;
+    if (alignment <= APR_ALIGN_DEFAULT(1))
+        return apr_palloc(pool, size);
+
+    /* If the active node has enough bytes left once padded, pad it and
+     * allocate from there (valgrind's redzones would break the alignment).
+     */
+#if HAVE_VALGRIND
+    if (!apr_running_on_valgrind)
+#endif
+    {
+        active = pool->active;
+        pad = APR_ALIGN((apr_uintptr_t)active->first_avail, alignment)
+              - (apr_uintptr_t)active->first_avail;
+        if (size <= node_free_space(active)
+                && pad <= node_free_space(active) - size) {
+            active->first_avail += pad;
+            return apr_palloc(pool, size);
+        }
+    }
+
+    /* Otherwise allocate enough to align (most likely from a new node) */
+    if (size + alignment < size) {
+        if (pool->abort_fn)
+            pool->abort_fn(APR_ENOMEM);
+
+        return NULL;
+    }
+    if ((mem = apr_palloc(pool, size + alignment - 1)) == NULL)
+        return NULL;
+
+    return (void *)APR_ALIGN((apr_uintptr_t)mem, alignment);
+}
+
+APR_DECLARE(apr_status_t) apr_pool_bump_reserve(apr_pool_t *pool,
+                                                apr_size_t size,
+                                                apr_pool_bump_t *bump)
+{
+    if ((bump->first_avail = apr_palloc(pool, size)) == NULL) {
+        bump->endp = NULL;
+        return APR_ENOMEM;
+    }
+    bump->endp = bump->first_avail + APR_ALIGN_DEFAULT(size);
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void) apr_pool_bump_release(apr_pool_t *pool,
+                                        apr_pool_bump_t *bump)
+{
+    apr_memnode_t *active = pool->active;
+
+    /* Nothing was allocated since, rewind */
+    if (active->first_avail == bump->endp
+            && bump->first_avail >= (char *)active
+            && bump->first_avail <= bump->endp) {
+        active->first_avail = bump->first_avail;
+    }
+    bump->first_avail = bump->endp;
+}
+
 
 /*
  * Pool creation/destruction
@@ -937,6 +1993,13 @@ APR_DECLARE(void) apr_pool_clear(apr_pool_t *pool)
 {
     apr_memnode_t *active;
 
+    if (pool->stats)
+        pool_stats_fold(pool);
+
+    /* Rewind the outstanding marks, if any */
+    while (pool->marks)
+        apr_pool_rewind(pool, pool->marks);
+
     /* Run pre destroy cleanups */
     run_cleanups(&pool->pre_cleanups);
 
@@ -970,6 +2033,9 @@ APR_DECLARE(void) apr_pool_clear(apr_pool_t *pool)
     active = pool->active = pool->self;
     active->first_avail = pool->self_first_avail;
 
+    if (pool->stats)
+        pool->stats->bytes_held = pool->stats->bytes_max = NODE_SIZE(active);
+
     APR_IF_VALGRIND(VALGRIND_MEMPOOL_TRIM(pool, pool, 1));
 
     if (active->next == active) {
@@ -990,6 +2056,13 @@ APR_DECLARE(void) apr_pool_destroy(apr_pool_t *pool)
     apr_memnode_t *active;
     apr_allocator_t *allocator;
 
+    if (pool->stats)
+        pool_stats_fold(pool);
+
+    /* Rewind the outstanding marks, if any */
+    while (pool->marks)
+        apr_pool_rewind(pool, pool->marks);
+
     /* Run pre destroy cleanups */
     run_cleanups(&pool->pre_cleanups);
 
@@ -1110,6 +2183,7 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
     pool = (apr_pool_t *)node->first_avail;
     pool->self_first_avail = (char *)pool + SIZEOF_POOL_T;
 #endif
+    pool_stats_init(pool, node);
     node->first_avail = pool->self_first_avail;
 
     pool->allocator = allocator;
@@ -1122,6 +2196,7 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
     pool->subprocesses = NULL;
     pool->user_data = NULL;
     pool->tag = NULL;
+    pool->marks = NULL;
 
 #ifdef NETWARE
     pool->owner_proc = (apr_os_proc_t)getnlmhandle();
@@ -1197,7 +2272,9 @@ APR_DECLARE(apr_status_t) apr_pool_create_unmanaged_ex(apr_pool_t **newpool,
     node->ref = &node->next;
 
     pool = (apr_pool_t *)node->first_avail;
-    node->first_avail = pool->self_first_avail = (char *)pool + SIZEOF_POOL_T;
+    pool->self_first_avail = (char *)pool + SIZEOF_POOL_T;
+    pool_stats_init(pool, node);
+    node->first_avail = pool->self_first_avail;
 
     pool->allocator = pool_allocator;
     pool->active = pool->self = node;
@@ -1209,6 +2286,7 @@ APR_DECLARE(apr_status_t) apr_pool_create_unmanaged_ex(apr_pool_t **newpool,
     pool->subprocesses = NULL;
     pool->user_data = NULL;
     pool->tag = NULL;
+    pool->marks = NULL;
     pool->parent = NULL;
     pool->sibling = NULL;
     pool->ref = NULL;
@@ -1422,6 +2500,12 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
     size = APR_ALIGN_DEFAULT(size);
     ps.node->first_avail += size;
 
+    if (pool->stats) {
+        pool_stats_palloc(pool->stats, size);
+        if (ps.got_a_new_node)
+            pool_stats_node(pool->stats, ps.node);
+    }
+
     if (ps.free)
         allocator_free(pool->allocator, ps.free);
 
@@ -1478,6 +2562,132 @@ error:
 }
 
 
+/*
+ * Marks
+ */
+
+static void pool_mark_memory(apr_pool_t *pool, apr_pool_mark_t *mark)
+{
+    apr_memnode_t *active = pool->active;
+
+    mark->node = active;
+    mark->pos = active->first_avail;
+    mark->index = active->free_index;
+
+    /* Keep the other nodes aside until the rewind, so that only the
+     * active node and the ones allocated after the mark are in the ring.
+     */
+    if (active->next != active) {
+        mark->ring = active->next;
+        mark->ring_ref = active->ref;
+        active->next = active;
+        active->ref = &active->next;
+    }
+    else {
+        mark->ring = NULL;
+        mark->ring_ref = NULL;
+    }
+}
+
+static void pool_rewind_memory(apr_pool_t *pool, apr_pool_mark_t *mark)
+{
+    apr_memnode_t *active = mark->node, *node;
+
+    /* Free the nodes allocated after the mark */
+    if (active->next != active) {
+        node = active->next;
+        list_remove(active);
+        *node->ref = NULL;
+        if (pool->stats) {
+            apr_memnode_t *n;
+
+            for (n = node; n; n = n->next)
+                pool->stats->bytes_held -= NODE_SIZE(n);
+        }
+        allocator_free(pool->allocator, node);
+    }
+
+    active->first_avail = mark->pos;
+    active->free_index = mark->index;
+    active->next = active;
+    active->ref = &active->next;
+    APR_VALGRIND_NOACCESS(active->first_avail,
+                          active->endp - active->first_avail);
+
+    /* Put back the other nodes */
+    if (mark->ring) {
+        active->next = mark->ring;
+        mark->ring->ref = &active->next;
+        *mark->ring_ref = active;
+        active->ref = mark->ring_ref;
+    }
+
+    pool->active = active;
+}
+
+
+/*
+ * Statistics
+ */
+
+APR_DECLARE(void) apr_pool_stats_enable(int on)
+{
+    pool_stats_enabled = (on != 0);
+}
+
+APR_DECLARE(apr_status_t) apr_pool_stats_get(apr_pool_t *pool,
+                                             apr_pool_stats_t *stats)
+{
+    if (!pool->stats)
+        return APR_ENOTIMPL;
+
+    *stats = *pool->stats;
+    stats->tag = pool->tag;
+    stats->cycles = 0;
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(int) apr_pool_stats_do(apr_pool_stats_do_callback_fn_t *comp,
+                                   void *rec)
+{
+    pool_stats_entry_t *entry;
+    int rv = 1;
+
+#if APR_HAS_THREADS
+    if (pool_stats_mutex)
+        apr_thread_mutex_lock(pool_stats_mutex);
+#endif /* APR_HAS_THREADS */
+
+    for (entry = pool_stats_list; entry; entry = entry->next) {
+        /* A snapshot, the pools accumulate concurrently */
+        apr_pool_stats_t stats;
+        unsigned int i;
+
+        stats.tag = entry->stats.tag;
+        stats.cycles = POOL_STATS_READ(&entry->stats.cycles);
+        stats.nodes = POOL_STATS_READ(&entry->stats.nodes);
+        stats.bytes = POOL_STATS_READ(&entry->stats.bytes);
+        stats.bytes_held = POOL_STATS_READ(&entry->stats.bytes_held);
+        stats.bytes_max = POOL_STATS_READ(&entry->stats.bytes_max);
+        for (i = 0; i < APR_POOL_STATS_BUCKETS; i++)
+            stats.palloc[i] = POOL_STATS_READ(&entry->stats.palloc[i]);
+
+        if (!comp(rec, &stats)) {
+            rv = 0;
+            break;
+        }
+    }
+
+#if APR_HAS_THREADS
+    if (pool_stats_mutex)
+        apr_thread_mutex_unlock(pool_stats_mutex);
+#endif /* APR_HAS_THREADS */
+
+    return rv;
+}
+
+
 #else /* APR_POOL_DEBUG */
 /*
  * Debug helper functions
@@ -1838,6 +3048,47 @@ APR_DECLARE(void *) apr_pcalloc_debug(apr_pool_t *pool, apr_size_t size,
     return mem;
 }
 
+APR_DECLARE(void *) apr_palloc_aligned(apr_pool_t *pool, apr_size_t size,
+                                       apr_size_t alignment)
+{
+    char *mem;
+
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+        return NULL;
+
+    if (size + alignment < size) {
+        if (pool->abort_fn)
+            pool->abort_fn(APR_ENOMEM);
+
+        return NULL;
+    }
+    if ((mem = apr_palloc(pool, size + alignment - 1)) == NULL)
+        return NULL;
+
+    return (void *)APR_ALIGN((apr_uintptr_t)mem, alignment);
+}
+
+APR_DECLARE(apr_status_t) apr_pool_bump_reserve(apr_pool_t *pool,
+                                                apr_size_t size,
+                                                apr_pool_bump_t *bump)
+{
+    if ((bump->first_avail = apr_palloc(pool, APR_ALIGN_DEFAULT(size)))
+            == NULL) {
+        bump->endp = NULL;
+        return APR_ENOMEM;
+    }
+    bump->endp = bump->first_avail + APR_ALIGN_DEFAULT(size);
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void) apr_pool_bump_release(apr_pool_t *pool,
+                                        apr_pool_bump_t *bump)
+{
+    /* Each debug allocation is its own block */
+    bump->first_avail = bump->endp;
+}
+
 
 /*
  * Pool creation/destruction (debug)
@@ -1850,6 +3101,10 @@ static void pool_clear_debug(apr_pool_t *pool, const char *file_line)
     debug_node_t *node;
     apr_uint32_t index;
 
+    /* Rewind the outstanding marks, if any */
+    while (pool->marks)
+        apr_pool_rewind(pool, pool->marks);
+
     /* Run pre destroy cleanups */
     run_cleanups(&pool->pre_cleanups);
     pool->pre_cleanups = NULL;
@@ -2332,6 +3587,56 @@ APR_DECLARE(void) apr_pool_lock(apr_pool_t *pool, int flag)
 {
 }
 
+static void pool_mark_memory(apr_pool_t *pool, apr_pool_mark_t *mark)
+{
+    mark->node = pool->nodes;
+    mark->index = pool->nodes ? pool->nodes->index : 0;
+}
+
+static void pool_rewind_memory(apr_pool_t *pool, apr_pool_mark_t *mark)
+{
+    debug_node_t *node;
+    apr_uint32_t index;
+
+    /* Free the blocks allocated after the mark, scribbling over them
+     * first like pool_clear_debug().
+     */
+    while ((node = pool->nodes) != NULL) {
+        index = (node == mark->node) ? mark->index : 0;
+        while (node->index > index) {
+            node->index--;
+            memset(node->beginp[node->index], POOL_POISON_BYTE,
+                   (char *)node->endp[node->index]
+                   - (char *)node->beginp[node->index]);
+            free(node->beginp[node->index]);
+        }
+        if (node == mark->node)
+            break;
+
+        pool->nodes = node->next;
+        memset(node, POOL_POISON_BYTE, SIZEOF_DEBUG_NODE_T);
+        free(node);
+    }
+}
+
+/* The debug pools keep their own statistics */
+
+APR_DECLARE(void) apr_pool_stats_enable(int on)
+{
+}
+
+APR_DECLARE(apr_status_t) apr_pool_stats_get(apr_pool_t *pool,
+                                             apr_pool_stats_t *stats)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(int) apr_pool_stats_do(apr_pool_stats_do_callback_fn_t *comp,
+                                   void *rec)
+{
+    return 1;
+}
+
 #endif /* !APR_POOL_DEBUG */
 
 #ifdef NETWARE
@@ -2430,6 +3735,13 @@ APR_DECLARE(int) apr_pool_is_ancestor(apr_pool_t *a, apr_pool_t *b)
 APR_DECLARE(void) apr_pool_tag(apr_pool_t *pool, const char *tag)
 {
     pool->tag = tag;
+#if !APR_POOL_DEBUG
+    if (pool->stats && apr_pools_initialized) {
+        /* Look the entry up once, not on each clear */
+        pool->stats_gen = pool_stats_gen;
+        pool->stats_entry = pool_stats_entry(tag);
+    }
+#endif /* !APR_POOL_DEBUG */
 }
 
 
@@ -2670,6 +3982,107 @@ static void run_cleanups(cleanup_t **cref)
     }
 }
 
+/*
+ * Marks: a no-op cleanup registered by apr_pool_mark() delimits the
+ * cleanups to run by apr_pool_rewind().
+ */
+
+static apr_status_t mark_cleanup(void *data)
+{
+    return APR_SUCCESS;
+}
+
+/* Run the cleanups up to the mark's, which is returned */
+static cleanup_t *run_mark_cleanups(cleanup_t **cref, apr_pool_mark_t *mark)
+{
+    cleanup_t *c;
+
+    while ((c = *cref) != NULL) {
+        *cref = c->next;
+        if (c->data == mark && c->plain_cleanup_fn == mark_cleanup)
+            return c;
+        (*c->plain_cleanup_fn)((void *)c->data);
+    }
+
+    return NULL;
+}
+
+APR_DECLARE(void) apr_pool_mark(apr_pool_t *p, apr_pool_mark_t *mark)
+{
+#if APR_POOL_DEBUG
+    apr_pool_check_integrity(p);
+#endif /* APR_POOL_DEBUG */
+
+    /* Register the delimiters first, for them to survive the rewind */
+    apr_pool_pre_cleanup_register(p, mark, mark_cleanup);
+    apr_pool_cleanup_register(p, mark, mark_cleanup, apr_pool_cleanup_null);
+
+    mark->user_data = p->user_data;
+    mark->subprocesses = p->subprocesses;
+    pool_mark_memory(p, mark);
+
+    mark->prev = p->marks;
+    p->marks = mark;
+}
+
+static void pool_rewind(apr_pool_t *p, apr_pool_mark_t *mark)
+{
+    struct process_chain *procs, **pref;
+    cleanup_t *pre, *c;
+
+    p->marks = mark->prev;
+
+    pre = run_mark_cleanups(&p->pre_cleanups, mark);
+    c = run_mark_cleanups(&p->cleanups, mark);
+
+    /* Free the subprocesses noted after the mark */
+    for (pref = &p->subprocesses; *pref != mark->subprocesses;
+         pref = &(*pref)->next)
+        ;
+    if (pref != &p->subprocesses) {
+        procs = p->subprocesses;
+        p->subprocesses = *pref;
+        *pref = NULL;
+        free_proc_chain(procs);
+    }
+
+    p->user_data = mark->user_data;
+
+    pool_rewind_memory(p, mark);
+
+    /* The free cleanups may have been allocated after the mark, forget
+     * about them but the delimiters (for the next mark to reuse).
+     */
+    p->free_cleanups = NULL;
+    if (pre) {
+        pre->next = p->free_cleanups;
+        p->free_cleanups = pre;
+    }
+    if (c) {
+        c->next = p->free_cleanups;
+        p->free_cleanups = c;
+    }
+}
+
+APR_DECLARE(void) apr_pool_rewind(apr_pool_t *p, apr_pool_mark_t *mark)
+{
+    apr_pool_mark_t *m;
+
+#if APR_POOL_DEBUG
+    apr_pool_check_integrity(p);
+#endif /* APR_POOL_DEBUG */
+
+    /* Ignore a mark already rewound, rewind the inner ones first */
+    for (m = p->marks; m && m != mark; m = m->prev)
+        ;
+    if (m == NULL)
+        return;
+
+    while (p->marks != mark)
+        pool_rewind(p, p->marks);
+    pool_rewind(p, mark);
+}
+
 #if !defined(WIN32) && !defined(OS2)
 
 static void run_child_cleanups(cleanup_t **cref)
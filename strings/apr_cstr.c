@@ -280,10 +280,144 @@ static const short ucharmap[] = {
 };
 #endif
 
+/* On x86 the comparisons are vectorized with SSE2 (and AVX2 if enabled
+ * at compile time), folding the case of the ASCII letters only, like the
+ * ucharmap[] above.  Since the length of the strings is not known, the
+ * vectors are loaded only when they don't cross a page boundary (so can't
+ * fault), the bytes near the end of a page are compared one at a time.
+ * That's an (harmless) over-read for the address sanitizers, which are
+ * given the scalar version.
+ */
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define CSTR_NO_SIMD 1
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__)
+#define CSTR_NO_SIMD 1
+#endif
+
+#if !APR_CHARSET_EBCDIC && !defined(CSTR_NO_SIMD) \
+    && (defined(__SSE2__) || defined(_M_X64) \
+        || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define CSTR_SIMD 1
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#define CSTR_PAGE_SIZE 4096
+#define CSTR_CAN_LOAD(p, n) \
+    (((apr_uintptr_t)(p) & (CSTR_PAGE_SIZE - 1)) <= CSTR_PAGE_SIZE - (n))
+
+static APR_INLINE unsigned int cstr_first_bit(apr_uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward(&i, mask);
+    return i;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+/* Lower case the ASCII letters: 'A' <= c <= 'Z' as signed bytes, so the
+ * ones above 0x7f are left alone.
+ */
+static APR_INLINE __m128i cstr_tolower16(__m128i v)
+{
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+#if defined(__AVX2__)
+static APR_INLINE __m256i cstr_tolower32(__m256i v)
+{
+    __m256i upper = _mm256_and_si256(
+                        _mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+                        _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+    return _mm256_or_si256(v, _mm256_and_si256(upper,
+                                               _mm256_set1_epi8(0x20)));
+}
+#endif
+
+/* Compare at most n bytes of str1 and str2 like apr_cstr_casecmpn().
+ * For each vector, the mask has a bit set for the bytes which differ or
+ * are the end of str1, the first one of them gives the result.
+ */
+static int cstr_casecmp_simd(const unsigned char *str1,
+                             const unsigned char *str2, apr_size_t n)
+{
+    apr_uint32_t mask;
+
+    for (;;) {
+#if defined(__AVX2__)
+        if (n >= 32 && CSTR_CAN_LOAD(str1, 32) && CSTR_CAN_LOAD(str2, 32)) {
+            __m256i v1 = _mm256_loadu_si256((const __m256i *)str1);
+            __m256i v2 = _mm256_loadu_si256((const __m256i *)str2);
+            __m256i eq = _mm256_cmpeq_epi8(cstr_tolower32(v1),
+                                           cstr_tolower32(v2));
+            __m256i nul = _mm256_cmpeq_epi8(v1, _mm256_setzero_si256());
+
+            mask = ~(apr_uint32_t)_mm256_movemask_epi8(eq)
+                   | (apr_uint32_t)_mm256_movemask_epi8(nul);
+            if (mask) {
+                break;
+            }
+            str1 += 32;
+            str2 += 32;
+            n -= 32;
+            continue;
+        }
+#endif
+        if (n >= 16 && CSTR_CAN_LOAD(str1, 16) && CSTR_CAN_LOAD(str2, 16)) {
+            __m128i v1 = _mm_loadu_si128((const __m128i *)str1);
+            __m128i v2 = _mm_loadu_si128((const __m128i *)str2);
+            __m128i eq = _mm_cmpeq_epi8(cstr_tolower16(v1),
+                                        cstr_tolower16(v2));
+            __m128i nul = _mm_cmpeq_epi8(v1, _mm_setzero_si128());
+
+            mask = (~_mm_movemask_epi8(eq) | _mm_movemask_epi8(nul)) & 0xffff;
+            if (mask) {
+                break;
+            }
+            str1 += 16;
+            str2 += 16;
+            n -= 16;
+            continue;
+        }
+
+        /* The end of n or of a page */
+        if (!n) {
+            return 0;
+        }
+        else {
+            const int cmp = ucharmap[*str1] - ucharmap[*str2];
+            if (cmp || !*str1) {
+                return cmp;
+            }
+        }
+        str1++;
+        str2++;
+        n--;
+    }
+
+    mask = cstr_first_bit(mask);
+    return ucharmap[str1[mask]] - ucharmap[str2[mask]];
+}
+#endif /* CSTR_SIMD */
+
 APR_DECLARE(int) apr_cstr_casecmp(const char *s1, const char *s2)
 {
     const unsigned char *str1 = (const unsigned char *)s1;
     const unsigned char *str2 = (const unsigned char *)s2;
+#ifdef CSTR_SIMD
+    return cstr_casecmp_simd(str1, str2, APR_SIZE_MAX);
+#else
     for (;;)
     {
         const int c1 = (int)(*str1);
@@ -295,6 +429,7 @@ APR_DECLARE(int) apr_cstr_casecmp(const char *s1, const char *s2)
         str1++;
         str2++;
     }
+#endif
 }
 
 APR_DECLARE(int) apr_cstr_casecmpn(const char *s1, const char *s2,
@@ -302,6 +437,9 @@ APR_DECLARE(int) apr_cstr_casecmpn(const char *s1, const char *s2,
 {
     const unsigned char *str1 = (const unsigned char *)s1;
     const unsigned char *str2 = (const unsigned char *)s2;
+#ifdef CSTR_SIMD
+    return cstr_casecmp_simd(str1, str2, n);
+#else
     while (n--)
     {
         const int c1 = (int)(*str1);
@@ -314,6 +452,7 @@ APR_DECLARE(int) apr_cstr_casecmpn(const char *s1, const char *s2,
         str2++;
     }
     return 0;
+#endif
 }
 
 APR_DECLARE(apr_status_t) apr_cstr_strtoui64(apr_uint64_t *n,
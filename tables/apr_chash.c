@@ -0,0 +1,524 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_private.h"
+
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_allocator.h"
+#include "apr_thread_mutex.h"
+
+#include "apr_chash.h"
+#include "apr_atomic_inline.h"
+
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+/*
+ * The table is split in stripes, each one being a chained hash table (a
+ * la apr_hash_t) with its own mutex, pool and sequence number, placed on
+ * its own cache line(s).
+ *
+ * The writers of a stripe take its mutex and make the sequence number odd
+ * while they modify it, then even again.  The readers don't write anything
+ * shared: they read the sequence number, look up the key, and read the
+ * sequence number again to validate what they found.  This is safe memory
+ * wise because nothing is ever freed before the table is destroyed: old
+ * bucket arrays stay in the stripe's pool and deleted entries are only
+ * recycled by the same stripe (a reader may see a recycled entry, but then
+ * the sequence number has changed).  For the same reason the keys are
+ * copied in the entries, so that the caller can free them.  The arrays and
+ * the entries are published (linked) with release stores, and followed by
+ * the readers with acquire loads, so that they are initialized before the
+ * readers dereference them, even if the sequence number then says retry.
+ *
+ * Lock-free readers need the inline atomics for ordering, otherwise they
+ * take the mutex too.
+ */
+
+#define CHASH_LOCKLESS (APR_HAS_THREADS && APR_ATOMIC_INLINE)
+
+#define CHASH_STRIPES       64  /* default */
+#define CHASH_MAX_STRIPES   65536
+#define CHASH_INITIAL_MAX   15  /* tunable == 2^n - 1 */
+#define CHASH_CACHE_LINE    64
+#define CHASH_READ_TRIES    8   /* before taking the mutex */
+
+/* Entries are recycled by size class of their key, the last class is
+ * for the larger keys (the capacity of each entry is checked then).
+ */
+#define CHASH_CLASSES       8
+#define CHASH_CLASS_MIN     16
+
+typedef struct chash_entry_t chash_entry_t;
+
+struct chash_entry_t {
+    chash_entry_t *volatile next;
+    const void    *volatile val;
+    volatile apr_ssize_t    klen;
+    volatile unsigned int   hash;
+    unsigned int            cls;
+    apr_size_t              size;   /* capacity of the key */
+};
+
+#define ENTRY_SIZE      APR_ALIGN_DEFAULT(sizeof(chash_entry_t))
+#define ENTRY_KEY(he)   ((char *)(he) + ENTRY_SIZE)
+
+typedef struct chash_array_t {
+    unsigned int max;
+    chash_entry_t *volatile buckets[1];
+} chash_array_t;
+
+typedef struct chash_stripe_t {
+    volatile apr_uint32_t   seq;
+    volatile unsigned int   count;
+    chash_array_t *volatile array;
+    chash_entry_t          *free[CHASH_CLASSES];
+    apr_pool_t             *pool;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t     *mutex;
+#endif
+} chash_stripe_t;
+
+struct apr_chash_t {
+    char                   *stripes;
+    apr_size_t              stride;
+    unsigned int            nstripes, shift;
+    apr_hashfunc_t          hash_func;
+};
+
+#define STRIPE(ht, i) \
+    ((chash_stripe_t *)((ht)->stripes + (apr_size_t)(i) * (ht)->stride))
+
+/* Fibonacci hashing of the top bits, so that the stripe does not depend on
+ * the low bits used for the buckets (nor on a weak custom hash function).
+ */
+#define STRIPE_OF(ht, hash) \
+    ((ht)->shift < 32 ? ((hash) * 0x9E3779B1U) >> (ht)->shift : 0)
+
+#if APR_HAS_THREADS
+#define stripe_lock(s)      apr_thread_mutex_lock((s)->mutex)
+#define stripe_unlock(s)    apr_thread_mutex_unlock((s)->mutex)
+#else
+#define stripe_lock(s)
+#define stripe_unlock(s)
+#endif
+
+/* Enter/leave a modification of the stripe, with its mutex held */
+static APR_INLINE void stripe_write_begin(chash_stripe_t *s)
+{
+#if CHASH_LOCKLESS
+    apr__atomic_store(&s->seq, s->seq + 1, RELAXED);
+    apr__atomic_fence(RELEASE);
+#endif
+}
+
+static APR_INLINE void stripe_write_end(chash_stripe_t *s)
+{
+#if CHASH_LOCKLESS
+    apr__atomic_store(&s->seq, s->seq + 1, RELEASE);
+#endif
+}
+
+static chash_array_t *alloc_array(chash_stripe_t *s, unsigned int max)
+{
+    chash_array_t *array;
+
+    array = apr_pcalloc(s->pool, APR_OFFSETOF(chash_array_t, buckets) +
+                                 sizeof(array->buckets[0]) * (max + 1));
+    array->max = max;
+    return array;
+}
+
+APR_DECLARE(apr_status_t) apr_chash_create(apr_chash_t **pht,
+                                           unsigned int stripes,
+                                           apr_hashfunc_t hash_func,
+                                           apr_pool_t *pool)
+{
+    apr_chash_t *ht;
+    apr_allocator_t *allocator;
+    apr_pool_t *owner;
+    apr_status_t rv;
+    unsigned int i, n, bits;
+
+    if (!stripes) {
+        stripes = CHASH_STRIPES;
+    }
+    else if (stripes > CHASH_MAX_STRIPES) {
+        stripes = CHASH_MAX_STRIPES;
+    }
+    for (n = 1, bits = 0; n < stripes; n <<= 1) {
+        bits++;
+    }
+
+    /* Our own allocator, thread-safe, for all the stripes' pools */
+    if ((rv = apr_allocator_create(&allocator)) != APR_SUCCESS) {
+        return rv;
+    }
+    if ((rv = apr_pool_create_ex(&owner, pool, NULL,
+                                 allocator)) != APR_SUCCESS) {
+        apr_allocator_destroy(allocator);
+        return rv;
+    }
+    apr_allocator_owner_set(allocator, owner);
+    apr_pool_tag(owner, "apr_chash");
+#if APR_HAS_THREADS
+    {
+        apr_thread_mutex_t *mutex;
+
+        rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, owner);
+        if (rv != APR_SUCCESS) {
+            apr_pool_destroy(owner);
+            return rv;
+        }
+        apr_allocator_mutex_set(allocator, mutex);
+    }
+#endif
+
+    ht = apr_pcalloc(owner, sizeof(*ht));
+    ht->nstripes = n;
+    ht->shift = 32 - bits;
+    ht->hash_func = hash_func ? hash_func : apr_hashfunc_fast;
+    ht->stride = APR_ALIGN(sizeof(chash_stripe_t), CHASH_CACHE_LINE);
+    ht->stripes = apr_palloc_aligned(owner, ht->stride * n, CHASH_CACHE_LINE);
+    memset(ht->stripes, 0, ht->stride * n);
+
+    for (i = 0; i < n; i++) {
+        chash_stripe_t *s = STRIPE(ht, i);
+
+        if ((rv = apr_pool_create(&s->pool, owner)) != APR_SUCCESS) {
+            apr_pool_destroy(owner);
+            return rv;
+        }
+#if APR_HAS_THREADS
+        rv = apr_thread_mutex_create(&s->mutex, APR_THREAD_MUTEX_DEFAULT,
+                                     s->pool);
+        if (rv != APR_SUCCESS) {
+            apr_pool_destroy(owner);
+            return rv;
+        }
+#endif
+        s->array = alloc_array(s, CHASH_INITIAL_MAX);
+    }
+
+    *pht = ht;
+    return APR_SUCCESS;
+}
+
+/*
+ * Stripes' internals, with the mutex held.
+ */
+
+static void expand_array(chash_stripe_t *s)
+{
+    chash_array_t *old_array = s->array, *new_array;
+    chash_entry_t *he, *next;
+    unsigned int i, j;
+
+    new_array = alloc_array(s, old_array->max * 2 + 1);
+    for (i = 0; i <= old_array->max; i++) {
+        for (he = old_array->buckets[i]; he; he = next) {
+            next = he->next;
+            j = he->hash & new_array->max;
+            he->next = new_array->buckets[j];
+            new_array->buckets[j] = he;
+        }
+    }
+    apr__atomic_store(&s->array, new_array, RELEASE);
+}
+
+static chash_entry_t *volatile *find_entry(chash_stripe_t *s,
+                                           unsigned int hash,
+                                           const void *key,
+                                           apr_ssize_t klen)
+{
+    chash_entry_t *volatile *hep, *he;
+
+    for (hep = &s->array->buckets[hash & s->array->max], he = *hep;
+         he; hep = &he->next, he = *hep) {
+        if (he->hash == hash
+            && he->klen == klen
+            && memcmp(ENTRY_KEY(he), key, klen) == 0)
+            break;
+    }
+    return hep;
+}
+
+static chash_entry_t *alloc_entry(chash_stripe_t *s, apr_ssize_t klen)
+{
+    chash_entry_t *he;
+    apr_size_t size = CHASH_CLASS_MIN;
+    unsigned int cls = 0;
+
+    while (size < (apr_size_t)klen && cls < CHASH_CLASSES - 1) {
+        size <<= 1;
+        cls++;
+    }
+    he = s->free[cls];
+    if (he && he->size >= (apr_size_t)klen) {
+        s->free[cls] = he->next;
+        return he;
+    }
+    if (size < (apr_size_t)klen) {
+        size = klen;
+    }
+    he = apr_palloc(s->pool, ENTRY_SIZE + size);
+    he->cls = cls;
+    he->size = size;
+    return he;
+}
+
+static APR_INLINE void free_entry(chash_stripe_t *s, chash_entry_t *he)
+{
+    he->next = s->free[he->cls];
+    s->free[he->cls] = he;
+}
+
+static APR_INLINE void *stripe_get(chash_stripe_t *s, unsigned int hash,
+                                   const void *key, apr_ssize_t klen)
+{
+    chash_entry_t *he;
+
+    stripe_lock(s);
+    he = *find_entry(s, hash, key, klen);
+    stripe_unlock(s);
+
+    return he ? (void *)he->val : NULL;
+}
+
+#if CHASH_LOCKLESS
+/*
+ * Look up the key without the mutex, returns non-zero if the result could
+ * be validated.
+ */
+static APR_INLINE int stripe_get_lockless(chash_stripe_t *s,
+                                          unsigned int hash,
+                                          const void *key, apr_ssize_t klen,
+                                          void **val)
+{
+    chash_array_t *array;
+    chash_entry_t *he;
+    const void *found = NULL;
+    apr_uint32_t seq;
+    unsigned int n = 0, count;
+
+    seq = apr__atomic_load(&s->seq, ACQUIRE);
+    if (seq & 1) {
+        return 0;
+    }
+
+    /* A chain can't be longer than the count, unless the stripe is
+     * modified meanwhile (and we could loop on recycled entries).
+     */
+    count = s->count;
+    array = apr__atomic_load(&s->array, ACQUIRE);
+    for (he = apr__atomic_load(&array->buckets[hash & array->max], ACQUIRE);
+         he; he = apr__atomic_load(&he->next, ACQUIRE)) {
+        if (he->hash == hash
+            && he->klen == klen
+            && memcmp(ENTRY_KEY(he), key, klen) == 0) {
+            found = he->val;
+            break;
+        }
+        if (++n > count) {
+            return 0;
+        }
+    }
+
+    apr__atomic_fence(ACQUIRE);
+    if (apr__atomic_load(&s->seq, RELAXED) != seq) {
+        return 0;
+    }
+    *val = (void *)found;
+    return 1;
+}
+#endif
+
+APR_DECLARE(void *) apr_chash_get(apr_chash_t *ht, const void *key,
+                                  apr_ssize_t klen)
+{
+    chash_stripe_t *s;
+    unsigned int hash;
+
+    hash = ht->hash_func(key, &klen);
+    s = STRIPE(ht, STRIPE_OF(ht, hash));
+#if CHASH_LOCKLESS
+    {
+        void *val;
+        int tries;
+
+        for (tries = 0; tries < CHASH_READ_TRIES; tries++) {
+            if (stripe_get_lockless(s, hash, key, klen, &val)) {
+                return val;
+            }
+        }
+    }
+#endif
+    return stripe_get(s, hash, key, klen);
+}
+
+/*
+ * Set or get_or_set the entry (with the mutex held), returns the value
+ * of the entry after the call.
+ */
+static const void *stripe_set(chash_stripe_t *s, unsigned int hash,
+                              const void *key, apr_ssize_t klen,
+                              const void *val, int replace)
+{
+    chash_entry_t *volatile *hep, *he;
+
+    hep = find_entry(s, hash, key, klen);
+    he = *hep;
+    if (he) {
+        if (!replace || he->val == val) {
+            return he->val;
+        }
+        stripe_write_begin(s);
+        if (!val) {
+            /* delete entry */
+            apr__atomic_store(hep, he->next, RELEASE);
+            s->count--;
+            free_entry(s, he);
+        }
+        else {
+            /* replace entry */
+            he->val = val;
+        }
+        stripe_write_end(s);
+        return val;
+    }
+    if (!val) {
+        return NULL;
+    }
+
+    /* add a new entry for non-NULL values */
+    stripe_write_begin(s);
+    he = alloc_entry(s, klen);
+    he->next = NULL;
+    he->hash = hash;
+    he->klen = klen;
+    he->val = val;
+    memcpy(ENTRY_KEY(he), key, klen);
+    apr__atomic_store(hep, he, RELEASE);
+    /* check that the collision rate isn't too high */
+    if (++s->count > s->array->max) {
+        expand_array(s);
+    }
+    stripe_write_end(s);
+    return val;
+}
+
+APR_DECLARE(void) apr_chash_set(apr_chash_t *ht, const void *key,
+                                apr_ssize_t klen, const void *val)
+{
+    chash_stripe_t *s;
+    unsigned int hash;
+
+    hash = ht->hash_func(key, &klen);
+    s = STRIPE(ht, STRIPE_OF(ht, hash));
+
+    stripe_lock(s);
+    stripe_set(s, hash, key, klen, val, 1);
+    stripe_unlock(s);
+}
+
+APR_DECLARE(void *) apr_chash_get_or_set(apr_chash_t *ht, const void *key,
+                                         apr_ssize_t klen, const void *val)
+{
+    chash_stripe_t *s;
+    unsigned int hash;
+
+    hash = ht->hash_func(key, &klen);
+    s = STRIPE(ht, STRIPE_OF(ht, hash));
+#if CHASH_LOCKLESS
+    {
+        void *found;
+
+        /* Avoid the mutex for existing entries */
+        if (stripe_get_lockless(s, hash, key, klen, &found) && found) {
+            return found;
+        }
+    }
+#endif
+
+    stripe_lock(s);
+    val = stripe_set(s, hash, key, klen, val, 0);
+    stripe_unlock(s);
+
+    return (void *)val;
+}
+
+APR_DECLARE(unsigned int) apr_chash_count(apr_chash_t *ht)
+{
+    unsigned int i, count = 0;
+
+    for (i = 0; i < ht->nstripes; i++) {
+        count += STRIPE(ht, i)->count;
+    }
+    return count;
+}
+
+APR_DECLARE(void) apr_chash_clear(apr_chash_t *ht)
+{
+    chash_entry_t *he, *next;
+    chash_array_t *array;
+    unsigned int i, j;
+
+    for (i = 0; i < ht->nstripes; i++) {
+        chash_stripe_t *s = STRIPE(ht, i);
+
+        stripe_lock(s);
+        if (s->count) {
+            stripe_write_begin(s);
+            array = s->array;
+            for (j = 0; j <= array->max; j++) {
+                for (he = array->buckets[j]; he; he = next) {
+                    next = he->next;
+                    free_entry(s, he);
+                }
+                array->buckets[j] = NULL;
+            }
+            s->count = 0;
+            stripe_write_end(s);
+        }
+        stripe_unlock(s);
+    }
+}
+
+APR_DECLARE(int) apr_chash_do(apr_hash_do_callback_fn_t *comp,
+                              void *rec, apr_chash_t *ht)
+{
+    chash_entry_t *he;
+    chash_array_t *array;
+    unsigned int i, j;
+    int rv = TRUE;
+
+    for (i = 0; i < ht->nstripes && rv; i++) {
+        chash_stripe_t *s = STRIPE(ht, i);
+
+        stripe_lock(s);
+        array = s->array;
+        for (j = 0; j <= array->max && rv; j++) {
+            for (he = array->buckets[j]; he && rv; he = he->next) {
+                rv = (*comp)(rec, ENTRY_KEY(he), he->klen, he->val);
+            }
+        }
+        stripe_unlock(s);
+    }
+
+    return rv;
+}
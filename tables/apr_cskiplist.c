@@ -0,0 +1,678 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_private.h"
+
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_allocator.h"
+#include "apr_thread_mutex.h"
+
+#include "apr_cskiplist.h"
+#include "apr_atomic_inline.h"
+
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+/*
+ * The skip list is lock-free (a la Fraser/Herlihy-Shavit): the nodes are
+ * linked at each of their levels with compare and swap, from the bottom
+ * level (which makes them part of the list) up, and removed by marking the
+ * low bit of their next pointers from the top level down (the bottom level
+ * mark making them removed).  The marked nodes are unlinked by the
+ * searches which walk past them.
+ *
+ * A removed node can still be read by the operations that were walking
+ * the list when it was unlinked, so it is reclaimed by epochs: each
+ * operation counts itself in the current epoch's parity for its whole
+ * duration, and a node unlinked during epoch e is reclaimed when the
+ * epoch is advanced to e + 2, which requires that no operation counted in
+ * e - 1 then e is in progress.  The counters are striped by thread (using
+ * the address of their stack, which only matters for contention), along
+ * with the pools and free lists of the nodes and the size of the list.
+ *
+ * A node is retired (put in the reclaim list of the current epoch) by the
+ * last of its inserter and remover to be done with it, after both have
+ * made sure that it's unlinked at all levels.
+ *
+ * Lock-free operations need the inline atomics, otherwise they are
+ * serialized by a mutex.
+ */
+
+#define CSL_LOCKLESS (APR_HAS_THREADS && APR_ATOMIC_INLINE)
+
+#if CSL_LOCKLESS
+static APR_INLINE apr_uintptr_t csl_xchg(apr_uintptr_t *p, apr_uintptr_t v)
+{
+    return apr__atomic_xchg(p, v, ACQ_REL);
+}
+
+static APR_INLINE int csl_cas(apr_uintptr_t *p, apr_uintptr_t o,
+                              apr_uintptr_t n)
+{
+    return apr__atomic_cas(p, &o, n, SEQ_CST, RELAXED);
+}
+
+static APR_INLINE void csl_raise(apr_uint32_t *p, apr_uint32_t v)
+{
+    apr_uint32_t o = apr__atomic_load(p, ACQUIRE);
+
+    while (o < v && !apr__atomic_cas(p, &o, v, SEQ_CST, ACQUIRE))
+        ;
+}
+#else
+static APR_INLINE apr_uintptr_t csl_xchg(apr_uintptr_t *p, apr_uintptr_t v)
+{
+    apr_uintptr_t o = *p;
+    *p = v;
+    return o;
+}
+
+static APR_INLINE int csl_cas(apr_uintptr_t *p, apr_uintptr_t o,
+                              apr_uintptr_t n)
+{
+    if (*p != o) {
+        return 0;
+    }
+    *p = n;
+    return 1;
+}
+
+static APR_INLINE void csl_raise(apr_uint32_t *p, apr_uint32_t v)
+{
+    if (*p < v) {
+        *p = v;
+    }
+}
+#endif
+
+#define CSL_MAX_HEIGHT  32
+#define CSL_STRIPES     16      /* == 2^CSL_STRIPES_BITS */
+#define CSL_STRIPES_BITS 4
+#define CSL_CACHE_LINE  64
+#define CSL_EPOCHS      6       /* epochs cycle, multiple of 2 and 3 */
+#define CSL_GC_BATCH    64      /* retired nodes before reclaiming */
+
+typedef struct csl_node_t csl_node_t;
+
+struct csl_node_t {
+    void                   *data;
+    apr_skiplist_freefunc   free;       /* data's, when reclaimed */
+    csl_node_t             *gc_next;    /* in a reclaim or free list */
+    apr_uint32_t            refs;       /* inserter and remover */
+    unsigned int            height;
+    unsigned int            stripe;     /* allocated from */
+    apr_uintptr_t           next[1];    /* height (marked) pointers */
+};
+
+#define NODE_SIZE(height) \
+    (APR_OFFSETOF(csl_node_t, next) + sizeof(apr_uintptr_t) * (height))
+#define MARKED(p)   ((p) & 1)
+#define NODE(p)     ((csl_node_t *)((p) & ~(apr_uintptr_t)1))
+
+typedef struct csl_stripe_t {
+    apr_uint32_t            active[2];  /* operations per epoch parity */
+    apr_uint32_t            retired;
+    apr_uint32_t            seed;
+    apr_ssize_t             count;
+    csl_node_t             *free[CSL_MAX_HEIGHT];
+    apr_pool_t             *pool;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t     *mutex;
+#endif
+} csl_stripe_t;
+
+struct apr_cskiplist_t {
+    csl_node_t             *head;
+    apr_skiplist_compare    compare;
+    apr_uint32_t            height;     /* max of the nodes' */
+    apr_uint32_t            epoch;
+    apr_uintptr_t           limbo[3];   /* retired by epoch % 3 */
+    char                   *stripes;
+    apr_size_t              stride;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t     *mutex;      /* reclaiming */
+#if !CSL_LOCKLESS
+    apr_thread_mutex_t     *lock;       /* everything */
+#endif
+#endif
+};
+
+#define STRIPE(sl, i) \
+    ((csl_stripe_t *)((sl)->stripes + (apr_size_t)(i) * (sl)->stride))
+
+/* An operation in progress, counted in its stripe for the epoch parity */
+typedef struct csl_op_t {
+    csl_stripe_t           *stripe;
+    unsigned int            parity;
+    int                     retired;
+} csl_op_t;
+
+static void csl_reclaim(apr_cskiplist_t *sl);
+
+static APR_INLINE void csl_enter(apr_cskiplist_t *sl, csl_op_t *op)
+{
+    apr_uint32_t epoch;
+    unsigned int i;
+
+#if APR_HAS_THREADS && !CSL_LOCKLESS
+    apr_thread_mutex_lock(sl->lock);
+#endif
+
+    /* The threads' stacks are far enough apart for their 64K blocks to
+     * differ, Fibonacci hashing spreads them on the stripes.
+     */
+    i = ((apr_uint32_t)((apr_uintptr_t)&epoch >> 16) * 0x9E3779B1U)
+        >> (32 - CSL_STRIPES_BITS);
+    op->stripe = STRIPE(sl, i);
+    op->retired = 0;
+
+    /* Count ourself in the current epoch, which must not have changed
+     * meanwhile (or the reclaimer may have missed us).
+     */
+    for (;;) {
+        epoch = apr__atomic_load(&sl->epoch, SEQ_CST);
+        op->parity = epoch & 1;
+        apr__atomic_add(&op->stripe->active[op->parity], 1, SEQ_CST);
+        if ((apr__atomic_load(&sl->epoch, SEQ_CST) & 1) == op->parity) {
+            break;
+        }
+        apr__atomic_sub(&op->stripe->active[op->parity], 1, SEQ_CST);
+    }
+}
+
+static APR_INLINE void csl_leave(apr_cskiplist_t *sl, csl_op_t *op)
+{
+    apr__atomic_sub(&op->stripe->active[op->parity], 1, SEQ_CST);
+    if (op->retired) {
+        csl_reclaim(sl);
+    }
+
+#if APR_HAS_THREADS && !CSL_LOCKLESS
+    apr_thread_mutex_unlock(sl->lock);
+#endif
+}
+
+/* Put an unlinked node in the reclaim list of the current epoch */
+static void csl_retire(apr_cskiplist_t *sl, csl_op_t *op, csl_node_t *node)
+{
+    apr_uint32_t epoch = apr__atomic_load(&sl->epoch, SEQ_CST);
+    apr_uintptr_t *limbo = &sl->limbo[epoch % 3];
+    apr_uintptr_t head;
+
+    do {
+        head = apr__atomic_load(limbo, ACQUIRE);
+        node->gc_next = NODE(head);
+    } while (!csl_cas(limbo, head, (apr_uintptr_t)node));
+
+    if (apr__atomic_add(&op->stripe->retired, 1, SEQ_CST)
+            % CSL_GC_BATCH == 0) {
+        op->retired = 1;
+    }
+}
+
+/* Release the inserter's or remover's reference */
+static APR_INLINE void csl_release(apr_cskiplist_t *sl, csl_op_t *op,
+                                   csl_node_t *node)
+{
+    if (apr__atomic_sub(&node->refs, 1, SEQ_CST) == 0) {
+        csl_retire(sl, op, node);
+    }
+}
+
+static void csl_free_nodes(apr_cskiplist_t *sl, csl_node_t *node)
+{
+    csl_node_t *next;
+
+    for (; node; node = next) {
+        csl_stripe_t *s = STRIPE(sl, node->stripe);
+
+        next = node->gc_next;
+        if (node->free) {
+            node->free(node->data);
+        }
+#if APR_HAS_THREADS
+        apr_thread_mutex_lock(s->mutex);
+#endif
+        node->gc_next = s->free[node->height - 1];
+        s->free[node->height - 1] = node;
+#if APR_HAS_THREADS
+        apr_thread_mutex_unlock(s->mutex);
+#endif
+    }
+}
+
+/*
+ * Advance the epoch (twice at most, for the nodes retired in the current
+ * one) as long as no operation counted in the previous one is still in
+ * progress, reclaiming the nodes retired two epochs before.
+ */
+static void csl_reclaim(apr_cskiplist_t *sl)
+{
+    int n;
+
+#if APR_HAS_THREADS
+    if (apr_thread_mutex_trylock(sl->mutex) != APR_SUCCESS) {
+        return;
+    }
+#endif
+
+    for (n = 0; n < 2; n++) {
+        apr_uint32_t epoch = apr__atomic_load(&sl->epoch, SEQ_CST);
+        apr_uint32_t active = 0;
+        apr_uint32_t prev = (epoch + CSL_EPOCHS - 1) % CSL_EPOCHS;
+        unsigned int i;
+
+        for (i = 0; i < CSL_STRIPES; i++) {
+            active += apr__atomic_load(&STRIPE(sl, i)->active[prev & 1],
+                                       SEQ_CST);
+        }
+        if (active) {
+            break;
+        }
+        apr__atomic_store(&sl->epoch, (epoch + 1) % CSL_EPOCHS, SEQ_CST);
+        csl_free_nodes(sl, NODE(csl_xchg(&sl->limbo[prev % 3], 0)));
+    }
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(sl->mutex);
+#endif
+}
+
+static csl_node_t *csl_alloc(apr_cskiplist_t *sl, csl_op_t *op)
+{
+    csl_stripe_t *s = op->stripe;
+    csl_node_t *node;
+    unsigned int height = 1;
+    apr_uint32_t r;
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(s->mutex);
+#endif
+
+    /* xorshift, for a height of n with a probability of 1/2^n */
+    r = s->seed;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    s->seed = r;
+    while (height < CSL_MAX_HEIGHT && (r & 1)) {
+        height++;
+        r >>= 1;
+    }
+
+    node = s->free[height - 1];
+    if (node) {
+        s->free[height - 1] = node->gc_next;
+    }
+    else {
+        node = apr_palloc(s->pool, NODE_SIZE(height));
+        node->height = height;
+        node->stripe = (unsigned int)(((char *)s - sl->stripes) / sl->stride);
+    }
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(s->mutex);
+#endif
+
+    return node;
+}
+
+static apr_status_t csl_cleanup(void *data)
+{
+    apr_cskiplist_t *sl = data;
+    int i;
+
+    /* Free the elements still waiting for their nodes to be reclaimed */
+    for (i = 0; i < 3; i++) {
+        csl_node_t *node = NODE(sl->limbo[i]);
+        for (; node; node = node->gc_next) {
+            if (node->free) {
+                node->free(node->data);
+            }
+        }
+        sl->limbo[i] = 0;
+    }
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_cskiplist_create(apr_cskiplist_t **psl,
+                                               apr_skiplist_compare comp,
+                                               apr_pool_t *pool)
+{
+    apr_cskiplist_t *sl;
+    apr_allocator_t *allocator;
+    apr_pool_t *owner;
+    apr_status_t rv;
+    unsigned int i;
+
+    /* Our own allocator, thread-safe, for all the stripes' pools */
+    if ((rv = apr_allocator_create(&allocator)) != APR_SUCCESS) {
+        return rv;
+    }
+    if ((rv = apr_pool_create_ex(&owner, pool, NULL,
+                                 allocator)) != APR_SUCCESS) {
+        apr_allocator_destroy(allocator);
+        return rv;
+    }
+    apr_allocator_owner_set(allocator, owner);
+    apr_pool_tag(owner, "apr_cskiplist");
+
+    sl = apr_pcalloc(owner, sizeof(*sl));
+#if APR_HAS_THREADS
+    {
+        apr_thread_mutex_t *mutex;
+
+        rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, owner);
+        if (rv != APR_SUCCESS) {
+            apr_pool_destroy(owner);
+            return rv;
+        }
+        apr_allocator_mutex_set(allocator, mutex);
+    }
+    rv = apr_thread_mutex_create(&sl->mutex, APR_THREAD_MUTEX_DEFAULT, owner);
+    if (rv != APR_SUCCESS) {
+        apr_pool_destroy(owner);
+        return rv;
+    }
+#if !CSL_LOCKLESS
+    /* nested, for apr_cskiplist_do() callbacks using the skip list */
+    rv = apr_thread_mutex_create(&sl->lock, APR_THREAD_MUTEX_NESTED, owner);
+    if (rv != APR_SUCCESS) {
+        apr_pool_destroy(owner);
+        return rv;
+    }
+#endif
+#endif
+
+    sl->compare = comp;
+    sl->height = 1;
+    sl->head = apr_pcalloc(owner, NODE_SIZE(CSL_MAX_HEIGHT));
+    sl->head->height = CSL_MAX_HEIGHT;
+    sl->stride = APR_ALIGN(sizeof(csl_stripe_t), CSL_CACHE_LINE);
+    sl->stripes = apr_palloc_aligned(owner, sl->stride * CSL_STRIPES,
+                                     CSL_CACHE_LINE);
+    memset(sl->stripes, 0, sl->stride * CSL_STRIPES);
+
+    for (i = 0; i < CSL_STRIPES; i++) {
+        csl_stripe_t *s = STRIPE(sl, i);
+
+        if ((rv = apr_pool_create(&s->pool, owner)) != APR_SUCCESS) {
+            apr_pool_destroy(owner);
+            return rv;
+        }
+#if APR_HAS_THREADS
+        rv = apr_thread_mutex_create(&s->mutex, APR_THREAD_MUTEX_DEFAULT,
+                                     s->pool);
+        if (rv != APR_SUCCESS) {
+            apr_pool_destroy(owner);
+            return rv;
+        }
+#endif
+        s->seed = (i + 1) * 0x9E3779B1U;
+    }
+
+    /* before the stripes' pools (and the nodes) are destroyed */
+    apr_pool_pre_cleanup_register(owner, sl, csl_cleanup);
+
+    *psl = sl;
+    return APR_SUCCESS;
+}
+
+/*
+ * Search for data from the top level down, filling in preds[] and succs[]
+ * (if not NULL) with the nodes lower and greater than or equal to data at
+ * each level, and unlinking the marked nodes on the way.  Returns the node
+ * equal to data if any.  With unlink, go on past the nodes equal to data,
+ * to make sure that a marked one is unlinked at all its levels.
+ */
+static csl_node_t *csl_search(apr_cskiplist_t *sl, void *data, int unlink,
+                              csl_node_t **preds, csl_node_t **succs)
+{
+    csl_node_t *pred, *curr, *found;
+    apr_uintptr_t next;
+    int level, top, c;
+
+retry:
+    top = (int)apr__atomic_load(&sl->height, ACQUIRE) - 1;
+    if (preds) {
+        for (level = CSL_MAX_HEIGHT - 1; level > top; level--) {
+            preds[level] = sl->head;
+            succs[level] = NULL;
+        }
+    }
+    pred = sl->head;
+    found = NULL;
+    for (level = top; level >= 0; level--) {
+        curr = NODE(apr__atomic_load(&pred->next[level], ACQUIRE));
+        while (curr) {
+            next = apr__atomic_load(&curr->next[level], ACQUIRE);
+            if (MARKED(next)) {
+                if (!csl_cas(&pred->next[level], (apr_uintptr_t)curr,
+                             (apr_uintptr_t)NODE(next))) {
+                    goto retry;
+                }
+                curr = NODE(next);
+                continue;
+            }
+            c = sl->compare(data, curr->data);
+            if (c > 0 || (c == 0 && unlink)) {
+                pred = curr;
+                curr = NODE(next);
+                continue;
+            }
+            if (c == 0 && level == 0) {
+                found = curr;
+            }
+            break;
+        }
+        if (preds) {
+            preds[level] = pred;
+            succs[level] = curr;
+        }
+    }
+    return found;
+}
+
+APR_DECLARE(void *) apr_cskiplist_insert(apr_cskiplist_t *sl, void *data)
+{
+    csl_node_t *preds[CSL_MAX_HEIGHT], *succs[CSL_MAX_HEIGHT];
+    csl_node_t *node = NULL, *found;
+    apr_uintptr_t next;
+    unsigned int level;
+    csl_op_t op;
+
+    csl_enter(sl, &op);
+
+    /* Link the node at the bottom level, where it's inserted */
+    for (;;) {
+        found = csl_search(sl, data, 0, preds, succs);
+        if (found) {
+            data = found->data;
+            if (node) {
+                /* never linked, recycle */
+                node->free = NULL;
+                node->gc_next = NULL;
+                csl_free_nodes(sl, node);
+            }
+            csl_leave(sl, &op);
+            return data;
+        }
+        if (!node) {
+            node = csl_alloc(sl, &op);
+            node->data = data;
+            node->free = NULL;
+            node->refs = 2;
+            csl_raise(&sl->height, node->height);
+        }
+        for (level = 0; level < node->height; level++) {
+            node->next[level] = (apr_uintptr_t)succs[level];
+        }
+        if (csl_cas(&preds[0]->next[0], (apr_uintptr_t)succs[0],
+                    (apr_uintptr_t)node)) {
+            break;
+        }
+    }
+    apr__atomic_add(&op.stripe->count, 1, SEQ_CST);
+
+    /* Link the upper levels, unless the node is removed meanwhile */
+    for (level = 1; level < node->height; level++) {
+        for (;;) {
+            next = apr__atomic_load(&node->next[level], ACQUIRE);
+            if (MARKED(next)) {
+                goto done;
+            }
+            if (NODE(next) != succs[level]
+                && !csl_cas(&node->next[level], next,
+                            (apr_uintptr_t)succs[level])) {
+                goto done;
+            }
+            if (csl_cas(&preds[level]->next[level], (apr_uintptr_t)succs[level],
+                        (apr_uintptr_t)node)) {
+                break;
+            }
+            if (csl_search(sl, data, 0, preds, succs) != node) {
+                goto done;
+            }
+        }
+    }
+
+done:
+    /* If it was removed, it may have been linked after the remover
+     * unlinked it.
+     */
+    apr__atomic_fence(SEQ_CST);
+    if (MARKED(apr__atomic_load(&node->next[0], ACQUIRE))) {
+        csl_search(sl, data, 1, NULL, NULL);
+    }
+    csl_release(sl, &op, node);
+    csl_leave(sl, &op);
+    return data;
+}
+
+APR_DECLARE(void *) apr_cskiplist_find(apr_cskiplist_t *sl, void *data)
+{
+    csl_node_t *pred, *curr;
+    apr_uintptr_t next;
+    void *found = NULL;
+    int level, c;
+    csl_op_t op;
+
+    csl_enter(sl, &op);
+
+    /* Read-only, walking past the marked nodes without unlinking them */
+    pred = sl->head;
+    for (level = (int)apr__atomic_load(&sl->height, ACQUIRE) - 1;
+         level >= 0; level--) {
+        curr = NODE(apr__atomic_load(&pred->next[level], ACQUIRE));
+        while (curr) {
+            next = apr__atomic_load(&curr->next[level], ACQUIRE);
+            if (!MARKED(next)) {
+                c = sl->compare(data, curr->data);
+                if (c == 0) {
+                    found = curr->data;
+                    goto done;
+                }
+                if (c < 0) {
+                    break;
+                }
+                pred = curr;
+            }
+            curr = NODE(next);
+        }
+    }
+
+done:
+    csl_leave(sl, &op);
+    return found;
+}
+
+APR_DECLARE(int) apr_cskiplist_remove(apr_cskiplist_t *sl, void *data,
+                                      apr_skiplist_freefunc myfree)
+{
+    csl_node_t *node;
+    apr_uintptr_t next;
+    unsigned int level;
+    csl_op_t op;
+
+    csl_enter(sl, &op);
+
+    for (;;) {
+        node = csl_search(sl, data, 0, NULL, NULL);
+        if (!node) {
+            csl_leave(sl, &op);
+            return 0;
+        }
+
+        /* Mark the upper levels, then the bottom one which removes the
+         * node, unless another thread removed it first (then search again
+         * since an equal element may have been inserted since).
+         */
+        for (level = node->height - 1; level > 0; level--) {
+            do {
+                next = apr__atomic_load(&node->next[level], ACQUIRE);
+            } while (!MARKED(next)
+                     && !csl_cas(&node->next[level], next, next | 1));
+        }
+        do {
+            next = apr__atomic_load(&node->next[0], ACQUIRE);
+        } while (!MARKED(next)
+                 && !csl_cas(&node->next[0], next, next | 1));
+        if (!MARKED(next)) {
+            break;
+        }
+    }
+    node->free = myfree;
+    apr__atomic_sub(&op.stripe->count, 1, SEQ_CST);
+
+    apr__atomic_fence(SEQ_CST);
+    csl_search(sl, data, 1, NULL, NULL);
+    csl_release(sl, &op, node);
+    csl_leave(sl, &op);
+    return 1;
+}
+
+APR_DECLARE(apr_size_t) apr_cskiplist_size(apr_cskiplist_t *sl)
+{
+    apr_ssize_t count = 0;
+    unsigned int i;
+
+    for (i = 0; i < CSL_STRIPES; i++) {
+        count += apr__atomic_load(&STRIPE(sl, i)->count, RELAXED);
+    }
+    return count > 0 ? count : 0;
+}
+
+APR_DECLARE(int) apr_cskiplist_do(apr_cskiplist_do_callback_fn_t *comp,
+                                  void *rec, apr_cskiplist_t *sl)
+{
+    csl_node_t *curr;
+    apr_uintptr_t next;
+    int rv = TRUE;
+    csl_op_t op;
+
+    csl_enter(sl, &op);
+    for (curr = NODE(apr__atomic_load(&sl->head->next[0], ACQUIRE));
+         curr && rv; curr = NODE(next)) {
+        next = apr__atomic_load(&curr->next[0], ACQUIRE);
+        if (!MARKED(next)) {
+            rv = comp(rec, curr->data);
+        }
+    }
+    csl_leave(sl, &op);
+    return rv;
+}
@@ -21,6 +21,7 @@
 #include "apr_time.h"
 
 #include "apr_hash.h"
+#include "apr_siphash.h"
 
 #if APR_HAVE_STDLIB_H
 #include <stdlib.h>
@@ -52,17 +53,72 @@ struct apr_hash_entry_t {
     const void       *val;
 };
 
+/*
+ * The open addressing form of a hash table (apr_hash_make_flat).
+ *
+ * The entries are stored inline in an array of slots, with a parallel
+ * array of control bytes telling for each slot whether it is empty,
+ * deleted (a tombstone) or full, in which case the control byte holds
+ * 7 bits of the (mixed) hash as a fingerprint.  Lookups probe groups of
+ * FLAT_GROUP control bytes at once, word-at-a-time, and compare the keys
+ * of the slots whose fingerprint matches only.  The control bytes of the
+ * first group are mirrored after the last one so that a group can start
+ * anywhere.  The arrays are malloc()ed, and freed when they are rehashed
+ * or when the pool is cleaned up.
+ */
+
+typedef struct apr_hash_slot_t apr_hash_slot_t;
+
+struct apr_hash_slot_t {
+    unsigned int      hash;
+    const void       *key;
+    apr_ssize_t       klen;
+    const void       *val;
+};
+
+/*
+ * The frozen form of a hash table (apr_hash_freeze).
+ *
+ * The entries are stored as records holding their key inline, one after
+ * the other sorted by bucket (hash & max), with an array of max + 2 byte
+ * offsets telling where the records of each bucket start.  So a lookup
+ * reads the offsets of its bucket and then scans a short contiguous run
+ * of records, usually a single cache line for short keys.  The table
+ * header, the offsets and the records are allocated as one block, the
+ * table is read-only (see apr_hash_freeze).
+ */
+
+typedef struct apr_hash_record_t apr_hash_record_t;
+
+struct apr_hash_record_t {
+    unsigned int      hash;
+    unsigned int      klen;
+    const void       *val;
+    char              key[1]; /* klen bytes and a nul */
+};
+
+#define RECORD_SIZE(klen) \
+    APR_ALIGN_DEFAULT(APR_OFFSETOF(apr_hash_record_t, key) + (klen) + 1)
+
+#define FLAT_GROUP      8
+#define FLAT_EMPTY      0x80
+#define FLAT_DELETED    0xFE
+#define FLAT_INITIAL    16 /* tunable == 2^n >= FLAT_GROUP */
+
 /*
  * Data structure for iterating through a hash table.
  *
  * We keep a pointer to the next hash entry here to allow the current
  * hash entry to be freed or otherwise mangled between calls to
- * apr_hash_next().
+ * apr_hash_next().  For flat tables, index is one past the current slot.
+ * For frozen tables, index is the offset of the record after the current
+ * one (record).
  */
 struct apr_hash_index_t {
     apr_hash_t         *ht;
     apr_hash_entry_t   *this, *next;
     unsigned int        index;
+    const apr_hash_record_t *record;
 };
 
 /*
@@ -76,13 +132,29 @@ struct apr_hash_t {
     apr_pool_t          *pool;
     apr_hash_entry_t   **array;
     apr_hash_index_t     iterator;  /* For apr_hash_first(NULL, ...) */
-    unsigned int         count, max, seed;
+    unsigned int         count, max, flags;
+    apr_uint64_t         secret[2]; /* Seed of the fast or SipHash key */
     apr_hashfunc_t       hash_func;
     apr_hash_entry_t    *free;  /* List of recycled entries */
+    /* Flat tables only (array is NULL), max + 1 slots */
+    apr_hash_slot_t     *slots;
+    unsigned char       *ctrl;
+    unsigned int         deleted;
+    /* Frozen tables only (array and slots are NULL), the records of
+     * bucket i being at frozen + offsets[i] up to frozen + offsets[i + 1]
+     * excluded */
+    char                *frozen;
+    unsigned int        *offsets;
 };
 
 #define INITIAL_MAX 15 /* tunable == 2^n - 1 */
 
+/* The constants of the fast hash function */
+#define HASH_P0 APR_UINT64_C(0xa0761d6478bd642f)
+#define HASH_P1 APR_UINT64_C(0xe7037ed1a0b428db)
+#define HASH_P2 APR_UINT64_C(0x8ebc6af09c88c6e3)
+#define HASH_P3 APR_UINT64_C(0x589965cc75374cc3)
+
 
 /*
  * Hash creation functions.
@@ -93,7 +165,9 @@ static apr_hash_entry_t **alloc_array(apr_hash_t *ht, unsigned int max)
    return apr_pcalloc(ht->pool, sizeof(*ht->array) * (max + 1));
 }
 
-APR_DECLARE(apr_hash_t *) apr_hash_make(apr_pool_t *pool)
+static apr_uint64_t hash_mix(apr_uint64_t a, apr_uint64_t b);
+
+static apr_hash_t *hash_make(apr_pool_t *pool)
 {
     apr_hash_t *ht;
     apr_time_t now = apr_time_now();
@@ -102,11 +176,28 @@ APR_DECLARE(apr_hash_t *) apr_hash_make(apr_pool_t *pool)
     ht->pool = pool;
     ht->free = NULL;
     ht->count = 0;
+    ht->flags = 0;
+    ht->secret[0] = hash_mix((apr_uint64_t)now ^ HASH_P0,
+                             (apr_uintptr_t)ht ^ HASH_P1);
+    ht->secret[1] = hash_mix((apr_uintptr_t)pool ^ HASH_P2,
+                             (apr_uintptr_t)&now ^ HASH_P3);
+    ht->hash_func = NULL;
+    ht->array = NULL;
+    ht->slots = NULL;
+    ht->ctrl = NULL;
+    ht->deleted = 0;
+    ht->frozen = NULL;
+    ht->offsets = NULL;
+
+    return ht;
+}
+
+APR_DECLARE(apr_hash_t *) apr_hash_make(apr_pool_t *pool)
+{
+    apr_hash_t *ht = hash_make(pool);
+
     ht->max = INITIAL_MAX;
-    ht->seed = (unsigned int)((now >> 32) ^ now ^ (apr_uintptr_t)pool ^
-                              (apr_uintptr_t)ht ^ (apr_uintptr_t)&now) - 1;
     ht->array = alloc_array(ht, ht->max);
-    ht->hash_func = NULL;
 
     return ht;
 }
@@ -119,6 +210,398 @@ APR_DECLARE(apr_hash_t *) apr_hash_make_custom(apr_pool_t *pool,
     return ht;
 }
 
+APR_DECLARE(apr_hash_t *) apr_hash_make_ex(apr_pool_t *pool,
+                                           unsigned int flags)
+{
+    apr_hash_t *ht;
+    unsigned char key[sizeof(ht->secret)];
+
+    if (flags & APR_HASH_SIPHASH) {
+        /* Not guessable, unlike the default seed, or no table at all:
+         * falling back to the guessable seed would defeat the purpose.
+         */
+#if APR_HAS_RANDOM
+        if (apr_generate_random_bytes(key, sizeof(key)) != APR_SUCCESS)
+            return NULL;
+#else
+        return NULL;
+#endif
+    }
+
+    if (flags & APR_HASH_FLAT) {
+        ht = apr_hash_make_flat(pool, NULL);
+    }
+    else {
+        ht = apr_hash_make(pool);
+    }
+    ht->flags = flags;
+    if (flags & APR_HASH_SIPHASH) {
+        memcpy(ht->secret, key, sizeof(key));
+    }
+    return ht;
+}
+
+
+/*
+ * Flat tables helpers.
+ */
+
+static unsigned int hash_key(const apr_hash_t *ht, const void *key,
+                             apr_ssize_t *klen);
+
+#define GROUP_LSB APR_UINT64_C(0x0101010101010101)
+#define GROUP_MSB APR_UINT64_C(0x8080808080808080)
+
+/* Load a group of control bytes, the first one in the lowest byte */
+static APR_INLINE apr_uint64_t group_load(const unsigned char *ctrl)
+{
+    apr_uint64_t g;
+
+    memcpy(&g, ctrl, sizeof(g));
+#if APR_IS_BIGENDIAN
+    g = ((g & APR_UINT64_C(0x00000000FFFFFFFF)) << 32) | (g >> 32);
+    g = ((g & APR_UINT64_C(0x0000FFFF0000FFFF)) << 16)
+        | ((g >> 16) & APR_UINT64_C(0x0000FFFF0000FFFF));
+    g = ((g & APR_UINT64_C(0x00FF00FF00FF00FF)) << 8)
+        | ((g >> 8) & APR_UINT64_C(0x00FF00FF00FF00FF));
+#endif
+    return g;
+}
+
+/* The high bit of each byte of the group matching the fingerprint (and
+ * possibly of the next bytes, hence the keys are compared anyway).
+ */
+static APR_INLINE apr_uint64_t group_match(apr_uint64_t g, unsigned int fp)
+{
+    apr_uint64_t v = g ^ (GROUP_LSB * fp);
+
+    return (v - GROUP_LSB) & ~v & GROUP_MSB;
+}
+
+/* The high bit of each byte of the group that is empty (not deleted) */
+static APR_INLINE apr_uint64_t group_match_empty(apr_uint64_t g)
+{
+    return g & ~(g << 6) & GROUP_MSB;
+}
+
+/* The high bit of each byte of the group that is empty or deleted */
+#define group_match_free(g) ((g) & GROUP_MSB)
+
+/* The index in the group of the first byte set in bits (non-zero) */
+static APR_INLINE unsigned int group_first(apr_uint64_t bits)
+{
+#if defined(__GNUC__)
+    return (unsigned int)__builtin_ctzll(bits) >> 3;
+#else
+    unsigned int i = 0;
+
+    while (!(bits & 0x80)) {
+        bits >>= 8;
+        i++;
+    }
+    return i;
+#endif
+}
+
+/* Mix the hash so that both the fingerprint (the top 7 bits) and the
+ * position (the low bits) are usable, whatever the hash function.
+ */
+static APR_INLINE unsigned int flat_mix(unsigned int hash)
+{
+    apr_uint32_t h = hash;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+#define FLAT_FP(mixed) ((mixed) >> 25)
+
+static APR_INLINE void flat_set_ctrl(apr_hash_t *ht, unsigned int i,
+                                     unsigned char c)
+{
+    ht->ctrl[i] = c;
+    if (i < FLAT_GROUP)
+        ht->ctrl[ht->max + 1 + i] = c;
+}
+
+/* The number of consecutive non-empty slots around slot i (included),
+ * up to FLAT_GROUP.
+ */
+static unsigned int flat_full_run(const apr_hash_t *ht, unsigned int i)
+{
+    unsigned int n = 1, j;
+
+    for (j = (i + 1) & ht->max; n < FLAT_GROUP && ht->ctrl[j] != FLAT_EMPTY;
+         j = (j + 1) & ht->max)
+        n++;
+    for (j = (i - 1) & ht->max; n < FLAT_GROUP && ht->ctrl[j] != FLAT_EMPTY;
+         j = (j - 1) & ht->max)
+        n++;
+    return n;
+}
+
+static apr_status_t flat_cleanup(void *data)
+{
+    apr_hash_t *ht = data;
+
+    free(ht->ctrl);
+    ht->ctrl = NULL;
+    ht->slots = NULL;
+    return APR_SUCCESS;
+}
+
+/* Allocate the arrays for size slots, all empty */
+static void flat_alloc(apr_hash_t *ht, unsigned int size)
+{
+    apr_size_t ctrl_size = APR_ALIGN_DEFAULT(size + FLAT_GROUP);
+    char *mem;
+
+    mem = malloc(ctrl_size + sizeof(apr_hash_slot_t) * size);
+    if (mem == NULL) {
+        apr_abortfunc_t abort_fn = apr_pool_abort_get(ht->pool);
+
+        if (abort_fn)
+            abort_fn(APR_ENOMEM);
+        abort();
+    }
+    memset(mem, FLAT_EMPTY, size + FLAT_GROUP);
+
+    ht->ctrl = (unsigned char *)mem;
+    ht->slots = (apr_hash_slot_t *)(mem + ctrl_size);
+    ht->max = size - 1;
+    ht->deleted = 0;
+}
+
+/* The first free (empty or deleted) slot for the given mixed hash */
+static unsigned int flat_free_slot(const apr_hash_t *ht, unsigned int mixed)
+{
+    unsigned int pos = mixed & ht->max, step = 0;
+    apr_uint64_t bits;
+
+    for (;;) {
+        bits = group_match_free(group_load(ht->ctrl + pos));
+        if (bits)
+            return (pos + group_first(bits)) & ht->max;
+        step += FLAT_GROUP;
+        pos = (pos + step) & ht->max;
+    }
+}
+
+/* Rehash the entries in new arrays, twice bigger if there are too few
+ * deleted slots to reclaim.
+ */
+static void flat_rehash(apr_hash_t *ht)
+{
+    unsigned char *old_ctrl = ht->ctrl;
+    apr_hash_slot_t *old_slots = ht->slots;
+    unsigned int i, j, old_size = ht->max + 1, size = old_size;
+    unsigned int mixed;
+
+    if (ht->count >= size / 2)
+        size *= 2;
+    flat_alloc(ht, size);
+
+    for (i = 0; i < old_size; i++) {
+        if (old_ctrl[i] & FLAT_EMPTY)
+            continue;
+        mixed = flat_mix(old_slots[i].hash);
+        j = flat_free_slot(ht, mixed);
+        flat_set_ctrl(ht, j, (unsigned char)FLAT_FP(mixed));
+        ht->slots[j] = old_slots[i];
+    }
+
+    free(old_ctrl);
+}
+
+/*
+ * Find the slot of the key, or if val is non-NULL and there is none,
+ * insert a new entry.  Returns the slot's index, or max + 1 if not found.
+ */
+static unsigned int flat_find(apr_hash_t *ht, const void *key,
+                              apr_ssize_t klen, const void *val)
+{
+    unsigned int hash, mixed, fp, pos, step = 0, i, free_slot = 0;
+    apr_uint64_t g, bits;
+    apr_hash_slot_t *slot;
+    int has_free = 0;
+
+    hash = hash_key(ht, key, &klen);
+    mixed = flat_mix(hash);
+    fp = FLAT_FP(mixed);
+
+    pos = mixed & ht->max;
+    for (;;) {
+        g = group_load(ht->ctrl + pos);
+        for (bits = group_match(g, fp); bits; bits &= bits - 1) {
+            i = (pos + group_first(bits)) & ht->max;
+            slot = &ht->slots[i];
+            if (slot->hash == hash
+                && slot->klen == klen
+                && memcmp(slot->key, key, klen) == 0)
+                return i;
+        }
+        if (!has_free && (bits = group_match_free(g))) {
+            free_slot = (pos + group_first(bits)) & ht->max;
+            has_free = 1;
+        }
+        if (group_match_empty(g))
+            break;
+        step += FLAT_GROUP;
+        pos = (pos + step) & ht->max;
+    }
+    if (!val)
+        return ht->max + 1;
+
+    /* Keep 1/8 of the slots empty for the probes to terminate early */
+    if (ht->ctrl[free_slot] == FLAT_EMPTY
+        && (ht->count + ht->deleted + 1) * 8 > (ht->max + 1) * 7) {
+        flat_rehash(ht);
+        i = flat_free_slot(ht, mixed);
+    }
+    else {
+        i = free_slot;
+    }
+    if (ht->ctrl[i] == FLAT_DELETED)
+        ht->deleted--;
+    flat_set_ctrl(ht, i, (unsigned char)fp);
+    slot = &ht->slots[i];
+    slot->hash = hash;
+    slot->key  = key;
+    slot->klen = klen;
+    slot->val  = val;
+    ht->count++;
+    return i;
+}
+
+APR_DECLARE(apr_hash_t *) apr_hash_make_flat(apr_pool_t *pool,
+                                             apr_hashfunc_t hash_func)
+{
+    apr_hash_t *ht = hash_make(pool);
+
+    ht->hash_func = hash_func;
+    flat_alloc(ht, FLAT_INITIAL);
+    apr_pool_cleanup_register(pool, ht, flat_cleanup, apr_pool_cleanup_null);
+
+    return ht;
+}
+
+
+/*
+ * Frozen tables helpers.
+ */
+
+static APR_INLINE const apr_hash_record_t *frozen_find(const apr_hash_t *ht,
+                                                       const void *key,
+                                                       apr_ssize_t klen)
+{
+    unsigned int hash = hash_key(ht, key, &klen);
+    const unsigned int *bucket = &ht->offsets[hash & ht->max];
+    const char *rec = ht->frozen + bucket[0];
+    const char *end = ht->frozen + bucket[1];
+
+    while (rec < end) {
+        const apr_hash_record_t *record = (const apr_hash_record_t *)rec;
+        if (record->hash == hash
+            && record->klen == (apr_size_t)klen
+            && memcmp(record->key, key, klen) == 0)
+            return record;
+        rec += RECORD_SIZE(record->klen);
+    }
+    return NULL;
+}
+
+/* The (precomputed) hash of the current entry of an iteration */
+static unsigned int hash_this_hash(const apr_hash_index_t *hi)
+{
+    if (hi->ht->slots)
+        return hi->ht->slots[hi->index - 1].hash;
+    if (hi->ht->frozen)
+        return hi->record->hash;
+    return hi->this->hash;
+}
+
+APR_DECLARE(apr_hash_t *) apr_hash_freeze(apr_pool_t *pool,
+                                          const apr_hash_t *orig)
+{
+    apr_hash_t *ht;
+    apr_hash_index_t hix, *hi;
+    apr_size_t offsets_size, records_size = 0;
+    unsigned int nbuckets = 1, i;
+    const void *key;
+    apr_ssize_t klen;
+    void *val;
+
+    while (nbuckets < orig->count)
+        nbuckets *= 2;
+    offsets_size = APR_ALIGN_DEFAULT(sizeof(unsigned int) * (nbuckets + 1));
+
+    hix.ht = (apr_hash_t *)orig;
+    hix.index = 0;
+    hix.this = hix.next = NULL;
+    for (hi = apr_hash_next(&hix); hi; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, NULL, &klen, NULL);
+        records_size += RECORD_SIZE(klen);
+    }
+
+    ht = apr_palloc(pool, APR_ALIGN_DEFAULT(sizeof(apr_hash_t))
+                          + offsets_size + records_size);
+    ht->pool = pool;
+    ht->array = NULL;
+    ht->count = orig->count;
+    ht->max = nbuckets - 1;
+    ht->flags = orig->flags;
+    memcpy(ht->secret, orig->secret, sizeof(ht->secret));
+    ht->hash_func = orig->hash_func;
+    ht->free = NULL;
+    ht->slots = NULL;
+    ht->ctrl = NULL;
+    ht->deleted = 0;
+    ht->offsets = (unsigned int *)((char *)ht
+                                   + APR_ALIGN_DEFAULT(sizeof(apr_hash_t)));
+    ht->frozen = (char *)ht->offsets + offsets_size;
+
+    /* Sum up the size of the records of each bucket (at offsets[bucket +
+     * 1]), then the sizes to get the start of each bucket, used as the
+     * insertion point (hence the end of the bucket once filled, i.e. the
+     * start of the next one).
+     */
+    memset(ht->offsets, 0, offsets_size);
+    hix.index = 0;
+    hix.this = hix.next = NULL;
+    for (hi = apr_hash_next(&hix); hi; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, NULL, &klen, NULL);
+        ht->offsets[(hash_this_hash(hi) & ht->max) + 1] += RECORD_SIZE(klen);
+    }
+    for (i = 1; i <= nbuckets; i++)
+        ht->offsets[i] += ht->offsets[i - 1];
+
+    hix.index = 0;
+    hix.this = hix.next = NULL;
+    for (hi = apr_hash_next(&hix); hi; hi = apr_hash_next(hi)) {
+        unsigned int hash = hash_this_hash(hi);
+        apr_hash_record_t *record;
+
+        apr_hash_this(hi, &key, &klen, &val);
+        record = (apr_hash_record_t *)(ht->frozen
+                                       + ht->offsets[hash & ht->max]);
+        ht->offsets[hash & ht->max] += RECORD_SIZE(klen);
+        record->hash = hash;
+        record->klen = (unsigned int)klen;
+        record->val  = val;
+        memcpy(record->key, key, klen);
+        record->key[klen] = '\0';
+    }
+    for (i = nbuckets; i > 0; i--)
+        ht->offsets[i] = ht->offsets[i - 1];
+    ht->offsets[0] = 0;
+
+    return ht;
+}
+
 
 /*
  * Hash iteration functions.
@@ -126,6 +609,36 @@ APR_DECLARE(apr_hash_t *) apr_hash_make_custom(apr_pool_t *pool,
 
 APR_DECLARE(apr_hash_index_t *) apr_hash_next(apr_hash_index_t *hi)
 {
+    if (hi->ht->frozen) {
+        const apr_hash_t *ht = hi->ht;
+
+        if (hi->index >= ht->offsets[ht->max + 1])
+            return NULL;
+        hi->record = (const apr_hash_record_t *)(ht->frozen + hi->index);
+        hi->index += RECORD_SIZE(hi->record->klen);
+        return hi;
+    }
+
+    if (hi->ht->slots) {
+        const apr_hash_t *ht = hi->ht;
+        unsigned int i = hi->index;
+        apr_uint64_t bits;
+
+        /* skip a group of empty or deleted slots at a time */
+        for (; i <= ht->max; i += FLAT_GROUP) {
+            bits = ~group_load(ht->ctrl + i) & GROUP_MSB;
+            if (bits) {
+                i += group_first(bits);
+                if (i > ht->max) /* mirrored */
+                    break;
+                hi->index = i + 1;
+                return hi;
+            }
+        }
+        hi->index = ht->max + 1;
+        return NULL;
+    }
+
     hi->this = hi->next;
     while (!hi->this) {
         if (hi->index > hi->ht->max)
@@ -157,6 +670,22 @@ APR_DECLARE(void) apr_hash_this(apr_hash_index_t *hi,
                                 apr_ssize_t *klen,
                                 void **val)
 {
+    if (hi->ht->frozen) {
+        if (key)  *key  = hi->record->key;
+        if (klen) *klen = hi->record->klen;
+        if (val)  *val  = (void *)hi->record->val;
+        return;
+    }
+
+    if (hi->ht->slots) {
+        const apr_hash_slot_t *slot = &hi->ht->slots[hi->index - 1];
+
+        if (key)  *key  = slot->key;
+        if (klen) *klen = slot->klen;
+        if (val)  *val  = (void *)slot->val;
+        return;
+    }
+
     if (key)  *key  = hi->this->key;
     if (klen) *klen = hi->this->klen;
     if (val)  *val  = (void *)hi->this->val;
@@ -273,6 +802,135 @@ APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_default(const char *char_key,
     return hashfunc_default(char_key, klen, 0);
 }
 
+/*
+ * The fast hash function, of the wyhash family: the key is consumed 16
+ * (or 48) bytes at a time, each pair of 64-bit words being mixed by a
+ * 64x64->128 bit multiplication.  Short keys are read with (at most
+ * four) overlapping loads, no byte-at-a-time loop.
+ */
+
+static APR_INLINE void hash_mum(apr_uint64_t *a, apr_uint64_t *b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t)*a * *b;
+
+    *a = (apr_uint64_t)r;
+    *b = (apr_uint64_t)(r >> 64);
+#else
+    apr_uint64_t ha = *a >> 32, hb = *b >> 32;
+    apr_uint64_t la = (apr_uint32_t)*a, lb = (apr_uint32_t)*b;
+    apr_uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    apr_uint64_t t = rl + (rm0 << 32), lo, c = t < rl;
+
+    lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static APR_INLINE apr_uint64_t hash_mix(apr_uint64_t a, apr_uint64_t b)
+{
+    hash_mum(&a, &b);
+    return a ^ b;
+}
+
+static APR_INLINE apr_uint64_t hash_r8(const unsigned char *p)
+{
+    apr_uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static APR_INLINE apr_uint64_t hash_r4(const unsigned char *p)
+{
+    apr_uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static apr_uint64_t hashfunc_fast(const unsigned char *p, apr_size_t len,
+                                  apr_uint64_t seed)
+{
+    apr_uint64_t a, b;
+
+    if (len <= 16) {
+        if (len >= 4) {
+            apr_size_t off = (len >> 3) << 2;
+            a = (hash_r4(p) << 32) | hash_r4(p + off);
+            b = (hash_r4(p + len - 4) << 32) | hash_r4(p + len - 4 - off);
+        }
+        else if (len > 0) {
+            a = ((apr_uint64_t)p[0] << 16) | ((apr_uint64_t)p[len >> 1] << 8)
+                | p[len - 1];
+            b = 0;
+        }
+        else {
+            a = b = 0;
+        }
+    }
+    else {
+        apr_size_t i = len;
+
+        if (i > 48) {
+            apr_uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = hash_mix(hash_r8(p) ^ HASH_P1, hash_r8(p + 8) ^ seed);
+                see1 = hash_mix(hash_r8(p + 16) ^ HASH_P2,
+                                hash_r8(p + 24) ^ see1);
+                see2 = hash_mix(hash_r8(p + 32) ^ HASH_P3,
+                                hash_r8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = hash_mix(hash_r8(p) ^ HASH_P1, hash_r8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = hash_r8(p + i - 16);
+        b = hash_r8(p + i - 8);
+    }
+
+    a ^= HASH_P1;
+    b ^= seed;
+    hash_mum(&a, &b);
+    return hash_mix(a ^ HASH_P0 ^ len, b ^ HASH_P1);
+}
+
+APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_fast(const char *char_key,
+                                                   apr_ssize_t *klen)
+{
+    apr_uint64_t hash;
+
+    if (*klen == APR_HASH_KEY_STRING)
+        *klen = strlen(char_key);
+    hash = hashfunc_fast((const unsigned char *)char_key, *klen, HASH_P0);
+    return (unsigned int)(hash ^ (hash >> 32));
+}
+
+/*
+ * Hash a key with the function of the table.
+ */
+static unsigned int hash_key(const apr_hash_t *ht, const void *key,
+                             apr_ssize_t *klen)
+{
+    apr_uint64_t hash;
+
+    if (ht->hash_func)
+        return ht->hash_func(key, klen);
+
+    if (*klen == APR_HASH_KEY_STRING)
+        *klen = strlen(key);
+    if (ht->flags & APR_HASH_SIPHASH)
+        hash = apr_siphash13(key, *klen, (const unsigned char *)ht->secret);
+    else
+        hash = hashfunc_fast(key, *klen, ht->secret[0]);
+    return (unsigned int)(hash ^ (hash >> 32));
+}
+
 /*
  * This is where we keep the details of the hash function and control
  * the maximum collision rate.
@@ -290,10 +948,7 @@ static apr_hash_entry_t **find_entry(apr_hash_t *ht,
     apr_hash_entry_t **hep, *he;
     unsigned int hash;
 
-    if (ht->hash_func)
-        hash = ht->hash_func(key, &klen);
-    else
-        hash = hashfunc_default(key, &klen, ht->seed);
+    hash = hash_key(ht, key, &klen);
 
     /* scan linked list */
     for (hep = &ht->array[hash & ht->max], he = *hep;
@@ -321,6 +976,17 @@ static apr_hash_entry_t **find_entry(apr_hash_t *ht,
     return hep;
 }
 
+static apr_hash_t *hash_merge_generic(apr_pool_t *p,
+                                      const apr_hash_t *overlay,
+                                      const apr_hash_t *base,
+                                      void * (*merger)(apr_pool_t *p,
+                                                  const void *key,
+                                                  apr_ssize_t klen,
+                                                  const void *h1_val,
+                                                  const void *h2_val,
+                                                  const void *data),
+                                      const void *data);
+
 APR_DECLARE(apr_hash_t *) apr_hash_copy(apr_pool_t *pool,
                                         const apr_hash_t *orig)
 {
@@ -328,6 +994,25 @@ APR_DECLARE(apr_hash_t *) apr_hash_copy(apr_pool_t *pool,
     apr_hash_entry_t *new_vals;
     unsigned int i, j;
 
+    if (orig->frozen) {
+        return hash_merge_generic(pool, NULL, orig, NULL, NULL);
+    }
+
+    if (orig->slots) {
+        ht = hash_make(pool);
+        ht->flags = orig->flags;
+        memcpy(ht->secret, orig->secret, sizeof(ht->secret));
+        ht->hash_func = orig->hash_func;
+        flat_alloc(ht, orig->max + 1);
+        memcpy(ht->ctrl, orig->ctrl, orig->max + 1 + FLAT_GROUP);
+        memcpy(ht->slots, orig->slots, sizeof(apr_hash_slot_t) * (orig->max + 1));
+        ht->count = orig->count;
+        ht->deleted = orig->deleted;
+        apr_pool_cleanup_register(pool, ht, flat_cleanup,
+                                  apr_pool_cleanup_null);
+        return ht;
+    }
+
     ht = apr_palloc(pool, sizeof(apr_hash_t) +
                     sizeof(*ht->array) * (orig->max + 1) +
                     sizeof(apr_hash_entry_t) * orig->count);
@@ -335,9 +1020,15 @@ APR_DECLARE(apr_hash_t *) apr_hash_copy(apr_pool_t *pool,
     ht->free = NULL;
     ht->count = orig->count;
     ht->max = orig->max;
-    ht->seed = orig->seed;
+    ht->flags = orig->flags;
+    memcpy(ht->secret, orig->secret, sizeof(ht->secret));
     ht->hash_func = orig->hash_func;
     ht->array = (apr_hash_entry_t **)((char *)ht + sizeof(apr_hash_t));
+    ht->slots = NULL;
+    ht->ctrl = NULL;
+    ht->deleted = 0;
+    ht->frozen = NULL;
+    ht->offsets = NULL;
 
     new_vals = (apr_hash_entry_t *)((char *)(ht) + sizeof(apr_hash_t) +
                                     sizeof(*ht->array) * (orig->max + 1));
@@ -364,6 +1055,17 @@ APR_DECLARE(void *) apr_hash_get(apr_hash_t *ht,
                                  apr_ssize_t klen)
 {
     apr_hash_entry_t *he;
+
+    if (ht->frozen) {
+        const apr_hash_record_t *record = frozen_find(ht, key, klen);
+        return record ? (void *)record->val : NULL;
+    }
+
+    if (ht->slots) {
+        unsigned int i = flat_find(ht, key, klen, NULL);
+        return i <= ht->max ? (void *)ht->slots[i].val : NULL;
+    }
+
     he = *find_entry(ht, key, klen, NULL);
     if (he)
         return (void *)he->val;
@@ -377,6 +1079,40 @@ APR_DECLARE(void) apr_hash_set(apr_hash_t *ht,
                                const void *val)
 {
     apr_hash_entry_t **hep;
+
+    if (ht->frozen) {
+#if APR_POOL_DEBUG
+        fprintf(stderr, "apr_hash_set: the table is frozen\n");
+        abort();
+#endif
+        return;
+    }
+
+    if (ht->slots) {
+        unsigned int i = flat_find(ht, key, klen, val);
+        if (i <= ht->max) {
+            if (!val) {
+                /* delete entry, leaving a tombstone unless no group
+                 * holding this slot can be full (probes would have
+                 * stopped there anyway)
+                 */
+                if (flat_full_run(ht, i) < FLAT_GROUP) {
+                    flat_set_ctrl(ht, i, FLAT_EMPTY);
+                }
+                else {
+                    flat_set_ctrl(ht, i, FLAT_DELETED);
+                    ht->deleted++;
+                }
+                --ht->count;
+            }
+            else {
+                /* replace entry */
+                ht->slots[i].val = val;
+            }
+        }
+        return;
+    }
+
     hep = find_entry(ht, key, klen, val);
     if (*hep) {
         if (!val) {
@@ -405,6 +1141,23 @@ APR_DECLARE(void *) apr_hash_get_or_set(apr_hash_t *ht,
                                         const void *val)
 {
     apr_hash_entry_t **hep;
+
+    if (ht->frozen) {
+        const apr_hash_record_t *record = frozen_find(ht, key, klen);
+#if APR_POOL_DEBUG
+        if (!record && val) {
+            fprintf(stderr, "apr_hash_get_or_set: the table is frozen\n");
+            abort();
+        }
+#endif
+        return record ? (void *)record->val : NULL;
+    }
+
+    if (ht->slots) {
+        unsigned int i = flat_find(ht, key, klen, val);
+        return i <= ht->max ? (void *)ht->slots[i].val : NULL;
+    }
+
     hep = find_entry(ht, key, klen, val);
     if (*hep) {
         val = (*hep)->val;
@@ -426,6 +1179,22 @@ APR_DECLARE(unsigned int) apr_hash_count(apr_hash_t *ht)
 APR_DECLARE(void) apr_hash_clear(apr_hash_t *ht)
 {
     apr_hash_index_t *hi;
+
+    if (ht->frozen) {
+#if APR_POOL_DEBUG
+        fprintf(stderr, "apr_hash_clear: the table is frozen\n");
+        abort();
+#endif
+        return;
+    }
+
+    if (ht->slots) {
+        memset(ht->ctrl, FLAT_EMPTY, ht->max + 1 + FLAT_GROUP);
+        ht->count = 0;
+        ht->deleted = 0;
+        return;
+    }
+
     for (hi = apr_hash_first(NULL, ht); hi; hi = apr_hash_next(hi))
         apr_hash_set(ht, hi->this->key, hi->this->klen, NULL);
 }
@@ -437,6 +1206,61 @@ APR_DECLARE(apr_hash_t*) apr_hash_overlay(apr_pool_t *p,
     return apr_hash_merge(p, overlay, base, NULL, NULL);
 }
 
+/* Merge by iterating, when any of the tables is flat or frozen; the
+ * result is of the same kind as base (chained if frozen).  Without an
+ * overlay, this is a copy.
+ */
+static apr_hash_t *hash_merge_generic(apr_pool_t *p,
+                                      const apr_hash_t *overlay,
+                                      const apr_hash_t *base,
+                                      void * (*merger)(apr_pool_t *p,
+                                                  const void *key,
+                                                  apr_ssize_t klen,
+                                                  const void *h1_val,
+                                                  const void *h2_val,
+                                                  const void *data),
+                                      const void *data)
+{
+    apr_hash_t *res;
+    apr_hash_index_t hix, *hi;
+    const void *key;
+    apr_ssize_t klen;
+    void *val, *old;
+
+    if (base->slots) {
+        res = apr_hash_make_flat(p, base->hash_func);
+    }
+    else {
+        res = apr_hash_make_custom(p, base->hash_func);
+    }
+    res->flags = base->flags;
+    memcpy(res->secret, base->secret, sizeof(res->secret));
+
+    hix.ht = (apr_hash_t *)base;
+    hix.index = 0;
+    hix.this = hix.next = NULL;
+    for (hi = apr_hash_next(&hix); hi; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, &key, &klen, &val);
+        apr_hash_set(res, key, klen, val);
+    }
+
+    if (!overlay)
+        return res;
+
+    hix.ht = (apr_hash_t *)overlay;
+    hix.index = 0;
+    hix.this = hix.next = NULL;
+    for (hi = apr_hash_next(&hix); hi; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, &key, &klen, &val);
+        if (merger && (old = apr_hash_get(res, key, klen)) != NULL) {
+            val = (*merger)(p, key, klen, val, old, data);
+        }
+        apr_hash_set(res, key, klen, val);
+    }
+
+    return res;
+}
+
 APR_DECLARE(apr_hash_t *) apr_hash_merge(apr_pool_t *p,
                                          const apr_hash_t *overlay,
                                          const apr_hash_t *base,
@@ -471,16 +1295,26 @@ APR_DECLARE(apr_hash_t *) apr_hash_merge(apr_pool_t *p,
     }
 #endif
 
+    if (base->slots || overlay->slots || base->frozen || overlay->frozen) {
+        return hash_merge_generic(p, overlay, base, merger, data);
+    }
+
     res = apr_palloc(p, sizeof(apr_hash_t));
     res->pool = p;
     res->free = NULL;
+    res->slots = NULL;
+    res->ctrl = NULL;
+    res->deleted = 0;
+    res->frozen = NULL;
+    res->offsets = NULL;
     res->hash_func = base->hash_func;
     res->count = base->count;
     res->max = (overlay->max > base->max) ? overlay->max : base->max;
     if (base->count + overlay->count > res->max) {
         res->max = res->max * 2 + 1;
     }
-    res->seed = base->seed;
+    res->flags = base->flags;
+    memcpy(res->secret, base->secret, sizeof(res->secret));
     res->array = alloc_array(res, res->max);
     if (base->count + overlay->count) {
         new_vals = apr_palloc(p, sizeof(apr_hash_entry_t) *
@@ -502,10 +1336,7 @@ APR_DECLARE(apr_hash_t *) apr_hash_merge(apr_pool_t *p,
 
     for (k = 0; k <= overlay->max; k++) {
         for (iter = overlay->array[k]; iter; iter = iter->next) {
-            if (res->hash_func)
-                hash = res->hash_func(iter->key, &iter->klen);
-            else
-                hash = hashfunc_default(iter->key, &iter->klen, res->seed);
+            hash = hash_key(res, iter->key, &iter->klen);
             i = hash & res->max;
             for (ent = res->array[i]; ent; ent = ent->next) {
                 if ((ent->klen == iter->klen) &&
@@ -558,7 +1389,12 @@ APR_DECLARE(int) apr_hash_do(apr_hash_do_callback_fn_t *comp,
     if ((hi = apr_hash_next(&hix))) {
         /* Scan the entire table */
         do {
-            rv = (*comp)(rec, hi->this->key, hi->this->klen, hi->this->val);
+            const void *key;
+            apr_ssize_t klen;
+            void *val;
+
+            apr_hash_this(hi, &key, &klen, &val);
+            rv = (*comp)(rec, key, klen, val);
         } while (rv && (hi = apr_hash_next(hi)));
 
         if (rv == 0) {
@@ -27,10 +27,20 @@
 
 typedef struct {
     apr_skiplistnode **data;
+    size_t *ranks;              /* of the nodes, stack_q only */
     size_t size, pos;
     apr_pool_t *p;
 } apr_skiplist_q; 
 
+/* The nodes are allocated by slabs, of growing sizes */
+typedef struct apr_skiplist_slab {
+    struct apr_skiplist_slab *next;
+} apr_skiplist_slab;
+
+#define SKIPLIST_SLAB_HEADER    APR_ALIGN_DEFAULT(sizeof(apr_skiplist_slab))
+#define SKIPLIST_SLAB_MIN       8
+#define SKIPLIST_SLAB_MAX       256
+
 struct apr_skiplist {
     apr_skiplist_compare compare;
     apr_skiplist_compare comparek;
@@ -46,11 +56,19 @@ struct apr_skiplist {
     apr_array_header_t *memlist;
     apr_skiplist_q nodes_q,
                    stack_q;
+    apr_skiplist_slab *slabs;
+    apr_skiplistnode *slab_next;
+    size_t slab_avail, slab_nodes;
     apr_pool_t *pool;
 };
 
+/* The span of a node is the difference between the rank (position at
+ * the bottom level, from 1) of its next node and its own (the heads' being
+ * 0), it's meaningless if there is no next node.
+ */
 struct apr_skiplistnode {
     void *data;
+    size_t span;
     apr_skiplistnode *next;
     apr_skiplistnode *prev;
     apr_skiplistnode *down;
@@ -71,58 +89,50 @@ static int get_b_rand(void)
     return randseq & (1 << ph++);
 }
 
+/* The chunks of the same size are recycled in a free list, each chunk is
+ * preceded by the index of its size's memlist_t.
+ */
 typedef struct {
     size_t size;
-    apr_array_header_t *list;
+    void *free;
 } memlist_t;
 
-typedef struct {
-    void *ptr;
-    char inuse;
-} chunk_t;
+#define CHUNK_HEADER APR_ALIGN_DEFAULT(sizeof(size_t))
 
 APR_DECLARE(void *) apr_skiplist_alloc(apr_skiplist *sl, size_t size)
 {
     if (sl->pool) {
-        void *ptr;
-        int found_size = 0;
-        int i;
-        chunk_t *newchunk;
+        size_t *chunk;
         memlist_t *memlist = (memlist_t *)sl->memlist->elts;
+        int i;
         for (i = 0; i < sl->memlist->nelts; i++) {
-            if (memlist->size == size) {
-                int j;
-                chunk_t *chunk = (chunk_t *)memlist->list->elts;
-                found_size = 1;
-                for (j = 0; j < memlist->list->nelts; j++) {
-                    if (!chunk->inuse) {
-                        chunk->inuse = 1;
-                        return chunk->ptr;
-                    }
-                    chunk++;
-                }
-                break; /* no free of this size; punt */
+            if (memlist[i].size == size) {
+                break;
             }
-            memlist++;
-        }
-        /* no free chunks */
-        ptr = apr_palloc(sl->pool, size);
-        if (!ptr) {
-            return ptr;
         }
-        /*
-         * is this a new sized chunk? If so, we need to create a new
-         * array of them. Otherwise, re-use what we already have.
-         */
-        if (!found_size) {
+        if (i == sl->memlist->nelts) {
+            /* a new sized chunk */
             memlist = apr_array_push(sl->memlist);
             memlist->size = size;
-            memlist->list = apr_array_make(sl->pool, 20, sizeof(chunk_t));
+            memlist->free = NULL;
         }
-        newchunk = apr_array_push(memlist->list);
-        newchunk->ptr = ptr;
-        newchunk->inuse = 1;
-        return ptr;
+        else {
+            memlist += i;
+        }
+        if (memlist->free) {
+            void *ptr = memlist->free;
+            memlist->free = *(void **)ptr;
+            return ptr;
+        }
+        /* no free chunks */
+        chunk = apr_palloc(sl->pool, CHUNK_HEADER + (size > sizeof(void *)
+                                                     ? size
+                                                     : sizeof(void *)));
+        if (!chunk) {
+            return NULL;
+        }
+        *chunk = i;
+        return (char *)chunk + CHUNK_HEADER;
     }
     else {
         return malloc(size);
@@ -134,43 +144,58 @@ APR_DECLARE(void) apr_skiplist_free(apr_skiplist *sl, void *mem)
     if (!sl->pool) {
         free(mem);
     }
-    else {
-        int i;
+    else if (mem) {
         memlist_t *memlist = (memlist_t *)sl->memlist->elts;
-        for (i = 0; i < sl->memlist->nelts; i++) {
-            int j;
-            chunk_t *chunk = (chunk_t *)memlist->list->elts;
-            for (j = 0; j < memlist->list->nelts; j++) {
-                if (chunk->ptr == mem) {
-                    chunk->inuse = 0;
-                    return;
-                }
-                chunk++;
+        memlist += *(size_t *)((char *)mem - CHUNK_HEADER);
+        *(void **)mem = memlist->free;
+        memlist->free = mem;
+    }
+}
+
+static apr_status_t skiplist_qgrow(apr_skiplist_q *q, int ranked)
+{
+    apr_skiplistnode **data;
+    size_t *ranks = NULL;
+    size_t size = (q->pos) ? q->pos * 2 : 32;
+    if (q->p) {
+        data = apr_palloc(q->p, size * sizeof(*data));
+        if (data) {
+            memcpy(data, q->data, q->pos * sizeof(*data));
+        }
+        if (ranked) {
+            ranks = apr_palloc(q->p, size * sizeof(*ranks));
+            if (ranks) {
+                memcpy(ranks, q->ranks, q->pos * sizeof(*ranks));
             }
-            memlist++;
         }
     }
+    else {
+        data = realloc(q->data, size * sizeof(*data));
+        if (data) {
+            q->data = data;
+        }
+        if (ranked) {
+            ranks = realloc(q->ranks, size * sizeof(*ranks));
+        }
+    }
+    if (!data || (ranked && !ranks)) {
+        return APR_ENOMEM;
+    }
+    q->data = data;
+    if (ranked) {
+        q->ranks = ranks;
+    }
+    q->size = size;
+    return APR_SUCCESS;
 }
 
 static apr_status_t skiplist_qpush(apr_skiplist_q *q, apr_skiplistnode *m)
 {
     if (q->pos >= q->size) {
-        apr_skiplistnode **data;
-        size_t size = (q->pos) ? q->pos * 2 : 32;
-        if (q->p) {
-            data = apr_palloc(q->p, size * sizeof(*data));
-            if (data) {
-                memcpy(data, q->data, q->pos * sizeof(*data));
-            }
-        }
-        else {
-            data = realloc(q->data, size * sizeof(*data));
-        }
-        if (!data) {
-            return APR_ENOMEM;
+        apr_status_t rv = skiplist_qgrow(q, 0);
+        if (rv != APR_SUCCESS) {
+            return rv;
         }
-        q->data = data;
-        q->size = size;
     }
     q->data[q->pos++] = m;
     return APR_SUCCESS;
@@ -181,6 +206,32 @@ static APR_INLINE apr_skiplistnode *skiplist_qpop(apr_skiplist_q *q)
     return (q->pos > 0) ? q->data[--q->pos] : NULL;
 }
 
+/* Push/pop a node with its rank (stack_q) */
+static apr_status_t skiplist_qpush_rank(apr_skiplist_q *q,
+                                        apr_skiplistnode *m, size_t rank)
+{
+    if (q->pos >= q->size) {
+        apr_status_t rv = skiplist_qgrow(q, 1);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+    q->ranks[q->pos] = rank;
+    q->data[q->pos++] = m;
+    return APR_SUCCESS;
+}
+
+static APR_INLINE apr_skiplistnode *skiplist_qpop_rank(apr_skiplist_q *q,
+                                                       size_t *rank)
+{
+    if (q->pos > 0) {
+        --q->pos;
+        *rank = q->ranks[q->pos];
+        return q->data[q->pos];
+    }
+    return NULL;
+}
+
 static APR_INLINE void skiplist_qclear(apr_skiplist_q *q)
 {
     q->pos = 0;
@@ -190,12 +241,33 @@ static apr_skiplistnode *skiplist_new_node(apr_skiplist *sl)
 {
     apr_skiplistnode *m = skiplist_qpop(&sl->nodes_q);
     if (!m) {
-        if (sl->pool) {
-            m = apr_palloc(sl->pool, sizeof *m);
-        }
-        else {
-            m = malloc(sizeof *m);
+        if (!sl->slab_avail) {
+            apr_skiplist_slab *slab;
+            size_t n = sl->slab_nodes * 2, size;
+            if (n < SKIPLIST_SLAB_MIN) {
+                n = SKIPLIST_SLAB_MIN;
+            }
+            else if (n > SKIPLIST_SLAB_MAX) {
+                n = SKIPLIST_SLAB_MAX;
+            }
+            size = SKIPLIST_SLAB_HEADER + n * sizeof *m;
+            if (sl->pool) {
+                slab = apr_palloc(sl->pool, size);
+            }
+            else {
+                slab = malloc(size);
+            }
+            if (!slab) {
+                return NULL;
+            }
+            slab->next = sl->slabs;
+            sl->slabs = slab;
+            sl->slab_next = (apr_skiplistnode *)((char *)slab
+                                                 + SKIPLIST_SLAB_HEADER);
+            sl->slab_avail = sl->slab_nodes = n;
         }
+        m = sl->slab_next++;
+        sl->slab_avail--;
     }
     return m;
 }
@@ -333,32 +405,34 @@ static int skiplisti_find_compare(apr_skiplist *sl, void *data,
     return count;
 }
 
+/* The skip list (sli itself or one of its indexes) ordered by comp, if any */
+static apr_skiplist *skiplisti_index(apr_skiplist *sli,
+                                     apr_skiplist_compare comp)
+{
+    apr_skiplistnode *m;
+    if (!comp) {
+        return NULL;
+    }
+    if (comp == sli->compare || !sli->index) {
+        return sli;
+    }
+    apr_skiplist_find(sli->index, (void *)comp, &m);
+    return (m) ? (apr_skiplist *) m->data : NULL;
+}
+
 static void *find_compare(apr_skiplist *sli, void *data,
                           apr_skiplistnode **iter,
                           apr_skiplist_compare comp,
                           int last)
 {
     apr_skiplistnode *m;
-    apr_skiplist *sl;
-    if (!comp) {
+    apr_skiplist *sl = skiplisti_index(sli, comp);
+    if (!sl) {
         if (iter) {
             *iter = NULL;
         }
         return NULL;
     }
-    if (comp == sli->compare || !sli->index) {
-        sl = sli;
-    }
-    else {
-        apr_skiplist_find(sli->index, (void *)comp, &m);
-        if (!m) {
-            if (iter) {
-                *iter = NULL;
-            }
-            return NULL;
-        }
-        sl = (apr_skiplist *) m->data;
-    }
     skiplisti_find_compare(sl, data, &m, sl->comparek, last);
     if (iter) {
         *iter = m;
@@ -392,6 +466,90 @@ APR_DECLARE(void *) apr_skiplist_last(apr_skiplist *sl, void *data,
 }
 
 
+/* The number of elements lower than data, summing the spans of the nodes
+ * walked past.
+ */
+static size_t skiplisti_rank(apr_skiplist *sl, void *data,
+                             apr_skiplist_compare comp)
+{
+    size_t rank = 0;
+    apr_skiplistnode *m = sl->top;
+    while (m) {
+        if (m->next && comp(data, m->next->data) > 0) {
+            rank += m->span;
+            m = m->next;
+        }
+        else {
+            m = m->down;
+        }
+    }
+    return rank;
+}
+
+APR_DECLARE(size_t) apr_skiplist_rank_compare(apr_skiplist *sli, void *data,
+                                              apr_skiplist_compare comp)
+{
+    apr_skiplist *sl = skiplisti_index(sli, comp);
+    if (!sl) {
+        return 0;
+    }
+    return skiplisti_rank(sl, data, sl->comparek);
+}
+
+APR_DECLARE(size_t) apr_skiplist_rank(apr_skiplist *sl, void *data)
+{
+    return apr_skiplist_rank_compare(sl, data, sl->compare);
+}
+
+APR_DECLARE(size_t) apr_skiplist_range_count(apr_skiplist *sl, void *lo,
+                                             void *hi)
+{
+    size_t rlo, rhi;
+    if (!sl->comparek) {
+        return 0;
+    }
+    rlo = skiplisti_rank(sl, lo, sl->comparek);
+    rhi = skiplisti_rank(sl, hi, sl->comparek);
+    return (rhi > rlo) ? rhi - rlo : 0;
+}
+
+APR_DECLARE(void *) apr_skiplist_select_compare(apr_skiplist *sli,
+                                                size_t index,
+                                                apr_skiplistnode **iter,
+                                                apr_skiplist_compare comp)
+{
+    apr_skiplistnode *m = NULL;
+    apr_skiplist *sl = skiplisti_index(sli, comp);
+    if (sl && index < sl->size) {
+        /* Walk down to the node whose rank is index + 1 */
+        size_t rank = 0;
+        for (m = sl->top; m; m = m->down) {
+            while (m->next && rank + m->span <= index + 1) {
+                rank += m->span;
+                m = m->next;
+            }
+            if (rank == index + 1) {
+                break;
+            }
+        }
+        if (m) {
+            while (m->down) {
+                m = m->down;
+            }
+        }
+    }
+    if (iter) {
+        *iter = m;
+    }
+    return (m) ? m->data : NULL;
+}
+
+APR_DECLARE(void *) apr_skiplist_select(apr_skiplist *sl, size_t index,
+                                        apr_skiplistnode **iter)
+{
+    return apr_skiplist_select_compare(sl, index, iter, sl->compare);
+}
+
 APR_DECLARE(apr_skiplistnode *) apr_skiplist_getlist(apr_skiplist *sl)
 {
     if (!sl->bottom) {
@@ -436,12 +594,31 @@ static APR_INLINE int skiplist_height(const apr_skiplist *sl)
     return sl->height ? sl->height : 1;
 }
 
+/* forward declared */
+static apr_skiplistnode *insert_compare(apr_skiplist *sl, void *data,
+                                        apr_skiplist_compare comp, int add,
+                                        apr_skiplist_freefunc myfree);
+
+/* Insert the (bottom) node of an element in each index of sl */
+static void skiplisti_insert_index(apr_skiplist *sl, apr_skiplistnode *ret)
+{
+    apr_skiplistnode *p, *ni, *li = ret;
+    for (p = apr_skiplist_getlist(sl->index); p; apr_skiplist_next(sl->index, &p)) {
+        apr_skiplist *sli = (apr_skiplist *)p->data;
+        ni = insert_compare(sli, ret->data, sli->compare, 1, NULL);
+        li->nextindex = ni;
+        ni->previndex = li;
+        li = ni;
+    }
+}
+
 static apr_skiplistnode *insert_compare(apr_skiplist *sl, void *data,
                                         apr_skiplist_compare comp, int add,
                                         apr_skiplist_freefunc myfree)
 {
     apr_skiplistnode *m, *p, *tmp, *ret = NULL;
-    int ch, top_nh, nh = 1;
+    size_t rank, mrank, r;
+    int ch, nh = 1, level;
 
     ch = skiplist_height(sl);
     if (sl->preheight) {
@@ -454,16 +631,16 @@ static apr_skiplistnode *insert_compare(apr_skiplist *sl, void *data,
             nh++;
         }
     }
-    top_nh = nh;
 
-    /* Now we have in nh the height at which we wish to insert our new node,
-     * and in ch the current height: don't create skip paths to the inserted
-     * element until the walk down through the tree (which decrements ch)
-     * reaches nh. From there, any walk down pushes the current node on a
-     * stack (the node(s) after which we would insert) to pop back through
-     * for insertion later.
+    /* Now we have in nh the height at which we wish to insert our new node.
+     * Any walk down through the tree pushes the current node on a stack
+     * (the node(s) after which we would insert), with its rank, to pop back
+     * through for insertion from the bottom later: the nodes of the levels
+     * up to nh are linked to the new ones, and the spans of the ones above
+     * now cover one more element.
      */
     m = sl->top;
+    rank = 0;
     while (m) {
         /*
          * To maintain stability, dups (compared == 0) must be added
@@ -485,34 +662,40 @@ static apr_skiplistnode *insert_compare(apr_skiplist *sl, void *data,
                     skiplisti_remove(sl, m->next, myfree);
                     if (top != sl->top) {
                         m = sl->top;
+                        rank = 0;
                         skiplist_qclear(&sl->stack_q);
-                        ch = skiplist_height(sl);
-                        nh = top_nh;
                     }
                     continue;
                 }
             }
             if (compared >= 0) {
+                rank += m->span;
                 m = m->next;
                 continue;
             }
         }
-        if (ch <= nh) {
-            /* push on stack */
-            skiplist_qpush(&sl->stack_q, m);
-        }
+        /* push on stack */
+        skiplist_qpush_rank(&sl->stack_q, m, rank);
         m = m->down;
-        ch--;
     }
-    /* Pop the stack and insert nodes */
+    /* Pop the stack and insert nodes, at rank r */
     p = NULL;
-    while ((m = skiplist_qpop(&sl->stack_q))) {
+    r = (sl->stack_q.pos) ? sl->stack_q.ranks[sl->stack_q.pos - 1] + 1 : 1;
+    for (level = 1; (m = skiplist_qpop_rank(&sl->stack_q, &mrank)); level++) {
+        if (level > nh) {
+            if (m->next) {
+                m->span++;
+            }
+            continue;
+        }
         tmp = skiplist_new_node(sl);
         tmp->next = m->next;
         if (m->next) {
             m->next->prev = tmp;
+            tmp->span = m->span + 1 - (r - mrank);
         }
         m->next = tmp;
+        m->span = r - mrank;
         tmp->prev = m;
         tmp->up = NULL;
         tmp->nextindex = tmp->previndex = NULL;
@@ -535,6 +718,7 @@ static apr_skiplistnode *insert_compare(apr_skiplist *sl, void *data,
         tmp = skiplist_new_node(sl);
         m->up = m->prev = m->nextindex = m->previndex = NULL;
         m->next = tmp;
+        m->span = r;
         m->down = sl->top;
         m->data = NULL;
         m->sl = sl;
@@ -546,6 +730,7 @@ static apr_skiplistnode *insert_compare(apr_skiplist *sl, void *data,
         }
         sl->top = sl->topend = tmp->prev = m;
         tmp->up = tmp->next = tmp->nextindex = tmp->previndex = NULL;
+        tmp->span = 0;
         tmp->down = p;
         tmp->data = data;
         tmp->sl = sl;
@@ -563,15 +748,7 @@ static apr_skiplistnode *insert_compare(apr_skiplist *sl, void *data,
          * this is a external insertion, we must insert into each index as
          * well
          */
-        apr_skiplistnode *ni, *li;
-        li = ret;
-        for (p = apr_skiplist_getlist(sl->index); p; apr_skiplist_next(sl->index, &p)) {
-            apr_skiplist *sli = (apr_skiplist *)p->data;
-            ni = insert_compare(sli, ret->data, sli->compare, 1, NULL);
-            li->nextindex = ni;
-            ni->previndex = li;
-            li = ni;
-        }
+        skiplisti_insert_index(sl, ret);
     }
     sl->size++;
     return ret;
@@ -621,6 +798,100 @@ APR_DECLARE(apr_skiplistnode *) apr_skiplist_replace(apr_skiplist *sl,
     return apr_skiplist_replace_compare(sl, data, myfree, sl->compare);
 }
 
+APR_DECLARE(apr_status_t) apr_skiplist_build(apr_skiplist *sl,
+                                             void *const *elts, size_t nelts)
+{
+    apr_skiplistnode *m, *p, *tmp;
+    apr_status_t rv;
+    size_t i;
+    int h, level;
+
+    if (!sl->compare) {
+        return APR_EINVAL;
+    }
+    for (i = 1; i < nelts; i++) {
+        if (sl->compare(elts[i - 1], elts[i]) > 0) {
+            return APR_EINVAL;
+        }
+    }
+    if (sl->size) {
+        for (i = 0; i < nelts; i++) {
+            apr_skiplist_add(sl, elts[i]);
+        }
+        return APR_SUCCESS;
+    }
+
+    /* Append each element after the last node of the levels up to its
+     * height, kept in stack_q (from the bottom) with their ranks, like
+     * insert_compare() would but without searching.
+     */
+    skiplist_qclear(&sl->stack_q);
+    for (i = 0; i < nelts; i++) {
+        h = 1;
+        if (sl->preheight) {
+            while (h < sl->preheight && get_b_rand()) {
+                h++;
+            }
+        }
+        else {
+            while (h <= skiplist_height(sl) && get_b_rand()) {
+                h++;
+            }
+        }
+        for (; sl->height < h; sl->height++) {
+            m = skiplist_new_node(sl);
+            if (!m) {
+                return APR_ENOMEM;
+            }
+            rv = skiplist_qpush_rank(&sl->stack_q, m, 0);
+            if (rv != APR_SUCCESS) {
+                skiplist_put_node(sl, m);
+                return rv;
+            }
+            m->up = m->prev = m->next = m->nextindex = m->previndex = NULL;
+            m->span = 0;
+            m->down = sl->top;
+            m->data = NULL;
+            m->sl = sl;
+            if (sl->top) {
+                sl->top->up = m;
+            }
+            else {
+                sl->bottom = sl->bottomend = m;
+            }
+            sl->top = sl->topend = m;
+        }
+        p = NULL;
+        for (level = 0; level < h; level++) {
+            m = sl->stack_q.data[level];
+            tmp = skiplist_new_node(sl);
+            if (!tmp) {
+                return APR_ENOMEM;
+            }
+            tmp->next = tmp->up = tmp->nextindex = tmp->previndex = NULL;
+            tmp->span = 0;
+            tmp->prev = m;
+            tmp->down = p;
+            if (p) {
+                p->up = tmp;
+            }
+            tmp->data = elts[i];
+            tmp->sl = sl;
+            m->next = tmp;
+            m->span = i + 1 - sl->stack_q.ranks[level];
+            sl->stack_q.data[level] = tmp;
+            sl->stack_q.ranks[level] = i + 1;
+            p = tmp;
+        }
+        sl->size++;
+        if (sl->index != NULL) {
+            skiplisti_insert_index(sl, sl->stack_q.data[0]);
+        }
+    }
+    skiplist_qclear(&sl->stack_q);
+    return APR_SUCCESS;
+}
+
 #if 0
 void skiplist_print_struct(apr_skiplist * sl, char *prefix)
 {
@@ -643,7 +914,7 @@ void skiplist_print_struct(apr_skiplist * sl, char *prefix)
 static int skiplisti_remove(apr_skiplist *sl, apr_skiplistnode *m,
                             apr_skiplist_freefunc myfree)
 {
-    apr_skiplistnode *p;
+    apr_skiplistnode *p, *q;
     if (!m) {
         return 0;
     }
@@ -653,12 +924,25 @@ static int skiplisti_remove(apr_skiplist *sl, apr_skiplistnode *m,
     while (m->up) {
         m = m->up;
     }
+    /* The spans passing over the tower now cover one less element */
+    for (p = m;; ) {
+        for (q = p; q && !q->up; q = q->prev)
+            ;
+        if (!q) {
+            break;
+        }
+        p = q->up;
+        if (p->next) {
+            p->span--;
+        }
+    }
     do {
         p = m;
         /* take me out of the list */
         p->prev->next = p->next;
         if (p->next) {
             p->next->prev = p->prev;
+            p->prev->span += p->span - 1;
         }
         m = m->down;
         /* This only frees the actual data in the bottom one */
@@ -816,10 +1100,14 @@ APR_DECLARE(void) apr_skiplist_destroy(apr_skiplist *sl, apr_skiplist_freefunc m
         ;
     apr_skiplist_remove_all(sl, myfree);
     if (!sl->pool) {
-        while (sl->nodes_q.pos)
-            free(sl->nodes_q.data[--sl->nodes_q.pos]);
+        while (sl->slabs) {
+            apr_skiplist_slab *slab = sl->slabs;
+            sl->slabs = slab->next;
+            free(slab);
+        }
         free(sl->nodes_q.data);
         free(sl->stack_q.data);
+        free(sl->stack_q.ranks);
         free(sl);
     }
 }
@@ -28,6 +28,11 @@
 #include "apr_tables.h"
 #include "apr_strings.h"
 #include "apr_lib.h"
+#include "apr_cstr.h"
+#include "apr_thread_pool.h"
+#include "apr_atomic.h"
+#include "apr_thread_mutex.h"
+#include "apr_thread_cond.h"
 #if APR_HAVE_STDLIB_H
 #include <stdlib.h>
 #endif
@@ -104,19 +109,44 @@ APR_DECLARE(void *) apr_array_pop(apr_array_header_t *arr)
     return arr->elts + (arr->elt_size * (--arr->nelts));
 }
 
-APR_DECLARE(void *) apr_array_push(apr_array_header_t *arr)
+/* Grow the array to new_size elements (more than nalloc), in a single
+ * allocation out of its pool.  The old buffer cannot be given back to the
+ * pool, which is why apr_array_reserve() and apr_array_push_n() try hard
+ * to grow once only.
+ */
+static void array_grow(apr_array_header_t *arr, int new_size, int clear)
 {
-    if (arr->nelts == arr->nalloc) {
-        int new_size = (arr->nalloc <= 0) ? 1 : arr->nalloc * 2;
-        char *new_data;
+    apr_size_t elt_size = arr->elt_size;
+    apr_size_t old_size = (arr->nalloc > 0) ? arr->nalloc : 0;
+    char *new_data;
+
+    new_data = apr_palloc(arr->pool, elt_size * new_size);
+
+    memcpy(new_data, arr->elts, elt_size * old_size);
+    if (clear) {
+        memset(new_data + elt_size * old_size, 0,
+               elt_size * (new_size - old_size));
+    }
+    arr->elts = new_data;
+    arr->nalloc = new_size;
+}
 
-        new_data = apr_palloc(arr->pool, arr->elt_size * new_size);
+/* Double the size of the array until it holds at least nelts elements */
+static APR_INLINE int array_grown_size(const apr_array_header_t *arr,
+                                       int nelts)
+{
+    int new_size = (arr->nalloc <= 0) ? 1 : arr->nalloc * 2;
 
-        memcpy(new_data, arr->elts, arr->nalloc * arr->elt_size);
-        memset(new_data + arr->nalloc * arr->elt_size, 0,
-               arr->elt_size * (new_size - arr->nalloc));
-        arr->elts = new_data;
-        arr->nalloc = new_size;
+    while (new_size < nelts) {
+        new_size *= 2;
+    }
+    return new_size;
+}
+
+APR_DECLARE(void *) apr_array_push(apr_array_header_t *arr)
+{
+    if (arr->nelts == arr->nalloc) {
+        array_grow(arr, array_grown_size(arr, arr->nelts + 1), 1);
     }
 
     ++arr->nelts;
@@ -126,38 +156,43 @@ APR_DECLARE(void *) apr_array_push(apr_array_header_t *arr)
 static void *apr_array_push_noclear(apr_array_header_t *arr)
 {
     if (arr->nelts == arr->nalloc) {
-        int new_size = (arr->nalloc <= 0) ? 1 : arr->nalloc * 2;
-        char *new_data;
-
-        new_data = apr_palloc(arr->pool, arr->elt_size * new_size);
-
-        memcpy(new_data, arr->elts, arr->nalloc * arr->elt_size);
-        arr->elts = new_data;
-        arr->nalloc = new_size;
+        array_grow(arr, array_grown_size(arr, arr->nelts + 1), 0);
     }
 
     ++arr->nelts;
     return arr->elts + (arr->elt_size * (arr->nelts - 1));
 }
 
+APR_DECLARE(void *) apr_array_push_n(apr_array_header_t *arr, int nelts)
+{
+    void *first;
+
+    if (nelts <= 0) {
+        return arr->elts + (arr->elt_size * arr->nelts);
+    }
+    if (arr->nelts + nelts > arr->nalloc) {
+        array_grow(arr, array_grown_size(arr, arr->nelts + nelts), 1);
+    }
+
+    first = arr->elts + (arr->elt_size * arr->nelts);
+    arr->nelts += nelts;
+    return first;
+}
+
+APR_DECLARE(void) apr_array_reserve(apr_array_header_t *arr, int nelts)
+{
+    if (nelts > arr->nalloc) {
+        array_grow(arr, nelts, 1);
+    }
+}
+
 APR_DECLARE(void) apr_array_cat(apr_array_header_t *dst,
 			       const apr_array_header_t *src)
 {
     int elt_size = dst->elt_size;
 
     if (dst->nelts + src->nelts > dst->nalloc) {
-	int new_size = (dst->nalloc <= 0) ? 1 : dst->nalloc * 2;
-	char *new_data;
-
-	while (dst->nelts + src->nelts > new_size) {
-	    new_size *= 2;
-	}
-
-	new_data = apr_pcalloc(dst->pool, elt_size * new_size);
-	memcpy(new_data, dst->elts, dst->nalloc * elt_size);
-
-	dst->elts = new_data;
-	dst->nalloc = new_size;
+        array_grow(dst, array_grown_size(dst, dst->nelts + src->nelts), 1);
     }
 
     memcpy(dst->elts + dst->nelts * elt_size, src->elts,
@@ -281,6 +316,326 @@ APR_DECLARE(char *) apr_array_pstrcat(apr_pool_t *p,
     return res;
 }
 
+/*****************************************************************
+ *
+ * Sorting and searching arrays in place...
+ */
+
+APR_DECLARE(void) apr_array_sort(apr_array_header_t *arr,
+                                 apr_array_compare_fn_t *cmp)
+{
+    if (arr->nelts > 1) {
+        qsort(arr->elts, arr->nelts, arr->elt_size, cmp);
+    }
+}
+
+APR_DECLARE(void *) apr_array_bsearch(const apr_array_header_t *arr,
+                                      const void *key,
+                                      apr_array_compare_fn_t *cmp)
+{
+    if (arr->nelts <= 0) {
+        return NULL;
+    }
+    return bsearch(key, arr->elts, arr->nelts, arr->elt_size, cmp);
+}
+
+APR_DECLARE(void) apr_array_dedup(apr_array_header_t *arr,
+                                  apr_array_compare_fn_t *cmp)
+{
+    apr_size_t elt_size = arr->elt_size;
+    char *last, *cur, *end;
+
+    if (arr->nelts <= 1) {
+        return;
+    }
+
+    last = arr->elts;
+    end = arr->elts + elt_size * arr->nelts;
+    for (cur = last + elt_size; cur < end; cur += elt_size) {
+        if (cmp(last, cur) != 0) {
+            last += elt_size;
+            if (last != cur) {
+                memcpy(last, cur, elt_size);
+            }
+        }
+    }
+    arr->nelts = (int)((last - arr->elts) / elt_size) + 1;
+}
+
+#if APR_HAS_THREADS
+
+/* Below this many elements, qsort() alone is faster than dispatching the
+ * chunks to the threads (and merging them back).
+ */
+#define ARRAY_SORT_PARALLEL_MIN 16384
+
+typedef struct array_sort_t {
+    apr_array_compare_fn_t *cmp;
+    apr_size_t elt_size;
+    apr_thread_mutex_t *mutex;
+    apr_thread_cond_t *cond;
+    int pending;
+} array_sort_t;
+
+/* Sort the elements [lo, hi) of src in place if dst is NULL, otherwise
+ * merge the sorted runs [lo, mid) and [mid, hi) of src into dst.
+ */
+typedef struct array_sort_task_t {
+    array_sort_t *sort;
+    char *src;
+    char *dst;
+    apr_size_t lo, mid, hi;
+} array_sort_task_t;
+
+static void array_sort_run(array_sort_task_t *task)
+{
+    apr_array_compare_fn_t *cmp = task->sort->cmp;
+    apr_size_t elt_size = task->sort->elt_size;
+    char *a, *a_end, *b, *b_end, *out;
+
+    if (!task->dst) {
+        qsort(task->src + elt_size * task->lo, task->hi - task->lo,
+              elt_size, cmp);
+        return;
+    }
+
+    a = task->src + elt_size * task->lo;
+    a_end = b = task->src + elt_size * task->mid;
+    b_end = task->src + elt_size * task->hi;
+    out = task->dst + elt_size * task->lo;
+
+    /* Take from the left run on equality, and copy the remaining of the
+     * run left over in a single go.
+     */
+    while (a < a_end && b < b_end) {
+        if (cmp(b, a) < 0) {
+            memcpy(out, b, elt_size);
+            b += elt_size;
+        }
+        else {
+            memcpy(out, a, elt_size);
+            a += elt_size;
+        }
+        out += elt_size;
+    }
+    if (a < a_end) {
+        memcpy(out, a, a_end - a);
+    }
+    else if (b < b_end) {
+        memcpy(out, b, b_end - b);
+    }
+}
+
+/* The tasks pushed to the thread pool are run by whichever of a worker
+ * or the calling thread claims them first, so that the caller never waits
+ * for a task that no worker took (they may all be busy, waiting for their
+ * own sorts).  A worker can still pop a task claimed by the caller after
+ * the sort is done, so the claims are malloc()ed in a batch freed by the
+ * last one to release it.
+ */
+#define ARRAY_SORT_UNCLAIMED    0
+#define ARRAY_SORT_BY_WORKER    1
+#define ARRAY_SORT_BY_CALLER    2
+
+typedef struct array_sort_batch_t array_sort_batch_t;
+
+typedef struct array_sort_claim_t {
+    array_sort_batch_t *batch;
+    array_sort_task_t *task;
+    volatile apr_uint32_t state;
+} array_sort_claim_t;
+
+struct array_sort_batch_t {
+    volatile apr_uint32_t refs;
+    array_sort_claim_t claims[1];
+};
+
+static void * APR_THREAD_FUNC array_sort_thread(apr_thread_t *thd,
+                                                void *data)
+{
+    array_sort_claim_t *claim = data;
+    array_sort_batch_t *batch = claim->batch;
+
+    if (apr_atomic_cas32(&claim->state, ARRAY_SORT_BY_WORKER,
+                         ARRAY_SORT_UNCLAIMED) == ARRAY_SORT_UNCLAIMED) {
+        array_sort_t *sort = claim->task->sort;
+
+        array_sort_run(claim->task);
+
+        apr_thread_mutex_lock(sort->mutex);
+        if (--sort->pending == 0) {
+            apr_thread_cond_signal(sort->cond);
+        }
+        apr_thread_mutex_unlock(sort->mutex);
+    }
+    if (!apr_atomic_dec32(&batch->refs)) {
+        free(batch);
+    }
+
+    return NULL;
+}
+
+/* Push the tasks to the thread pool but the last one, which the calling
+ * thread runs itself before those that no worker claimed in the meantime,
+ * and then waits for the others.
+ */
+static void array_sort_tasks(array_sort_t *sort, array_sort_task_t *tasks,
+                             int ntasks, apr_thread_pool_t *tp)
+{
+    array_sort_batch_t *batch = NULL;
+    int i, nworkers = 0;
+
+    sort->pending = 0;
+    if (ntasks > 1) {
+        batch = malloc(sizeof(*batch)
+                       + (ntasks - 2) * sizeof(*batch->claims));
+    }
+    if (!batch) {
+        for (i = 0; i < ntasks; i++) {
+            array_sort_run(&tasks[i]);
+        }
+        return;
+    }
+    batch->refs = 1;
+    for (i = 0; i < ntasks - 1; i++) {
+        array_sort_claim_t *claim = &batch->claims[i];
+
+        claim->batch = batch;
+        claim->task = &tasks[i];
+        claim->state = ARRAY_SORT_UNCLAIMED;
+        apr_atomic_inc32(&batch->refs);
+        if (apr_thread_pool_push(tp, array_sort_thread, claim,
+                                 APR_THREAD_TASK_PRIORITY_NORMAL,
+                                 sort) != APR_SUCCESS) {
+            apr_atomic_dec32(&batch->refs);
+            claim->state = ARRAY_SORT_BY_CALLER;
+            array_sort_run(&tasks[i]);
+        }
+    }
+
+    array_sort_run(&tasks[ntasks - 1]);
+    for (i = 0; i < ntasks - 1; i++) {
+        apr_uint32_t state = apr_atomic_cas32(&batch->claims[i].state,
+                                              ARRAY_SORT_BY_CALLER,
+                                              ARRAY_SORT_UNCLAIMED);
+        if (state == ARRAY_SORT_UNCLAIMED) {
+            array_sort_run(&tasks[i]);
+        }
+        else if (state == ARRAY_SORT_BY_WORKER) {
+            nworkers++;
+        }
+    }
+
+    /* The workers count down from zero, maybe before we count up */
+    apr_thread_mutex_lock(sort->mutex);
+    sort->pending += nworkers;
+    while (sort->pending > 0) {
+        apr_thread_cond_wait(sort->cond, sort->mutex);
+    }
+    apr_thread_mutex_unlock(sort->mutex);
+
+    if (!apr_atomic_dec32(&batch->refs)) {
+        free(batch);
+    }
+}
+
+#endif /* APR_HAS_THREADS */
+
+APR_DECLARE(apr_status_t) apr_array_sort_parallel(apr_array_header_t *arr,
+                                                  apr_array_compare_fn_t *cmp,
+                                                  struct apr_thread_pool *tp)
+{
+#if APR_HAS_THREADS
+    apr_pool_t *p;
+    array_sort_t sort;
+    array_sort_task_t *tasks;
+    apr_size_t *bounds, nelts;
+    char *src, *dst;
+    apr_status_t rv;
+    int nchunks, nruns, i;
+
+    nelts = (arr->nelts > 0) ? arr->nelts : 0;
+    nchunks = tp ? (int)apr_thread_pool_thread_max_get(tp) + 1 : 1;
+    if (nchunks > (int)(nelts / (ARRAY_SORT_PARALLEL_MIN / 2))) {
+        nchunks = (int)(nelts / (ARRAY_SORT_PARALLEL_MIN / 2));
+    }
+    if (nchunks < 2) {
+        apr_array_sort(arr, cmp);
+        return APR_SUCCESS;
+    }
+
+    /* The merge buffer and everything else are allocated from a subpool,
+     * so they are given back when done.
+     */
+    rv = apr_pool_create(&p, arr->pool);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    if ((rv = apr_thread_mutex_create(&sort.mutex, APR_THREAD_MUTEX_DEFAULT,
+                                      p)) != APR_SUCCESS
+            || (rv = apr_thread_cond_create(&sort.cond, p)) != APR_SUCCESS) {
+        apr_pool_destroy(p);
+        return rv;
+    }
+    sort.cmp = cmp;
+    sort.elt_size = arr->elt_size;
+
+    tasks = apr_palloc(p, nchunks * sizeof(*tasks));
+    bounds = apr_palloc(p, (nchunks + 1) * sizeof(*bounds));
+    src = arr->elts;
+    dst = apr_palloc(p, sort.elt_size * nelts);
+
+    /* Sort the chunks... */
+    for (i = 0; i <= nchunks; i++) {
+        bounds[i] = nelts * i / nchunks;
+    }
+    for (i = 0; i < nchunks; i++) {
+        tasks[i].sort = &sort;
+        tasks[i].src = src;
+        tasks[i].dst = NULL;
+        tasks[i].lo = bounds[i];
+        tasks[i].mid = tasks[i].hi = bounds[i + 1];
+    }
+    array_sort_tasks(&sort, tasks, nchunks, tp);
+
+    /* ...then merge the runs pairwise, from src to dst and back, the odd
+     * one out (if any) being merged with nothing (copied).
+     */
+    for (nruns = nchunks; nruns > 1; nruns = (nruns + 1) / 2) {
+        int ntasks = (nruns + 1) / 2;
+
+        for (i = 0; i < ntasks; i++) {
+            tasks[i].sort = &sort;
+            tasks[i].src = src;
+            tasks[i].dst = dst;
+            tasks[i].lo = bounds[2 * i];
+            if (2 * i + 1 < nruns) {
+                tasks[i].mid = bounds[2 * i + 1];
+                tasks[i].hi = bounds[2 * i + 2];
+            }
+            else {
+                tasks[i].mid = tasks[i].hi = bounds[2 * i + 1];
+            }
+        }
+        array_sort_tasks(&sort, tasks, ntasks, tp);
+
+        for (i = 0; i < ntasks; i++) {
+            bounds[i + 1] = tasks[i].hi;
+        }
+        dst = src;
+        src = tasks[0].dst;
+    }
+    if (src != arr->elts) {
+        memcpy(arr->elts, src, sort.elt_size * nelts);
+    }
+
+    apr_pool_destroy(p);
+#else
+    apr_array_sort(arr, cmp);
+#endif /* APR_HAS_THREADS */
+    return APR_SUCCESS;
+}
+
 
 /*****************************************************************
  *
@@ -303,31 +658,64 @@ APR_DECLARE(char *) apr_array_pstrcat(apr_pool_t *p,
  * 4 bytes, normalized for case-insensitivity and packed into
  * an int...this checksum allows us to do a single integer
  * comparison as a fast check to determine whether we can
- * skip a strcasecmp
+ * skip an apr_cstr_casecmp()
+ *
+ * The 4 bytes are read at once unless they could cross a page
+ * boundary, then those after the end of the key are cleared.
  */
-#define COMPUTE_KEY_CHECKSUM(key, checksum)    \
-{                                              \
-    const char *k = (key);                     \
-    apr_uint32_t c = (apr_uint32_t)*k;         \
-    (checksum) = c;                            \
-    (checksum) <<= 8;                          \
-    if (c) {                                   \
-        c = (apr_uint32_t)*++k;                \
-        checksum |= c;                         \
-    }                                          \
-    (checksum) <<= 8;                          \
-    if (c) {                                   \
-        c = (apr_uint32_t)*++k;                \
-        checksum |= c;                         \
-    }                                          \
-    (checksum) <<= 8;                          \
-    if (c) {                                   \
-        c = (apr_uint32_t)*++k;                \
-        checksum |= c;                         \
-    }                                          \
-    checksum &= CASE_MASK;                     \
+static APR_INLINE apr_uint32_t table_key_checksum(const char *key)
+{
+    apr_uint32_t w, nul;
+
+    if (((apr_uintptr_t)key & 4095) > 4096 - 4) {
+        unsigned char buf[4] = { 0 };
+        int i;
+        for (i = 0; i < 4 && key[i]; i++) {
+            buf[i] = key[i];
+        }
+        memcpy(&w, buf, 4);
+        return w & CASE_MASK;
+    }
+    memcpy(&w, key, 4);
+
+    /* The high bit of each NUL byte (exactly) */
+    nul = ~(((w & 0x7f7f7f7f) + 0x7f7f7f7f) | w | 0x7f7f7f7f);
+#if APR_IS_BIGENDIAN
+    nul |= nul >> 1;
+    nul |= nul >> 2;
+    nul |= nul >> 4;
+    nul |= nul >> 8;
+    nul |= nul >> 16;
+    w &= ~nul;
+#else
+    w &= ((nul & (0 - nul)) >> 7) - 1;
+#endif
+    return w & CASE_MASK;
 }
 
+#define COMPUTE_KEY_CHECKSUM(key, checksum) \
+    ((checksum) = table_key_checksum(key))
+
+/* Tables of at least this many elements also get a full hash index of
+ * their keys (below that, the first-character index is as fast).
+ */
+#define TABLE_FULL_INDEX_MIN 32
+
+/* Tables of at least this many elements are compressed (overlapped) using
+ * a temporary hash of their keys, the smaller ones by sorting them.
+ */
+#define TABLE_COMPRESS_HASH_MIN 8
+
+/* A slot of the full hash index, elt is the offset of the entry within
+ * the table, or TABLE_SLOT_EMPTY.
+ */
+typedef struct table_slot_t {
+    apr_uint32_t hash;
+    int elt;
+} table_slot_t;
+
+#define TABLE_SLOT_EMPTY (-1)
+
 /** The opaque string-content table type */
 struct apr_table_t {
     /* This has to be first to promote backwards compatibility with
@@ -355,6 +743,24 @@ struct apr_table_t {
     apr_uint32_t index_initialized;
     int index_first[TABLE_HASH_SIZE];
     int index_last[TABLE_HASH_SIZE];
+    /* A full hash index, for the tables which have grown beyond
+     * TABLE_FULL_INDEX_MIN elements.  The way this works is:
+     *   - The case-insensitive hash of each key is stored in the
+     *     (open addressed, linearly probed) hash_index, along with
+     *     the offset of its entry within the table.
+     *   - Entries are only appended to the index, anything removing
+     *     or moving entries rebuilds it, so the slots of a key are
+     *     probed in the order of their entries in the table.
+     *   - The index is built by the functions modifying the table
+     *     only (never by a lookup), so that concurrent lookups in a
+     *     table which isn't modified anymore remain safe.
+     *   - It is in use if (and only if) hash_index_valid is not zero.
+     */
+    table_slot_t *hash_index;
+    int hash_index_size;
+    int hash_index_valid;
+    /* Whether the table is read-only (apr_table_freeze) */
+    int frozen;
 };
 
 /* keep state for apr_table_getm() */
@@ -387,6 +793,223 @@ static apr_table_entry_t *do_table_push(const char *func, apr_table_t *t)
 #define table_push(t)	((apr_table_entry_t *) apr_array_push_noclear(&(t)->a))
 #endif /* MAKE_TABLE_PROFILE */
 
+/* Leave a frozen table alone (see apr_table_freeze) */
+#if APR_POOL_DEBUG
+#define TABLE_CHECK_FROZEN(t, func) do { \
+    if ((t)->frozen) { \
+        fprintf(stderr, func ": the table is frozen\n"); \
+        abort(); \
+    } \
+} while (0)
+#else
+#define TABLE_CHECK_FROZEN(t, func) do { \
+    if ((t)->frozen) \
+        return; \
+} while (0)
+#endif
+
+/* Compute the case-insensitive hash of a key for the full hash index,
+ * normalizing the bytes like COMPUTE_KEY_CHECKSUM (so that the keys
+ * equal per apr_cstr_casecmp() have the same hash).  The key is read eight
+ * bytes at a time, the last (partial) word overlapping the previous one.
+ */
+#define TABLE_CASE_MASK64 \
+    (((apr_uint64_t)CASE_MASK << 32) | (apr_uint64_t)CASE_MASK)
+#define TABLE_HASH_MUL1 APR_UINT64_C(0x9e3779b97f4a7c15)
+#define TABLE_HASH_MUL2 APR_UINT64_C(0xbf58476d1ce4e5b9)
+
+static APR_INLINE apr_uint32_t table_key_hash(const char *key)
+{
+    const unsigned char *k = (const unsigned char *)key;
+    apr_size_t len = strlen(key);
+    apr_uint64_t hash = len, w;
+
+    for (; len >= 8; k += 8, len -= 8) {
+        memcpy(&w, k, 8);
+        hash = (hash ^ (w & TABLE_CASE_MASK64)) * TABLE_HASH_MUL1;
+        hash ^= hash >> 31;
+    }
+    if (len) {
+        if (len >= 4) {
+            apr_uint32_t lo, hi;
+            memcpy(&hi, k, 4);
+            memcpy(&lo, k + len - 4, 4);
+            w = ((apr_uint64_t)hi << 32) | lo;
+        }
+        else {
+            w = ((apr_uint64_t)k[0] << 16) | ((apr_uint64_t)k[len >> 1] << 8)
+                | k[len - 1];
+        }
+        hash = (hash ^ (w & TABLE_CASE_MASK64)) * TABLE_HASH_MUL1;
+        hash ^= hash >> 31;
+    }
+    hash *= TABLE_HASH_MUL2;
+    return (apr_uint32_t)(hash ^ (hash >> 32));
+}
+
+/* The hash of a key to be added to the table, needed only if the table
+ * has a full hash index (table_index_add() builds it otherwise).
+ */
+#define TABLE_INDEX_HASH(t, key) \
+    ((t)->hash_index_valid ? table_key_hash(key) : 0)
+
+static APR_INLINE void table_index_insert(apr_table_t *t, int elt,
+                                          apr_uint32_t hash)
+{
+    apr_uint32_t mask = t->hash_index_size - 1;
+    apr_uint32_t pos = hash & mask;
+
+    while (t->hash_index[pos].elt != TABLE_SLOT_EMPTY) {
+        pos = (pos + 1) & mask;
+    }
+    t->hash_index[pos].hash = hash;
+    t->hash_index[pos].elt = elt;
+}
+
+/* (Re)build the full hash index of a table, or stop using it if the
+ * table has become small enough (with some hysteresis, so that a table
+ * around the threshold doesn't build it over and over).
+ */
+static void table_index_build(apr_table_t *t)
+{
+    apr_table_entry_t *elts = (apr_table_entry_t *)t->a.elts;
+    int i;
+
+    if (t->a.nelts < (t->hash_index_valid ? TABLE_FULL_INDEX_MIN / 2
+                                          : TABLE_FULL_INDEX_MIN)) {
+        t->hash_index_valid = 0;
+        return;
+    }
+
+    /* Keep the load factor at most 1/2 */
+    if (t->hash_index_size < t->a.nelts * 2) {
+        int size = TABLE_FULL_INDEX_MIN * 2;
+        while (size < t->a.nelts * 2) {
+            size *= 2;
+        }
+        t->hash_index = apr_palloc(t->a.pool, size * sizeof(table_slot_t));
+        t->hash_index_size = size;
+    }
+    for (i = 0; i < t->hash_index_size; i++) {
+        t->hash_index[i].elt = TABLE_SLOT_EMPTY;
+    }
+    for (i = 0; i < t->a.nelts; i++) {
+        if (elts[i].key) {
+            table_index_insert(t, i, table_key_hash(elts[i].key));
+        }
+    }
+    t->hash_index_valid = 1;
+}
+
+/* Double the size of the full hash index, without hashing the keys
+ * again: the slots are moved from the start of a cluster (after an
+ * empty slot), so that the ones of a same key keep their order.
+ */
+static void table_index_grow(apr_table_t *t)
+{
+    table_slot_t *slots = t->hash_index;
+    apr_uint32_t mask = t->hash_index_size - 1;
+    apr_uint32_t pos = 0, i;
+    int size = t->hash_index_size * 2;
+
+    while (slots[pos].elt != TABLE_SLOT_EMPTY) {
+        pos++;
+    }
+
+    t->hash_index = apr_palloc(t->a.pool, size * sizeof(table_slot_t));
+    t->hash_index_size = size;
+    for (i = 0; i < (apr_uint32_t)size; i++) {
+        t->hash_index[i].elt = TABLE_SLOT_EMPTY;
+    }
+    for (i = 0; i <= mask; i++) {
+        const table_slot_t *slot = &slots[(pos + i) & mask];
+        if (slot->elt != TABLE_SLOT_EMPTY) {
+            table_index_insert(t, slot->elt, slot->hash);
+        }
+    }
+}
+
+/* Index the last entry pushed to the table, whose key hash is given by
+ * TABLE_INDEX_HASH().
+ */
+static APR_INLINE void table_index_add(apr_table_t *t, apr_uint32_t hash)
+{
+    if (t->hash_index_valid) {
+        if (t->a.nelts * 2 > t->hash_index_size) {
+            table_index_grow(t);
+        }
+        table_index_insert(t, t->a.nelts - 1, hash);
+    }
+    else if (t->a.nelts >= TABLE_FULL_INDEX_MIN) {
+        table_index_build(t);
+    }
+}
+
+/* Remove from the full hash index the entry which was at offset elt
+ * (and whose key has the given hash) before its removal from the table,
+ * the next entries having moved down by one.
+ */
+static void table_index_remove(apr_table_t *t, int elt, apr_uint32_t hash)
+{
+    table_slot_t *slots = t->hash_index;
+    apr_uint32_t mask = t->hash_index_size - 1;
+    apr_uint32_t pos = hash & mask, next;
+    int i;
+
+    while (slots[pos].elt != elt) {
+        pos = (pos + 1) & mask;
+    }
+
+    /* Fill the hole with the next slots of the cluster which can go there
+     * (i.e. whose probing starts before it), so that no tombstone is
+     * needed; the slots of a same key keep their order this way.
+     */
+    for (next = (pos + 1) & mask; slots[next].elt != TABLE_SLOT_EMPTY;
+         next = (next + 1) & mask) {
+        if (((next - slots[next].hash) & mask) >= ((next - pos) & mask)) {
+            slots[pos] = slots[next];
+            pos = next;
+        }
+    }
+    slots[pos].elt = TABLE_SLOT_EMPTY;
+
+    /* (branchless, the outcome is random) */
+    for (i = 0; i < t->hash_index_size; i++) {
+        slots[i].elt -= (slots[i].elt > elt);
+    }
+}
+
+/* Find the next entry with the given key in the full hash index, probing
+ * from *pos (initially the hash of the key).  Returns the offset of the
+ * entry within the table, or -1 if there is none.
+ */
+static APR_INLINE int table_index_next(const apr_table_t *t, const char *key,
+                                       apr_uint32_t hash, apr_uint32_t *pos)
+{
+    const apr_table_entry_t *elts = (const apr_table_entry_t *)t->a.elts;
+    apr_uint32_t mask = t->hash_index_size - 1;
+
+    for (;;) {
+        const table_slot_t *slot = &t->hash_index[*pos & mask];
+        *pos = (*pos & mask) + 1;
+        if (slot->elt == TABLE_SLOT_EMPTY) {
+            return -1;
+        }
+        if (slot->hash == hash
+                && !apr_cstr_casecmp(elts[slot->elt].key, key)) {
+            return slot->elt;
+        }
+    }
+}
+
+static APR_INLINE int table_index_find(const apr_table_t *t, const char *key,
+                                       apr_uint32_t hash)
+{
+    apr_uint32_t pos = hash;
+
+    return table_index_next(t, key, hash, &pos);
+}
+
 APR_DECLARE(const apr_array_header_t *) apr_table_elts(const apr_table_t *t)
 {
     return (const apr_array_header_t *)t;
@@ -406,6 +1029,10 @@ APR_DECLARE(apr_table_t *) apr_table_make(apr_pool_t *p, int nelts)
     t->creator = __builtin_return_address(0);
 #endif
     t->index_initialized = 0;
+    t->hash_index = NULL;
+    t->hash_index_size = 0;
+    t->hash_index_valid = 0;
+    t->frozen = 0;
     return t;
 }
 
@@ -428,6 +1055,18 @@ APR_DECLARE(apr_table_t *) apr_table_copy(apr_pool_t *p, const apr_table_t *t)
     memcpy(new->index_first, t->index_first, sizeof(int) * TABLE_HASH_SIZE);
     memcpy(new->index_last, t->index_last, sizeof(int) * TABLE_HASH_SIZE);
     new->index_initialized = t->index_initialized;
+    if (t->hash_index_valid) {
+        new->hash_index = apr_pmemdup(p, t->hash_index, t->hash_index_size
+                                                        * sizeof(table_slot_t));
+        new->hash_index_size = t->hash_index_size;
+        new->hash_index_valid = 1;
+    }
+    else {
+        new->hash_index = NULL;
+        new->hash_index_size = 0;
+        new->hash_index_valid = 0;
+    }
+    new->frozen = 0;
     return new;
 }
 
@@ -462,10 +1101,83 @@ static void table_reindex(apr_table_t *t)
     }
 }
 
+APR_DECLARE(apr_table_t *) apr_table_freeze(apr_pool_t *p,
+                                            const apr_table_t *t)
+{
+    const apr_table_entry_t *elts = (const apr_table_entry_t *)t->a.elts;
+    apr_table_entry_t *new_elts;
+    apr_table_t *new;
+    apr_size_t elts_size, index_size = 0, strings_size = 0;
+    int i, size = 0;
+    char *strings;
+
+    for (i = 0; i < t->a.nelts; i++) {
+        strings_size += strlen(elts[i].key) + 1;
+        if (elts[i].val) {
+            strings_size += strlen(elts[i].val) + 1;
+        }
+    }
+    elts_size = APR_ALIGN_DEFAULT(t->a.nelts * sizeof(apr_table_entry_t));
+    if (t->a.nelts >= TABLE_FULL_INDEX_MIN) {
+        for (size = TABLE_FULL_INDEX_MIN * 2; size < t->a.nelts * 2;) {
+            size *= 2;
+        }
+        index_size = size * sizeof(table_slot_t);
+    }
+
+    /* The table, its entries, index and strings in a single block */
+    new = apr_palloc(p, APR_ALIGN_DEFAULT(sizeof(apr_table_t)) + elts_size
+                        + index_size + strings_size);
+    new_elts = (apr_table_entry_t *)((char *)new
+                                     + APR_ALIGN_DEFAULT(sizeof(apr_table_t)));
+    strings = (char *)new_elts + elts_size + index_size;
+    for (i = 0; i < t->a.nelts; i++) {
+        apr_size_t len = strlen(elts[i].key) + 1;
+
+        new_elts[i].key = memcpy(strings, elts[i].key, len);
+        strings += len;
+        if (elts[i].val) {
+            len = strlen(elts[i].val) + 1;
+            new_elts[i].val = memcpy(strings, elts[i].val, len);
+            strings += len;
+        }
+        else {
+            new_elts[i].val = NULL;
+        }
+        new_elts[i].key_checksum = elts[i].key_checksum;
+    }
+
+    new->a.pool = p;
+    new->a.elt_size = sizeof(apr_table_entry_t);
+    new->a.nelts = new->a.nalloc = t->a.nelts;
+    new->a.elts = (char *)new_elts;
+#ifdef MAKE_TABLE_PROFILE
+    new->creator = __builtin_return_address(0);
+#endif
+    table_reindex(new);
+    new->hash_index_valid = 0;
+    new->hash_index_size = size;
+    new->hash_index = NULL;
+    if (size) {
+        new->hash_index = (table_slot_t *)((char *)new_elts + elts_size);
+        for (i = 0; i < size; i++) {
+            new->hash_index[i].elt = TABLE_SLOT_EMPTY;
+        }
+        for (i = 0; i < new->a.nelts; i++) {
+            table_index_insert(new, i, table_key_hash(new_elts[i].key));
+        }
+        new->hash_index_valid = 1;
+    }
+    new->frozen = 1;
+    return new;
+}
+
 APR_DECLARE(void) apr_table_clear(apr_table_t *t)
 {
+    TABLE_CHECK_FROZEN(t, "apr_table_clear");
     t->a.nelts = 0;
     t->index_initialized = 0;
+    t->hash_index_valid = 0;
 }
 
 APR_DECLARE(const char *) apr_table_get(const apr_table_t *t, const char *key)
@@ -483,13 +1195,17 @@ APR_DECLARE(const char *) apr_table_get(const apr_table_t *t, const char *key)
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
         return NULL;
     }
+    if (t->hash_index_valid) {
+        int i = table_index_find(t, key, table_key_hash(key));
+        return (i < 0) ? NULL : ((apr_table_entry_t *) t->a.elts)[i].val;
+    }
     COMPUTE_KEY_CHECKSUM(key, checksum);
     next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
 
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
+            !apr_cstr_casecmp(next_elt->key, key)) {
 	    return next_elt->val;
 	}
     }
@@ -503,23 +1219,38 @@ APR_DECLARE(void) apr_table_set(apr_table_t *t, const char *key,
     apr_table_entry_t *next_elt;
     apr_table_entry_t *end_elt;
     apr_table_entry_t *table_end;
-    apr_uint32_t checksum;
+    apr_uint32_t checksum, khash;
     int hash;
 
+    TABLE_CHECK_FROZEN(t, "apr_table_set");
     COMPUTE_KEY_CHECKSUM(key, checksum);
     hash = TABLE_HASH(key);
+    khash = TABLE_INDEX_HASH(t, key);
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
         t->index_first[hash] = t->a.nelts;
         TABLE_SET_INDEX_INITIALIZED(t, hash);
         goto add_new_elt;
     }
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
+    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];
+    if (t->hash_index_valid) {
+        apr_uint32_t pos = khash;
+        int i = table_index_next(t, key, khash, &pos);
+        if (i < 0) {
+            goto add_new_elt;
+        }
+        next_elt = ((apr_table_entry_t *) t->a.elts) + i;
+        if (table_index_next(t, key, khash, &pos) < 0) {
+            /* The only entry with this key, just overwrite it */
+            next_elt->val = apr_pstrdup(t->a.pool, val);
+            return;
+        }
+    }
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
     table_end =((apr_table_entry_t *) t->a.elts) + t->a.nelts;
 
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
+            !apr_cstr_casecmp(next_elt->key, key)) {
 
             /* Found an existing entry with the same key, so overwrite it */
 
@@ -531,7 +1262,7 @@ APR_DECLARE(void) apr_table_set(apr_table_t *t, const char *key,
             /* Remove any other instances of this key */
             for (next_elt++; next_elt <= end_elt; next_elt++) {
                 if ((checksum == next_elt->key_checksum) &&
-                    !strcasecmp(next_elt->key, key)) {
+                    !apr_cstr_casecmp(next_elt->key, key)) {
                     t->a.nelts--;
                     if (!dst_elt) {
                         dst_elt = next_elt;
@@ -556,6 +1287,7 @@ APR_DECLARE(void) apr_table_set(apr_table_t *t, const char *key,
             }
             if (must_reindex) {
                 table_reindex(t);
+                table_index_build(t);
             }
             return;
         }
@@ -567,6 +1299,7 @@ add_new_elt:
     next_elt->key = apr_pstrdup(t->a.pool, key);
     next_elt->val = apr_pstrdup(t->a.pool, val);
     next_elt->key_checksum = checksum;
+    table_index_add(t, khash);
 }
 
 APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
@@ -575,23 +1308,38 @@ APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
     apr_table_entry_t *next_elt;
     apr_table_entry_t *end_elt;
     apr_table_entry_t *table_end;
-    apr_uint32_t checksum;
+    apr_uint32_t checksum, khash;
     int hash;
 
+    TABLE_CHECK_FROZEN(t, "apr_table_setn");
     COMPUTE_KEY_CHECKSUM(key, checksum);
     hash = TABLE_HASH(key);
+    khash = TABLE_INDEX_HASH(t, key);
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
         t->index_first[hash] = t->a.nelts;
         TABLE_SET_INDEX_INITIALIZED(t, hash);
         goto add_new_elt;
     }
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
+    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];
+    if (t->hash_index_valid) {
+        apr_uint32_t pos = khash;
+        int i = table_index_next(t, key, khash, &pos);
+        if (i < 0) {
+            goto add_new_elt;
+        }
+        next_elt = ((apr_table_entry_t *) t->a.elts) + i;
+        if (table_index_next(t, key, khash, &pos) < 0) {
+            /* The only entry with this key, just overwrite it */
+            next_elt->val = (char *)val;
+            return;
+        }
+    }
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
     table_end =((apr_table_entry_t *) t->a.elts) + t->a.nelts;
 
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
+            !apr_cstr_casecmp(next_elt->key, key)) {
 
             /* Found an existing entry with the same key, so overwrite it */
 
@@ -603,7 +1351,7 @@ APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
             /* Remove any other instances of this key */
             for (next_elt++; next_elt <= end_elt; next_elt++) {
                 if ((checksum == next_elt->key_checksum) &&
-                    !strcasecmp(next_elt->key, key)) {
+                    !apr_cstr_casecmp(next_elt->key, key)) {
                     t->a.nelts--;
                     if (!dst_elt) {
                         dst_elt = next_elt;
@@ -628,6 +1376,7 @@ APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
             }
             if (must_reindex) {
                 table_reindex(t);
+                table_index_build(t);
             }
             return;
         }
@@ -639,6 +1388,7 @@ add_new_elt:
     next_elt->key = (char *)key;
     next_elt->val = (char *)val;
     next_elt->key_checksum = checksum;
+    table_index_add(t, khash);
 }
 
 APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
@@ -650,17 +1400,42 @@ APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
     int hash;
     int must_reindex;
 
+    TABLE_CHECK_FROZEN(t, "apr_table_unset");
     hash = TABLE_HASH(key);
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
         return;
     }
     COMPUTE_KEY_CHECKSUM(key, checksum);
     next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];
+    if (t->hash_index_valid) {
+        apr_uint32_t khash = table_key_hash(key), pos = khash;
+        int i = table_index_next(t, key, khash, &pos);
+        if (i < 0) {
+            return;
+        }
+        next_elt = ((apr_table_entry_t *) t->a.elts) + i;
+        if (table_index_next(t, key, khash, &pos) < 0) {
+            /* The only entry with this key, remove it from both indexes
+             * without hashing all the keys again
+             */
+            t->a.nelts--;
+            memmove(next_elt, next_elt + 1,
+                    (t->a.nelts - i) * sizeof(apr_table_entry_t));
+            table_reindex(t);
+            if (t->a.nelts >= TABLE_FULL_INDEX_MIN / 2) {
+                table_index_remove(t, i, khash);
+            }
+            else {
+                t->hash_index_valid = 0;
+            }
+            return;
+        }
+    }
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
     must_reindex = 0;
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
+            !apr_cstr_casecmp(next_elt->key, key)) {
 
             /* Found a match: remove this entry, plus any additional
              * matches for the same key that might follow
@@ -671,7 +1446,7 @@ APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
             dst_elt = next_elt;
             for (next_elt++; next_elt <= end_elt; next_elt++) {
                 if ((checksum == next_elt->key_checksum) &&
-                    !strcasecmp(next_elt->key, key)) {
+                    !apr_cstr_casecmp(next_elt->key, key)) {
                     t->a.nelts--;
                 }
                 else {
@@ -692,6 +1467,7 @@ APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
     }
     if (must_reindex) {
         table_reindex(t);
+        table_index_build(t);
     }
 }
 
@@ -700,22 +1476,31 @@ APR_DECLARE(void) apr_table_merge(apr_table_t *t, const char *key,
 {
     apr_table_entry_t *next_elt;
     apr_table_entry_t *end_elt;
-    apr_uint32_t checksum;
+    apr_uint32_t checksum, khash;
     int hash;
 
+    TABLE_CHECK_FROZEN(t, "apr_table_merge");
     COMPUTE_KEY_CHECKSUM(key, checksum);
     hash = TABLE_HASH(key);
+    khash = TABLE_INDEX_HASH(t, key);
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
         t->index_first[hash] = t->a.nelts;
         TABLE_SET_INDEX_INITIALIZED(t, hash);
         goto add_new_elt;
     }
     next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];
+    if (t->hash_index_valid) {
+        int i = table_index_find(t, key, khash);
+        if (i < 0) {
+            goto add_new_elt;
+        }
+        next_elt = ((apr_table_entry_t *) t->a.elts) + i;
+    }
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
 
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
+            !apr_cstr_casecmp(next_elt->key, key)) {
 
             /* Found an existing entry with the same key, so merge with it */
 	    next_elt->val = apr_pstrcat(t->a.pool, next_elt->val, ", ",
@@ -730,6 +1515,7 @@ add_new_elt:
     next_elt->key = apr_pstrdup(t->a.pool, key);
     next_elt->val = apr_pstrdup(t->a.pool, val);
     next_elt->key_checksum = checksum;
+    table_index_add(t, khash);
 }
 
 APR_DECLARE(void) apr_table_mergen(apr_table_t *t, const char *key,
@@ -737,9 +1523,10 @@ APR_DECLARE(void) apr_table_mergen(apr_table_t *t, const char *key,
 {
     apr_table_entry_t *next_elt;
     apr_table_entry_t *end_elt;
-    apr_uint32_t checksum;
+    apr_uint32_t checksum, khash;
     int hash;
 
+    TABLE_CHECK_FROZEN(t, "apr_table_mergen");
 #if APR_POOL_DEBUG
     {
 	apr_pool_t *pool;
@@ -760,17 +1547,25 @@ APR_DECLARE(void) apr_table_mergen(apr_table_t *t, const char *key,
 
     COMPUTE_KEY_CHECKSUM(key, checksum);
     hash = TABLE_HASH(key);
+    khash = TABLE_INDEX_HASH(t, key);
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
         t->index_first[hash] = t->a.nelts;
         TABLE_SET_INDEX_INITIALIZED(t, hash);
         goto add_new_elt;
     }
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
+    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];
+    if (t->hash_index_valid) {
+        int i = table_index_find(t, key, khash);
+        if (i < 0) {
+            goto add_new_elt;
+        }
+        next_elt = ((apr_table_entry_t *) t->a.elts) + i;
+    }
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
 
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
+            !apr_cstr_casecmp(next_elt->key, key)) {
 
             /* Found an existing entry with the same key, so merge with it */
 	    next_elt->val = apr_pstrcat(t->a.pool, next_elt->val, ", ",
@@ -785,15 +1580,17 @@ add_new_elt:
     next_elt->key = (char *)key;
     next_elt->val = (char *)val;
     next_elt->key_checksum = checksum;
+    table_index_add(t, khash);
 }
 
 APR_DECLARE(void) apr_table_add(apr_table_t *t, const char *key,
 			       const char *val)
 {
     apr_table_entry_t *elts;
-    apr_uint32_t checksum;
+    apr_uint32_t checksum, khash;
     int hash;
 
+    TABLE_CHECK_FROZEN(t, "apr_table_add");
     hash = TABLE_HASH(key);
     t->index_last[hash] = t->a.nelts;
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
@@ -801,19 +1598,22 @@ APR_DECLARE(void) apr_table_add(apr_table_t *t, const char *key,
         TABLE_SET_INDEX_INITIALIZED(t, hash);
     }
     COMPUTE_KEY_CHECKSUM(key, checksum);
+    khash = TABLE_INDEX_HASH(t, key);
     elts = (apr_table_entry_t *) table_push(t);
     elts->key = apr_pstrdup(t->a.pool, key);
     elts->val = apr_pstrdup(t->a.pool, val);
     elts->key_checksum = checksum;
+    table_index_add(t, khash);
 }
 
 APR_DECLARE(void) apr_table_addn(apr_table_t *t, const char *key,
 				const char *val)
 {
     apr_table_entry_t *elts;
-    apr_uint32_t checksum;
+    apr_uint32_t checksum, khash;
     int hash;
 
+    TABLE_CHECK_FROZEN(t, "apr_table_addn");
 #if APR_POOL_DEBUG
     {
 	if (!apr_pool_is_ancestor(apr_pool_find(key), t->a.pool)) {
@@ -834,10 +1634,12 @@ APR_DECLARE(void) apr_table_addn(apr_table_t *t, const char *key,
         TABLE_SET_INDEX_INITIALIZED(t, hash);
     }
     COMPUTE_KEY_CHECKSUM(key, checksum);
+    khash = TABLE_INDEX_HASH(t, key);
     elts = (apr_table_entry_t *) table_push(t);
     elts->key = (char *)key;
     elts->val = (char *)val;
     elts->key_checksum = checksum;
+    table_index_add(t, khash);
 }
 
 APR_DECLARE(apr_table_t *) apr_table_overlay(apr_pool_t *p,
@@ -868,7 +1670,12 @@ APR_DECLARE(apr_table_t *) apr_table_overlay(apr_pool_t *p,
     res->a.pool = p;
     copy_array_hdr_core(&res->a, &overlay->a);
     apr_array_cat(&res->a, &base->a);
+    res->hash_index = NULL;
+    res->hash_index_size = 0;
+    res->hash_index_valid = 0;
+    res->frozen = 0;
     table_reindex(res);
+    table_index_build(res);
     return res;
 }
 
@@ -971,13 +1778,20 @@ APR_DECLARE(int) apr_table_vdo(apr_table_do_callback_fn_t *comp,
         if (argp) {
             /* Scan for entries that match the next key */
             int hash = TABLE_HASH(argp);
-            if (TABLE_INDEX_IS_INITIALIZED(t, hash)) {
+            if (TABLE_INDEX_IS_INITIALIZED(t, hash) && t->hash_index_valid) {
+                apr_uint32_t khash = table_key_hash(argp), pos = khash;
+                while (rv && (i = table_index_next(t, argp, khash,
+                                                   &pos)) >= 0) {
+                    rv = (*comp) (rec, elts[i].key, elts[i].val);
+                }
+            }
+            else if (TABLE_INDEX_IS_INITIALIZED(t, hash)) {
                 apr_uint32_t checksum;
                 COMPUTE_KEY_CHECKSUM(argp, checksum);
                 for (i = t->index_first[hash];
                      rv && (i <= t->index_last[hash]); ++i) {
                     if (elts[i].key && (checksum == elts[i].key_checksum) &&
-                                        !strcasecmp(elts[i].key, argp)) {
+                                        !apr_cstr_casecmp(elts[i].key, argp)) {
                         rv = (*comp) (rec, elts[i].key, elts[i].val);
                     }
                 }
@@ -1013,7 +1827,7 @@ static apr_table_entry_t **table_mergesort(apr_pool_t *pool,
 
     /* First pass: sort pairs of elements (blocksize=1) */
     for (i = 0; i + 1 < n; i += 2) {
-        if (strcasecmp(values[i]->key, values[i + 1]->key) > 0) {
+        if (apr_cstr_casecmp(values[i]->key, values[i + 1]->key) > 0) {
             apr_table_entry_t *swap = values[i];
             values[i] = values[i + 1];
             values[i + 1] = swap;
@@ -1063,7 +1877,7 @@ static apr_table_entry_t **table_mergesort(apr_pool_t *pool,
                     }
                     break;
                 }
-                if (strcasecmp(values[block1_start]->key,
+                if (apr_cstr_casecmp(values[block1_start]->key,
                                values[block2_start]->key) > 0) {
                     *dst++ = values[block2_start++];
                 }
@@ -1093,7 +1907,11 @@ static apr_table_entry_t **table_mergesort(apr_pool_t *pool,
     return values;
 }
 
-APR_DECLARE(void) apr_table_compress(apr_table_t *t, unsigned flags)
+/* Remove the duplicate keys of a table by sorting (pointers to) its
+ * entries, the duplicates are marked with a NULL key.  Returns whether
+ * some were found.
+ */
+static int table_compress_sort(apr_table_t *t, unsigned flags)
 {
     apr_table_entry_t **sort_array;
     apr_table_entry_t **sort_next;
@@ -1103,14 +1921,6 @@ APR_DECLARE(void) apr_table_compress(apr_table_t *t, unsigned flags)
     int i;
     int dups_found;
 
-    if (flags == APR_OVERLAP_TABLES_ADD) {
-        return;
-    }
-
-    if (t->a.nelts <= 1) {
-        return;
-    }
-
     /* Copy pointers to all the table elements into an
      * array and sort to allow for easy detection of
      * duplicate keys
@@ -1138,12 +1948,12 @@ APR_DECLARE(void) apr_table_compress(apr_table_t *t, unsigned flags)
     last = sort_next++;
     while (sort_next < sort_end) {
         if (((*sort_next)->key_checksum == (*last)->key_checksum) &&
-            !strcasecmp((*sort_next)->key, (*last)->key)) {
+            !apr_cstr_casecmp((*sort_next)->key, (*last)->key)) {
             apr_table_entry_t **dup_last = sort_next + 1;
             dups_found = 1;
             while ((dup_last < sort_end) &&
                    ((*dup_last)->key_checksum == (*last)->key_checksum) &&
-                   !strcasecmp((*dup_last)->key, (*last)->key)) {
+                   !apr_cstr_casecmp((*dup_last)->key, (*last)->key)) {
                 dup_last++;
             }
             dup_last--; /* Elements from last through dup_last, inclusive,
@@ -1188,6 +1998,132 @@ APR_DECLARE(void) apr_table_compress(apr_table_t *t, unsigned flags)
         }
     }
 
+    return dups_found;
+}
+
+/* A slot of the temporary hash of table_compress_hash(), for a key: the
+ * offsets of its first and last entries within the table, first being
+ * TABLE_SLOT_EMPTY for an empty slot.
+ */
+typedef struct table_compress_slot_t {
+    apr_uint32_t hash;
+    int first;
+    int last;
+} table_compress_slot_t;
+
+/* Same as table_compress_sort() in linear time, using a temporary (open
+ * addressed) hash of the keys to find the first entry of each.  For
+ * APR_OVERLAP_TABLES_MERGE, the entries of a same key are chained in
+ * order by next[] to merge their values once all found.
+ */
+static int table_compress_hash(apr_table_t *t, unsigned flags)
+{
+    apr_table_entry_t *elts = (apr_table_entry_t *)t->a.elts;
+    table_compress_slot_t *slots, *slot;
+    apr_uint32_t size, mask, pos;
+    int *next = NULL;
+    int i, dups_found = 0;
+
+    /* Keep the load factor at most 1/2 */
+    for (size = 2; size < (apr_uint32_t)t->a.nelts * 2; size *= 2)
+        ;
+    mask = size - 1;
+    slots = apr_palloc(t->a.pool, size * sizeof(table_compress_slot_t));
+    for (pos = 0; pos < size; pos++) {
+        slots[pos].first = TABLE_SLOT_EMPTY;
+    }
+    if (flags == APR_OVERLAP_TABLES_MERGE) {
+        next = apr_palloc(t->a.pool, t->a.nelts * sizeof(int));
+    }
+
+    for (i = 0; i < t->a.nelts; i++) {
+        apr_uint32_t hash = table_key_hash(elts[i].key);
+
+        for (pos = hash & mask;; pos = (pos + 1) & mask) {
+            slot = &slots[pos];
+            if (slot->first == TABLE_SLOT_EMPTY) {
+                break;
+            }
+            if (slot->hash == hash
+                    && elts[slot->first].key_checksum == elts[i].key_checksum
+                    && !apr_cstr_casecmp(elts[slot->first].key,
+                                         elts[i].key)) {
+                break;
+            }
+        }
+        if (slot->first == TABLE_SLOT_EMPTY) {
+            slot->hash = hash;
+            slot->first = slot->last = i;
+            continue;
+        }
+
+        dups_found = 1;
+        if (next) {
+            next[slot->last] = i;
+            slot->last = i;
+        }
+        else { /* overwrite */
+            elts[slot->first].val = elts[i].val;
+        }
+        elts[i].key = NULL;
+    }
+
+    if (next && dups_found) {
+        for (pos = 0; pos < size; pos++) {
+            apr_size_t len = 0;
+            char *new_val, *val_dst;
+
+            slot = &slots[pos];
+            if (slot->first == TABLE_SLOT_EMPTY || slot->first == slot->last) {
+                continue;
+            }
+            for (i = slot->first;; i = next[i]) {
+                len += strlen(elts[i].val);
+                len += 2; /* for ", " or trailing null */
+                if (i == slot->last) {
+                    break;
+                }
+            }
+            new_val = (char *)apr_palloc(t->a.pool, len);
+            val_dst = new_val;
+            for (i = slot->first;; i = next[i]) {
+                len = strlen(elts[i].val);
+                memcpy(val_dst, elts[i].val, len);
+                val_dst += len;
+                if (i == slot->last) {
+                    *val_dst = 0;
+                    break;
+                }
+                *val_dst++ = ',';
+                *val_dst++ = ' ';
+            }
+            elts[slot->first].val = new_val;
+        }
+    }
+
+    return dups_found;
+}
+
+APR_DECLARE(void) apr_table_compress(apr_table_t *t, unsigned flags)
+{
+    int dups_found;
+
+    TABLE_CHECK_FROZEN(t, "apr_table_compress");
+    if (flags == APR_OVERLAP_TABLES_ADD) {
+        return;
+    }
+
+    if (t->a.nelts <= 1) {
+        return;
+    }
+
+    if (t->a.nelts < TABLE_COMPRESS_HASH_MIN) {
+        dups_found = table_compress_sort(t, flags);
+    }
+    else {
+        dups_found = table_compress_hash(t, flags);
+    }
+
     /* Shift elements to the left to fill holes left by removing duplicates */
     if (dups_found) {
         apr_table_entry_t *src = (apr_table_entry_t *)t->a.elts;
@@ -1202,6 +2138,7 @@ APR_DECLARE(void) apr_table_compress(apr_table_t *t, unsigned flags)
     }
 
     table_reindex(t);
+    table_index_build(t);
 }
 
 static void apr_table_cat(apr_table_t *t, const apr_table_t *s)
@@ -1215,24 +2152,36 @@ static void apr_table_cat(apr_table_t *t, const apr_table_t *s)
         memcpy(t->index_first,s->index_first,sizeof(int) * TABLE_HASH_SIZE);
         memcpy(t->index_last, s->index_last, sizeof(int) * TABLE_HASH_SIZE);
         t->index_initialized = s->index_initialized;
-        return;
     }
-
-    for (idx = 0; idx < TABLE_HASH_SIZE; ++idx) {
-        if (TABLE_INDEX_IS_INITIALIZED(s, idx)) {
-            t->index_last[idx] = s->index_last[idx] + n;
-            if (!TABLE_INDEX_IS_INITIALIZED(t, idx)) {
-                t->index_first[idx] = s->index_first[idx] + n;
+    else {
+        for (idx = 0; idx < TABLE_HASH_SIZE; ++idx) {
+            if (TABLE_INDEX_IS_INITIALIZED(s, idx)) {
+                t->index_last[idx] = s->index_last[idx] + n;
+                if (!TABLE_INDEX_IS_INITIALIZED(t, idx)) {
+                    t->index_first[idx] = s->index_first[idx] + n;
+                }
             }
         }
+
+        t->index_initialized |= s->index_initialized;
     }
 
-    t->index_initialized |= s->index_initialized;
+    if (t->hash_index_valid && t->a.nelts * 2 <= t->hash_index_size) {
+        apr_table_entry_t *elts = (apr_table_entry_t *)t->a.elts;
+        for (idx = n; idx < t->a.nelts; ++idx) {
+            table_index_insert(t, idx, table_key_hash(elts[idx].key));
+        }
+    }
+    else if (t->a.nelts >= TABLE_FULL_INDEX_MIN) {
+        table_index_build(t);
+    }
 }
 
 APR_DECLARE(void) apr_table_overlap(apr_table_t *a, const apr_table_t *b,
 				    unsigned flags)
 {
+    TABLE_CHECK_FROZEN(a, "apr_table_overlap");
+
     if (a->a.nelts + b->a.nelts == 0) {
         return;
     }
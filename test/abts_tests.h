@@ -40,6 +40,7 @@ const struct testlist {
     {testglobalmutex},
 #endif
     {testhash},
+    {testchash},
     {testhooks},
     {testipsub},
     {testlock},
@@ -90,6 +91,11 @@ const struct testlist {
     {testreslist},
     {testlfsabi},
     {testskiplist},
+    {testcskiplist},
+    {testtimerwheel},
+    {testthreadpool},
+    {testspscqueue},
+    {testcounter},
     {testsiphash}
 };
 
@@ -0,0 +1,184 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_allocator.h"
+#include "apr_pools.h"
+#include "apr_thread_proc.h"
+#include "apr_thread_mutex.h"
+#include "apr_time.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if !APR_HAS_THREADS
+int main(void)
+{
+    printf("This program won't work on this platform because there is no "
+           "support for threads.\n");
+    return 0;
+}
+#else /* !APR_HAS_THREADS */
+
+#define DEFAULT_MAX_COUNTER 100000
+#define DEFAULT_MAX_THREADS 64
+#define LIVE_NODES 16
+
+static long max_counter = DEFAULT_MAX_COUNTER;
+static int max_threads = DEFAULT_MAX_THREADS;
+static apr_pool_t *pool;
+
+/* Each thread keeps a small window of live nodes of mixed sizes (one to
+ * four pages), freeing the oldest one for each new allocation.
+ */
+static void * APR_THREAD_FUNC alloc_thread(apr_thread_t *thd, void *data)
+{
+    apr_allocator_t *allocator = data;
+    apr_memnode_t *live[LIVE_NODES] = { NULL };
+    long i;
+    int n;
+
+    for (i = 0; i < max_counter; i++) {
+        n = i % LIVE_NODES;
+        if (live[n]) {
+            apr_allocator_free(allocator, live[n]);
+        }
+        live[n] = apr_allocator_alloc(allocator, (i % 4) * 4096 + 100);
+        if (!live[n]) {
+            fprintf(stderr, "allocation failed\n");
+            exit(-1);
+        }
+    }
+    for (n = 0; n < LIVE_NODES; n++) {
+        if (live[n]) {
+            apr_allocator_free(allocator, live[n]);
+        }
+    }
+
+    return NULL;
+}
+
+static apr_status_t test_allocator(int num_threads, apr_uint32_t cache)
+{
+    apr_thread_t *t[DEFAULT_MAX_THREADS];
+    apr_allocator_t *allocator;
+    apr_thread_mutex_t *mutex;
+    apr_pool_t *owner;
+    apr_time_t time_start, time_stop;
+    apr_status_t rv;
+    double secs;
+    int i;
+
+    if ((rv = apr_allocator_create(&allocator)) != APR_SUCCESS) {
+        return rv;
+    }
+    if ((rv = apr_pool_create_ex(&owner, pool, NULL,
+                                 allocator)) != APR_SUCCESS) {
+        apr_allocator_destroy(allocator);
+        return rv;
+    }
+    apr_allocator_owner_set(allocator, owner);
+    if ((rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT,
+                                      owner)) != APR_SUCCESS) {
+        apr_pool_destroy(owner);
+        return rv;
+    }
+    apr_allocator_mutex_set(allocator, mutex);
+    if (cache && (rv = apr_allocator_thread_cache_set(allocator, cache,
+                                                      owner)) != APR_SUCCESS) {
+        apr_pool_destroy(owner);
+        return rv;
+    }
+
+    time_start = apr_time_now();
+    for (i = 0; i < num_threads; ++i) {
+        rv = apr_thread_create(&t[i], NULL, alloc_thread, allocator, owner);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+    for (i = 0; i < num_threads; ++i) {
+        apr_thread_join(&rv, t[i]);
+    }
+    time_stop = apr_time_now();
+
+    secs = (double)(time_stop - time_start) / APR_USEC_PER_SEC;
+    printf("    %-8s %3d threads: %10" APR_INT64_T_FMT " usec, "
+           "%12.0f alloc+free/s\n", cache ? "cached" : "shared", num_threads,
+           (apr_int64_t)(time_stop - time_start),
+           secs > 0 ? (double)max_counter * num_threads / secs : 0.0);
+
+    apr_pool_destroy(owner);
+
+    return APR_SUCCESS;
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    int i;
+
+    printf("APR Allocator Performance Test\n==============\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "c:t:", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'c') {
+            max_counter = atol(optarg);
+        }
+        else if (optchar == 't') {
+            max_threads = atoi(optarg);
+            if (max_threads < 1 || max_threads > DEFAULT_MAX_THREADS) {
+                max_threads = DEFAULT_MAX_THREADS;
+            }
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    printf("apr_allocator_alloc/free (%ld per thread)\n", max_counter);
+    for (i = 1; i <= max_threads; i *= 2) {
+        if ((rv = test_allocator(i, 0)) != APR_SUCCESS
+                || (rv = test_allocator(i, 32)) != APR_SUCCESS) {
+            fprintf(stderr, "allocator test failed : [%d] %s\n",
+                    rv, apr_strerror(rv, errmsg, sizeof errmsg));
+            exit(-2);
+        }
+    }
+
+    return 0;
+}
+
+#endif /* !APR_HAS_THREADS */
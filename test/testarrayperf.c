@@ -0,0 +1,217 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_tables.h"
+#include "apr_pools.h"
+#include "apr_strings.h"
+#include "apr_thread_pool.h"
+#include "apr_time.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_NELTS       500000
+#define DEFAULT_MAX_THREADS 4
+
+static int nelts = DEFAULT_NELTS;
+static int max_threads = DEFAULT_MAX_THREADS;
+static apr_pool_t *pool;
+
+/* Something like the log records kept in arrays by the applications */
+typedef struct log_record_t {
+    apr_time_t time;
+    apr_uint32_t id;
+    apr_uint32_t status;
+    char host[16];
+} log_record_t;
+
+static void make_record(log_record_t *rec, int i)
+{
+    rec->time = (apr_time_t)((apr_uint32_t)i * 2654435761u);
+    rec->id = i;
+    rec->status = 200;
+    memcpy(rec->host, "192.168.0.1", 12);
+}
+
+static int record_cmp(const void *a, const void *b)
+{
+    const apr_time_t x = ((const log_record_t *)a)->time;
+    const apr_time_t y = ((const log_record_t *)b)->time;
+
+    return (x > y) - (x < y);
+}
+
+static void report_push(const char *name, apr_time_t usecs, apr_pool_t *p)
+{
+    apr_pool_stats_t stats;
+
+    if (apr_pool_stats_get(p, &stats) == APR_SUCCESS) {
+        printf("    %-16s: %10" APR_INT64_T_FMT " usec, %10" APR_SIZE_T_FMT
+               " bytes held\n", name, (apr_int64_t)usecs, stats.bytes_held);
+    }
+    else {
+        printf("    %-16s: %10" APR_INT64_T_FMT " usec\n", name,
+               (apr_int64_t)usecs);
+    }
+}
+
+/* Build the array one element at a time (growing by doubling), or reserve
+ * the room upfront and fill it at once.
+ */
+static apr_array_header_t *test_push(int reserve, apr_pool_t *p)
+{
+    apr_array_header_t *arr;
+    apr_time_t start;
+    int i;
+
+    start = apr_time_now();
+    arr = apr_array_make(p, 16, sizeof(log_record_t));
+    if (reserve) {
+        log_record_t *recs;
+
+        apr_array_reserve(arr, nelts);
+        recs = apr_array_push_n(arr, nelts);
+        for (i = 0; i < nelts; i++) {
+            make_record(&recs[i], i);
+        }
+    }
+    else {
+        for (i = 0; i < nelts; i++) {
+            make_record(apr_array_push(arr), i);
+        }
+    }
+    report_push(reserve ? "reserve+push_n" : "push", apr_time_now() - start,
+                p);
+
+    if (arr->nelts != nelts) {
+        fprintf(stderr, "push: unexpected results\n");
+        exit(-2);
+    }
+    return arr;
+}
+
+static void test_sort(const char *name, apr_array_header_t *arr,
+                      apr_thread_pool_t *tp)
+{
+    apr_array_header_t *copy = apr_array_copy(pool, arr);
+    apr_time_t start;
+    apr_status_t rv;
+    int i;
+
+    start = apr_time_now();
+    if (name) {
+        rv = apr_array_sort_parallel(copy, record_cmp, tp);
+    }
+    else {
+        apr_array_sort(copy, record_cmp);
+        rv = APR_SUCCESS;
+    }
+    printf("    %-16s: %10" APR_INT64_T_FMT " usec\n",
+           name ? name : "sort", (apr_int64_t)(apr_time_now() - start));
+
+    for (i = 1; i < copy->nelts; i++) {
+        if (record_cmp(&APR_ARRAY_IDX(copy, i - 1, log_record_t),
+                       &APR_ARRAY_IDX(copy, i, log_record_t)) > 0) {
+            rv = APR_EGENERAL;
+        }
+    }
+    if (rv != APR_SUCCESS) {
+        fprintf(stderr, "sort: unexpected results\n");
+        exit(-2);
+    }
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    apr_array_header_t *arr;
+    apr_pool_t *p;
+    int i;
+
+    printf("APR Array Performance Test\n==============\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "n:t:", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'n') {
+            nelts = atoi(optarg);
+            if (nelts < 1) {
+                nelts = DEFAULT_NELTS;
+            }
+        }
+        else if (optchar == 't') {
+            max_threads = atoi(optarg);
+            if (max_threads < 0) {
+                max_threads = DEFAULT_MAX_THREADS;
+            }
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    /* The pool statistics tell the memory held for the array */
+    apr_pool_stats_enable(1);
+
+    printf("build an array of %d records of %d bytes\n", nelts,
+           (int)sizeof(log_record_t));
+    apr_pool_create(&p, pool);
+    test_push(0, p);
+    apr_pool_destroy(p);
+    apr_pool_create(&p, pool);
+    arr = test_push(1, p);
+
+    printf("\nsort the array by time\n");
+    test_sort(NULL, arr, NULL);
+#if APR_HAS_THREADS
+    for (i = 1; i <= max_threads; i *= 2) {
+        apr_thread_pool_t *tp;
+        char name[32];
+
+        rv = apr_thread_pool_create(&tp, i, i, pool);
+        if (rv != APR_SUCCESS) {
+            fprintf(stderr, "Could not create the thread pool: [%d] %s\n",
+                    rv, apr_strerror(rv, errmsg, sizeof errmsg));
+            exit(-1);
+        }
+        apr_snprintf(name, sizeof(name), "parallel (%d+1)", i);
+        test_sort(name, arr, tp);
+        apr_thread_pool_destroy(tp);
+    }
+#endif
+
+    return 0;
+}
@@ -230,6 +230,142 @@ static void test_inc_neg1(abts_case *tc, void *data)
     ABTS_ASSERT(tc, str, y32 == 0);
 }
 
+static void test_bitwise32(abts_case *tc, void *data)
+{
+    apr_uint32_t y32 = 0x0ff0;
+
+    ABTS_INT_EQUAL(tc, 0x0ff0, apr_atomic_and32(&y32, 0x00ff));
+    ABTS_INT_EQUAL(tc, 0x00f0, y32);
+    ABTS_INT_EQUAL(tc, 0x00f0, apr_atomic_or32(&y32, 0xf000));
+    ABTS_INT_EQUAL(tc, 0xf0f0, y32);
+    ABTS_INT_EQUAL(tc, 0xf0f0, apr_atomic_xor32(&y32, 0xffff));
+    ABTS_INT_EQUAL(tc, 0x0f0f, y32);
+}
+
+static void test_readptr_setptr(abts_case *tc, void *data)
+{
+    int a;
+    void *target_ptr = NULL;
+
+    apr_atomic_setptr(&target_ptr, &a);
+    ABTS_PTR_EQUAL(tc, &a, apr_atomic_readptr(&target_ptr));
+}
+
+static const apr_atomic_order_e orders[] = {
+    APR_ATOMIC_RELAXED, APR_ATOMIC_ACQUIRE, APR_ATOMIC_RELEASE,
+    APR_ATOMIC_ACQ_REL, APR_ATOMIC_SEQ_CST
+};
+#define NUM_ORDERS (int)(sizeof(orders) / sizeof(orders[0]))
+
+static void test_ordered32(abts_case *tc, void *data)
+{
+    apr_uint32_t y32;
+    int a, i;
+    void *target_ptr;
+
+    for (i = 0; i < NUM_ORDERS; i++) {
+        apr_atomic_order_e order = orders[i];
+
+        apr_atomic_fence(order);
+
+        apr_atomic_set32_ex(&y32, 2, order);
+        ABTS_INT_EQUAL(tc, 2, apr_atomic_read32_ex(&y32, order));
+        ABTS_INT_EQUAL(tc, 2, apr_atomic_add32_ex(&y32, 3, order));
+        ABTS_INT_EQUAL(tc, 5, apr_atomic_cas32_ex(&y32, 7, 5, order));
+        ABTS_INT_EQUAL(tc, 7, apr_atomic_cas32_ex(&y32, 9, 5, order));
+        ABTS_INT_EQUAL(tc, 7, apr_atomic_xchg32_ex(&y32, 11, order));
+        ABTS_INT_EQUAL(tc, 11, y32);
+
+        apr_atomic_setptr_ex(&target_ptr, NULL, order);
+        ABTS_PTR_EQUAL(tc, NULL, apr_atomic_readptr_ex(&target_ptr, order));
+        ABTS_PTR_EQUAL(tc, NULL,
+                       apr_atomic_casptr_ex(&target_ptr, &a, NULL, order));
+        ABTS_PTR_EQUAL(tc, &a,
+                       apr_atomic_casptr_ex(&target_ptr, &i, NULL, order));
+        ABTS_PTR_EQUAL(tc, &a,
+                       apr_atomic_xchgptr_ex(&target_ptr, &i, order));
+        ABTS_PTR_EQUAL(tc, &i, target_ptr);
+    }
+}
+
+#define BIG64 APR_UINT64_C(0x100000000)
+
+static void test_ops64(abts_case *tc, void *data)
+{
+    apr_uint64_t y64;
+    int rv;
+
+    apr_atomic_set64(&y64, BIG64 + 2);
+    ABTS_ASSERT(tc, "set64/read64 failed",
+                apr_atomic_read64(&y64) == BIG64 + 2);
+
+    ABTS_ASSERT(tc, "add64 didn't return the old value",
+                apr_atomic_add64(&y64, BIG64) == BIG64 + 2);
+    ABTS_ASSERT(tc, "add64 failed", y64 == 2 * BIG64 + 2);
+
+    apr_atomic_sub64(&y64, BIG64 + 1);
+    ABTS_ASSERT(tc, "sub64 failed", y64 == BIG64 + 1);
+
+    ABTS_ASSERT(tc, "inc64 didn't return the old value",
+                apr_atomic_inc64(&y64) == BIG64 + 1);
+    ABTS_ASSERT(tc, "inc64 failed", y64 == BIG64 + 2);
+
+    ABTS_ASSERT(tc, "cas64 didn't return the old value",
+                apr_atomic_cas64(&y64, 5, BIG64 + 2) == BIG64 + 2);
+    ABTS_ASSERT(tc, "cas64 failed", y64 == 5);
+    ABTS_ASSERT(tc, "cas64 didn't return the old value",
+                apr_atomic_cas64(&y64, 7, BIG64 + 2) == 5);
+    ABTS_ASSERT(tc, "cas64 swapped when it shouldn't", y64 == 5);
+
+    ABTS_ASSERT(tc, "xchg64 didn't return the old value",
+                apr_atomic_xchg64(&y64, BIG64 | 0xf0) == 5);
+    ABTS_ASSERT(tc, "and64 didn't return the old value",
+                apr_atomic_and64(&y64, BIG64 | 0x30) == (BIG64 | 0xf0));
+    ABTS_ASSERT(tc, "and64 failed", y64 == (BIG64 | 0x30));
+    ABTS_ASSERT(tc, "or64 didn't return the old value",
+                apr_atomic_or64(&y64, 0x0f) == (BIG64 | 0x30));
+    ABTS_ASSERT(tc, "or64 failed", y64 == (BIG64 | 0x3f));
+    ABTS_ASSERT(tc, "xor64 didn't return the old value",
+                apr_atomic_xor64(&y64, BIG64 | 0x01) == (BIG64 | 0x3f));
+    ABTS_ASSERT(tc, "xor64 failed", y64 == 0x3e);
+
+    apr_atomic_set64(&y64, 2);
+    rv = apr_atomic_dec64(&y64);
+    ABTS_ASSERT(tc, "dec64 returned zero when it shouldn't", rv != 0);
+    rv = apr_atomic_dec64(&y64);
+    ABTS_ASSERT(tc, "dec64 didn't return zero when it should", rv == 0);
+    rv = apr_atomic_dec64(&y64);
+    ABTS_ASSERT(tc, "dec64 on zero returned zero", rv != 0);
+    ABTS_ASSERT(tc, "dec64 zero wrap failed", y64 == (apr_uint64_t)-1);
+    ABTS_ASSERT(tc, "inc64 didn't return the old value",
+                apr_atomic_inc64(&y64) == (apr_uint64_t)-1);
+    ABTS_ASSERT(tc, "inc64 zero wrap failed", y64 == 0);
+}
+
+static void test_ordered64(abts_case *tc, void *data)
+{
+    apr_uint64_t y64;
+    int i;
+
+    for (i = 0; i < NUM_ORDERS; i++) {
+        apr_atomic_order_e order = orders[i];
+
+        apr_atomic_set64_ex(&y64, BIG64, order);
+        ABTS_ASSERT(tc, "set64_ex/read64_ex failed",
+                    apr_atomic_read64_ex(&y64, order) == BIG64);
+        ABTS_ASSERT(tc, "add64_ex didn't return the old value",
+                    apr_atomic_add64_ex(&y64, BIG64, order) == BIG64);
+        ABTS_ASSERT(tc, "cas64_ex didn't return the old value",
+                    apr_atomic_cas64_ex(&y64, 1, 2 * BIG64, order)
+                    == 2 * BIG64);
+        ABTS_ASSERT(tc, "cas64_ex swapped when it shouldn't",
+                    apr_atomic_cas64_ex(&y64, 3, 2 * BIG64, order) == 1);
+        ABTS_ASSERT(tc, "xchg64_ex didn't return the old value",
+                    apr_atomic_xchg64_ex(&y64, BIG64, order) == 1);
+        ABTS_ASSERT(tc, "xchg64_ex failed", y64 == BIG64);
+    }
+}
+
 
 #if APR_HAS_THREADS
 
@@ -309,6 +445,49 @@ static void test_atomics_threaded(abts_case *tc, void *data)
     ABTS_ASSERT(tc, "Failed creating threads", rv == APR_SUCCESS);
 }
 
+
+volatile apr_uint64_t atomic_ops64 = 0;
+
+static void *APR_THREAD_FUNC thread_func_atomic64(apr_thread_t *thd,
+                                                  void *data)
+{
+    int i;
+
+    for (i = 0; i < NUM_ITERATIONS ; i++) {
+        apr_atomic_inc64(&atomic_ops64);
+        apr_atomic_add64(&atomic_ops64, BIG64 + 2);
+        apr_atomic_sub64(&atomic_ops64, BIG64);
+        apr_atomic_dec64(&atomic_ops64);
+        apr_atomic_add64_ex(&atomic_ops64, (apr_uint64_t)-2,
+                            APR_ATOMIC_RELAXED);
+    }
+    apr_thread_exit(thd, exit_ret_val);
+    return NULL;
+}
+
+static void test_atomics64_threaded(abts_case *tc, void *data)
+{
+    apr_thread_t *t[NUM_THREADS];
+    apr_status_t rv;
+    int i;
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        rv = apr_thread_create(&t[i], NULL, thread_func_atomic64, NULL, p);
+        APR_ASSERT_SUCCESS(tc, "Failed creating threads", rv);
+    }
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        apr_status_t s;
+        apr_thread_join(&s, t[i]);
+
+        ABTS_ASSERT(tc, "Invalid return value from thread_join",
+                    s == exit_ret_val);
+    }
+
+    ABTS_ASSERT(tc, "64-bit atomic operations lost updates",
+                apr_atomic_read64(&atomic_ops64) == 0);
+}
+
 #undef NUM_THREADS
 #define NUM_THREADS 7
 
@@ -525,9 +704,15 @@ abts_suite *testatomic(abts_suite *suite)
     abts_run_test(suite, test_set_add_inc_sub, NULL);
     abts_run_test(suite, test_wrap_zero, NULL);
     abts_run_test(suite, test_inc_neg1, NULL);
+    abts_run_test(suite, test_bitwise32, NULL);
+    abts_run_test(suite, test_readptr_setptr, NULL);
+    abts_run_test(suite, test_ordered32, NULL);
+    abts_run_test(suite, test_ops64, NULL);
+    abts_run_test(suite, test_ordered64, NULL);
 
 #if APR_HAS_THREADS
     abts_run_test(suite, test_atomics_threaded, NULL);
+    abts_run_test(suite, test_atomics64_threaded, NULL);
     abts_run_test(suite, test_atomics_busyloop_threaded, NULL);
 #endif
 
@@ -0,0 +1,340 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_atomic.h"
+#include "apr_thread_proc.h"
+#include "apr_pools.h"
+#include "apr_time.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_MAX_OPS 10000000
+#define MAX_THREADS     16
+
+static long max_ops = DEFAULT_MAX_OPS;
+static apr_pool_t *pool;
+
+/* Each counter in its own cache line, so that threads don't share them */
+static struct {
+    volatile apr_uint32_t u32;
+    char pad1[64 - sizeof(apr_uint32_t)];
+    volatile apr_uint64_t u64;
+    char pad2[64 - sizeof(apr_uint64_t)];
+    void *volatile ptr;
+} shared;
+
+typedef enum {
+    OP_READ32,
+    OP_READ32_ACQUIRE,
+    OP_READ32_RELAXED,
+    OP_SET32,
+    OP_SET32_RELEASE,
+    OP_SET32_RELAXED,
+    OP_ADD32,
+    OP_ADD32_RELAXED,
+    OP_CAS32,
+    OP_CAS32_ACQ_REL,
+    OP_OR32,
+    OP_READPTR_ACQUIRE,
+    OP_SETPTR_RELEASE,
+    OP_READ64,
+    OP_READ64_ACQUIRE,
+    OP_SET64,
+    OP_SET64_RELEASE,
+    OP_ADD64,
+    OP_ADD64_RELAXED,
+    OP_CAS64,
+    OP_FENCE_ACQUIRE,
+    OP_FENCE_RELEASE,
+    OP_FENCE_SEQ_CST,
+    OP_COUNT
+} op_e;
+
+static const char *const op_names[OP_COUNT] = {
+    "read32",
+    "read32_ex(ACQUIRE)",
+    "read32_ex(RELAXED)",
+    "set32",
+    "set32_ex(RELEASE)",
+    "set32_ex(RELAXED)",
+    "add32",
+    "add32_ex(RELAXED)",
+    "cas32",
+    "cas32_ex(ACQ_REL)",
+    "or32",
+    "readptr_ex(ACQUIRE)",
+    "setptr_ex(RELEASE)",
+    "read64",
+    "read64_ex(ACQUIRE)",
+    "set64",
+    "set64_ex(RELEASE)",
+    "add64",
+    "add64_ex(RELAXED)",
+    "cas64",
+    "fence(ACQUIRE)",
+    "fence(RELEASE)",
+    "fence(SEQ_CST)"
+};
+
+static apr_uint64_t run_op(op_e op, long n)
+{
+    apr_uint64_t sum = 0;
+    long i;
+
+    switch (op) {
+    case OP_READ32:
+        for (i = 0; i < n; i++)
+            sum += apr_atomic_read32(&shared.u32);
+        break;
+    case OP_READ32_ACQUIRE:
+        for (i = 0; i < n; i++)
+            sum += apr_atomic_read32_ex(&shared.u32, APR_ATOMIC_ACQUIRE);
+        break;
+    case OP_READ32_RELAXED:
+        for (i = 0; i < n; i++)
+            sum += apr_atomic_read32_ex(&shared.u32, APR_ATOMIC_RELAXED);
+        break;
+    case OP_SET32:
+        for (i = 0; i < n; i++)
+            apr_atomic_set32(&shared.u32, (apr_uint32_t)i);
+        break;
+    case OP_SET32_RELEASE:
+        for (i = 0; i < n; i++)
+            apr_atomic_set32_ex(&shared.u32, (apr_uint32_t)i,
+                                APR_ATOMIC_RELEASE);
+        break;
+    case OP_SET32_RELAXED:
+        for (i = 0; i < n; i++)
+            apr_atomic_set32_ex(&shared.u32, (apr_uint32_t)i,
+                                APR_ATOMIC_RELAXED);
+        break;
+    case OP_ADD32:
+        for (i = 0; i < n; i++)
+            apr_atomic_add32(&shared.u32, 1);
+        break;
+    case OP_ADD32_RELAXED:
+        for (i = 0; i < n; i++)
+            apr_atomic_add32_ex(&shared.u32, 1, APR_ATOMIC_RELAXED);
+        break;
+    case OP_CAS32:
+        for (i = 0; i < n; i++)
+            sum += apr_atomic_cas32(&shared.u32, (apr_uint32_t)i + 1,
+                                    (apr_uint32_t)i);
+        break;
+    case OP_CAS32_ACQ_REL:
+        for (i = 0; i < n; i++)
+            sum += apr_atomic_cas32_ex(&shared.u32, (apr_uint32_t)i + 1,
+                                       (apr_uint32_t)i, APR_ATOMIC_ACQ_REL);
+        break;
+    case OP_OR32:
+        for (i = 0; i < n; i++)
+            sum += apr_atomic_or32(&shared.u32, (apr_uint32_t)i);
+        break;
+    case OP_READPTR_ACQUIRE:
+        for (i = 0; i < n; i++)
+            sum += (apr_uintptr_t)apr_atomic_readptr_ex(&shared.ptr,
+                                                        APR_ATOMIC_ACQUIRE);
+        break;
+    case OP_SETPTR_RELEASE:
+        for (i = 0; i < n; i++)
+            apr_atomic_setptr_ex(&shared.ptr, &sum, APR_ATOMIC_RELEASE);
+        break;
+    case OP_READ64:
+        for (i = 0; i < n; i++)
+            sum += apr_atomic_read64(&shared.u64);
+        break;
+    case OP_READ64_ACQUIRE:
+        for (i = 0; i < n; i++)
+            sum += apr_atomic_read64_ex(&shared.u64, APR_ATOMIC_ACQUIRE);
+        break;
+    case OP_SET64:
+        for (i = 0; i < n; i++)
+            apr_atomic_set64(&shared.u64, (apr_uint64_t)i);
+        break;
+    case OP_SET64_RELEASE:
+        for (i = 0; i < n; i++)
+            apr_atomic_set64_ex(&shared.u64, (apr_uint64_t)i,
+                                APR_ATOMIC_RELEASE);
+        break;
+    case OP_ADD64:
+        for (i = 0; i < n; i++)
+            apr_atomic_add64(&shared.u64, 1);
+        break;
+    case OP_ADD64_RELAXED:
+        for (i = 0; i < n; i++)
+            apr_atomic_add64_ex(&shared.u64, 1, APR_ATOMIC_RELAXED);
+        break;
+    case OP_CAS64:
+        for (i = 0; i < n; i++)
+            sum += apr_atomic_cas64(&shared.u64, (apr_uint64_t)i + 1,
+                                    (apr_uint64_t)i);
+        break;
+    case OP_FENCE_ACQUIRE:
+        for (i = 0; i < n; i++)
+            apr_atomic_fence(APR_ATOMIC_ACQUIRE);
+        break;
+    case OP_FENCE_RELEASE:
+        for (i = 0; i < n; i++)
+            apr_atomic_fence(APR_ATOMIC_RELEASE);
+        break;
+    case OP_FENCE_SEQ_CST:
+        for (i = 0; i < n; i++)
+            apr_atomic_fence(APR_ATOMIC_SEQ_CST);
+        break;
+    default:
+        break;
+    }
+
+    return sum;
+}
+
+static void test_single(void)
+{
+    apr_time_t time_start, time_stop;
+    int op;
+
+    printf("Single thread, %ld operations each:\n", max_ops);
+    for (op = 0; op < OP_COUNT; op++) {
+        shared.u32 = 0;
+        shared.u64 = 0;
+        time_start = apr_time_now();
+        run_op(op, max_ops);
+        time_stop = apr_time_now();
+        printf("    %-22s %8.2f ns/op\n", op_names[op],
+               (double)(time_stop - time_start) * 1000.0 / max_ops);
+    }
+}
+
+#if APR_HAS_THREADS
+
+static long ops_per_thread;
+
+static void * APR_THREAD_FUNC thread_func(apr_thread_t *thd, void *data)
+{
+    run_op(*(op_e *)data, ops_per_thread);
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static apr_status_t test_threaded(op_e op, int num_threads)
+{
+    apr_thread_t *threads[MAX_THREADS];
+    apr_time_t time_start, time_stop;
+    apr_status_t rv = APR_SUCCESS, retval;
+    int i, created = 0;
+
+    shared.u32 = 0;
+    shared.u64 = 0;
+    ops_per_thread = max_ops / num_threads;
+
+    time_start = apr_time_now();
+    for (i = 0; i < num_threads; i++) {
+        rv = apr_thread_create(&threads[i], NULL, thread_func, &op, pool);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+        created++;
+    }
+    for (i = 0; i < created; i++) {
+        apr_thread_join(&retval, threads[i]);
+    }
+    time_stop = apr_time_now();
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    printf("    %-22s %2d threads: %8.2f ns/op\n", op_names[op], num_threads,
+           (double)(time_stop - time_start) * 1000.0
+                / (ops_per_thread * num_threads));
+
+    return APR_SUCCESS;
+}
+
+#endif /* APR_HAS_THREADS */
+
+int main(int argc, const char * const *argv)
+{
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    int max_threads = 4;
+
+    printf("APR Atomic Performance Test\n==============\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "n:t:", &optchar,
+                            &optarg)) == APR_SUCCESS) {
+        if (optchar == 'n') {
+            max_ops = atol(optarg);
+            if (max_ops < MAX_THREADS) {
+                max_ops = DEFAULT_MAX_OPS;
+            }
+        }
+        else if (optchar == 't') {
+            max_threads = atoi(optarg);
+            if (max_threads < 1 || max_threads > MAX_THREADS) {
+                max_threads = 4;
+            }
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    test_single();
+
+#if APR_HAS_THREADS
+    {
+        static const op_e contended[] = {
+            OP_ADD32, OP_ADD32_RELAXED, OP_ADD64, OP_ADD64_RELAXED
+        };
+        int i, n;
+
+        printf("\nContended counter, %ld operations in all:\n", max_ops);
+        for (n = 2; n <= max_threads; n *= 2) {
+            for (i = 0; i < (int)(sizeof(contended) / sizeof(contended[0]));
+                 i++) {
+                if ((rv = test_threaded(contended[i], n)) != APR_SUCCESS) {
+                    fprintf(stderr, "atomic test failed : [%d] %s\n",
+                            rv, apr_strerror(rv, errmsg, sizeof errmsg));
+                    exit(-2);
+                }
+            }
+        }
+    }
+#endif
+
+    return 0;
+}
@@ -0,0 +1,214 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_strings.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_chash.h"
+#include "apr_thread_proc.h"
+#include "apr_atomic.h"
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+#define NUM_KEYS    1000
+
+static void chash_set_get(abts_case *tc, void *data)
+{
+    apr_chash_t *ht;
+    apr_status_t rv;
+    char key[32];
+    int i;
+
+    rv = apr_chash_create(&ht, 4, NULL, p);
+    APR_ASSERT_SUCCESS(tc, "create concurrent hash", rv);
+
+    apr_chash_set(ht, "key", APR_HASH_KEY_STRING, "value");
+    ABTS_STR_EQUAL(tc, "value", apr_chash_get(ht, "key", 3));
+    apr_chash_set(ht, "key", APR_HASH_KEY_STRING, "new");
+    ABTS_STR_EQUAL(tc, "new", apr_chash_get(ht, "key", APR_HASH_KEY_STRING));
+    ABTS_INT_EQUAL(tc, 1, apr_chash_count(ht));
+
+    /* the keys are copied */
+    for (i = 0; i < NUM_KEYS; i++) {
+        apr_snprintf(key, sizeof(key), "key%d", i);
+        apr_chash_set(ht, key, APR_HASH_KEY_STRING, "value");
+    }
+    memset(key, 0, sizeof(key));
+    ABTS_INT_EQUAL(tc, NUM_KEYS + 1, apr_chash_count(ht));
+    ABTS_STR_EQUAL(tc, "value", apr_chash_get(ht, "key0", 4));
+    ABTS_STR_EQUAL(tc, "value", apr_chash_get(ht, "key999", 6));
+    ABTS_PTR_EQUAL(tc, NULL, apr_chash_get(ht, "key1000", 7));
+
+    /* deleted entries are recycled */
+    for (i = 0; i < NUM_KEYS; i += 2) {
+        apr_snprintf(key, sizeof(key), "key%d", i);
+        apr_chash_set(ht, key, APR_HASH_KEY_STRING, NULL);
+    }
+    ABTS_INT_EQUAL(tc, NUM_KEYS / 2 + 1, apr_chash_count(ht));
+    ABTS_PTR_EQUAL(tc, NULL, apr_chash_get(ht, "key0", 4));
+    apr_chash_set(ht, "a much longer key, in another size class", 40, "long");
+    ABTS_STR_EQUAL(tc, "long",
+                   apr_chash_get(ht, "a much longer key, in another size "
+                                     "class", APR_HASH_KEY_STRING));
+
+    apr_chash_clear(ht);
+    ABTS_INT_EQUAL(tc, 0, apr_chash_count(ht));
+    ABTS_PTR_EQUAL(tc, NULL, apr_chash_get(ht, "key1", 4));
+    apr_chash_set(ht, "key1", 4, "again");
+    ABTS_STR_EQUAL(tc, "again", apr_chash_get(ht, "key1", 4));
+}
+
+static void chash_get_or_set(abts_case *tc, void *data)
+{
+    apr_chash_t *ht;
+    apr_status_t rv;
+    char *result;
+
+    rv = apr_chash_create(&ht, 0, NULL, p);
+    APR_ASSERT_SUCCESS(tc, "create concurrent hash", rv);
+
+    result = apr_chash_get_or_set(ht, "key", APR_HASH_KEY_STRING, "value");
+    ABTS_STR_EQUAL(tc, "value", result);
+    result = apr_chash_get_or_set(ht, "key", APR_HASH_KEY_STRING, "other");
+    ABTS_STR_EQUAL(tc, "value", result);
+    result = apr_chash_get_or_set(ht, "key", APR_HASH_KEY_STRING, NULL);
+    ABTS_STR_EQUAL(tc, "value", result);
+
+    apr_chash_set(ht, "key", APR_HASH_KEY_STRING, NULL);
+    result = apr_chash_get_or_set(ht, "key", APR_HASH_KEY_STRING, NULL);
+    ABTS_PTR_EQUAL(tc, NULL, result);
+    result = apr_chash_get_or_set(ht, "key", APR_HASH_KEY_STRING, "other");
+    ABTS_STR_EQUAL(tc, "other", result);
+    ABTS_INT_EQUAL(tc, 1, apr_chash_count(ht));
+}
+
+static int sum_cb(void *rec, const void *key, apr_ssize_t klen,
+                  const void *value)
+{
+    int *sum = rec;
+
+    *sum += atoi((const char *)value);
+    return *sum < 10;
+}
+
+static void chash_do(abts_case *tc, void *data)
+{
+    apr_chash_t *ht;
+    apr_status_t rv;
+    int sum = 0;
+
+    rv = apr_chash_create(&ht, 2, NULL, p);
+    APR_ASSERT_SUCCESS(tc, "create concurrent hash", rv);
+
+    apr_chash_set(ht, "one", APR_HASH_KEY_STRING, "1");
+    apr_chash_set(ht, "two", APR_HASH_KEY_STRING, "2");
+    apr_chash_set(ht, "three", APR_HASH_KEY_STRING, "3");
+    ABTS_INT_EQUAL(tc, TRUE, apr_chash_do(sum_cb, &sum, ht));
+    ABTS_INT_EQUAL(tc, 6, sum);
+
+    apr_chash_set(ht, "four", APR_HASH_KEY_STRING, "4");
+    sum = 0;
+    ABTS_INT_EQUAL(tc, FALSE, apr_chash_do(sum_cb, &sum, ht));
+}
+
+#if APR_HAS_THREADS
+
+#define NUM_THREADS 8
+#define NUM_LOOPS   20000
+
+static apr_chash_t *shared;
+static char shared_keys[NUM_KEYS][16];
+static volatile apr_uint32_t shared_errors;
+
+/* Each thread reads all the keys (which must always be found, with their
+ * own key as value), and sets and deletes its own ones.
+ */
+static void * APR_THREAD_FUNC chash_thread(apr_thread_t *thd, void *data)
+{
+    long id = (long)data;
+    apr_uint32_t errors = 0;
+    char key[32];
+    int i;
+
+    for (i = 0; i < NUM_LOOPS; i++) {
+        const char *k = shared_keys[i % NUM_KEYS];
+        const char *v = apr_chash_get(shared, k, APR_HASH_KEY_STRING);
+
+        if (!v || strcmp(k, v) != 0) {
+            errors++;
+        }
+        if (i % 8 == 0) {
+            apr_snprintf(key, sizeof(key), "thread%ld-%d", id, i / 16 % 64);
+            if (i % 16 == 0) {
+                apr_chash_set(shared, key, APR_HASH_KEY_STRING, "set");
+            }
+            else {
+                apr_chash_set(shared, key, APR_HASH_KEY_STRING, NULL);
+            }
+        }
+    }
+
+    apr_atomic_add32(&shared_errors, errors);
+    return NULL;
+}
+
+static void chash_threads(abts_case *tc, void *data)
+{
+    apr_thread_t *t[NUM_THREADS];
+    apr_status_t rv, retval;
+    int i;
+
+    rv = apr_chash_create(&shared, 4, NULL, p);
+    APR_ASSERT_SUCCESS(tc, "create concurrent hash", rv);
+
+    for (i = 0; i < NUM_KEYS; i++) {
+        apr_snprintf(shared_keys[i], sizeof(shared_keys[i]), "key%d", i);
+        apr_chash_set(shared, shared_keys[i], APR_HASH_KEY_STRING,
+                      shared_keys[i]);
+    }
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        rv = apr_thread_create(&t[i], NULL, chash_thread, (void *)(long)i, p);
+        APR_ASSERT_SUCCESS(tc, "create thread", rv);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        apr_thread_join(&retval, t[i]);
+    }
+    ABTS_INT_EQUAL(tc, 0, apr_atomic_read32(&shared_errors));
+    ABTS_INT_EQUAL(tc, NUM_KEYS, apr_chash_count(shared));
+}
+
+#endif /* APR_HAS_THREADS */
+
+abts_suite *testchash(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, chash_set_get, NULL);
+    abts_run_test(suite, chash_get_or_set, NULL);
+    abts_run_test(suite, chash_do, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, chash_threads, NULL);
+#endif
+
+    return suite;
+}
@@ -0,0 +1,209 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_chash.h"
+#include "apr_hash.h"
+#include "apr_pools.h"
+#include "apr_strings.h"
+#include "apr_thread_proc.h"
+#include "apr_thread_rwlock.h"
+#include "apr_time.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if !APR_HAS_THREADS
+int main(void)
+{
+    printf("This program won't work on this platform because there is no "
+           "support for threads.\n");
+    return 0;
+}
+#else /* !APR_HAS_THREADS */
+
+#define DEFAULT_MAX_COUNTER 1000000
+#define DEFAULT_MAX_THREADS 64
+#define DEFAULT_WRITES      1   /* percent */
+#define NUM_KEYS            10000
+
+static long max_counter = DEFAULT_MAX_COUNTER;
+static int max_threads = DEFAULT_MAX_THREADS;
+static int writes = DEFAULT_WRITES;
+static apr_pool_t *pool;
+static char *keys[NUM_KEYS];
+
+static apr_hash_t *locked_hash;
+static apr_thread_rwlock_t *locked_rwlock;
+static apr_chash_t *chash;
+
+/* The keys are looked up (or set for the given percentage of them) in an
+ * order which differs for each thread.
+ */
+static void * APR_THREAD_FUNC locked_thread(apr_thread_t *thd, void *data)
+{
+    unsigned int n = (unsigned int)(apr_uintptr_t)data;
+    long i;
+
+    for (i = 0; i < max_counter; i++) {
+        const char *key = keys[(n = n * 1103515245 + 12345) % NUM_KEYS];
+
+        if ((long)(n >> 16) % 100 < writes) {
+            apr_thread_rwlock_wrlock(locked_rwlock);
+            apr_hash_set(locked_hash, key, APR_HASH_KEY_STRING, key);
+            apr_thread_rwlock_unlock(locked_rwlock);
+        }
+        else {
+            apr_thread_rwlock_rdlock(locked_rwlock);
+            if (!apr_hash_get(locked_hash, key, APR_HASH_KEY_STRING)) {
+                fprintf(stderr, "key not found\n");
+                exit(-1);
+            }
+            apr_thread_rwlock_unlock(locked_rwlock);
+        }
+    }
+
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC chash_thread(apr_thread_t *thd, void *data)
+{
+    unsigned int n = (unsigned int)(apr_uintptr_t)data;
+    long i;
+
+    for (i = 0; i < max_counter; i++) {
+        const char *key = keys[(n = n * 1103515245 + 12345) % NUM_KEYS];
+
+        if ((long)(n >> 16) % 100 < writes) {
+            apr_chash_set(chash, key, APR_HASH_KEY_STRING, key);
+        }
+        else if (!apr_chash_get(chash, key, APR_HASH_KEY_STRING)) {
+            fprintf(stderr, "key not found\n");
+            exit(-1);
+        }
+    }
+
+    return NULL;
+}
+
+static apr_status_t test_threads(const char *name, int num_threads,
+                                 apr_thread_start_t func)
+{
+    apr_thread_t *t[DEFAULT_MAX_THREADS];
+    apr_time_t time_start, time_stop;
+    apr_status_t rv;
+    double secs;
+    int i;
+
+    time_start = apr_time_now();
+    for (i = 0; i < num_threads; ++i) {
+        rv = apr_thread_create(&t[i], NULL, func, (void *)(apr_uintptr_t)i,
+                               pool);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+    for (i = 0; i < num_threads; ++i) {
+        apr_thread_join(&rv, t[i]);
+    }
+    time_stop = apr_time_now();
+
+    secs = (double)(time_stop - time_start) / APR_USEC_PER_SEC;
+    printf("    %-8s %3d threads: %10" APR_INT64_T_FMT " usec, "
+           "%12.0f ops/s\n", name, num_threads,
+           (apr_int64_t)(time_stop - time_start),
+           secs > 0 ? (double)max_counter * num_threads / secs : 0.0);
+
+    return APR_SUCCESS;
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    int i;
+
+    printf("APR Concurrent Hash Performance Test\n==============\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "c:t:w:", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'c') {
+            max_counter = atol(optarg);
+        }
+        else if (optchar == 't') {
+            max_threads = atoi(optarg);
+            if (max_threads < 1 || max_threads > DEFAULT_MAX_THREADS) {
+                max_threads = DEFAULT_MAX_THREADS;
+            }
+        }
+        else if (optchar == 'w') {
+            writes = atoi(optarg);
+            if (writes < 0 || writes > 100) {
+                writes = DEFAULT_WRITES;
+            }
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    locked_hash = apr_hash_make(pool);
+    if ((rv = apr_thread_rwlock_create(&locked_rwlock, pool)) != APR_SUCCESS
+            || (rv = apr_chash_create(&chash, 0, NULL, pool)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not create the tables: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+    for (i = 0; i < NUM_KEYS; i++) {
+        keys[i] = apr_psprintf(pool, "/some/path/to/key/%d", i);
+        apr_hash_set(locked_hash, keys[i], APR_HASH_KEY_STRING, keys[i]);
+        apr_chash_set(chash, keys[i], APR_HASH_KEY_STRING, keys[i]);
+    }
+
+    printf("get/set (%ld per thread, %d%% writes, %d keys)\n",
+           max_counter, writes, NUM_KEYS);
+    for (i = 1; i <= max_threads; i *= 2) {
+        if ((rv = test_threads("rwlock", i, locked_thread)) != APR_SUCCESS
+                || (rv = test_threads("chash", i, chash_thread))
+                   != APR_SUCCESS) {
+            fprintf(stderr, "thread test failed : [%d] %s\n",
+                    rv, apr_strerror(rv, errmsg, sizeof errmsg));
+            exit(-2);
+        }
+    }
+
+    return 0;
+}
+
+#endif /* !APR_HAS_THREADS */
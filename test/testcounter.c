@@ -0,0 +1,116 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr_counter.h"
+#include "apr_thread_proc.h"
+
+#define NUM_THREADS     8
+#define NUM_ITERATIONS  20000
+
+static void test_counter_basic(abts_case *tc, void *data)
+{
+    apr_uint32_t flags = *(apr_uint32_t *)data;
+    apr_counter_t *c;
+    apr_status_t rv;
+
+    rv = apr_counter_create(&c, 0, flags, p);
+    APR_ASSERT_SUCCESS(tc, "create counter", rv);
+    ABTS_ASSERT(tc, "new counter is not zero", apr_counter_read(c) == 0);
+
+    apr_counter_inc(c);
+    apr_counter_add(c, 10);
+    ABTS_ASSERT(tc, "inc/add failed", apr_counter_read(c) == 11);
+
+    apr_counter_sub(c, 12);
+    ABTS_ASSERT(tc, "sub below zero failed",
+                apr_counter_read(c) == (apr_uint64_t)-1);
+
+    apr_counter_add(c, APR_UINT64_C(0x100000001));
+    ABTS_ASSERT(tc, "64-bit add failed",
+                apr_counter_read(c) == APR_UINT64_C(0x100000000));
+
+    apr_counter_set(c, 42);
+    ABTS_ASSERT(tc, "set failed", apr_counter_read(c) == 42);
+    apr_counter_inc(c);
+    ABTS_ASSERT(tc, "inc after set failed", apr_counter_read(c) == 43);
+
+    /* a single slot is a plain counter */
+    rv = apr_counter_create(&c, 1, flags, p);
+    APR_ASSERT_SUCCESS(tc, "create counter", rv);
+    apr_counter_add(c, 5);
+    apr_counter_sub(c, 2);
+    ABTS_ASSERT(tc, "single slot failed", apr_counter_read(c) == 3);
+}
+
+#if APR_HAS_THREADS
+
+static void *APR_THREAD_FUNC counter_thread(apr_thread_t *thd, void *data)
+{
+    apr_counter_t *c = data;
+    int i;
+
+    for (i = 0; i < NUM_ITERATIONS; i++) {
+        apr_counter_inc(c);
+        apr_counter_add(c, 3);
+        apr_counter_sub(c, 2);
+    }
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static void test_counter_threads(abts_case *tc, void *data)
+{
+    apr_uint32_t flags = *(apr_uint32_t *)data;
+    apr_thread_t *t[NUM_THREADS];
+    apr_counter_t *c;
+    apr_status_t rv, retval;
+    int i;
+
+    /* fewer slots than threads, so that some share them */
+    rv = apr_counter_create(&c, 4, flags, p);
+    APR_ASSERT_SUCCESS(tc, "create counter", rv);
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        rv = apr_thread_create(&t[i], NULL, counter_thread, c, p);
+        APR_ASSERT_SUCCESS(tc, "create thread", rv);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        apr_thread_join(&retval, t[i]);
+        APR_ASSERT_SUCCESS(tc, "thread exit", retval);
+    }
+
+    ABTS_ASSERT(tc, "lost updates",
+                apr_counter_read(c) == 2 * NUM_THREADS * NUM_ITERATIONS);
+}
+
+#endif /* APR_HAS_THREADS */
+
+abts_suite *testcounter(abts_suite *suite)
+{
+    static apr_uint32_t per_cpu = 0, per_thread = APR_COUNTER_PER_THREAD;
+
+    suite = ADD_SUITE(suite);
+
+    abts_run_test(suite, test_counter_basic, &per_cpu);
+    abts_run_test(suite, test_counter_basic, &per_thread);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_counter_threads, &per_cpu);
+    abts_run_test(suite, test_counter_threads, &per_thread);
+#endif
+
+    return suite;
+}
@@ -0,0 +1,184 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_counter.h"
+#include "apr_atomic.h"
+#include "apr_thread_proc.h"
+#include "apr_pools.h"
+#include "apr_time.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if !APR_HAS_THREADS
+int main(void)
+{
+    printf("This program won't work on this platform because there is no "
+           "support for threads.\n");
+    return 0;
+}
+#else /* !APR_HAS_THREADS */
+
+#define DEFAULT_MAX_INCS    10000000
+#define MAX_THREADS         64
+
+static long max_incs = DEFAULT_MAX_INCS;
+static long incs_per_thread;
+static apr_pool_t *pool;
+static volatile apr_uint32_t shared32;
+static apr_counter_t *counter;
+
+static void * APR_THREAD_FUNC atomic_func(apr_thread_t *thd, void *data)
+{
+    long i;
+
+    for (i = 0; i < incs_per_thread; i++) {
+        apr_atomic_inc32(&shared32);
+    }
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC counter_func(apr_thread_t *thd, void *data)
+{
+    long i;
+
+    for (i = 0; i < incs_per_thread; i++) {
+        apr_counter_inc(counter);
+    }
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static apr_status_t test_incs(const char *name, apr_thread_start_t func,
+                              int num_threads)
+{
+    apr_thread_t *threads[MAX_THREADS];
+    apr_time_t time_start, time_stop;
+    apr_status_t rv = APR_SUCCESS, retval;
+    apr_uint64_t total;
+    double secs;
+    int i, created = 0;
+
+    incs_per_thread = max_incs / num_threads;
+
+    time_start = apr_time_now();
+    for (i = 0; i < num_threads; i++) {
+        rv = apr_thread_create(&threads[i], NULL, func, NULL, pool);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+        created++;
+    }
+    for (i = 0; i < created; i++) {
+        apr_thread_join(&retval, threads[i]);
+    }
+    time_stop = apr_time_now();
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    total = (func == atomic_func) ? apr_atomic_read32(&shared32)
+                                  : apr_counter_read(counter);
+    if (total != (apr_uint64_t)incs_per_thread * num_threads) {
+        fprintf(stderr, "%s: lost increments\n", name);
+        return APR_EGENERAL;
+    }
+
+    secs = (double)(time_stop - time_start) / APR_USEC_PER_SEC;
+    printf("    %-20s %2d threads: %10" APR_INT64_T_FMT " usec, "
+           "%12.0f incs/s\n", name, num_threads,
+           (apr_int64_t)(time_stop - time_start),
+           secs > 0 ? (double)total / secs : 0.0);
+
+    return APR_SUCCESS;
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    int max_threads = 16, n;
+
+    printf("APR Counter Performance Test\n==============\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "n:t:", &optchar,
+                            &optarg)) == APR_SUCCESS) {
+        if (optchar == 'n') {
+            max_incs = atol(optarg);
+            if (max_incs < MAX_THREADS) {
+                max_incs = DEFAULT_MAX_INCS;
+            }
+        }
+        else if (optchar == 't') {
+            max_threads = atoi(optarg);
+            if (max_threads < 1 || max_threads > MAX_THREADS) {
+                max_threads = 16;
+            }
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    printf("Incrementing a counter %ld times in all:\n", max_incs);
+    for (n = 1; n <= max_threads; n *= 2) {
+        shared32 = 0;
+        if ((rv = test_incs("apr_atomic_inc32", atomic_func, n))
+                != APR_SUCCESS) {
+            break;
+        }
+        apr_counter_create(&counter, 0, 0, pool);
+        if ((rv = test_incs("apr_counter per-CPU", counter_func, n))
+                != APR_SUCCESS) {
+            break;
+        }
+        apr_counter_create(&counter, 0, APR_COUNTER_PER_THREAD, pool);
+        if ((rv = test_incs("apr_counter per-thd", counter_func, n))
+                != APR_SUCCESS) {
+            break;
+        }
+    }
+    if (rv != APR_SUCCESS) {
+        fprintf(stderr, "counter test failed : [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-2);
+    }
+
+    return 0;
+}
+
+#endif /* !APR_HAS_THREADS */
@@ -0,0 +1,214 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_cskiplist.h"
+#include "apr_thread_proc.h"
+#include "apr_atomic.h"
+
+#define NUM_ELTS    1000
+
+static int elts[NUM_ELTS];
+static apr_uint32_t freed;
+
+static int int_compare(void *a, void *b)
+{
+    int i = *(int *)a, j = *(int *)b;
+
+    return (i > j) - (i < j);
+}
+
+static void count_free(void *data)
+{
+    apr_atomic_inc32(&freed);
+}
+
+static int check_order(void *rec, void *data)
+{
+    int *prev = rec;
+
+    if (*(int *)data <= *prev) {
+        *prev = NUM_ELTS * 2;
+        return FALSE;
+    }
+    *prev = *(int *)data;
+    return TRUE;
+}
+
+static void cskiplist_insert_find(abts_case *tc, void *data)
+{
+    apr_cskiplist_t *sl;
+    apr_status_t rv;
+    int i, key, prev = -1;
+
+    rv = apr_cskiplist_create(&sl, int_compare, p);
+    APR_ASSERT_SUCCESS(tc, "create concurrent skip list", rv);
+
+    /* insert in a scattered order */
+    for (i = 0; i < NUM_ELTS; i++) {
+        elts[i] = i * 2;
+    }
+    for (i = 0; i < NUM_ELTS; i++) {
+        int *elt = &elts[(i * 7) % NUM_ELTS];
+        ABTS_PTR_EQUAL(tc, elt, apr_cskiplist_insert(sl, elt));
+    }
+    ABTS_INT_EQUAL(tc, NUM_ELTS, apr_cskiplist_size(sl));
+
+    /* duplicates are not inserted */
+    key = 10;
+    ABTS_PTR_EQUAL(tc, &elts[5], apr_cskiplist_insert(sl, &key));
+    ABTS_INT_EQUAL(tc, NUM_ELTS, apr_cskiplist_size(sl));
+
+    ABTS_PTR_EQUAL(tc, &elts[5], apr_cskiplist_find(sl, &key));
+    key = 11;
+    ABTS_PTR_EQUAL(tc, NULL, apr_cskiplist_find(sl, &key));
+    key = -1;
+    ABTS_PTR_EQUAL(tc, NULL, apr_cskiplist_find(sl, &key));
+    key = NUM_ELTS * 2;
+    ABTS_PTR_EQUAL(tc, NULL, apr_cskiplist_find(sl, &key));
+
+    ABTS_INT_EQUAL(tc, TRUE, apr_cskiplist_do(check_order, &prev, sl));
+    ABTS_INT_EQUAL(tc, (NUM_ELTS - 1) * 2, prev);
+}
+
+static void cskiplist_remove(abts_case *tc, void *data)
+{
+    apr_cskiplist_t *sl;
+    apr_pool_t *subp;
+    apr_status_t rv;
+    int i, key, prev = -1;
+
+    apr_pool_create(&subp, p);
+    rv = apr_cskiplist_create(&sl, int_compare, subp);
+    APR_ASSERT_SUCCESS(tc, "create concurrent skip list", rv);
+
+    for (i = 0; i < NUM_ELTS; i++) {
+        elts[i] = i;
+        apr_cskiplist_insert(sl, &elts[i]);
+    }
+
+    freed = 0;
+    for (i = 0; i < NUM_ELTS; i += 2) {
+        ABTS_INT_EQUAL(tc, 1, apr_cskiplist_remove(sl, &elts[i], count_free));
+    }
+    key = 0;
+    ABTS_INT_EQUAL(tc, 0, apr_cskiplist_remove(sl, &key, count_free));
+    ABTS_PTR_EQUAL(tc, NULL, apr_cskiplist_find(sl, &key));
+    key = 1;
+    ABTS_PTR_EQUAL(tc, &elts[1], apr_cskiplist_find(sl, &key));
+    ABTS_INT_EQUAL(tc, NUM_ELTS / 2, apr_cskiplist_size(sl));
+    ABTS_INT_EQUAL(tc, TRUE, apr_cskiplist_do(check_order, &prev, sl));
+
+    /* removed elements are freed once reclaimed, or on cleanup */
+    ABTS_ASSERT(tc, "some removed elements reclaimed",
+                freed > 0 && freed <= NUM_ELTS / 2);
+    ABTS_PTR_EQUAL(tc, &elts[0], apr_cskiplist_insert(sl, &elts[0]));
+    apr_pool_destroy(subp);
+    ABTS_INT_EQUAL(tc, NUM_ELTS / 2, freed);
+}
+
+#if APR_HAS_THREADS
+
+#define NUM_THREADS 8
+#define NUM_LOOPS   20000
+
+static apr_cskiplist_t *shared;
+static int shared_elts[NUM_THREADS + 1][NUM_ELTS];
+static apr_uint32_t shared_errors;
+
+/* Each thread finds all the common elements (which must always be found),
+ * and inserts and removes its own ones.
+ */
+static void * APR_THREAD_FUNC cskiplist_thread(apr_thread_t *thd,
+                                               void *data)
+{
+    long id = (long)data;
+    apr_uint32_t errors = 0;
+    int i;
+
+    for (i = 0; i < NUM_LOOPS; i++) {
+        int *common = &shared_elts[NUM_THREADS][i % NUM_ELTS];
+        int *own = &shared_elts[id][i / 2 % NUM_ELTS];
+
+        if (apr_cskiplist_find(shared, common) != common) {
+            errors++;
+        }
+        if (i % 2 == 0) {
+            if (apr_cskiplist_insert(shared, own) != own) {
+                errors++;
+            }
+        }
+        else if (!apr_cskiplist_remove(shared, own, NULL)) {
+            errors++;
+        }
+    }
+
+    apr_atomic_add32(&shared_errors, errors);
+    return NULL;
+}
+
+static void cskiplist_threads(abts_case *tc, void *data)
+{
+    apr_thread_t *t[NUM_THREADS];
+    apr_status_t rv, retval;
+    int i, j, prev = -1;
+
+    rv = apr_cskiplist_create(&shared, int_compare, p);
+    APR_ASSERT_SUCCESS(tc, "create concurrent skip list", rv);
+
+    /* interleaved values, the common ones being the multiples of
+     * NUM_THREADS + 1
+     */
+    for (i = 0; i <= NUM_THREADS; i++) {
+        for (j = 0; j < NUM_ELTS; j++) {
+            shared_elts[i][j] = j * (NUM_THREADS + 1)
+                                + (i + 1) % (NUM_THREADS + 1);
+        }
+    }
+    for (j = 0; j < NUM_ELTS; j++) {
+        apr_cskiplist_insert(shared, &shared_elts[NUM_THREADS][j]);
+    }
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        rv = apr_thread_create(&t[i], NULL, cskiplist_thread,
+                               (void *)(long)i, p);
+        APR_ASSERT_SUCCESS(tc, "create thread", rv);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        apr_thread_join(&retval, t[i]);
+    }
+    ABTS_INT_EQUAL(tc, 0, apr_atomic_read32(&shared_errors));
+    ABTS_INT_EQUAL(tc, NUM_ELTS, apr_cskiplist_size(shared));
+    ABTS_INT_EQUAL(tc, TRUE, apr_cskiplist_do(check_order, &prev, shared));
+}
+
+#endif /* APR_HAS_THREADS */
+
+abts_suite *testcskiplist(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, cskiplist_insert_find, NULL);
+    abts_run_test(suite, cskiplist_remove, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, cskiplist_threads, NULL);
+#endif
+
+    return suite;
+}
@@ -0,0 +1,231 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_cskiplist.h"
+#include "apr_skiplist.h"
+#include "apr_pools.h"
+#include "apr_thread_proc.h"
+#include "apr_thread_mutex.h"
+#include "apr_time.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if !APR_HAS_THREADS
+int main(void)
+{
+    printf("This program won't work on this platform because there is no "
+           "support for threads.\n");
+    return 0;
+}
+#else /* !APR_HAS_THREADS */
+
+#define DEFAULT_MAX_COUNTER 1000000
+#define DEFAULT_MAX_THREADS 64
+#define NUM_KEYS            10000
+
+static long max_counter = DEFAULT_MAX_COUNTER;
+static int max_threads = DEFAULT_MAX_THREADS;
+static int writes;
+static apr_pool_t *pool;
+static int keys[NUM_KEYS];
+
+static apr_skiplist *locked_sl;
+static apr_thread_mutex_t *locked_mutex;
+static apr_cskiplist_t *csl;
+
+static int int_compare(void *a, void *b)
+{
+    int i = *(int *)a, j = *(int *)b;
+
+    return (i > j) - (i < j);
+}
+
+/* The keys are looked up (or inserted and removed alternately for the
+ * given percentage of them) in an order which differs for each thread.
+ * Half of the keys are in the list initially.
+ */
+static void * APR_THREAD_FUNC locked_thread(apr_thread_t *thd, void *data)
+{
+    unsigned int n = (unsigned int)(apr_uintptr_t)data;
+    long i;
+
+    for (i = 0; i < max_counter; i++) {
+        int *key = &keys[(n = n * 1103515245 + 12345) % NUM_KEYS];
+
+        apr_thread_mutex_lock(locked_mutex);
+        if ((long)(n >> 16) % 100 >= writes) {
+            apr_skiplist_find(locked_sl, key, NULL);
+        }
+        else if (n & 0x80000000U) {
+            apr_skiplist_insert(locked_sl, key);
+        }
+        else {
+            apr_skiplist_remove(locked_sl, key, NULL);
+        }
+        apr_thread_mutex_unlock(locked_mutex);
+    }
+
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC csl_thread(apr_thread_t *thd, void *data)
+{
+    unsigned int n = (unsigned int)(apr_uintptr_t)data;
+    long i;
+
+    for (i = 0; i < max_counter; i++) {
+        int *key = &keys[(n = n * 1103515245 + 12345) % NUM_KEYS];
+
+        if ((long)(n >> 16) % 100 >= writes) {
+            apr_cskiplist_find(csl, key);
+        }
+        else if (n & 0x80000000U) {
+            apr_cskiplist_insert(csl, key);
+        }
+        else {
+            apr_cskiplist_remove(csl, key, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+static apr_status_t test_threads(const char *name, int num_threads,
+                                 apr_thread_start_t func)
+{
+    apr_thread_t *t[DEFAULT_MAX_THREADS];
+    apr_time_t time_start, time_stop;
+    apr_status_t rv;
+    double secs;
+    int i;
+
+    time_start = apr_time_now();
+    for (i = 0; i < num_threads; ++i) {
+        rv = apr_thread_create(&t[i], NULL, func, (void *)(apr_uintptr_t)i,
+                               pool);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+    for (i = 0; i < num_threads; ++i) {
+        apr_thread_join(&rv, t[i]);
+    }
+    time_stop = apr_time_now();
+
+    secs = (double)(time_stop - time_start) / APR_USEC_PER_SEC;
+    printf("    %-9s %3d threads: %10" APR_INT64_T_FMT " usec, "
+           "%12.0f ops/s\n", name, num_threads,
+           (apr_int64_t)(time_stop - time_start),
+           secs > 0 ? (double)max_counter * num_threads / secs : 0.0);
+
+    return APR_SUCCESS;
+}
+
+int main(int argc, const char * const *argv)
+{
+    static const int default_writes[] = { 0, 10, 50 };
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    int i, w, nwrites = 3, only_writes = -1;
+
+    printf("APR Concurrent Skip List Performance Test\n==============\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "c:t:w:", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'c') {
+            max_counter = atol(optarg);
+        }
+        else if (optchar == 't') {
+            max_threads = atoi(optarg);
+            if (max_threads < 1 || max_threads > DEFAULT_MAX_THREADS) {
+                max_threads = DEFAULT_MAX_THREADS;
+            }
+        }
+        else if (optchar == 'w') {
+            only_writes = atoi(optarg);
+            if (only_writes < 0 || only_writes > 100) {
+                only_writes = -1;
+            }
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+    if (only_writes >= 0) {
+        nwrites = 1;
+    }
+
+    for (i = 0; i < NUM_KEYS; i++) {
+        keys[i] = i;
+    }
+
+    for (w = 0; w < nwrites; w++) {
+        writes = only_writes >= 0 ? only_writes : default_writes[w];
+
+        if ((rv = apr_skiplist_init(&locked_sl, pool)) != APR_SUCCESS
+                || (rv = apr_thread_mutex_create(&locked_mutex,
+                                                 APR_THREAD_MUTEX_DEFAULT,
+                                                 pool)) != APR_SUCCESS
+                || (rv = apr_cskiplist_create(&csl, int_compare,
+                                              pool)) != APR_SUCCESS) {
+            fprintf(stderr, "Could not create the skip lists: [%d] %s\n",
+                    rv, apr_strerror(rv, errmsg, sizeof errmsg));
+            exit(-1);
+        }
+        apr_skiplist_set_compare(locked_sl, int_compare, int_compare);
+        for (i = 0; i < NUM_KEYS; i += 2) {
+            apr_skiplist_insert(locked_sl, &keys[i]);
+            apr_cskiplist_insert(csl, &keys[i]);
+        }
+
+        printf("find/insert/remove (%ld per thread, %d%% writes, %d keys)\n",
+               max_counter, writes, NUM_KEYS);
+        for (i = 1; i <= max_threads; i *= 2) {
+            if ((rv = test_threads("mutex", i, locked_thread)) != APR_SUCCESS
+                    || (rv = test_threads("cskiplist", i, csl_thread))
+                       != APR_SUCCESS) {
+                fprintf(stderr, "thread test failed : [%d] %s\n",
+                        rv, apr_strerror(rv, errmsg, sizeof errmsg));
+                exit(-2);
+            }
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
+
+#endif /* !APR_HAS_THREADS */
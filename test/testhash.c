@@ -539,6 +539,257 @@ static void overlay_fetch(abts_case *tc, void *data)
                        apr_hash_get(overlay, "overlay5", APR_HASH_KEY_STRING));
 }
 
+static void flat_hash(abts_case *tc, void *data)
+{
+    apr_hash_t *h, *h2, *base, *result;
+    apr_hash_index_t *hi;
+    char **keys;
+    int i, count, sum;
+
+    h = apr_hash_make_flat(p, NULL);
+    ABTS_PTR_NOTNULL(tc, h);
+
+    keys = apr_palloc(p, 1000 * sizeof(*keys));
+    for (i = 0; i < 1000; i++) {
+        keys[i] = apr_psprintf(p, "key%d", i);
+        apr_hash_set(h, keys[i], APR_HASH_KEY_STRING, keys[i]);
+    }
+    ABTS_INT_EQUAL(tc, 1000, apr_hash_count(h));
+    for (i = 0; i < 1000; i++) {
+        ABTS_STR_EQUAL(tc, keys[i],
+                       apr_hash_get(h, keys[i], APR_HASH_KEY_STRING));
+    }
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_get(h, "key1000", APR_HASH_KEY_STRING));
+
+    /* delete the odd keys, replace the others */
+    for (i = 1; i < 1000; i += 2) {
+        apr_hash_set(h, keys[i], APR_HASH_KEY_STRING, NULL);
+    }
+    for (i = 0; i < 1000; i += 2) {
+        apr_hash_set(h, keys[i], APR_HASH_KEY_STRING, "even");
+    }
+    ABTS_INT_EQUAL(tc, 500, apr_hash_count(h));
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_get(h, "key1", APR_HASH_KEY_STRING));
+    ABTS_STR_EQUAL(tc, "even", apr_hash_get(h, "key2", APR_HASH_KEY_STRING));
+    ABTS_STR_EQUAL(tc, "even",
+                   apr_hash_get_or_set(h, "key4", APR_HASH_KEY_STRING, "x"));
+    ABTS_STR_EQUAL(tc, "odd",
+                   apr_hash_get_or_set(h, "key3", APR_HASH_KEY_STRING, "odd"));
+    apr_hash_set(h, "key3", APR_HASH_KEY_STRING, NULL);
+
+    /* churn through the tombstones */
+    for (i = 0; i < 10000; i++) {
+        apr_hash_set(h, keys[1 + i % 500 * 2], APR_HASH_KEY_STRING, "odd");
+        apr_hash_set(h, keys[1 + i % 500 * 2], APR_HASH_KEY_STRING, NULL);
+    }
+    ABTS_INT_EQUAL(tc, 500, apr_hash_count(h));
+
+    count = sum = 0;
+    for (hi = apr_hash_first(p, h); hi; hi = apr_hash_next(hi)) {
+        const char *key = apr_hash_this_key(hi);
+        ABTS_INT_EQUAL(tc, 0, atoi(key + 3) % 2);
+        ABTS_STR_EQUAL(tc, "even", apr_hash_this_val(hi));
+        sum += atoi(key + 3);
+        count++;
+    }
+    ABTS_INT_EQUAL(tc, 500, count);
+    ABTS_INT_EQUAL(tc, 249500, sum);
+
+    h2 = apr_hash_copy(p, h);
+    apr_hash_clear(h);
+    ABTS_INT_EQUAL(tc, 0, apr_hash_count(h));
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_first(p, h));
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_get(h, "key2", APR_HASH_KEY_STRING));
+    ABTS_INT_EQUAL(tc, 500, apr_hash_count(h2));
+    ABTS_STR_EQUAL(tc, "even", apr_hash_get(h2, "key998", APR_HASH_KEY_STRING));
+
+    /* overlay a chained table on a flat one, and vice versa */
+    base = apr_hash_make(p);
+    apr_hash_set(base, "key1", APR_HASH_KEY_STRING, "base");
+    apr_hash_set(base, "key2", APR_HASH_KEY_STRING, "base");
+    result = apr_hash_overlay(p, base, h2);
+    ABTS_INT_EQUAL(tc, 501, apr_hash_count(result));
+    ABTS_STR_EQUAL(tc, "base", apr_hash_get(result, "key1", APR_HASH_KEY_STRING));
+    ABTS_STR_EQUAL(tc, "base", apr_hash_get(result, "key2", APR_HASH_KEY_STRING));
+    ABTS_STR_EQUAL(tc, "even", apr_hash_get(result, "key4", APR_HASH_KEY_STRING));
+    result = apr_hash_overlay(p, h2, base);
+    ABTS_INT_EQUAL(tc, 501, apr_hash_count(result));
+    ABTS_STR_EQUAL(tc, "base", apr_hash_get(result, "key1", APR_HASH_KEY_STRING));
+    ABTS_STR_EQUAL(tc, "even", apr_hash_get(result, "key2", APR_HASH_KEY_STRING));
+}
+
+static void flat_hash_custom(abts_case *tc, void *data)
+{
+    apr_hash_t *h;
+    char *result;
+
+    h = apr_hash_make_flat(p, hash_custom);
+    ABTS_PTR_NOTNULL(tc, h);
+
+    apr_hash_set(h, "same1", 5, "same");
+    apr_hash_set(h, "same2", 5, "same");
+    result = apr_hash_get(h, "same1", 5);
+    ABTS_STR_EQUAL(tc, "same", result);
+    result = apr_hash_get(h, "same2", 5);
+    ABTS_STR_EQUAL(tc, "same", result);
+    ABTS_INT_EQUAL(tc, 2, apr_hash_count(h));
+}
+
+static int sum_values(void *rec, const void *key, apr_ssize_t klen,
+                      const void *value)
+{
+    int *sum = rec;
+
+    *sum += atoi((const char *)value);
+    return 1;
+}
+
+static void frozen_hash(abts_case *tc, void *data)
+{
+    apr_pool_t *subp;
+    apr_hash_t *h, *frozen, *copy;
+    apr_hash_index_t *hi;
+    char key[32];
+    int i, count, sum;
+
+    /* the source table and keys can go away, for chained, flat and
+     * custom hashed tables
+     */
+    for (i = 0; i < 3; i++) {
+        int k;
+
+        apr_pool_create(&subp, p);
+        h = (i == 0) ? apr_hash_make(subp)
+            : (i == 1) ? apr_hash_make_flat(subp, NULL)
+            : apr_hash_make_custom(subp, apr_hashfunc_default);
+        for (k = 0; k < 1000; k++) {
+            apr_hash_set(h, apr_psprintf(subp, "key%d", k),
+                         APR_HASH_KEY_STRING, apr_itoa(p, k));
+        }
+        apr_hash_set(h, "binary\0key", 10, "10");
+        frozen = apr_hash_freeze(p, h);
+        apr_pool_destroy(subp);
+
+        ABTS_INT_EQUAL(tc, 1001, apr_hash_count(frozen));
+        for (k = 0; k < 1000; k += 7) {
+            apr_snprintf(key, sizeof(key), "key%d", k);
+            ABTS_INT_EQUAL(tc, k, atoi(apr_hash_get(frozen, key,
+                                                    APR_HASH_KEY_STRING)));
+        }
+        ABTS_STR_EQUAL(tc, "10", apr_hash_get(frozen, "binary\0key", 10));
+        ABTS_PTR_EQUAL(tc, NULL, apr_hash_get(frozen, "binary", 6));
+        ABTS_PTR_EQUAL(tc, NULL, apr_hash_get(frozen, "key1000",
+                                              APR_HASH_KEY_STRING));
+
+        count = sum = 0;
+        for (hi = apr_hash_first(p, frozen); hi; hi = apr_hash_next(hi)) {
+            const char *k2 = apr_hash_this_key(hi);
+            if (apr_hash_this_key_len(hi) != 10) {
+                ABTS_INT_EQUAL(tc, atoi(k2 + 3),
+                               atoi(apr_hash_this_val(hi)));
+            }
+            sum += atoi(apr_hash_this_val(hi));
+            count++;
+        }
+        ABTS_INT_EQUAL(tc, 1001, count);
+        ABTS_INT_EQUAL(tc, 499510, sum);
+        sum = 0;
+        ABTS_INT_EQUAL(tc, TRUE, apr_hash_do(sum_values, &sum, frozen));
+        ABTS_INT_EQUAL(tc, 499510, sum);
+    }
+
+    /* copies and merges are not frozen, the frozen table is read-only */
+    copy = apr_hash_copy(p, frozen);
+    apr_hash_set(copy, "key1", APR_HASH_KEY_STRING, NULL);
+    ABTS_INT_EQUAL(tc, 1000, apr_hash_count(copy));
+    ABTS_STR_EQUAL(tc, "1", apr_hash_get(frozen, "key1", 4));
+    copy = apr_hash_overlay(p, copy, frozen);
+    ABTS_INT_EQUAL(tc, 1001, apr_hash_count(copy));
+    ABTS_STR_EQUAL(tc, "new", apr_hash_get_or_set(copy, "new", 3, "new"));
+    ABTS_INT_EQUAL(tc, 1002, apr_hash_count(copy));
+
+    ABTS_STR_EQUAL(tc, "2", apr_hash_get_or_set(frozen, "key2", 4, "x"));
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_get_or_set(frozen, "new", 3, NULL));
+    ABTS_INT_EQUAL(tc, 1001, apr_hash_count(frozen));
+#if !APR_POOL_DEBUG
+    /* modifications leave the frozen table alone */
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_get_or_set(frozen, "new", 3, "new"));
+    apr_hash_set(frozen, "key1", 4, NULL);
+    apr_hash_clear(frozen);
+    ABTS_INT_EQUAL(tc, 1001, apr_hash_count(frozen));
+    ABTS_STR_EQUAL(tc, "1", apr_hash_get(frozen, "key1", 4));
+#endif
+
+    frozen = apr_hash_freeze(p, apr_hash_make(p));
+    ABTS_INT_EQUAL(tc, 0, apr_hash_count(frozen));
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_first(p, frozen));
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_get(frozen, "key", 3));
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_get_or_set(frozen, "key", 3, NULL));
+}
+
+static void hash_func_fast(abts_case *tc, void *data)
+{
+    const char *key = "a longer key, over forty-eight bytes, like an URL";
+    apr_ssize_t klen = APR_HASH_KEY_STRING, len;
+    unsigned int hash;
+    char buf[64];
+
+    hash = apr_hashfunc_fast(key, &klen);
+    ABTS_INT_EQUAL(tc, strlen(key), klen);
+
+    /* all the lengths, and an unaligned copy */
+    for (len = 0; len <= klen; len++) {
+        apr_ssize_t l = len;
+        memcpy(buf + 1, key, len);
+        ABTS_INT_EQUAL(tc, apr_hashfunc_fast(key, &l),
+                       apr_hashfunc_fast(buf + 1, &l));
+        ABTS_INT_EQUAL(tc, len, l);
+        if (len < klen) {
+            ABTS_ASSERT(tc, "prefix hash differs",
+                        apr_hashfunc_fast(key, &l) != hash);
+        }
+    }
+}
+
+static void hash_make_ex(abts_case *tc, void *data)
+{
+    static const unsigned int flags[] = {
+        0, APR_HASH_SIPHASH, APR_HASH_FLAT, APR_HASH_FLAT | APR_HASH_SIPHASH
+    };
+    apr_hash_t *h, *h2;
+    char *key;
+    int i, j;
+
+    for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+        h = apr_hash_make_ex(p, flags[i]);
+#if !APR_HAS_RANDOM
+        if (flags[i] & APR_HASH_SIPHASH) {
+            ABTS_PTR_EQUAL(tc, NULL, h);
+            continue;
+        }
+#endif
+        ABTS_PTR_NOTNULL(tc, h);
+
+        for (j = 0; j < 100; j++) {
+            key = apr_psprintf(p, "key%d", j);
+            apr_hash_set(h, key, APR_HASH_KEY_STRING, key);
+        }
+        ABTS_INT_EQUAL(tc, 100, apr_hash_count(h));
+        ABTS_STR_EQUAL(tc, "key42", apr_hash_get(h, "key42", 5));
+        ABTS_STR_EQUAL(tc, "key99",
+                       apr_hash_get(h, "key99", APR_HASH_KEY_STRING));
+
+        h2 = apr_hash_make(p);
+        apr_hash_set(h2, "key42", APR_HASH_KEY_STRING, "overlay");
+        apr_hash_set(h2, "key100", APR_HASH_KEY_STRING, "overlay");
+        h2 = apr_hash_overlay(p, h2, apr_hash_copy(p, h));
+        ABTS_INT_EQUAL(tc, 101, apr_hash_count(h2));
+        ABTS_STR_EQUAL(tc, "overlay", apr_hash_get(h2, "key42", 5));
+        ABTS_STR_EQUAL(tc, "overlay", apr_hash_get(h2, "key100", 6));
+        ABTS_STR_EQUAL(tc, "key7", apr_hash_get(h2, "key7", 4));
+    }
+}
+
 abts_suite *testhash(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -565,6 +816,13 @@ abts_suite *testhash(abts_suite *suite)
     abts_run_test(suite, overlay_same, NULL);
     abts_run_test(suite, overlay_fetch, NULL);
 
+    abts_run_test(suite, flat_hash, NULL);
+    abts_run_test(suite, flat_hash_custom, NULL);
+    abts_run_test(suite, frozen_hash, NULL);
+
+    abts_run_test(suite, hash_func_fast, NULL);
+    abts_run_test(suite, hash_make_ex, NULL);
+
     return suite;
 }
 
@@ -0,0 +1,275 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_hash.h"
+#include "apr_siphash.h"
+#include "apr_pools.h"
+#include "apr_strings.h"
+#include "apr_time.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_MAX_ENTRIES 100000
+#define DEFAULT_MAX_ROUNDS  10
+#define FUNC_KEYS           1000
+
+static int max_entries = DEFAULT_MAX_ENTRIES;
+static int max_rounds = DEFAULT_MAX_ROUNDS;
+static apr_pool_t *pool;
+static char **keys;
+static char **lookups;
+static int *order;
+static unsigned int hash_sum;
+
+typedef apr_hash_t *make_fn_t(apr_pool_t *p);
+
+static apr_hash_t *make_chained(apr_pool_t *p)
+{
+    return apr_hash_make(p);
+}
+
+static apr_hash_t *make_times33(apr_pool_t *p)
+{
+    return apr_hash_make_custom(p, apr_hashfunc_default);
+}
+
+static apr_hash_t *make_siphash(apr_pool_t *p)
+{
+    return apr_hash_make_ex(p, APR_HASH_SIPHASH);
+}
+
+static apr_hash_t *make_flat(apr_pool_t *p)
+{
+    return apr_hash_make_flat(p, NULL);
+}
+
+static const unsigned char sipkey[APR_SIPHASH_KSIZE] = "0123456789abcdef";
+
+static unsigned int hashfunc_siphash13(const char *key, apr_ssize_t *klen)
+{
+    return (unsigned int)apr_siphash13(key, *klen, sipkey);
+}
+
+static unsigned int hashfunc_siphash24(const char *key, apr_ssize_t *klen)
+{
+    return (unsigned int)apr_siphash24(key, *klen, sipkey);
+}
+
+/* Hash keys of random lengths between min_len and max_len */
+static void test_hashfunc(const char *name, apr_hashfunc_t func,
+                          int min_len, int max_len)
+{
+    apr_pool_t *p;
+    char *keys[FUNC_KEYS];
+    apr_ssize_t lens[FUNC_KEYS], klen;
+    apr_time_t start, usecs;
+    long total = 0;
+    int i, j, r;
+
+    apr_pool_create(&p, pool);
+    srand(min_len);
+    for (i = 0; i < FUNC_KEYS; i++) {
+        lens[i] = min_len + rand() % (max_len - min_len + 1);
+        keys[i] = apr_palloc(p, lens[i]);
+        for (j = 0; j < lens[i]; j++) {
+            keys[i][j] = ' ' + rand() % 95;
+        }
+    }
+
+    start = apr_time_now();
+    for (r = 0; r < max_rounds * 100; r++) {
+        for (i = 0; i < FUNC_KEYS; i++) {
+            klen = lens[i];
+            hash_sum += func(keys[i], &klen);
+        }
+        total += FUNC_KEYS;
+    }
+    usecs = apr_time_now() - start;
+
+    printf("    %-10s %4d-%-4d bytes: %8.2f ns/key\n", name, min_len,
+           max_len, (double)usecs * 1000 / total);
+    apr_pool_destroy(p);
+}
+
+static void test_hashfuncs(int min_len, int max_len)
+{
+    test_hashfunc("times33", apr_hashfunc_default, min_len, max_len);
+    test_hashfunc("fast", apr_hashfunc_fast, min_len, max_len);
+    test_hashfunc("siphash13", hashfunc_siphash13, min_len, max_len);
+    test_hashfunc("siphash24", hashfunc_siphash24, min_len, max_len);
+}
+
+static void report(const char *name, const char *op, apr_time_t usecs,
+                   long ops)
+{
+    double secs = (double)usecs / APR_USEC_PER_SEC;
+
+    printf("    %-8s %-8s: %10" APR_INT64_T_FMT " usec, %12.0f ops/s\n",
+           name, op, (apr_int64_t)usecs, secs > 0 ? (double)ops / secs : 0.0);
+}
+
+/* Set the entries in a table made by make(), and get and iterate them in
+ * that table, or with freeze in a frozen copy.
+ */
+static void test_hash(const char *name, make_fn_t *make, int freeze)
+{
+    apr_pool_t *p;
+    apr_hash_t *h;
+    apr_hash_index_t *hi;
+    apr_time_t start, set_time = 0, freeze_time = 0, get_time = 0;
+    apr_time_t iter_time = 0;
+    long found = 0, iterated = 0;
+    int i, r;
+
+    for (r = 0; r < max_rounds; r++) {
+        apr_pool_create(&p, pool);
+
+        start = apr_time_now();
+        h = make(p);
+        for (i = 0; i < max_entries; i++) {
+            apr_hash_set(h, keys[i], APR_HASH_KEY_STRING, keys[i]);
+        }
+        set_time += apr_time_now() - start;
+
+        if (freeze) {
+            start = apr_time_now();
+            h = apr_hash_freeze(p, h);
+            freeze_time += apr_time_now() - start;
+        }
+
+        /* half of the lookups hit, the other half miss */
+        start = apr_time_now();
+        for (i = 0; i < max_entries; i++) {
+            const char *key = lookups[order[i]] + (i & 1);
+            if (apr_hash_get(h, key, APR_HASH_KEY_STRING)) {
+                found++;
+            }
+        }
+        get_time += apr_time_now() - start;
+
+        start = apr_time_now();
+        for (hi = apr_hash_first(p, h); hi; hi = apr_hash_next(hi)) {
+            if (apr_hash_this_val(hi)) {
+                iterated++;
+            }
+        }
+        iter_time += apr_time_now() - start;
+
+        apr_pool_destroy(p);
+    }
+    if (iterated != (long)max_entries * max_rounds
+            || found != (long)((max_entries + 1) / 2) * max_rounds) {
+        fprintf(stderr, "%s: unexpected results\n", name);
+        exit(-2);
+    }
+
+    report(name, "set", set_time, (long)max_entries * max_rounds);
+    if (freeze) {
+        report(name, "freeze", freeze_time, (long)max_entries * max_rounds);
+    }
+    report(name, "get", get_time, (long)max_entries * max_rounds);
+    report(name, "iterate", iter_time, (long)max_entries * max_rounds);
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    int i;
+
+    printf("APR Hash Performance Test\n==============\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "n:r:", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'n') {
+            max_entries = atoi(optarg);
+            if (max_entries < 1) {
+                max_entries = DEFAULT_MAX_ENTRIES;
+            }
+        }
+        else if (optchar == 'r') {
+            max_rounds = atoi(optarg);
+            if (max_rounds < 1) {
+                max_rounds = DEFAULT_MAX_ROUNDS;
+            }
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    /* Keys are "k<i>", the lookups of "<i>" (skipping the 'k') miss.
+     * Lookups are in random order, so that they don't benefit from the
+     * locality of the keys and entries allocated in insertion order, and
+     * with other copies of the keys (as in real use, where the keys come
+     * from the outside), which aren't already in the cache.
+     */
+    keys = apr_palloc(pool, max_entries * sizeof(*keys));
+    order = apr_palloc(pool, max_entries * sizeof(*order));
+    for (i = 0; i < max_entries; i++) {
+        keys[i] = apr_psprintf(pool, "k%d", i);
+        order[i] = i;
+    }
+    lookups = apr_palloc(pool, max_entries * sizeof(*lookups));
+    for (i = 0; i < max_entries; i++) {
+        lookups[i] = apr_pstrdup(pool, keys[i]);
+    }
+    srand(1);
+    for (i = max_entries - 1; i > 0; i--) {
+        int j = rand() % (i + 1), tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    printf("apr_hash set/get/iterate (%d entries, %d rounds)\n",
+           max_entries, max_rounds);
+    test_hash("times33", make_times33, 0);
+    test_hash("chained", make_chained, 0);
+    if (make_siphash(pool)) {
+        test_hash("siphash", make_siphash, 0);
+    }
+    test_hash("flat", make_flat, 0);
+    test_hash("frozen", make_chained, 1);
+
+    printf("\nhash functions (%d keys, %d rounds)\n", FUNC_KEYS,
+           max_rounds * 100);
+    test_hashfuncs(1, 8);
+    test_hashfuncs(8, 32);
+    test_hashfuncs(32, 128);
+    test_hashfuncs(128, 1024);
+
+    return 0;
+}
@@ -17,7 +17,11 @@
 
 #include "apr_general.h"
 #include "apr_pools.h"
+#include "apr_allocator.h"
+#include "apr_thread_proc.h"
+#include "apr_thread_mutex.h"
 #include "apr_errno.h"
+#include "apr_strings.h"
 #include "apr_file_io.h"
 #include <string.h>
 #include <stdlib.h>
@@ -139,6 +143,412 @@ static void test_cleanups(abts_case *tc, void *data)
     }
 }
 
+static void test_palloc_aligned(abts_case *tc, void *data)
+{
+    apr_size_t alignment;
+    apr_pool_t *pool;
+    char *mem, *mem2;
+    int i;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_pool_create(&pool, pmain));
+
+    ABTS_PTR_EQUAL(tc, NULL, apr_palloc_aligned(pool, 10, 0));
+    ABTS_PTR_EQUAL(tc, NULL, apr_palloc_aligned(pool, 10, 48));
+
+    for (alignment = 1; alignment <= 8192; alignment <<= 1) {
+        for (i = 0; i < 50; i++) {
+            apr_palloc(pool, i);
+            mem = apr_palloc_aligned(pool, i * 37 + 1, alignment);
+            ABTS_PTR_NOTNULL(tc, mem);
+            ABTS_INT_EQUAL(tc, 0, (int)((apr_uintptr_t)mem & (alignment - 1)));
+            memset(mem, 'a', i * 37 + 1);
+        }
+    }
+
+#if !APR_POOL_DEBUG
+    /* Small aligned blocks are packed in the same node (the first one
+     * after a clear, so that they don't straddle a node boundary).
+     */
+    apr_pool_clear(pool);
+    mem = apr_palloc_aligned(pool, 64, 64);
+    mem2 = apr_palloc_aligned(pool, 64, 64);
+    ABTS_PTR_EQUAL(tc, mem + 64, mem2);
+#else
+    (void)mem2;
+#endif
+
+    apr_pool_destroy(pool);
+}
+
+static void test_pool_bump(abts_case *tc, void *data)
+{
+    apr_pool_bump_t bump;
+    apr_pool_t *pool;
+    char *first, *mem = NULL;
+    int i;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_pool_create(&pool, pmain));
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_pool_bump_reserve(pool, 2000, &bump));
+    first = bump.first_avail;
+    for (i = 0; i < 100; i++) {
+        mem = apr_pool_bump_alloc(&bump, 10);
+        ABTS_PTR_EQUAL(tc, first + i * APR_ALIGN_DEFAULT(10), mem);
+        memcpy(mem, "0123456789", 10);
+    }
+    ABTS_TRUE(tc, bump.first_avail <= bump.endp);
+    apr_pool_bump_release(pool, &bump);
+
+#if !APR_POOL_DEBUG
+    /* The unused part was given back */
+    mem = apr_palloc(pool, 8);
+    ABTS_PTR_EQUAL(tc, first + 100 * APR_ALIGN_DEFAULT(10), mem);
+
+    /* Nothing to give back once something else got allocated */
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_pool_bump_reserve(pool, 64, &bump));
+    first = bump.first_avail;
+    mem = apr_palloc(pool, 8);
+    apr_pool_bump_release(pool, &bump);
+    ABTS_PTR_EQUAL(tc, first + 64 + 8, apr_palloc(pool, 8));
+#endif
+
+    apr_pool_destroy(pool);
+}
+
+static char mark_order[8];
+static int mark_count;
+
+static apr_status_t mark_order_cleanup(void *data)
+{
+    mark_order[mark_count++] = *(const char *)data;
+    return APR_SUCCESS;
+}
+
+static void test_pool_mark(abts_case *tc, void *data)
+{
+    apr_pool_mark_t mark1, mark2;
+    apr_pool_t *pool;
+    char *before, *mem, *end;
+    int i;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_pool_create(&pool, pmain));
+    mark_count = 0;
+
+    apr_pool_cleanup_register(pool, "0", mark_order_cleanup,
+                              apr_pool_cleanup_null);
+    apr_palloc(pool, 8);
+    apr_pool_mark(pool, &mark1);
+    before = apr_palloc(pool, 0);
+    apr_pool_cleanup_register(pool, "1", mark_order_cleanup,
+                              apr_pool_cleanup_null);
+    mem = apr_palloc(pool, 100 * 1024);
+    memset(mem, 'a', 100 * 1024);
+    apr_pool_mark(pool, &mark2);
+    apr_pool_cleanup_register(pool, "2", mark_order_cleanup,
+                              apr_pool_cleanup_null);
+    apr_pool_cleanup_register(pool, "x", mark_order_cleanup,
+                              apr_pool_cleanup_null);
+    apr_pool_cleanup_kill(pool, "x", mark_order_cleanup);
+    apr_palloc(pool, 200 * 1024);
+    apr_pool_pre_cleanup_register(pool, "3", mark_order_cleanup);
+
+    /* Rewinding the outer mark rewinds the inner one first */
+    apr_pool_rewind(pool, &mark1);
+    ABTS_INT_EQUAL(tc, 3, mark_count);
+    ABTS_INT_EQUAL(tc, '3', mark_order[0]);
+    ABTS_INT_EQUAL(tc, '2', mark_order[1]);
+    ABTS_INT_EQUAL(tc, '1', mark_order[2]);
+    apr_pool_rewind(pool, &mark2);
+    ABTS_INT_EQUAL(tc, 3, mark_count);
+
+    /* Scratch loops don't grow the pool (an empty allocation gives the
+     * current position, even at the end of the active node).
+     */
+    mem = apr_palloc(pool, 8);
+    end = apr_palloc(pool, 0);
+    for (i = 0; i < 1000; i++) {
+        apr_pool_mark(pool, &mark1);
+        apr_palloc(pool, (i % 10) * 1000);
+        apr_pool_cleanup_register(pool, "4", apr_pool_cleanup_null,
+                                  apr_pool_cleanup_null);
+        apr_pool_rewind(pool, &mark1);
+    }
+#if !APR_POOL_DEBUG
+    ABTS_PTR_EQUAL(tc, before, mem);
+    ABTS_PTR_EQUAL(tc, end, apr_palloc(pool, 0));
+#else
+    (void)before;
+    (void)end;
+#endif
+
+    /* Outstanding marks are rewound by clear */
+    apr_pool_mark(pool, &mark1);
+    apr_pool_cleanup_register(pool, "5", mark_order_cleanup,
+                              apr_pool_cleanup_null);
+    apr_pool_clear(pool);
+    ABTS_INT_EQUAL(tc, 5, mark_count);
+    ABTS_INT_EQUAL(tc, '5', mark_order[3]);
+    ABTS_INT_EQUAL(tc, '0', mark_order[4]);
+
+    apr_pool_destroy(pool);
+}
+
+static apr_uint32_t arena_flags[] = {
+    APR_ALLOCATOR_HUGE_PAGES,
+    APR_ALLOCATOR_NUMA_LOCAL,
+    APR_ALLOCATOR_HUGE_PAGES | APR_ALLOCATOR_NUMA_LOCAL
+};
+
+static void test_arena_allocator(abts_case *tc, void *data)
+{
+    apr_uint32_t flags = *(apr_uint32_t *)data;
+    apr_allocator_t *allocator;
+    apr_memnode_t *node1, *node2;
+    apr_pool_t *owner;
+    apr_size_t size;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_allocator_create_ex(&allocator, flags);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "Huge pages or NUMA local allocator");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* Nodes are carved contiguously from the region */
+    size = apr_allocator_align(allocator, 100);
+    node1 = apr_allocator_alloc(allocator, 100);
+    ABTS_PTR_NOTNULL(tc, node1);
+    node2 = apr_allocator_alloc(allocator, 100);
+    ABTS_PTR_NOTNULL(tc, node2);
+    ABTS_PTR_EQUAL(tc, (char *)node1 + size, (char *)node2);
+    apr_allocator_free(allocator, node1);
+    apr_allocator_free(allocator, node2);
+
+    /* ... and recycled even above the max free threshold */
+    apr_allocator_max_free_set(allocator, 1);
+    node1 = apr_allocator_alloc(allocator, 100);
+    ABTS_PTR_NOTNULL(tc, node1);
+    apr_allocator_free(allocator, node1);
+    node2 = apr_allocator_alloc(allocator, 100);
+    ABTS_PTR_EQUAL(tc, node1, node2);
+    apr_allocator_free(allocator, node2);
+
+    rv = apr_pool_create_ex(&owner, NULL, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_owner_set(allocator, owner);
+#if APR_HAS_THREADS
+    /* NUMA local nodes don't go through the thread caches */
+    rv = apr_allocator_thread_cache_set(allocator, 8, owner);
+    if (flags & APR_ALLOCATOR_NUMA_LOCAL) {
+        ABTS_INT_EQUAL(tc, APR_ENOTIMPL, rv);
+    }
+    else {
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+#endif
+    for (i = 0; i < 1000; i++) {
+        char *mem = apr_palloc(owner, (i % 20) * 4096 + 1);
+        ABTS_PTR_NOTNULL(tc, mem);
+        mem[0] = 'a';
+        if (i % 100 == 0) {
+            apr_pool_clear(owner);
+        }
+    }
+    apr_palloc(owner, 1024 * 1024);
+    apr_pool_destroy(owner);
+}
+
+static void test_allocator_stats(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_allocator_stats_t stats;
+    apr_memnode_t *node;
+    apr_size_t size;
+    apr_status_t rv;
+
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    size = apr_allocator_align(allocator, 100);
+
+    node = apr_allocator_alloc(allocator, 100);
+    ABTS_PTR_NOTNULL(tc, node);
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_SIZE_EQUAL(tc, 1, stats.nodes_alloc);
+    ABTS_SIZE_EQUAL(tc, 1, stats.nodes_sys_alloc);
+    ABTS_SIZE_EQUAL(tc, size, stats.bytes_total);
+    ABTS_SIZE_EQUAL(tc, 0, stats.bytes_free);
+    ABTS_SIZE_EQUAL(tc, size, stats.bytes_used);
+
+    /* Recycled nodes are held on the free lists */
+    apr_allocator_free(allocator, node);
+    node = apr_allocator_alloc(allocator, 100);
+    apr_allocator_free(allocator, node);
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_SIZE_EQUAL(tc, 2, stats.nodes_alloc);
+    ABTS_SIZE_EQUAL(tc, 2, stats.nodes_free);
+    ABTS_SIZE_EQUAL(tc, 1, stats.nodes_sys_alloc);
+    ABTS_SIZE_EQUAL(tc, size, stats.bytes_free);
+    ABTS_SIZE_EQUAL(tc, 0, stats.bytes_used);
+
+    /* ... until given back to the system */
+    apr_allocator_max_free_set(allocator, 1);
+    node = apr_allocator_alloc(allocator, 100);
+    apr_allocator_free(allocator, node);
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_SIZE_EQUAL(tc, 1, stats.nodes_sys_free);
+    ABTS_SIZE_EQUAL(tc, 0, stats.bytes_total);
+    ABTS_SIZE_EQUAL(tc, 0, stats.bytes_free);
+    ABTS_SIZE_EQUAL(tc, size, stats.bytes_total_max);
+
+    apr_allocator_destroy(allocator);
+}
+
+static int find_stats(void *rec, const apr_pool_stats_t *stats)
+{
+    apr_pool_stats_t *found = rec;
+
+    if (stats->tag && strcmp(stats->tag, "testpool-stats") == 0) {
+        *found = *stats;
+        return 0;
+    }
+    return 1;
+}
+
+static void test_pool_stats(abts_case *tc, void *data)
+{
+    apr_pool_stats_t stats;
+    apr_pool_t *pool;
+    apr_status_t rv;
+
+    apr_pool_stats_enable(1);
+    rv = apr_pool_create(&pool, pmain);
+    apr_pool_stats_enable(0);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_pool_tag(pool, "testpool-stats");
+
+    rv = apr_pool_stats_get(pool, &stats);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "Pool statistics with APR_POOL_DEBUG");
+        apr_pool_destroy(pool);
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_SIZE_EQUAL(tc, 0, stats.bytes);
+
+    apr_palloc(pool, 10);
+    apr_palloc(pool, 100);
+    apr_palloc(pool, 64 * 1024);
+    rv = apr_pool_stats_get(pool, &stats);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_STR_EQUAL(tc, "testpool-stats", stats.tag);
+    ABTS_SIZE_EQUAL(tc, 1, stats.palloc[0]);
+    ABTS_SIZE_EQUAL(tc, 1, stats.palloc[3]);
+    ABTS_SIZE_EQUAL(tc, 1, stats.palloc[APR_POOL_STATS_BUCKETS - 1]);
+    ABTS_SIZE_EQUAL(tc, 1, stats.nodes);
+    ABTS_TRUE(tc, stats.bytes >= 10 + 100 + 64 * 1024);
+    ABTS_TRUE(tc, stats.bytes_held > 64 * 1024);
+    ABTS_SIZE_EQUAL(tc, stats.bytes_held, stats.bytes_max);
+
+    /* Clearing starts over */
+    apr_pool_clear(pool);
+    rv = apr_pool_stats_get(pool, &stats);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_SIZE_EQUAL(tc, 0, stats.nodes);
+    ABTS_SIZE_EQUAL(tc, 0, stats.bytes);
+    ABTS_TRUE(tc, stats.bytes_held < 64 * 1024);
+
+    apr_psprintf(pool, "%s", "hello");
+    apr_pool_destroy(pool);
+
+    /* Both cycles are accounted for the tag */
+    memset(&stats, 0, sizeof(stats));
+    ABTS_INT_EQUAL(tc, 0, apr_pool_stats_do(find_stats, &stats));
+    ABTS_SIZE_EQUAL(tc, 2, stats.cycles);
+    ABTS_SIZE_EQUAL(tc, 1, stats.nodes);
+    ABTS_SIZE_EQUAL(tc, 2, stats.palloc[0]);
+    ABTS_TRUE(tc, stats.bytes_max > 64 * 1024);
+}
+
+#if APR_HAS_THREADS
+#define TCACHE_THREADS 4
+
+static void * APR_THREAD_FUNC tcache_thread(apr_thread_t *thd, void *data)
+{
+    apr_pool_t *parent = data;
+    int i;
+
+    for (i = 0; i < 1000; i++) {
+        apr_pool_t *subp;
+
+        if (apr_pool_create(&subp, parent) != APR_SUCCESS) {
+            break;
+        }
+        apr_palloc(subp, (i % 7) * 4096 + 10);
+        apr_palloc(subp, 100);
+        apr_pool_destroy(subp);
+    }
+
+    apr_thread_exit(thd, i == 1000 ? APR_SUCCESS : APR_ENOMEM);
+    return NULL;
+}
+
+static void test_thread_cache(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_thread_mutex_t *mutex;
+    apr_thread_t *threads[TCACHE_THREADS];
+    apr_memnode_t *node1, *node2, *nodes[32];
+    apr_pool_t *owner;
+    apr_status_t rv, retval;
+    int i;
+
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pool_create_ex(&owner, NULL, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_owner_set(allocator, owner);
+    rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, owner);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_mutex_set(allocator, mutex);
+
+    rv = apr_allocator_thread_cache_set(allocator, 0, owner);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+    rv = apr_allocator_thread_cache_set(allocator, 8, owner);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* A freed node is recycled by the same thread */
+    node1 = apr_allocator_alloc(allocator, 3 * 4096);
+    ABTS_PTR_NOTNULL(tc, node1);
+    apr_allocator_free(allocator, node1);
+    node2 = apr_allocator_alloc(allocator, 3 * 4096);
+    ABTS_PTR_EQUAL(tc, node1, node2);
+    apr_allocator_free(allocator, node2);
+
+    /* Overflowing the cache hands nodes back */
+    for (i = 0; i < 32; i++) {
+        nodes[i] = apr_allocator_alloc(allocator, 100);
+        ABTS_PTR_NOTNULL(tc, nodes[i]);
+    }
+    for (i = 0; i < 32; i++) {
+        apr_allocator_free(allocator, nodes[i]);
+    }
+
+    for (i = 0; i < TCACHE_THREADS; i++) {
+        rv = apr_thread_create(&threads[i], NULL, tcache_thread, owner, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < TCACHE_THREADS; i++) {
+        rv = apr_thread_join(&retval, threads[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, retval);
+    }
+
+    apr_pool_destroy(owner);
+}
+#endif /* APR_HAS_THREADS */
+
 abts_suite *testpool(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -150,6 +560,17 @@ abts_suite *testpool(abts_suite *suite)
     abts_run_test(suite, alloc_bytes, NULL);
     abts_run_test(suite, calloc_bytes, NULL);
     abts_run_test(suite, test_cleanups, NULL);
+    abts_run_test(suite, test_palloc_aligned, NULL);
+    abts_run_test(suite, test_pool_bump, NULL);
+    abts_run_test(suite, test_pool_mark, NULL);
+    abts_run_test(suite, test_arena_allocator, &arena_flags[0]);
+    abts_run_test(suite, test_arena_allocator, &arena_flags[1]);
+    abts_run_test(suite, test_arena_allocator, &arena_flags[2]);
+    abts_run_test(suite, test_allocator_stats, NULL);
+    abts_run_test(suite, test_pool_stats, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_thread_cache, NULL);
+#endif
 
     return suite;
 }
@@ -18,9 +18,13 @@
 #include "apr_queue.h"
 #include "apr_thread_pool.h"
 #include "apr_time.h"
+#include "apr_atomic.h"
 #include "abts.h"
 #include "testutil.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #if APR_HAS_THREADS
 
 #define NUMBER_CONSUMERS    3
@@ -29,7 +33,15 @@
 #define PRODUCER_ACTIVITY   5
 #define QUEUE_SIZE          100
 
+#define MPMC_THREADS        4
+#define MPMC_ITEMS          10000
+
+static apr_uint32_t locked_flags = 0;
+static apr_uint32_t lockfree_flags = APR_QUEUE_LOCKFREE;
+
 static apr_queue_t *queue;
+static char seen[MPMC_THREADS * MPMC_ITEMS];
+static apr_uint32_t misordered;
 
 static void * APR_THREAD_FUNC consumer(apr_thread_t *thd, void *data)
 {
@@ -89,6 +101,7 @@ static void * APR_THREAD_FUNC producer(apr_thread_t *thd, void *data)
 
 static void test_queue_producer_consumer(abts_case *tc, void *data)
 {
+    apr_uint32_t flags = *(apr_uint32_t *)data;
     unsigned int i;
     apr_status_t rv;
     apr_thread_pool_t *thrp;
@@ -96,7 +109,7 @@ static void test_queue_producer_consumer(abts_case *tc, void *data)
     /* XXX: non-portable */
     srand((unsigned int)apr_time_now());
 
-    rv = apr_queue_create(&queue, QUEUE_SIZE, p);
+    rv = apr_queue_create_ex(&queue, QUEUE_SIZE, flags, p);
     ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
 
     rv = apr_thread_pool_create(&thrp, 0, NUMBER_CONSUMERS + NUMBER_PRODUCERS, p);
@@ -123,20 +136,23 @@ static void test_queue_producer_consumer(abts_case *tc, void *data)
 
 static void test_queue_timeout(abts_case *tc, void *data)
 {
+    apr_uint32_t flags = *(apr_uint32_t *)data;
+    /* the lock-free capacity is a power of two */
+    unsigned int size = (flags & APR_QUEUE_LOCKFREE) ? 8 : 5;
     apr_queue_t *q;
     apr_status_t rv;
     apr_time_t start;
     unsigned int i;
     void *value;
 
-    rv = apr_queue_create(&q, 5, p);
+    rv = apr_queue_create_ex(&q, size, flags, p);
     ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
 
     for (i = 0; i < 2; ++i) {
         rv = apr_queue_timedpush(q, NULL, apr_time_from_msec(1));
         ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
     }
-    for (i = 0; i < 3; ++i) {
+    for (i = 0; i < size - 2; ++i) {
         rv = apr_queue_trypush(q, NULL);
         ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
     }
@@ -148,12 +164,13 @@ static void test_queue_timeout(abts_case *tc, void *data)
 
     rv = apr_queue_trypush(q, NULL);
     ABTS_TRUE(tc, APR_STATUS_IS_EAGAIN(rv));
+    ABTS_INT_EQUAL(tc, size, apr_queue_size(q));
 
     for (i = 0; i < 2; ++i) {
         rv = apr_queue_timedpop(q, &value, apr_time_from_msec(1));
         ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
     }
-    for (i = 0; i < 3; ++i) {
+    for (i = 0; i < size - 2; ++i) {
         rv = apr_queue_trypop(q, &value);
         ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
     }
@@ -170,15 +187,173 @@ static void test_queue_timeout(abts_case *tc, void *data)
     ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
 }
 
+static void * APR_THREAD_FUNC mpmc_producer(apr_thread_t *thd, void *data)
+{
+    apr_uintptr_t base = (apr_uintptr_t)data * MPMC_ITEMS;
+    apr_uintptr_t i;
+
+    for (i = 0; i < MPMC_ITEMS; i++) {
+        while (apr_queue_push(queue, (void *)(base + i + 1)) == APR_EINTR)
+            ;
+    }
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC mpmc_consumer(apr_thread_t *thd, void *data)
+{
+    apr_uintptr_t last[MPMC_THREADS] = { 0 };
+    int i;
+
+    for (i = 0; i < MPMC_ITEMS; i++) {
+        apr_uintptr_t v;
+        void *value;
+
+        while (apr_queue_pop(queue, &value) == APR_EINTR)
+            ;
+        v = (apr_uintptr_t)value - 1;
+        seen[v]++;
+        /* FIFO: the items of a producer come in order */
+        if (v <= last[v / MPMC_ITEMS] && last[v / MPMC_ITEMS]) {
+            apr_atomic_inc32(&misordered);
+        }
+        last[v / MPMC_ITEMS] = v;
+    }
+    return NULL;
+}
+
+static void test_queue_mpmc(abts_case *tc, void *data)
+{
+    apr_uint32_t flags = *(apr_uint32_t *)data;
+    apr_thread_t *producers[MPMC_THREADS], *consumers[MPMC_THREADS];
+    apr_status_t rv, retval;
+    int i;
+
+    rv = apr_queue_create_ex(&queue, 16, flags, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    memset(seen, 0, sizeof(seen));
+    apr_atomic_set32(&misordered, 0);
+
+    for (i = 0; i < MPMC_THREADS; i++) {
+        rv = apr_thread_create(&consumers[i], NULL, mpmc_consumer, NULL, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        rv = apr_thread_create(&producers[i], NULL, mpmc_producer,
+                               (void *)(apr_uintptr_t)i, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < MPMC_THREADS; i++) {
+        apr_thread_join(&retval, producers[i]);
+        apr_thread_join(&retval, consumers[i]);
+    }
+
+    /* each item popped once */
+    for (i = 0; i < MPMC_THREADS * MPMC_ITEMS; i++) {
+        if (seen[i] != 1) {
+            ABTS_INT_EQUAL(tc, 1, seen[i]);
+            break;
+        }
+    }
+    ABTS_INT_EQUAL(tc, 0, apr_atomic_read32(&misordered));
+    ABTS_INT_EQUAL(tc, 0, apr_queue_size(queue));
+
+    rv = apr_queue_term(queue);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
 #endif /* APR_HAS_THREADS */
 
+static void test_queue_batch(abts_case *tc, void *data)
+{
+    apr_uint32_t flags = *(apr_uint32_t *)data;
+    apr_array_header_t *items;
+    apr_queue_t *q;
+    apr_status_t rv;
+    void *in[12], *out[12];
+    unsigned int i, n;
+    int values[12];
+
+    for (i = 0; i < 12; ++i) {
+        in[i] = &values[i];
+    }
+
+    rv = apr_queue_create_ex(&q, 8, flags, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_queue_push_n(q, in, 0, &n, 0);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 0, n);
+
+    /* only what fits is pushed, without blocking */
+    rv = apr_queue_push_n(q, in, 12, &n, -1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 8, n);
+    ABTS_INT_EQUAL(tc, 8, apr_queue_size(q));
+
+    rv = apr_queue_push_n(q, in + 8, 4, &n, 0);
+    ABTS_TRUE(tc, APR_STATUS_IS_EAGAIN(rv));
+    ABTS_INT_EQUAL(tc, 0, n);
+    rv = apr_queue_push_n(q, in + 8, 4, &n, apr_time_from_msec(1));
+    ABTS_TRUE(tc, APR_STATUS_IS_TIMEUP(rv));
+
+    rv = apr_queue_pop_n(q, out, 3, &n, 0);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 3, n);
+    for (i = 0; i < 3; ++i) {
+        ABTS_PTR_EQUAL(tc, in[i], out[i]);
+    }
+
+    /* wraps around the ring */
+    rv = apr_queue_push_n(q, in + 8, 4, &n, 0);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 3, n);
+
+    rv = apr_queue_pop_n(q, out, 12, &n, -1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 8, n);
+    for (i = 0; i < 8; ++i) {
+        ABTS_PTR_EQUAL(tc, in[i + 3], out[i]);
+    }
+
+    rv = apr_queue_pop_n(q, out, 12, &n, 0);
+    ABTS_TRUE(tc, APR_STATUS_IS_EAGAIN(rv));
+    ABTS_INT_EQUAL(tc, 0, n);
+    rv = apr_queue_pop_n(q, out, 12, NULL, apr_time_from_msec(1));
+    ABTS_TRUE(tc, APR_STATUS_IS_TIMEUP(rv));
+
+    /* what remains is drained after termination */
+    rv = apr_queue_push_n(q, in, 5, NULL, 0);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_queue_term(q);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_queue_pop_n(q, out, 12, &n, 0);
+    ABTS_INT_EQUAL(tc, APR_EOF, rv);
+
+    items = apr_array_make(p, 1, sizeof(void *));
+    rv = apr_queue_drain(q, items);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 5, items->nelts);
+    for (i = 0; i < 5; ++i) {
+        ABTS_PTR_EQUAL(tc, in[i], APR_ARRAY_IDX(items, i, void *));
+    }
+    ABTS_INT_EQUAL(tc, 0, apr_queue_size(q));
+
+    rv = apr_queue_drain(q, items);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 5, items->nelts);
+}
+
 abts_suite *testqueue(abts_suite *suite)
 {
     suite = ADD_SUITE(suite);
 
 #if APR_HAS_THREADS
-    abts_run_test(suite, test_queue_producer_consumer, NULL);
-    abts_run_test(suite, test_queue_timeout, NULL);
+    abts_run_test(suite, test_queue_producer_consumer, &locked_flags);
+    abts_run_test(suite, test_queue_producer_consumer, &lockfree_flags);
+    abts_run_test(suite, test_queue_timeout, &locked_flags);
+    abts_run_test(suite, test_queue_timeout, &lockfree_flags);
+    abts_run_test(suite, test_queue_mpmc, &locked_flags);
+    abts_run_test(suite, test_queue_mpmc, &lockfree_flags);
+    abts_run_test(suite, test_queue_batch, &locked_flags);
+    abts_run_test(suite, test_queue_batch, &lockfree_flags);
 #endif /* APR_HAS_THREADS */
 
     return suite;
@@ -0,0 +1,324 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_queue.h"
+#include "apr_spsc_queue.h"
+#include "apr_thread_proc.h"
+#include "apr_pools.h"
+#include "apr_time.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if !APR_HAS_THREADS
+int main(void)
+{
+    printf("This program won't work on this platform because there is no "
+           "support for threads.\n");
+    return 0;
+}
+#else /* !APR_HAS_THREADS */
+
+#define DEFAULT_MAX_ITEMS   1000000
+#define DEFAULT_CAPACITY    1024
+#define MAX_THREADS         16
+#define MAX_BATCH           256
+
+static long max_items = DEFAULT_MAX_ITEMS;
+static unsigned int capacity = DEFAULT_CAPACITY;
+static unsigned int batch = 1;
+static apr_pool_t *pool;
+static apr_queue_t *queue;
+static apr_spsc_queue_t *spsc;
+static long items_per_thread;
+
+static void * APR_THREAD_FUNC producer(apr_thread_t *thd, void *data)
+{
+    apr_status_t rv = APR_SUCCESS;
+    void *values[MAX_BATCH];
+    unsigned int n;
+    long i;
+
+    if (batch > 1) {
+        for (n = 0; n < batch; n++) {
+            values[n] = &items_per_thread;
+        }
+        for (i = 0; i < items_per_thread && rv == APR_SUCCESS; i += n) {
+            n = batch;
+            if (n > items_per_thread - i) {
+                n = (unsigned int)(items_per_thread - i);
+            }
+            while ((rv = apr_queue_push_n(queue, values, n, &n,
+                                          -1)) == APR_EINTR)
+                ;
+        }
+        apr_thread_exit(thd, rv);
+        return NULL;
+    }
+
+    for (i = 0; i < items_per_thread && rv == APR_SUCCESS; i++) {
+        while ((rv = apr_queue_push(queue, &items_per_thread)) == APR_EINTR)
+            ;
+    }
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC consumer(apr_thread_t *thd, void *data)
+{
+    apr_status_t rv = APR_SUCCESS;
+    void *value, *values[MAX_BATCH];
+    unsigned int n;
+    long i;
+
+    if (batch > 1) {
+        for (i = 0; i < items_per_thread && rv == APR_SUCCESS; i += n) {
+            n = batch;
+            if (n > items_per_thread - i) {
+                n = (unsigned int)(items_per_thread - i);
+            }
+            while ((rv = apr_queue_pop_n(queue, values, n, &n,
+                                         -1)) == APR_EINTR)
+                ;
+        }
+        apr_thread_exit(thd, rv);
+        return NULL;
+    }
+
+    for (i = 0; i < items_per_thread && rv == APR_SUCCESS; i++) {
+        while ((rv = apr_queue_pop(queue, &value)) == APR_EINTR)
+            ;
+    }
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC spsc_producer(apr_thread_t *thd, void *data)
+{
+    apr_status_t rv = APR_SUCCESS;
+    void *values[MAX_BATCH];
+    apr_uint32_t n;
+    long i;
+
+    for (n = 0; n < batch; n++) {
+        values[n] = &items_per_thread;
+    }
+    for (i = 0; i < items_per_thread; i += n) {
+        n = batch;
+        if (n > items_per_thread - i) {
+            n = (apr_uint32_t)(items_per_thread - i);
+        }
+        rv = apr_spsc_queue_push_n(spsc, values, n, &n);
+        if (rv == APR_EAGAIN) {
+            rv = apr_spsc_queue_wait(spsc, APR_POLLOUT, -1);
+        }
+        if (rv != APR_SUCCESS && rv != APR_EINTR) {
+            break;
+        }
+    }
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC spsc_consumer(apr_thread_t *thd, void *data)
+{
+    apr_status_t rv = APR_SUCCESS;
+    void *values[MAX_BATCH];
+    apr_uint32_t n;
+    long i;
+
+    for (i = 0; i < items_per_thread; i += n) {
+        rv = apr_spsc_queue_pop_n(spsc, values, batch, &n);
+        if (rv == APR_EAGAIN) {
+            rv = apr_spsc_queue_wait(spsc, APR_POLLIN, -1);
+        }
+        if (rv != APR_SUCCESS && rv != APR_EINTR) {
+            break;
+        }
+    }
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+
+static apr_status_t test_spsc(void)
+{
+    apr_thread_t *producer, *consumer;
+    apr_time_t time_start, time_stop;
+    apr_status_t rv, retval;
+    double secs;
+
+    rv = apr_spsc_queue_create(&spsc, capacity, sizeof(void *),
+                               APR_SPSC_QUEUE_NOTIFY, pool);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    items_per_thread = max_items;
+
+    time_start = apr_time_now();
+    rv = apr_thread_create(&consumer, NULL, spsc_consumer, NULL, pool);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    rv = apr_thread_create(&producer, NULL, spsc_producer, NULL, pool);
+    if (rv != APR_SUCCESS) {
+        return rv; /* the consumer is left blocked, we exit anyway */
+    }
+    apr_thread_join(&retval, producer);
+    rv = retval;
+    apr_thread_join(&retval, consumer);
+    if (rv == APR_SUCCESS) {
+        rv = retval;
+    }
+    time_stop = apr_time_now();
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    secs = (double)(time_stop - time_start) / APR_USEC_PER_SEC;
+    printf("    %-10s %2d:%-2d threads: %10" APR_INT64_T_FMT " usec, "
+           "%12.0f items/s\n", "spsc", 1, 1,
+           (apr_int64_t)(time_stop - time_start),
+           secs > 0 ? (double)items_per_thread / secs : 0.0);
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t test_queue(const char *name, int num_threads,
+                               apr_uint32_t flags)
+{
+    apr_thread_t *producers[MAX_THREADS], *consumers[MAX_THREADS];
+    apr_time_t time_start, time_stop;
+    apr_status_t rv, retval;
+    double secs;
+    int i, created = 0;
+
+    rv = apr_queue_create_ex(&queue, capacity, flags, pool);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    items_per_thread = max_items / num_threads;
+
+    time_start = apr_time_now();
+    for (i = 0; rv == APR_SUCCESS && i < num_threads; i++) {
+        rv = apr_thread_create(&consumers[i], NULL, consumer, NULL, pool);
+        if (rv == APR_SUCCESS) {
+            rv = apr_thread_create(&producers[i], NULL, producer, NULL,
+                                   pool);
+            if (rv != APR_SUCCESS) {
+                apr_queue_term(queue);
+                apr_thread_join(&retval, consumers[i]);
+            }
+        }
+        if (rv == APR_SUCCESS) {
+            created++;
+        }
+    }
+    for (i = 0; i < created; i++) {
+        apr_thread_join(&retval, producers[i]);
+        if (rv == APR_SUCCESS) {
+            rv = retval;
+        }
+        apr_thread_join(&retval, consumers[i]);
+        if (rv == APR_SUCCESS) {
+            rv = retval;
+        }
+    }
+    time_stop = apr_time_now();
+    apr_queue_term(queue);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    secs = (double)(time_stop - time_start) / APR_USEC_PER_SEC;
+    printf("    %-10s %2d:%-2d threads: %10" APR_INT64_T_FMT " usec, "
+           "%12.0f items/s\n", name, num_threads, num_threads,
+           (apr_int64_t)(time_stop - time_start),
+           secs > 0 ? (double)(items_per_thread * num_threads) / secs : 0.0);
+
+    return APR_SUCCESS;
+}
+
+int main(int argc, const char * const *argv)
+{
+    static const int ratios[] = { 1, 4, 16 };
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    int i;
+
+    printf("APR Queue Performance Test\n==============\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "n:c:b:", &optchar,
+                            &optarg)) == APR_SUCCESS) {
+        if (optchar == 'n') {
+            max_items = atol(optarg);
+            if (max_items < MAX_THREADS) {
+                max_items = DEFAULT_MAX_ITEMS;
+            }
+        }
+        else if (optchar == 'c') {
+            capacity = (unsigned int)atoi(optarg);
+            if (capacity < 1) {
+                capacity = DEFAULT_CAPACITY;
+            }
+        }
+        else if (optchar == 'b') {
+            batch = (unsigned int)atoi(optarg);
+            if (batch < 1 || batch > MAX_BATCH) {
+                batch = 1;
+            }
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    printf("producers:consumers pushing and popping %ld items through a "
+           "queue of %u, by %u\n", max_items, capacity, batch);
+    for (i = 0; i < (int)(sizeof(ratios) / sizeof(ratios[0])); i++) {
+        if ((rv = test_queue("locked", ratios[i], 0)) != APR_SUCCESS
+                || (rv = test_queue("lock-free", ratios[i],
+                                    APR_QUEUE_LOCKFREE)) != APR_SUCCESS
+                || (ratios[i] == 1 && (rv = test_spsc()) != APR_SUCCESS)) {
+            fprintf(stderr, "queue test failed : [%d] %s\n",
+                    rv, apr_strerror(rv, errmsg, sizeof errmsg));
+            exit(-2);
+        }
+    }
+
+    return 0;
+}
+
+#endif /* !APR_HAS_THREADS */
@@ -519,6 +519,158 @@ static void skiplist_test(abts_case *tc, void *data) {
     apr_pool_clear(ptmp);
 }
 
+#define NUM_RANK 1000
+
+static int int_cmp(const void *a, const void *b)
+{
+    return comp((void *)a, (void *)b);
+}
+
+/* Check the ranks and positions of the skip list's elements against the
+ * sorted array of their values.
+ */
+static void check_ranks(abts_case *tc, apr_skiplist *sl, int *sorted, int n)
+{
+    apr_skiplistnode *iter;
+    int i, lo, hi;
+
+    ABTS_INT_EQUAL(tc, n, (int)apr_skiplist_size(sl));
+    for (i = 0; i < n; i++) {
+        int *val = apr_skiplist_select(sl, i, &iter);
+        ABTS_PTR_NOTNULL(tc, val);
+        if (!val) {
+            return;
+        }
+        ABTS_INT_EQUAL(tc, sorted[i], *val);
+        ABTS_PTR_EQUAL(tc, val, apr_skiplist_element(iter));
+        if (i == 0 || sorted[i - 1] != sorted[i]) {
+            ABTS_INT_EQUAL(tc, i, (int)apr_skiplist_rank(sl, &sorted[i]));
+        }
+    }
+    ABTS_PTR_EQUAL(tc, NULL, apr_skiplist_select(sl, n, &iter));
+    ABTS_PTR_EQUAL(tc, NULL, iter);
+
+    for (lo = -1; lo < NUM_RANK / 2 + 1; lo += 37) {
+        for (hi = lo; hi < NUM_RANK / 2 + 1; hi += 41) {
+            int count = 0;
+            for (i = 0; i < n; i++) {
+                count += (sorted[i] >= lo && sorted[i] < hi);
+            }
+            ABTS_INT_EQUAL(tc, count,
+                           (int)apr_skiplist_range_count(sl, &lo, &hi));
+        }
+    }
+}
+
+static void skiplist_rank(abts_case *tc, void *data)
+{
+    apr_skiplist *sl;
+    int *vals, *sorted;
+    int i, n;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_skiplist_init(&sl, ptmp));
+    apr_skiplist_set_compare(sl, comp, comp);
+    vals = apr_palloc(ptmp, NUM_RANK * sizeof(int));
+    sorted = apr_palloc(ptmp, NUM_RANK * sizeof(int));
+
+    /* with duplicates */
+    for (i = 0; i < NUM_RANK; i++) {
+        vals[i] = rand() % (NUM_RANK / 2);
+        ABTS_PTR_NOTNULL(tc, apr_skiplist_add(sl, &vals[i]));
+        sorted[i] = vals[i];
+    }
+    qsort(sorted, NUM_RANK, sizeof(int), int_cmp);
+    check_ranks(tc, sl, sorted, NUM_RANK);
+
+    /* remove one third of them */
+    for (i = 0, n = 0; i < NUM_RANK; i++) {
+        if (i % 3) {
+            sorted[n++] = vals[i];
+        }
+        else {
+            ABTS_TRUE(tc, apr_skiplist_remove(sl, &vals[i], NULL) != 0);
+        }
+    }
+    qsort(sorted, n, sizeof(int), int_cmp);
+    check_ranks(tc, sl, sorted, n);
+
+    /* replace (remove the duplicates of) some values */
+    for (i = 0; i < NUM_RANK; i += 10) {
+        ABTS_PTR_NOTNULL(tc, apr_skiplist_replace(sl, &vals[i], NULL));
+    }
+    for (i = 0, n = 0; i < NUM_RANK; i++) {
+        int *val = apr_skiplist_select(sl, i, NULL);
+        if (!val) {
+            break;
+        }
+        sorted[n++] = *val;
+    }
+    ABTS_INT_EQUAL(tc, n, (int)apr_skiplist_size(sl));
+    check_ranks(tc, sl, sorted, n);
+
+    apr_pool_clear(ptmp);
+}
+
+static void skiplist_build(abts_case *tc, void *data)
+{
+    apr_skiplist *sl;
+    void **elts;
+    int *vals, *sorted, *mem;
+    int i;
+
+    /* without a pool, to release the nodes with the skip list */
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_skiplist_init(&sl, NULL));
+    apr_skiplist_set_compare(sl, comp, comp);
+    vals = apr_palloc(ptmp, 2 * NUM_RANK * sizeof(int));
+    sorted = apr_palloc(ptmp, 2 * NUM_RANK * sizeof(int));
+    elts = apr_palloc(ptmp, NUM_RANK * sizeof(void *));
+    for (i = 0; i < NUM_RANK; i++) {
+        vals[i] = i / 2;
+        elts[i] = &vals[i];
+    }
+
+    /* not sorted */
+    elts[0] = &vals[NUM_RANK - 1];
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_skiplist_build(sl, elts, NUM_RANK));
+    ABTS_INT_EQUAL(tc, 0, (int)apr_skiplist_size(sl));
+    elts[0] = &vals[0];
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_skiplist_build(sl, elts, NUM_RANK));
+    skiplist_get_size(tc, sl);
+    for (i = 0; i < NUM_RANK; i++) {
+        sorted[i] = vals[i];
+        /* duplicates are kept in order */
+        ABTS_PTR_EQUAL(tc, &vals[i], apr_skiplist_select(sl, i, NULL));
+    }
+    check_ranks(tc, sl, sorted, NUM_RANK);
+
+    /* not empty, added one by one */
+    for (i = 0; i < NUM_RANK; i++) {
+        vals[NUM_RANK + i] = i / 4;
+        elts[i] = &vals[NUM_RANK + i];
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_skiplist_build(sl, elts, NUM_RANK));
+    memcpy(sorted, vals, 2 * NUM_RANK * sizeof(int));
+    qsort(sorted, 2 * NUM_RANK, sizeof(int), int_cmp);
+    check_ranks(tc, sl, sorted, 2 * NUM_RANK);
+
+    /* the values removed are equal, the ones left are sorted already */
+    for (i = 0; i < NUM_RANK; i++) {
+        ABTS_TRUE(tc, apr_skiplist_remove(sl, &vals[i], NULL) != 0);
+    }
+    check_ranks(tc, sl, vals + NUM_RANK, NUM_RANK);
+    apr_skiplist_destroy(sl, NULL);
+
+    /* the memory freed is reused for the same size */
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_skiplist_init(&sl, ptmp));
+    mem = apr_skiplist_alloc(sl, sizeof(int));
+    ABTS_PTR_NOTNULL(tc, mem);
+    apr_skiplist_free(sl, mem);
+    ABTS_PTR_NOTNULL(tc, apr_skiplist_alloc(sl, sizeof(elem)));
+    ABTS_PTR_EQUAL(tc, mem, apr_skiplist_alloc(sl, sizeof(int)));
+
+    apr_pool_clear(ptmp);
+}
 
 abts_suite *testskiplist(abts_suite *suite)
 {
@@ -538,6 +690,8 @@ abts_suite *testskiplist(abts_suite *suite)
     abts_run_test(suite, skiplist_random_loop, NULL);
 
     abts_run_test(suite, skiplist_test, NULL);
+    abts_run_test(suite, skiplist_rank, NULL);
+    abts_run_test(suite, skiplist_build, NULL);
 
     apr_pool_destroy(ptmp);
 
@@ -0,0 +1,349 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr_spsc_queue.h"
+#include "apr_poll.h"
+#include "apr_shm.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#define NUM_ITEMS 100000
+#define BATCH     7
+
+static void test_spsc_basic(abts_case *tc, void *data)
+{
+    apr_spsc_queue_t *q;
+    apr_status_t rv;
+    apr_uint32_t n;
+    int i, in[12], out[12];
+
+    rv = apr_spsc_queue_create(&q, 8, 0, 0, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    rv = apr_spsc_queue_create(&q, 5, sizeof(int), 0, p);
+    APR_ASSERT_SUCCESS(tc, "create queue", rv);
+    ABTS_INT_EQUAL(tc, 8, apr_spsc_queue_capacity(q));
+    ABTS_INT_EQUAL(tc, 0, apr_spsc_queue_size(q));
+
+    for (i = 0; i < 12; ++i) {
+        in[i] = i;
+    }
+    for (i = 0; i < 8; ++i) {
+        rv = apr_spsc_queue_push(q, &in[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    rv = apr_spsc_queue_push(q, &in[8]);
+    ABTS_INT_EQUAL(tc, APR_EAGAIN, rv);
+    ABTS_INT_EQUAL(tc, 8, apr_spsc_queue_size(q));
+
+    rv = apr_spsc_queue_push_n(q, in, 0, &n);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 0, n);
+
+    for (i = 0; i < 3; ++i) {
+        rv = apr_spsc_queue_pop(q, &out[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_INT_EQUAL(tc, i, out[i]);
+    }
+
+    /* wraps around the ring */
+    rv = apr_spsc_queue_push_n(q, in + 8, 4, &n);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 3, n);
+
+    rv = apr_spsc_queue_pop_n(q, out, 12, &n);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 8, n);
+    for (i = 0; i < 8; ++i) {
+        ABTS_INT_EQUAL(tc, i + 3, out[i]);
+    }
+
+    rv = apr_spsc_queue_pop(q, &out[0]);
+    ABTS_INT_EQUAL(tc, APR_EAGAIN, rv);
+    rv = apr_spsc_queue_pop_n(q, out, 12, &n);
+    ABTS_INT_EQUAL(tc, APR_EAGAIN, rv);
+    ABTS_INT_EQUAL(tc, 0, n);
+
+    rv = apr_spsc_queue_wait(q, APR_POLLIN, 0);
+    ABTS_INT_EQUAL(tc, APR_ENOTIMPL, rv);
+}
+
+static void test_spsc_attach(abts_case *tc, void *data)
+{
+    apr_spsc_queue_t *q1, *q2;
+    apr_size_t size = apr_spsc_queue_memsize(4, sizeof(int));
+    apr_status_t rv;
+    void *mem;
+    int i;
+
+    ABTS_TRUE(tc, size > 0);
+    mem = apr_pcalloc(p, size);
+
+    rv = apr_spsc_queue_attach(&q2, mem, size, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+    rv = apr_spsc_queue_create_at(&q1, mem, size - 1, 4, sizeof(int), 0, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    rv = apr_spsc_queue_create_at(&q1, mem, size, 4, sizeof(int), 0, p);
+    APR_ASSERT_SUCCESS(tc, "create queue in memory", rv);
+    i = 42;
+    rv = apr_spsc_queue_push(q1, &i);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_spsc_queue_attach(&q2, mem, size - 1, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+    rv = apr_spsc_queue_attach(&q2, mem, size, p);
+    APR_ASSERT_SUCCESS(tc, "attach queue", rv);
+    ABTS_INT_EQUAL(tc, 1, apr_spsc_queue_size(q2));
+    i = 0;
+    rv = apr_spsc_queue_pop(q2, &i);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 42, i);
+    ABTS_INT_EQUAL(tc, 0, apr_spsc_queue_size(q1));
+
+    rv = apr_spsc_queue_create_at(&q1, mem, size, 4, sizeof(int),
+                                  APR_SPSC_QUEUE_NOTIFY, p);
+    if (rv == APR_ENOTIMPL) {
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "create notifying queue in memory", rv);
+    rv = apr_spsc_queue_attach(&q2, mem, size, p);
+    ABTS_INT_EQUAL(tc, APR_ENOTIMPL, rv);
+}
+
+static void test_spsc_pollset(abts_case *tc, void *data)
+{
+    apr_spsc_queue_t *q;
+    apr_pollset_t *pollset;
+    const apr_pollfd_t *descs;
+    apr_pollfd_t pfd;
+    apr_int32_t num;
+    apr_status_t rv;
+    int i = 1;
+
+    rv = apr_spsc_queue_create(&q, 2, sizeof(int), APR_SPSC_QUEUE_NOTIFY, p);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "SPSC queue notifications");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "create queue", rv);
+
+    rv = apr_pollset_create(&pollset, 1, p, 0);
+    APR_ASSERT_SUCCESS(tc, "create pollset", rv);
+    rv = apr_spsc_queue_pollfd_get(q, APR_POLLIN, &pfd);
+    APR_ASSERT_SUCCESS(tc, "get pollfd", rv);
+    pfd.client_data = q;
+    rv = apr_pollset_add(pollset, &pfd);
+    APR_ASSERT_SUCCESS(tc, "add to pollset", rv);
+
+    rv = apr_spsc_queue_arm(q, APR_POLLIN);
+    APR_ASSERT_SUCCESS(tc, "arm", rv);
+    rv = apr_pollset_poll(pollset, 0, &num, &descs);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+
+    rv = apr_spsc_queue_push(q, &i);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pollset_poll(pollset, apr_time_from_sec(5), &num, &descs);
+    APR_ASSERT_SUCCESS(tc, "poll after push", rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+    ABTS_PTR_EQUAL(tc, q, descs[0].client_data);
+
+    /* arming a non-empty queue makes it readable right away */
+    rv = apr_spsc_queue_arm(q, APR_POLLIN);
+    APR_ASSERT_SUCCESS(tc, "arm non-empty", rv);
+    rv = apr_pollset_poll(pollset, 0, &num, &descs);
+    APR_ASSERT_SUCCESS(tc, "poll non-empty", rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+
+    i = 0;
+    rv = apr_spsc_queue_pop(q, &i);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, i);
+    rv = apr_spsc_queue_arm(q, APR_POLLIN);
+    APR_ASSERT_SUCCESS(tc, "arm empty", rv);
+    rv = apr_pollset_poll(pollset, 0, &num, &descs);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+
+    rv = apr_spsc_queue_wait(q, APR_POLLIN, apr_time_from_msec(1));
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+    rv = apr_spsc_queue_wait(q, APR_POLLOUT, 0);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_spsc_queue_wait(q, APR_POLLPRI, 0);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+}
+
+/* Push the integers from 0 to NUM_ITEMS - 1, by batches */
+static apr_status_t spsc_produce(apr_spsc_queue_t *q)
+{
+    apr_status_t rv;
+    apr_uint32_t n;
+    int batch[BATCH];
+    int i = 0, j;
+
+    while (i < NUM_ITEMS) {
+        for (j = 0; j < BATCH; ++j) {
+            batch[j] = i + j;
+        }
+        n = (i % BATCH) + 1;
+        if (n > (apr_uint32_t)(NUM_ITEMS - i)) {
+            n = NUM_ITEMS - i;
+        }
+        rv = apr_spsc_queue_push_n(q, batch, n, &n);
+        if (rv == APR_EAGAIN) {
+            rv = apr_spsc_queue_wait(q, APR_POLLOUT, -1);
+        }
+        if (rv != APR_SUCCESS && rv != APR_EINTR) {
+            return rv;
+        }
+        i += n;
+    }
+    return APR_SUCCESS;
+}
+
+/* Pop and check the integers pushed by spsc_produce() */
+static apr_status_t spsc_consume(apr_spsc_queue_t *q, int *next)
+{
+    apr_status_t rv;
+    apr_uint32_t n, j;
+    int batch[BATCH];
+
+    *next = 0;
+    while (*next < NUM_ITEMS) {
+        rv = apr_spsc_queue_pop_n(q, batch, BATCH, &n);
+        if (rv == APR_EAGAIN) {
+            rv = apr_spsc_queue_wait(q, APR_POLLIN, apr_time_from_sec(30));
+        }
+        if (rv != APR_SUCCESS && rv != APR_EINTR) {
+            return rv;
+        }
+        for (j = 0; j < n; ++j) {
+            if (batch[j] != *next) {
+                return APR_EGENERAL;
+            }
+            ++*next;
+        }
+    }
+    return APR_SUCCESS;
+}
+
+#if APR_HAS_THREADS
+static void * APR_THREAD_FUNC spsc_producer(apr_thread_t *thd, void *data)
+{
+    apr_thread_exit(thd, spsc_produce(data));
+    return NULL;
+}
+
+static void test_spsc_threads(abts_case *tc, void *data)
+{
+    apr_spsc_queue_t *q;
+    apr_thread_t *thd;
+    apr_status_t rv, retval;
+    int next;
+
+    rv = apr_spsc_queue_create(&q, 16, sizeof(int), APR_SPSC_QUEUE_NOTIFY,
+                               p);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "SPSC queue notifications");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "create queue", rv);
+
+    rv = apr_thread_create(&thd, NULL, spsc_producer, q, p);
+    APR_ASSERT_SUCCESS(tc, "create producer thread", rv);
+
+    rv = spsc_consume(q, &next);
+    APR_ASSERT_SUCCESS(tc, "consume", rv);
+    ABTS_INT_EQUAL(tc, NUM_ITEMS, next);
+
+    rv = apr_thread_join(&retval, thd);
+    APR_ASSERT_SUCCESS(tc, "join producer thread", rv);
+    APR_ASSERT_SUCCESS(tc, "produce", retval);
+    ABTS_INT_EQUAL(tc, 0, apr_spsc_queue_size(q));
+}
+#endif /* APR_HAS_THREADS */
+
+#if APR_HAS_FORK && APR_HAS_SHARED_MEMORY
+static void test_spsc_shm(abts_case *tc, void *data)
+{
+    apr_spsc_queue_t *q;
+    apr_size_t size = apr_spsc_queue_memsize(16, sizeof(int));
+    apr_shm_t *shm;
+    apr_proc_t proc;
+    apr_status_t rv;
+    int next, code;
+    apr_exit_why_e why;
+
+    rv = apr_shm_create(&shm, size, NULL, p);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "anonymous shared memory");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "create shared memory", rv);
+
+    rv = apr_spsc_queue_create_at(&q, apr_shm_baseaddr_get(shm), size, 16,
+                                  sizeof(int), APR_SPSC_QUEUE_NOTIFY, p);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "SPSC queue notifications");
+        apr_shm_destroy(shm);
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "create queue in shared memory", rv);
+
+    rv = apr_proc_fork(&proc, p);
+    if (rv == APR_INCHILD) {
+        exit(spsc_produce(q) == APR_SUCCESS ? 0 : 1);
+    }
+    else if (rv != APR_INPARENT) {
+        ABTS_FAIL(tc, "apr_proc_fork failed");
+        apr_shm_destroy(shm);
+        return;
+    }
+
+    rv = spsc_consume(q, &next);
+    APR_ASSERT_SUCCESS(tc, "consume", rv);
+    ABTS_INT_EQUAL(tc, NUM_ITEMS, next);
+
+    rv = apr_proc_wait(&proc, &code, &why, APR_WAIT);
+    ABTS_INT_EQUAL(tc, APR_CHILD_DONE, rv);
+    ABTS_INT_EQUAL(tc, APR_PROC_EXIT, why);
+    ABTS_INT_EQUAL(tc, 0, code);
+
+    rv = apr_shm_destroy(shm);
+    APR_ASSERT_SUCCESS(tc, "destroy shared memory", rv);
+}
+#endif /* APR_HAS_FORK && APR_HAS_SHARED_MEMORY */
+
+abts_suite *testspscqueue(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite);
+
+    abts_run_test(suite, test_spsc_basic, NULL);
+    abts_run_test(suite, test_spsc_attach, NULL);
+    abts_run_test(suite, test_spsc_pollset, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_spsc_threads, NULL);
+#endif
+#if APR_HAS_FORK && APR_HAS_SHARED_MEMORY
+    abts_run_test(suite, test_spsc_shm, NULL);
+#endif
+
+    return suite;
+}
@@ -27,6 +27,7 @@
 #include "apr_general.h"
 #include "apr_strings.h"
 #include "apr_cstr.h"
+#include "apr_lib.h"
 #include "apr_errno.h"
 
 /* I haven't bothered to check for APR_ENOTIMPL here, AFAIK, all string
@@ -394,6 +395,77 @@ static void skip_prefix(abts_case *tc, void *data)
     ABTS_STR_EQUAL(tc, apr_cstr_skip_prefix("",      "12"),    NULL);
 }
 
+static int ascii_casecmp(const char *s1, const char *s2, apr_size_t n)
+{
+    for (; n--; s1++, s2++) {
+        int c1 = (unsigned char)*s1, c2 = (unsigned char)*s2;
+        if (c1 >= 'A' && c1 <= 'Z') {
+            c1 += 'a' - 'A';
+        }
+        if (c2 >= 'A' && c2 <= 'Z') {
+            c2 += 'a' - 'A';
+        }
+        if (c1 != c2 || !c1) {
+            return c1 - c2;
+        }
+    }
+    return 0;
+}
+
+static void string_casecmp(abts_case *tc, void *data)
+{
+    /* Strings up to 100 bytes, at all the offsets of a page end (where
+     * the comparisons can't be vectorized)
+     */
+    char *buf1 = apr_palloc(p, 8192), *buf2 = apr_palloc(p, 8192);
+    char *page1 = (char *)(((apr_uintptr_t)buf1 + 128 + 4095) & ~4095) - 128;
+    char *page2 = (char *)(((apr_uintptr_t)buf2 + 128 + 4095) & ~4095) - 128;
+    int len, off, diff;
+
+    ABTS_INT_EQUAL(tc, 0, apr_cstr_casecmp("", ""));
+    ABTS_INT_EQUAL(tc, 0, apr_cstr_casecmp("Content-Type", "content-TYPE"));
+    ABTS_TRUE(tc, apr_cstr_casecmp("Content-Type", "Content-Typ") > 0);
+    ABTS_TRUE(tc, apr_cstr_casecmp("Content-Type", "Content-Typf") < 0);
+    ABTS_TRUE(tc, apr_cstr_casecmp("[", "a") < 0);
+    ABTS_TRUE(tc, apr_cstr_casecmp("@", "`") != 0);
+    ABTS_TRUE(tc, apr_cstr_casecmp("\xc9", "\xe9") != 0);
+    ABTS_INT_EQUAL(tc, 0, apr_cstr_casecmpn("Content-Type", "CONTENT-LENGTH",
+                                            8));
+    ABTS_TRUE(tc, apr_cstr_casecmpn("Content-Type", "CONTENT-LENGTH", 9) > 0);
+
+    for (len = 0; len < 100; len++) {
+        for (off = 0; off < 64; off++) {
+            char *s1 = page1 + 128 - 1 - len + off / 2;
+            char *s2 = page2 + 128 - 1 - len + off % 8;
+            int i;
+
+            for (i = 0; i < len; i++) {
+                s1[i] = 'A' + (i * 7 + len) % 58;
+                s2[i] = apr_tolower(s1[i]);
+            }
+            s1[len] = s2[len] = '\0';
+            for (diff = -1; diff <= len; diff++) {
+                char c = 0;
+                int expected, n;
+
+                if (diff >= 0) {
+                    c = s2[diff];
+                    s2[diff] = (diff == len) ? 'x' : (char)0xe9;
+                }
+                expected = ascii_casecmp(s1, s2, len + 1);
+                ABTS_INT_EQUAL(tc, expected, apr_cstr_casecmp(s1, s2));
+                for (n = len / 2; n <= len + 1; n += len / 2 + 1) {
+                    expected = ascii_casecmp(s1, s2, n);
+                    ABTS_INT_EQUAL(tc, expected, apr_cstr_casecmpn(s1, s2, n));
+                }
+                if (diff >= 0) {
+                    s2[diff] = c;
+                }
+            }
+        }
+    }
+}
+
 abts_suite *teststr(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -412,6 +484,7 @@ abts_suite *teststr(abts_suite *suite)
     abts_run_test(suite, string_cpystrn, NULL);
     abts_run_test(suite, snprintf_overflow, NULL);
     abts_run_test(suite, skip_prefix, NULL);
+    abts_run_test(suite, string_casecmp, NULL);
 
     return suite;
 }
@@ -20,6 +20,7 @@
 #include "apr_general.h"
 #include "apr_pools.h"
 #include "apr_tables.h"
+#include "apr_thread_pool.h"
 #if APR_HAVE_STDIO_H
 #include <stdio.h>
 #endif
@@ -42,6 +43,178 @@ static void array_clear(abts_case *tc, void *data)
     ABTS_INT_EQUAL(tc, 0, a1->nelts);
 }
 
+static void array_push_n(abts_case *tc, void *data)
+{
+    apr_array_header_t *a = apr_array_make(p, 2, sizeof(int));
+    int *elts, i;
+
+    APR_ARRAY_PUSH(a, int) = 1;
+    elts = apr_array_push_n(a, 5);
+    ABTS_INT_EQUAL(tc, 6, a->nelts);
+    ABTS_INT_EQUAL(tc, 8, a->nalloc);
+    ABTS_PTR_EQUAL(tc, &APR_ARRAY_IDX(a, 1, int), elts);
+    for (i = 0; i < 5; i++) {
+        ABTS_INT_EQUAL(tc, 0, elts[i]);
+        elts[i] = i + 2;
+    }
+    ABTS_INT_EQUAL(tc, 1, APR_ARRAY_IDX(a, 0, int));
+    ABTS_INT_EQUAL(tc, 6, APR_ARRAY_IDX(a, 5, int));
+
+    /* reserving grows once to the exact size, and never shrinks */
+    apr_array_reserve(a, 1000);
+    ABTS_INT_EQUAL(tc, 1000, a->nalloc);
+    ABTS_INT_EQUAL(tc, 6, a->nelts);
+    elts = (int *)a->elts;
+    apr_array_push_n(a, 994);
+    ABTS_PTR_EQUAL(tc, elts, a->elts);
+    ABTS_INT_EQUAL(tc, 0, APR_ARRAY_IDX(a, 999, int));
+    apr_array_reserve(a, 10);
+    ABTS_INT_EQUAL(tc, 1000, a->nalloc);
+    ABTS_INT_EQUAL(tc, 6, APR_ARRAY_IDX(a, 5, int));
+
+    /* pushing to a copied header does not write to the original */
+    a = apr_array_copy_hdr(p, a);
+    *(int *)apr_array_push_n(a, 1) = 42;
+    ABTS_INT_EQUAL(tc, 1001, a->nelts);
+    ABTS_INT_EQUAL(tc, 42, APR_ARRAY_IDX(a, 1000, int));
+    ABTS_TRUE(tc, (int *)a->elts != elts);
+    ABTS_INT_EQUAL(tc, 6, APR_ARRAY_IDX(a, 5, int));
+}
+
+static int int_cmp(const void *a, const void *b)
+{
+    const int x = *(const int *)a, y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void array_sort(abts_case *tc, void *data)
+{
+    apr_array_header_t *a = apr_array_make(p, 0, sizeof(int));
+    int key, i;
+
+    ABTS_PTR_EQUAL(tc, NULL, apr_array_bsearch(a, &key, int_cmp));
+    apr_array_sort(a, int_cmp);
+    apr_array_dedup(a, int_cmp);
+    ABTS_INT_EQUAL(tc, 0, a->nelts);
+
+    for (i = 0; i < 100; i++) {
+        APR_ARRAY_PUSH(a, int) = (i * 37) % 50;
+    }
+    apr_array_sort(a, int_cmp);
+    for (i = 1; i < a->nelts; i++) {
+        ABTS_TRUE(tc, APR_ARRAY_IDX(a, i - 1, int)
+                      <= APR_ARRAY_IDX(a, i, int));
+    }
+
+    apr_array_dedup(a, int_cmp);
+    ABTS_INT_EQUAL(tc, 50, a->nelts);
+    for (i = 0; i < a->nelts; i++) {
+        ABTS_INT_EQUAL(tc, i, APR_ARRAY_IDX(a, i, int));
+    }
+
+    key = 42;
+    ABTS_PTR_EQUAL(tc, &APR_ARRAY_IDX(a, 42, int),
+                   apr_array_bsearch(a, &key, int_cmp));
+    key = 50;
+    ABTS_PTR_EQUAL(tc, NULL, apr_array_bsearch(a, &key, int_cmp));
+}
+
+#if APR_HAS_THREADS
+
+#define SORT_NELTS 200000
+
+typedef struct sort_in_pool_t {
+    apr_array_header_t *a;
+    apr_thread_pool_t *tp;
+    apr_status_t rv;
+    volatile int done;
+} sort_in_pool_t;
+
+static void * APR_THREAD_FUNC sort_in_pool(apr_thread_t *thd, void *data)
+{
+    sort_in_pool_t *s = data;
+
+    s->rv = apr_array_sort_parallel(s->a, int_cmp, s->tp);
+    s->done = 1;
+    return NULL;
+}
+
+static void array_sort_parallel(abts_case *tc, void *data)
+{
+    apr_array_header_t *a = apr_array_make(p, 0, sizeof(int));
+    apr_thread_pool_t *tp;
+    apr_status_t rv;
+    unsigned int n = 1;
+    int *elts, i, sorted = 1;
+    apr_int64_t sum = 0;
+
+    rv = apr_thread_pool_create(&tp, 0, 4, p);
+    APR_ASSERT_SUCCESS(tc, "create thread pool", rv);
+
+    elts = apr_array_push_n(a, SORT_NELTS);
+    for (i = 0; i < SORT_NELTS; i++) {
+        n = n * 1103515245 + 12345;
+        elts[i] = (int)(n >> 8);
+        sum += elts[i];
+    }
+    rv = apr_array_sort_parallel(a, int_cmp, tp);
+    APR_ASSERT_SUCCESS(tc, "sort in parallel", rv);
+
+    ABTS_INT_EQUAL(tc, SORT_NELTS, a->nelts);
+    ABTS_PTR_EQUAL(tc, elts, a->elts);
+    for (i = 0; i < SORT_NELTS; i++) {
+        sum -= elts[i];
+        if (i && elts[i - 1] > elts[i]) {
+            sorted = 0;
+        }
+    }
+    ABTS_TRUE(tc, sorted);
+    ABTS_TRUE(tc, sum == 0);
+
+    /* odd number of runs, and without a thread pool */
+    apr_thread_pool_thread_max_set(tp, 2);
+    for (i = 0; i < SORT_NELTS; i++) {
+        elts[i] = SORT_NELTS - i;
+    }
+    rv = apr_array_sort_parallel(a, int_cmp, tp);
+    APR_ASSERT_SUCCESS(tc, "sort in parallel", rv);
+    for (i = 0; i < SORT_NELTS; i++) {
+        ABTS_INT_EQUAL(tc, i + 1, elts[i]);
+    }
+    rv = apr_array_sort_parallel(a, int_cmp, NULL);
+    APR_ASSERT_SUCCESS(tc, "sort without threads", rv);
+    ABTS_INT_EQUAL(tc, SORT_NELTS, elts[SORT_NELTS - 1]);
+
+    /* from the only thread of the pool, which can't wait for itself */
+    {
+        sort_in_pool_t s;
+
+        apr_thread_pool_thread_max_set(tp, 1);
+        for (i = 0; i < SORT_NELTS; i++) {
+            elts[i] = SORT_NELTS - i;
+        }
+        s.a = a;
+        s.tp = tp;
+        s.rv = APR_EGENERAL;
+        s.done = 0;
+        rv = apr_thread_pool_push(tp, sort_in_pool, &s,
+                                  APR_THREAD_TASK_PRIORITY_NORMAL, NULL);
+        APR_ASSERT_SUCCESS(tc, "push the sort", rv);
+        for (i = 0; i < 1000 && !s.done; i++) {
+            apr_sleep(apr_time_from_msec(10));
+        }
+        ABTS_TRUE(tc, s.done);
+        APR_ASSERT_SUCCESS(tc, "sort in the pool", s.rv);
+        ABTS_INT_EQUAL(tc, 1, elts[0]);
+        ABTS_INT_EQUAL(tc, SORT_NELTS, elts[SORT_NELTS - 1]);
+    }
+
+    apr_thread_pool_destroy(tp);
+}
+
+#endif /* APR_HAS_THREADS */
+
 static void table_make(abts_case *tc, void *data)
 {
     t1 = apr_table_make(p, 5);
@@ -222,11 +395,212 @@ static void table_overlap3(abts_case *tc, void *data)
 
 }
 
+/* Compress tables small enough to be sorted, and large enough to be
+ * hashed, which must give the same results.
+ */
+static void table_compress(abts_case *tc, void *data)
+{
+    const apr_table_entry_t *elts;
+    apr_table_t *t;
+    char key[32];
+    int n, i;
+
+    for (n = 1; n <= 64; n *= 4) {
+        t = apr_table_make(p, 1);
+        apr_table_addn(t, "a", "1");
+        apr_table_addn(t, "b", "2");
+        apr_table_addn(t, "A", "3");
+        for (i = 0; i < n; i++) {
+            apr_snprintf(key, sizeof(key), "key%d", i);
+            apr_table_add(t, key, key);
+        }
+        apr_table_addn(t, "B", "4");
+        apr_table_addn(t, "a", "5");
+        apr_table_compress(t, APR_OVERLAP_TABLES_MERGE);
+
+        ABTS_INT_EQUAL(tc, n + 2, apr_table_elts(t)->nelts);
+        elts = (const apr_table_entry_t *)apr_table_elts(t)->elts;
+        ABTS_STR_EQUAL(tc, "a", elts[0].key);
+        ABTS_STR_EQUAL(tc, "1, 3, 5", elts[0].val);
+        ABTS_STR_EQUAL(tc, "b", elts[1].key);
+        ABTS_STR_EQUAL(tc, "2, 4", elts[1].val);
+        ABTS_STR_EQUAL(tc, "key0", elts[2].key);
+        ABTS_STR_EQUAL(tc, "1, 3, 5", apr_table_get(t, "A"));
+
+        apr_table_addn(t, "A", "6");
+        apr_table_addn(t, "b", "7");
+        apr_table_compress(t, APR_OVERLAP_TABLES_SET);
+        ABTS_INT_EQUAL(tc, n + 2, apr_table_elts(t)->nelts);
+        elts = (const apr_table_entry_t *)apr_table_elts(t)->elts;
+        ABTS_STR_EQUAL(tc, "6", elts[0].val);
+        ABTS_STR_EQUAL(tc, "7", elts[1].val);
+        ABTS_STR_EQUAL(tc, "7", apr_table_get(t, "B"));
+        apr_snprintf(key, sizeof(key), "KEY%d", n - 1);
+        ABTS_STR_EQUAL(tc, key + 3, apr_table_get(t, key) + 3);
+    }
+}
+
+static void table_freeze(abts_case *tc, void *data)
+{
+    apr_pool_t *subp;
+    apr_table_t *t, *frozen;
+    char key[32];
+    int n, i;
+
+    for (n = 4; n <= 64; n *= 4) {
+        apr_pool_create(&subp, p);
+        t = apr_table_make(subp, 1);
+        for (i = 0; i < n; i++) {
+            apr_snprintf(key, sizeof(key), "X-Header-%d", i);
+            apr_table_set(t, key, key + 2);
+        }
+        apr_table_add(t, "x-header-1", "dup");
+        frozen = apr_table_freeze(p, t);
+        apr_pool_destroy(subp);
+
+        ABTS_INT_EQUAL(tc, n + 1, apr_table_elts(frozen)->nelts);
+        for (i = 0; i < n; i++) {
+            apr_snprintf(key, sizeof(key), "x-HEADER-%d", i);
+            ABTS_INT_EQUAL(tc, 0, strcasecmp(key + 2,
+                                             apr_table_get(frozen, key)));
+        }
+        ABTS_PTR_EQUAL(tc, NULL, apr_table_get(frozen, "X-Header-64"));
+        ABTS_STR_EQUAL(tc, "Header-1,dup",
+                       apr_table_getm(p, frozen, "X-Header-1"));
+
+        /* read-only, but copies are modifiable */
+        t = apr_table_copy(p, frozen);
+        apr_table_set(t, "X-Header-1", "set");
+        apr_table_setn(t, "X-New", "new");
+        ABTS_INT_EQUAL(tc, n + 1, apr_table_elts(t)->nelts);
+        ABTS_STR_EQUAL(tc, "set", apr_table_get(t, "X-Header-1"));
+        ABTS_STR_EQUAL(tc, "new", apr_table_get(t, "X-New"));
+        ABTS_STR_EQUAL(tc, "Header-1,dup",
+                       apr_table_getm(p, frozen, "X-Header-1"));
+        ABTS_PTR_EQUAL(tc, NULL, apr_table_get(frozen, "X-New"));
+
+#if !APR_POOL_DEBUG
+        /* modifications leave the frozen table alone */
+        apr_table_set(frozen, "X-Header-1", "set");
+        apr_table_unset(frozen, "X-Header-2");
+        apr_table_clear(frozen);
+        ABTS_INT_EQUAL(tc, n + 1, apr_table_elts(frozen)->nelts);
+        ABTS_STR_EQUAL(tc, "Header-1,dup",
+                       apr_table_getm(p, frozen, "X-Header-1"));
+#endif
+    }
+
+    frozen = apr_table_freeze(p, apr_table_make(p, 0));
+    ABTS_INT_EQUAL(tc, 0, apr_table_elts(frozen)->nelts);
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(frozen, "X-Header-1"));
+    t = apr_table_clone(p, frozen);
+    apr_table_set(t, "X-Header-1", "set");
+    ABTS_STR_EQUAL(tc, "set", apr_table_get(t, "X-Header-1"));
+}
+
+#define LARGE_NELTS 100
+
+/* Tables large enough to get a full hash index of their keys */
+static void table_large(abts_case *tc, void *data)
+{
+    apr_table_t *t = apr_table_make(p, 1), *t2;
+    char key[32];
+    int i;
+
+    for (i = 0; i < LARGE_NELTS; i++) {
+        apr_snprintf(key, sizeof(key), "X-Header-%d", i);
+        apr_table_set(t, key, key);
+    }
+    ABTS_INT_EQUAL(tc, LARGE_NELTS, apr_table_elts(t)->nelts);
+    for (i = 0; i < LARGE_NELTS; i++) {
+        apr_snprintf(key, sizeof(key), "x-header-%d", i);
+        ABTS_TRUE(tc, apr_table_get(t, key) != NULL);
+        ABTS_INT_EQUAL(tc, 0, strcasecmp(key, apr_table_get(t, key)));
+    }
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "X-Header-100"));
+
+    /* duplicates are found in order, and removed by set and unset */
+    apr_table_add(t, "X-HEADER-1", "dup1");
+    apr_table_add(t, "x-header-1", "dup2");
+    ABTS_STR_EQUAL(tc, "X-Header-1", apr_table_get(t, "X-Header-1"));
+    ABTS_STR_EQUAL(tc, "X-Header-1,dup1,dup2",
+                   apr_table_getm(p, t, "X-Header-1"));
+    apr_table_set(t, "X-Header-1", "set");
+    ABTS_INT_EQUAL(tc, LARGE_NELTS, apr_table_elts(t)->nelts);
+    ABTS_STR_EQUAL(tc, "set", apr_table_getm(p, t, "X-Header-1"));
+
+    apr_table_unset(t, "X-Header-0");
+    apr_table_unset(t, "X-Header-0");
+    ABTS_INT_EQUAL(tc, LARGE_NELTS - 1, apr_table_elts(t)->nelts);
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "X-Header-0"));
+    ABTS_STR_EQUAL(tc, "X-Header-99", apr_table_get(t, "X-Header-99"));
+
+    apr_table_merge(t, "X-Header-2", "merged");
+    apr_table_mergen(t, "X-Header-100", "new");
+    ABTS_STR_EQUAL(tc, "X-Header-2, merged", apr_table_get(t, "X-Header-2"));
+    ABTS_STR_EQUAL(tc, "new", apr_table_get(t, "X-Header-100"));
+
+    /* copies, overlays and compression keep the index working */
+    t2 = apr_table_copy(p, t);
+    apr_table_setn(t2, "X-Header-3", "copy");
+    ABTS_STR_EQUAL(tc, "X-Header-3", apr_table_get(t, "X-Header-3"));
+    ABTS_STR_EQUAL(tc, "copy", apr_table_get(t2, "X-Header-3"));
+
+    t2 = apr_table_overlay(p, t2, t);
+    ABTS_INT_EQUAL(tc, 2 * LARGE_NELTS, apr_table_elts(t2)->nelts);
+    ABTS_STR_EQUAL(tc, "copy,X-Header-3", apr_table_getm(p, t2, "X-Header-3"));
+    apr_table_compress(t2, APR_OVERLAP_TABLES_SET);
+    ABTS_INT_EQUAL(tc, LARGE_NELTS, apr_table_elts(t2)->nelts);
+    ABTS_STR_EQUAL(tc, "X-Header-3", apr_table_get(t2, "X-Header-3"));
+    ABTS_STR_EQUAL(tc, "new", apr_table_get(t2, "X-Header-100"));
+
+    apr_table_overlap(t2, t, APR_OVERLAP_TABLES_ADD);
+    ABTS_INT_EQUAL(tc, 2 * LARGE_NELTS, apr_table_elts(t2)->nelts);
+    ABTS_STR_EQUAL(tc, "X-Header-99,X-Header-99",
+                   apr_table_getm(p, t2, "X-Header-99"));
+
+    /* removing entries moves the next ones in the index */
+    for (i = 4; i < LARGE_NELTS; i += 2) {
+        apr_snprintf(key, sizeof(key), "X-Header-%d", i);
+        apr_table_unset(t, key);
+    }
+    for (i = 3; i < LARGE_NELTS; i++) {
+        apr_snprintf(key, sizeof(key), "X-HEADER-%d", i);
+        if (i % 2) {
+            ABTS_INT_EQUAL(tc, 0, strcasecmp(key, apr_table_get(t, key)));
+        }
+        else {
+            ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, key));
+        }
+    }
+
+    /* shrinking below the threshold, and growing again */
+    for (i = 3; i < LARGE_NELTS; i++) {
+        apr_snprintf(key, sizeof(key), "X-Header-%d", i);
+        apr_table_unset(t, key);
+    }
+    ABTS_INT_EQUAL(tc, 3, apr_table_elts(t)->nelts);
+    ABTS_STR_EQUAL(tc, "set", apr_table_get(t, "X-Header-1"));
+    ABTS_STR_EQUAL(tc, "new", apr_table_get(t, "X-Header-100"));
+    apr_table_clear(t);
+    for (i = 0; i < LARGE_NELTS; i++) {
+        apr_snprintf(key, sizeof(key), "X-Header-%d", i);
+        apr_table_add(t, key, "again");
+    }
+    ABTS_STR_EQUAL(tc, "again", apr_table_get(t, "X-Header-42"));
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "X-Header-100"));
+}
+
 abts_suite *testtable(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
 
     abts_run_test(suite, array_clear, NULL);
+    abts_run_test(suite, array_push_n, NULL);
+    abts_run_test(suite, array_sort, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, array_sort_parallel, NULL);
+#endif
     abts_run_test(suite, table_make, NULL);
     abts_run_test(suite, table_get, NULL);
     abts_run_test(suite, table_getm, NULL);
@@ -239,6 +613,9 @@ abts_suite *testtable(abts_suite *suite)
     abts_run_test(suite, table_overlap, NULL);
     abts_run_test(suite, table_overlap2, NULL);
     abts_run_test(suite, table_overlap3, NULL);
+    abts_run_test(suite, table_compress, NULL);
+    abts_run_test(suite, table_large, NULL);
+    abts_run_test(suite, table_freeze, NULL);
 
     return suite;
 }
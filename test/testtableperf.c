@@ -0,0 +1,335 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_tables.h"
+#include "apr_pools.h"
+#include "apr_strings.h"
+#include "apr_time.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_lib.h"
+#include "apr_cstr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#if APR_HAVE_STRINGS_H
+#include <strings.h>
+#endif
+
+#define DEFAULT_MAX_ROUNDS  100000
+#define MAX_NELTS           128
+
+static int max_rounds = DEFAULT_MAX_ROUNDS;
+static apr_pool_t *pool;
+
+/* HTTP request and response headers, many sharing their first letter
+ * (hence their first-character index bucket); the tables larger than
+ * this are padded with X-Custom-<n> headers.
+ */
+static const char *const headers[] = {
+    "Accept", "Accept-Charset", "Accept-Encoding", "Accept-Language",
+    "Accept-Ranges", "Access-Control-Allow-Origin", "Age", "Allow",
+    "Authorization", "Cache-Control", "Connection", "Content-Disposition",
+    "Content-Encoding", "Content-Language", "Content-Length",
+    "Content-Location", "Content-Range", "Content-Security-Policy",
+    "Content-Type", "Cookie", "Date", "DNT", "ETag", "Expect", "Expires",
+    "Forwarded", "From", "Host", "If-Match", "If-Modified-Since",
+    "If-None-Match", "If-Range", "If-Unmodified-Since", "Keep-Alive",
+    "Last-Modified", "Link", "Location", "Origin", "Pragma",
+    "Proxy-Authenticate", "Proxy-Authorization", "Range", "Referer",
+    "Retry-After", "Sec-Fetch-Dest", "Sec-Fetch-Mode", "Sec-Fetch-Site",
+    "Server", "Set-Cookie", "Strict-Transport-Security", "TE", "Trailer",
+    "Transfer-Encoding", "Upgrade", "Upgrade-Insecure-Requests",
+    "User-Agent", "Vary", "Via", "Warning", "WWW-Authenticate",
+    "X-Content-Type-Options", "X-Forwarded-For", "X-Forwarded-Host",
+    "X-Forwarded-Proto", "X-Frame-Options", "X-Requested-With"
+};
+#define NUM_HEADERS (sizeof(headers) / sizeof(headers[0]))
+
+static const char *keys[MAX_NELTS];
+static const char *lower_keys[MAX_NELTS];
+static const char *missing_keys[MAX_NELTS];
+
+static void report(int nelts, const char *op, apr_time_t usecs, long ops)
+{
+    printf("    %3d entries %-8s: %10" APR_INT64_T_FMT " usec, "
+           "%8.2f ns/op\n", nelts, op, (apr_int64_t)usecs,
+           ops ? (double)usecs * 1000 / ops : 0.0);
+}
+
+static void test_table(int nelts)
+{
+    apr_pool_t *p;
+    apr_table_t *t, *frozen;
+    apr_time_t start;
+    long found = 0;
+    int i, r;
+
+    apr_pool_create(&p, pool);
+
+    /* Tables are built in a pool cleared each round, as per request */
+    start = apr_time_now();
+    for (r = 0; r < max_rounds / 10; r++) {
+        t = apr_table_make(p, 10);
+        for (i = 0; i < nelts; i++) {
+            apr_table_addn(t, keys[i], "value");
+        }
+        apr_pool_clear(p);
+    }
+    report(nelts, "add", apr_time_now() - start, (long)nelts * (r ? r : 1));
+
+    t = apr_table_make(p, 10);
+    for (i = 0; i < nelts; i++) {
+        apr_table_addn(t, keys[i], "value");
+    }
+
+    start = apr_time_now();
+    for (r = 0; r < max_rounds; r++) {
+        for (i = 0; i < nelts; i++) {
+            if (apr_table_get(t, lower_keys[i])) {
+                found++;
+            }
+        }
+    }
+    report(nelts, "get", apr_time_now() - start, (long)nelts * max_rounds);
+
+    frozen = apr_table_freeze(p, t);
+    start = apr_time_now();
+    for (r = 0; r < max_rounds; r++) {
+        for (i = 0; i < nelts; i++) {
+            if (apr_table_get(frozen, lower_keys[i])) {
+                found++;
+            }
+        }
+    }
+    report(nelts, "get frz", apr_time_now() - start,
+           (long)nelts * max_rounds);
+
+    start = apr_time_now();
+    for (r = 0; r < max_rounds; r++) {
+        for (i = 0; i < nelts; i++) {
+            if (apr_table_get(t, missing_keys[i])) {
+                found++;
+            }
+        }
+    }
+    report(nelts, "get miss", apr_time_now() - start,
+           (long)nelts * max_rounds);
+
+    start = apr_time_now();
+    for (r = 0; r < max_rounds; r++) {
+        for (i = 0; i < nelts; i++) {
+            apr_table_setn(t, keys[i], "other");
+        }
+    }
+    report(nelts, "set", apr_time_now() - start, (long)nelts * max_rounds);
+
+    start = apr_time_now();
+    for (r = 0; r < max_rounds / 10; r++) {
+        for (i = 0; i < nelts; i++) {
+            apr_table_unset(t, keys[i]);
+            apr_table_addn(t, keys[i], "again");
+        }
+    }
+    report(nelts, "unset", apr_time_now() - start,
+           (long)nelts * (r ? r : 1));
+
+    if (found != (long)nelts * max_rounds * 2
+            || apr_table_elts(t)->nelts != nelts) {
+        fprintf(stderr, "%d entries: unexpected results\n", nelts);
+        exit(-2);
+    }
+
+    apr_pool_destroy(p);
+}
+
+/* Overlay a table of nelts entries with another one, half of whose keys
+ * (in another case) are in the first one too, as per request.
+ */
+static void test_overlap(int nelts, unsigned flags)
+{
+    apr_pool_t *p;
+    apr_table_t *a, *b, *t;
+    apr_time_t start, usecs;
+    int i, r, rounds;
+
+    apr_pool_create(&p, pool);
+
+    a = apr_table_make(pool, nelts);
+    b = apr_table_make(pool, nelts);
+    for (i = 0; i < nelts; i++) {
+        apr_table_addn(a, apr_psprintf(pool, "X-Overlap-%d", i), "a");
+        apr_table_addn(b, apr_psprintf(pool, "x-overlap-%d", i + nelts / 2),
+                       "b");
+    }
+
+    rounds = (int)((apr_int64_t)max_rounds * 10 / nelts);
+    if (rounds < 1) {
+        rounds = 1;
+    }
+    start = apr_time_now();
+    for (r = 0; r < rounds; r++) {
+        t = apr_table_copy(p, a);
+        apr_table_overlap(t, b, flags);
+        if (apr_table_elts(t)->nelts != nelts + nelts / 2) {
+            fprintf(stderr, "%d entries: unexpected results\n", nelts);
+            exit(-2);
+        }
+        apr_pool_clear(p);
+    }
+    usecs = apr_time_now() - start;
+    printf("    %4d entries %-5s: %10" APR_INT64_T_FMT " usec, "
+           "%10.2f ns/overlap\n", nelts,
+           flags == APR_OVERLAP_TABLES_SET ? "set" : "merge",
+           (apr_int64_t)usecs, (double)usecs * 1000 / rounds);
+
+    apr_pool_destroy(p);
+}
+
+typedef int casecmp_fn_t(const char *s1, const char *s2);
+
+/* The reference byte per byte comparison, ASCII only */
+static int casecmp_bytewise(const char *s1, const char *s2)
+{
+    for (;; s1++, s2++) {
+        const int c1 = apr_tolower(*s1), c2 = apr_tolower(*s2);
+        if (c1 != c2 || !c1) {
+            return c1 - c2;
+        }
+    }
+}
+
+static int casecmp_strcasecmp(const char *s1, const char *s2)
+{
+    return strcasecmp(s1, s2);
+}
+
+/* Compare the lower case keys with the original ones (equal), and with the
+ * next ones (different, mostly after a common prefix since the headers
+ * are sorted).
+ */
+static void test_casecmp(const char *name, casecmp_fn_t *casecmp)
+{
+    apr_time_t start;
+    long equal = 0;
+    int i, r;
+
+    start = apr_time_now();
+    for (r = 0; r < max_rounds; r++) {
+        for (i = 0; i < NUM_HEADERS; i++) {
+            if (!casecmp(keys[i], lower_keys[i])) {
+                equal++;
+            }
+        }
+    }
+    printf("    %-12s equal    : %8.2f ns/op\n", name,
+           (double)(apr_time_now() - start) * 1000 / max_rounds / NUM_HEADERS);
+
+    start = apr_time_now();
+    for (r = 0; r < max_rounds; r++) {
+        for (i = 0; i < NUM_HEADERS - 1; i++) {
+            if (!casecmp(keys[i], lower_keys[i + 1])) {
+                equal++;
+            }
+        }
+    }
+    printf("    %-12s different: %8.2f ns/op\n", name,
+           (double)(apr_time_now() - start) * 1000 / max_rounds
+           / (NUM_HEADERS - 1));
+
+    if (equal != (long)NUM_HEADERS * max_rounds) {
+        fprintf(stderr, "%s: unexpected results\n", name);
+        exit(-2);
+    }
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    int i;
+
+    printf("APR Table Performance Test\n==============\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "r:", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'r') {
+            max_rounds = atoi(optarg);
+            if (max_rounds < 1) {
+                max_rounds = DEFAULT_MAX_ROUNDS;
+            }
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    /* Lookups are case-insensitive, do them with lower case keys, and
+     * the misses with keys sharing their first characters with hits.
+     */
+    for (i = 0; i < MAX_NELTS; i++) {
+        char *lower;
+
+        if (i < NUM_HEADERS) {
+            keys[i] = headers[i];
+        }
+        else {
+            keys[i] = apr_psprintf(pool, "X-Custom-%d", i);
+        }
+        lower_keys[i] = lower = apr_pstrdup(pool, keys[i]);
+        for (; *lower; lower++) {
+            *lower = apr_tolower(*lower);
+        }
+        missing_keys[i] = apr_pstrcat(pool, keys[i], "-Missing", NULL);
+    }
+
+    printf("case-insensitive comparisons of header names (%d rounds)\n",
+           max_rounds);
+    test_casecmp("bytewise", casecmp_bytewise);
+    test_casecmp("strcasecmp", casecmp_strcasecmp);
+    test_casecmp("apr_cstr", apr_cstr_casecmp);
+
+    printf("\napr_table add/get/set/unset (%d rounds)\n", max_rounds);
+    for (i = 8; i <= MAX_NELTS; i *= 2) {
+        test_table(i);
+    }
+
+    printf("\napr_table_overlap (%d rounds for 10 entries)\n",
+           max_rounds);
+    for (i = 10; i <= 1000; i *= 10) {
+        test_overlap(i, APR_OVERLAP_TABLES_SET);
+        test_overlap(i, APR_OVERLAP_TABLES_MERGE);
+    }
+
+    return 0;
+}
@@ -104,6 +104,55 @@ static void check_thread_once(abts_case *tc, void *data)
     ABTS_INT_EQUAL(tc, 1, value);
 }
 
+static void * APR_THREAD_FUNC cpu_func(apr_thread_t *thd, void *data)
+{
+    apr_uint32_t *cpu = data;
+
+    if (apr_thread_cpu_get(&cpu[1], NULL) != APR_SUCCESS) {
+        cpu[1] = (apr_uint32_t)-1;
+    }
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static void thread_affinity(abts_case *tc, void *data)
+{
+    apr_threadattr_t *attr;
+    apr_thread_t *thd;
+    apr_uint32_t cpu[2], node;
+    apr_status_t rv, s;
+
+    rv = apr_thread_cpu_get(&cpu[0], &node);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "Current CPU not available on this platform");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "get the current CPU", rv);
+
+    rv = apr_threadattr_create(&attr, p);
+    APR_ASSERT_SUCCESS(tc, "create thread attr", rv);
+    rv = apr_threadattr_affinity_set(attr, &cpu[0], 1);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "Thread affinity not implemented on this platform");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "set the attr affinity", rv);
+
+    /* a thread pinned to a CPU runs there */
+    cpu[1] = (apr_uint32_t)-1;
+    rv = apr_thread_create(&thd, attr, cpu_func, cpu, p);
+    APR_ASSERT_SUCCESS(tc, "create pinned thread", rv);
+    apr_thread_join(&s, thd);
+    ABTS_INT_EQUAL(tc, cpu[0], cpu[1]);
+
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_thread_affinity_set(thd, cpu, 0));
+    rv = apr_threadattr_affinity_set(attr, NULL, 0);
+    APR_ASSERT_SUCCESS(tc, "reset the attr affinity", rv);
+    rv = apr_thread_create(&thd, attr, cpu_func, cpu, p);
+    APR_ASSERT_SUCCESS(tc, "create unpinned thread", rv);
+    apr_thread_join(&s, thd);
+}
+
 #else
 
 static void threads_not_impl(abts_case *tc, void *data)
@@ -125,6 +174,7 @@ abts_suite *testthread(abts_suite *suite)
     abts_run_test(suite, join_threads, NULL);
     abts_run_test(suite, check_locks, NULL);
     abts_run_test(suite, check_thread_once, NULL);
+    abts_run_test(suite, thread_affinity, NULL);
 #endif
 
     return suite;
@@ -0,0 +1,348 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_thread_pool.h"
+#include "apr_atomic.h"
+
+#if APR_HAS_THREADS
+
+#define NUM_THREADS 4
+#define NUM_TASKS   2000
+#define NUM_SPAWNS  10
+
+static apr_uint32_t normal_flags = 0;
+static apr_uint32_t ws_flags = APR_THREAD_POOL_WORK_STEALING;
+static apr_uint32_t hist_flags = APR_THREAD_POOL_HISTOGRAMS;
+static apr_uint32_t ws_hist_flags = APR_THREAD_POOL_WORK_STEALING
+                                    | APR_THREAD_POOL_HISTOGRAMS;
+
+static apr_thread_pool_t *tp;
+static apr_uint32_t ran;
+static apr_uint32_t started;
+static apr_uint32_t released;
+static int owner_a, owner_b;
+
+static void * APR_THREAD_FUNC count_task(apr_thread_t *thd, void *data)
+{
+    apr_atomic_inc32(&ran);
+    return NULL;
+}
+
+/* Push some tasks from within the pool, of all the priorities */
+static void * APR_THREAD_FUNC spawn_task(apr_thread_t *thd, void *data)
+{
+    int i;
+
+    for (i = 0; i < NUM_SPAWNS; i++) {
+        if (i % 2) {
+            apr_thread_pool_push(tp, count_task, NULL, (apr_byte_t)(i * 25),
+                                 NULL);
+        }
+        else {
+            apr_thread_pool_top(tp, count_task, NULL, (apr_byte_t)(i * 25),
+                                NULL);
+        }
+    }
+    apr_atomic_inc32(&ran);
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC blocking_task(apr_thread_t *thd, void *data)
+{
+    apr_atomic_set32(&started, 1);
+    while (!apr_atomic_read32(&released)) {
+        apr_sleep(1000);
+    }
+    apr_atomic_inc32(&ran);
+    return NULL;
+}
+
+static void wait_for_tasks(apr_uint32_t n)
+{
+    int i;
+
+    for (i = 0; i < 10000 && apr_atomic_read32(&ran) < n; i++) {
+        apr_sleep(1000);
+    }
+    /* the counts are updated after the tasks return */
+    for (i = 0; i < 1000 && apr_thread_pool_tasks_run_count(tp) < n; i++) {
+        apr_sleep(1000);
+    }
+}
+
+static void thread_pool_tasks(abts_case *tc, void *data)
+{
+    apr_uint32_t flags = *(apr_uint32_t *)data;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_thread_pool_create_ex(&tp, NUM_THREADS, NUM_THREADS, flags, p);
+    APR_ASSERT_SUCCESS(tc, "create thread pool", rv);
+    ABTS_INT_EQUAL(tc, NUM_THREADS, (int)apr_thread_pool_threads_count(tp));
+
+    apr_atomic_set32(&ran, 0);
+    for (i = 0; i < NUM_TASKS; i++) {
+        rv = apr_thread_pool_push(tp, i % 10 ? count_task : spawn_task, NULL,
+                                  (apr_byte_t)i, NULL);
+        APR_ASSERT_SUCCESS(tc, "push task", rv);
+    }
+    wait_for_tasks(NUM_TASKS + NUM_TASKS / 10 * NUM_SPAWNS);
+
+    ABTS_INT_EQUAL(tc, NUM_TASKS + NUM_TASKS / 10 * NUM_SPAWNS,
+                   apr_atomic_read32(&ran));
+    ABTS_INT_EQUAL(tc, NUM_TASKS + NUM_TASKS / 10 * NUM_SPAWNS,
+                   (int)apr_thread_pool_tasks_run_count(tp));
+    ABTS_INT_EQUAL(tc, 0, (int)apr_thread_pool_tasks_count(tp));
+
+    apr_thread_pool_destroy(tp);
+}
+
+static void thread_pool_cancel(abts_case *tc, void *data)
+{
+    apr_uint32_t flags = *(apr_uint32_t *)data;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_thread_pool_create_ex(&tp, 1, 1, flags, p);
+    APR_ASSERT_SUCCESS(tc, "create thread pool", rv);
+
+    /* the only thread is kept busy while the tasks are queued */
+    apr_atomic_set32(&ran, 0);
+    apr_atomic_set32(&started, 0);
+    apr_atomic_set32(&released, 0);
+    rv = apr_thread_pool_push(tp, blocking_task, NULL, 0, &owner_a);
+    APR_ASSERT_SUCCESS(tc, "push blocking task", rv);
+    for (i = 0; i < 10000 && !apr_atomic_read32(&started); i++) {
+        apr_sleep(1000);
+    }
+    for (i = 0; i < 100; i++) {
+        apr_thread_pool_push(tp, count_task, NULL, (apr_byte_t)i,
+                             i % 2 ? &owner_a : &owner_b);
+    }
+    ABTS_INT_EQUAL(tc, 100, (int)apr_thread_pool_tasks_count(tp));
+
+    apr_thread_pool_tasks_cancel(tp, &owner_b);
+    ABTS_INT_EQUAL(tc, 50, (int)apr_thread_pool_tasks_count(tp));
+
+    apr_atomic_set32(&released, 1);
+    wait_for_tasks(51);
+    ABTS_INT_EQUAL(tc, 51, apr_atomic_read32(&ran));
+    ABTS_INT_EQUAL(tc, 0, (int)apr_thread_pool_tasks_count(tp));
+
+    /* nothing left to run */
+    apr_sleep(apr_time_from_msec(10));
+    ABTS_INT_EQUAL(tc, 51, apr_atomic_read32(&ran));
+
+    apr_thread_pool_destroy(tp);
+}
+
+static void thread_pool_batch(abts_case *tc, void *data)
+{
+    apr_uint32_t flags = *(apr_uint32_t *)data;
+    apr_thread_pool_group_t *group;
+    void *params[NUM_TASKS];
+    apr_status_t rv;
+    int i;
+
+    rv = apr_thread_pool_create_ex(&tp, NUM_THREADS, NUM_THREADS, flags, p);
+    APR_ASSERT_SUCCESS(tc, "create thread pool", rv);
+    rv = apr_thread_pool_group_create(&group, p);
+    APR_ASSERT_SUCCESS(tc, "create group", rv);
+    for (i = 0; i < NUM_TASKS; i++) {
+        params[i] = NULL;
+    }
+
+    apr_atomic_set32(&ran, 0);
+    rv = apr_thread_pool_push_batch(tp, count_task, params, NUM_TASKS, 0,
+                                    NULL, group);
+    APR_ASSERT_SUCCESS(tc, "push tasks", rv);
+    rv = apr_thread_pool_group_wait(group, -1);
+    APR_ASSERT_SUCCESS(tc, "wait for the group", rv);
+    ABTS_INT_EQUAL(tc, NUM_TASKS, apr_atomic_read32(&ran));
+    ABTS_INT_EQUAL(tc, 0, (int)apr_thread_pool_group_count(group));
+
+    /* cancelled tasks are done too */
+    apr_atomic_set32(&ran, 0);
+    apr_atomic_set32(&started, 0);
+    apr_atomic_set32(&released, 0);
+    for (i = 0; i < NUM_THREADS; i++) {
+        apr_thread_pool_push(tp, blocking_task, NULL, 0, &owner_a);
+    }
+    for (i = 0; i < 10000 && !apr_atomic_read32(&started); i++) {
+        apr_sleep(1000);
+    }
+    rv = apr_thread_pool_push_batch(tp, count_task, params, 100, 0,
+                                    &owner_b, group);
+    APR_ASSERT_SUCCESS(tc, "push tasks", rv);
+    ABTS_INT_EQUAL(tc, APR_TIMEUP, apr_thread_pool_group_wait(group, 0));
+    apr_atomic_set32(&released, 1);
+    apr_thread_pool_tasks_cancel(tp, &owner_b);
+    rv = apr_thread_pool_group_wait(group, apr_time_from_sec(10));
+    APR_ASSERT_SUCCESS(tc, "wait for the cancelled group", rv);
+    ABTS_INT_EQUAL(tc, 0, (int)apr_thread_pool_group_count(group));
+
+    apr_thread_pool_destroy(tp);
+}
+
+static apr_uint32_t pinned_cpu;
+static apr_uint32_t misplaced;
+
+static void * APR_THREAD_FUNC cpu_task(apr_thread_t *thd, void *data)
+{
+    apr_uint32_t cpu;
+
+    if (apr_thread_cpu_get(&cpu, NULL) == APR_SUCCESS && cpu != pinned_cpu) {
+        apr_atomic_inc32(&misplaced);
+    }
+    apr_atomic_inc32(&ran);
+    return NULL;
+}
+
+static void thread_pool_affinity(abts_case *tc, void *data)
+{
+    apr_uint32_t flags = *(apr_uint32_t *)data;
+    apr_status_t rv;
+    int i;
+
+    if (apr_thread_cpu_get(&pinned_cpu, NULL) != APR_SUCCESS) {
+        ABTS_NOT_IMPL(tc, "Current CPU not available on this platform");
+        return;
+    }
+    rv = apr_thread_pool_create_ex(&tp, NUM_THREADS, NUM_THREADS, flags, p);
+    APR_ASSERT_SUCCESS(tc, "create thread pool", rv);
+
+    ABTS_INT_EQUAL(tc, APR_EINVAL,
+                   apr_thread_pool_affinity_set(tp, &pinned_cpu, 1, -1));
+    rv = apr_thread_pool_affinity_set(tp, &pinned_cpu, 1,
+                                      APR_THREAD_POOL_AFFINITY_SPREAD);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "Thread affinity not implemented on this platform");
+        apr_thread_pool_destroy(tp);
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "set the pool affinity", rv);
+
+    /* all the threads run on the single CPU */
+    apr_atomic_set32(&ran, 0);
+    apr_atomic_set32(&misplaced, 0);
+    for (i = 0; i < NUM_TASKS; i++) {
+        apr_thread_pool_push(tp, cpu_task, NULL, 0, NULL);
+    }
+    wait_for_tasks(NUM_TASKS);
+    ABTS_INT_EQUAL(tc, NUM_TASKS, apr_atomic_read32(&ran));
+    ABTS_INT_EQUAL(tc, 0, apr_atomic_read32(&misplaced));
+
+    rv = apr_thread_pool_affinity_set(tp, NULL, 0,
+                                      APR_THREAD_POOL_AFFINITY_COMPACT);
+    APR_ASSERT_SUCCESS(tc, "reset the pool affinity", rv);
+
+    apr_thread_pool_destroy(tp);
+}
+
+static void * APR_THREAD_FUNC sleep_task(apr_thread_t *thd, void *data)
+{
+    apr_sleep(apr_time_from_msec(2));
+    apr_atomic_inc32(&ran);
+    return NULL;
+}
+
+static void thread_pool_latency(abts_case *tc, void *data)
+{
+    apr_uint32_t flags = *(apr_uint32_t *)data;
+    apr_interval_time_t median, tail;
+    apr_uint64_t count;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_thread_pool_create_ex(&tp, 1, 1, flags, p);
+    APR_ASSERT_SUCCESS(tc, "create thread pool", rv);
+    ABTS_INT_EQUAL(tc, APR_ENOENT,
+                   apr_thread_pool_latency_get(tp, APR_THREAD_POOL_RUN_TIME,
+                                               APR_THREAD_POOL_ALL_PRIORITIES,
+                                               50, &median, &count));
+    ABTS_INT_EQUAL(tc, 0, (int)count);
+    ABTS_INT_EQUAL(tc, APR_EINVAL,
+                   apr_thread_pool_latency_get(tp, APR_THREAD_POOL_RUN_TIME,
+                                               0, 101, &median, NULL));
+    ABTS_INT_EQUAL(tc, APR_EINVAL,
+                   apr_thread_pool_latency_get(tp, 2, 0, 50, &median, NULL));
+
+    /* queued behind each other on the single thread */
+    apr_atomic_set32(&ran, 0);
+    for (i = 0; i < 20; i++) {
+        rv = apr_thread_pool_push(tp, sleep_task, NULL,
+                                  APR_THREAD_TASK_PRIORITY_HIGH, NULL);
+        APR_ASSERT_SUCCESS(tc, "push task", rv);
+    }
+    wait_for_tasks(20);
+    /* the run time is accounted for after the task returns */
+    for (i = 0; i < 1000; i++) {
+        rv = apr_thread_pool_latency_get(tp, APR_THREAD_POOL_RUN_TIME,
+                                         APR_THREAD_POOL_ALL_PRIORITIES, 50,
+                                         &median, &count);
+        if (rv == APR_SUCCESS && count == 20) {
+            break;
+        }
+        apr_sleep(1000);
+    }
+
+    rv = apr_thread_pool_latency_get(tp, APR_THREAD_POOL_RUN_TIME,
+                                     APR_THREAD_TASK_PRIORITY_HIGH, 50,
+                                     &median, &count);
+    APR_ASSERT_SUCCESS(tc, "get the run time", rv);
+    ABTS_INT_EQUAL(tc, 20, (int)count);
+    ABTS_ASSERT(tc, "tasks ran for their time",
+                median >= apr_time_from_msec(2));
+    rv = apr_thread_pool_latency_get(tp, APR_THREAD_POOL_WAIT_TIME,
+                                     APR_THREAD_POOL_ALL_PRIORITIES, 99,
+                                     &tail, &count);
+    APR_ASSERT_SUCCESS(tc, "get the wait time", rv);
+    ABTS_INT_EQUAL(tc, 20, (int)count);
+    ABTS_ASSERT(tc, "last tasks waited for the others",
+                tail >= apr_time_from_msec(2 * 18));
+    ABTS_INT_EQUAL(tc, APR_ENOENT,
+                   apr_thread_pool_latency_get(tp, APR_THREAD_POOL_WAIT_TIME,
+                                               APR_THREAD_TASK_PRIORITY_LOW,
+                                               50, &median, NULL));
+
+    apr_thread_pool_destroy(tp);
+}
+
+#endif /* APR_HAS_THREADS */
+
+abts_suite *testthreadpool(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+#if APR_HAS_THREADS
+    abts_run_test(suite, thread_pool_tasks, &normal_flags);
+    abts_run_test(suite, thread_pool_tasks, &ws_flags);
+    abts_run_test(suite, thread_pool_cancel, &normal_flags);
+    abts_run_test(suite, thread_pool_cancel, &ws_flags);
+    abts_run_test(suite, thread_pool_batch, &normal_flags);
+    abts_run_test(suite, thread_pool_batch, &ws_flags);
+    abts_run_test(suite, thread_pool_affinity, &normal_flags);
+    abts_run_test(suite, thread_pool_affinity, &ws_flags);
+    abts_run_test(suite, thread_pool_latency, &hist_flags);
+    abts_run_test(suite, thread_pool_latency, &ws_hist_flags);
+#endif
+
+    return suite;
+}
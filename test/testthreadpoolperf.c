@@ -0,0 +1,199 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_thread_pool.h"
+#include "apr_pools.h"
+#include "apr_atomic.h"
+#include "apr_time.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if !APR_HAS_THREADS
+int main(void)
+{
+    printf("This program won't work on this platform because there is no "
+           "support for threads.\n");
+    return 0;
+}
+#else /* !APR_HAS_THREADS */
+
+#define DEFAULT_MAX_TASKS   100000
+#define DEFAULT_MAX_THREADS 64
+
+static long max_tasks = DEFAULT_MAX_TASKS;
+static int max_threads = DEFAULT_MAX_THREADS;
+static apr_uint32_t hist_flags = 0;
+static apr_pool_t *pool;
+static apr_thread_pool_t *tp;
+static apr_uint32_t done;
+
+static void * APR_THREAD_FUNC tiny_task(apr_thread_t *thd, void *data)
+{
+    apr_atomic_inc32(&done);
+    return NULL;
+}
+
+/* Split the range of tasks in two halves pushed from within the pool, down
+ * to single tasks.
+ */
+static void * APR_THREAD_FUNC spawn_task(apr_thread_t *thd, void *data)
+{
+    apr_uintptr_t n = (apr_uintptr_t)data;
+
+    if (n > 1) {
+        apr_thread_pool_push(tp, spawn_task, (void *)(n / 2), 0, NULL);
+        apr_thread_pool_push(tp, spawn_task, (void *)(n - n / 2), 0, NULL);
+    }
+    else {
+        apr_atomic_inc32(&done);
+    }
+    return NULL;
+}
+
+static apr_status_t test_pool(const char *name, int num_threads,
+                              apr_uint32_t flags, int spawn)
+{
+    apr_time_t time_start, time_stop;
+    apr_interval_time_t wait50, wait99;
+    apr_status_t rv;
+    double secs;
+    long i;
+
+    rv = apr_thread_pool_create_ex(&tp, num_threads, num_threads,
+                                   flags | hist_flags, pool);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    apr_atomic_set32(&done, 0);
+
+    time_start = apr_time_now();
+    if (spawn) {
+        rv = apr_thread_pool_push(tp, spawn_task,
+                                  (void *)(apr_uintptr_t)max_tasks, 0, NULL);
+    }
+    else {
+        for (i = 0; rv == APR_SUCCESS && i < max_tasks; i++) {
+            rv = apr_thread_pool_push(tp, tiny_task, NULL, 0, NULL);
+        }
+    }
+    while (rv == APR_SUCCESS && (long)apr_atomic_read32(&done) < max_tasks) {
+        apr_sleep(1000);
+    }
+    time_stop = apr_time_now();
+    if (rv == APR_SUCCESS && hist_flags) {
+        rv = apr_thread_pool_latency_get(tp, APR_THREAD_POOL_WAIT_TIME,
+                                         APR_THREAD_POOL_ALL_PRIORITIES, 50,
+                                         &wait50, NULL);
+    }
+    if (rv == APR_SUCCESS && hist_flags) {
+        rv = apr_thread_pool_latency_get(tp, APR_THREAD_POOL_WAIT_TIME,
+                                         APR_THREAD_POOL_ALL_PRIORITIES, 99,
+                                         &wait99, NULL);
+    }
+    apr_thread_pool_destroy(tp);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    secs = (double)(time_stop - time_start) / APR_USEC_PER_SEC;
+    printf("    %-14s %3d threads: %10" APR_INT64_T_FMT " usec, "
+           "%12.0f tasks/s", name, num_threads,
+           (apr_int64_t)(time_stop - time_start),
+           secs > 0 ? (double)max_tasks / secs : 0.0);
+    if (hist_flags) {
+        printf(", waited %" APR_INT64_T_FMT " usec (p50) %" APR_INT64_T_FMT
+               " usec (p99)", (apr_int64_t)wait50, (apr_int64_t)wait99);
+    }
+    printf("\n");
+
+    return APR_SUCCESS;
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    int i, spawn;
+
+    printf("APR Thread Pool Performance Test\n==============\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "n:t:l", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'n') {
+            max_tasks = atol(optarg);
+            if (max_tasks < 1) {
+                max_tasks = DEFAULT_MAX_TASKS;
+            }
+        }
+        else if (optchar == 't') {
+            max_threads = atoi(optarg);
+            if (max_threads < 1 || max_threads > DEFAULT_MAX_THREADS) {
+                max_threads = DEFAULT_MAX_THREADS;
+            }
+        }
+        else if (optchar == 'l') {
+            hist_flags = APR_THREAD_POOL_HISTOGRAMS;
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    for (spawn = 0; spawn < 2; spawn++) {
+        if (spawn) {
+            printf("tasks pushed by the tasks (%ld tiny tasks)\n", max_tasks);
+        }
+        else {
+            printf("tasks pushed by the main thread (%ld tiny tasks)\n",
+                   max_tasks);
+        }
+        for (i = 1; i <= max_threads; i *= 2) {
+            if ((rv = test_pool("locked", i, 0, spawn)) != APR_SUCCESS
+                    || (rv = test_pool("work stealing", i,
+                                       APR_THREAD_POOL_WORK_STEALING,
+                                       spawn)) != APR_SUCCESS) {
+                fprintf(stderr, "thread pool test failed : [%d] %s\n",
+                        rv, apr_strerror(rv, errmsg, sizeof errmsg));
+                exit(-2);
+            }
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
+
+#endif /* !APR_HAS_THREADS */
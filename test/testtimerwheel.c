@@ -0,0 +1,223 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_timer_wheel.h"
+#include "apr_thread_pool.h"
+#include "apr_thread_mutex.h"
+#include <stdlib.h>
+
+#define NUM_TIMERS  10000
+#define RESOLUTION  10
+
+static apr_time_t start = 1000000;
+static apr_time_t times[NUM_TIMERS];
+static int expired[NUM_TIMERS];
+
+struct expire_ctx {
+    abts_case *tc;
+    apr_time_t now;
+    int count;
+};
+
+/* Expired no sooner than its time, nor later than the next tick (but the
+ * ones in the past when added).
+ */
+static int check_expired(void *rec, apr_timer_t *timer, void *data)
+{
+    struct expire_ctx *ctx = rec;
+    int i = (int)((apr_time_t *)data - times);
+
+    ABTS_ASSERT(ctx->tc, "expired at its time",
+                times[i] <= ctx->now && (times[i] > ctx->now - RESOLUTION
+                                         || times[i] < start));
+    ABTS_INT_EQUAL(ctx->tc, 0, expired[i]);
+    expired[i]++;
+    ctx->count++;
+    return 1;
+}
+
+static int cancel_odd(void *rec, apr_timer_t *timer, void *data)
+{
+    if (((apr_time_t *)data - times) % 2) {
+        apr_timer_wheel_cancel(rec, timer);
+    }
+    return 1;
+}
+
+static void timer_wheel_expire(abts_case *tc, void *data)
+{
+    apr_timer_wheel_t *tw;
+    struct expire_ctx ctx;
+    apr_time_t when;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_timer_wheel_create(&tw, RESOLUTION, start, p);
+    APR_ASSERT_SUCCESS(tc, "create timer wheel", rv);
+    ABTS_INT_EQUAL(tc, APR_EAGAIN, apr_timer_wheel_next(tw, &when));
+
+    /* from the past to many minutes ahead, at all the levels */
+    for (i = 0; i < NUM_TIMERS; i++) {
+        times[i] = start - 100 + (apr_time_t)(rand() % 1000000)
+                                 * (1 + i % 1000);
+        expired[i] = 0;
+        rv = apr_timer_wheel_add(tw, times[i], &times[i], NULL);
+        APR_ASSERT_SUCCESS(tc, "add timer", rv);
+    }
+    ABTS_INT_EQUAL(tc, NUM_TIMERS, (int)apr_timer_wheel_count(tw));
+
+    ctx.tc = tc;
+    ctx.count = 0;
+    ctx.now = start;
+    apr_timer_wheel_expire(tw, ctx.now, check_expired, &ctx);
+
+    /* nothing expires before the next time */
+    while (apr_timer_wheel_next(tw, &when) == APR_SUCCESS) {
+        ABTS_ASSERT(tc, "next time ahead", when > ctx.now);
+        ctx.now = when - 1;
+        ABTS_INT_EQUAL(tc, 0, (int)apr_timer_wheel_expire(tw, ctx.now,
+                                                          check_expired,
+                                                          &ctx));
+        ctx.now = when;
+        apr_timer_wheel_expire(tw, ctx.now, check_expired, &ctx);
+    }
+    ABTS_INT_EQUAL(tc, NUM_TIMERS, ctx.count);
+    ABTS_INT_EQUAL(tc, 0, (int)apr_timer_wheel_count(tw));
+    for (i = 0; i < NUM_TIMERS; i++) {
+        ABTS_INT_EQUAL(tc, 1, expired[i]);
+    }
+}
+
+static void timer_wheel_cancel(abts_case *tc, void *data)
+{
+    apr_timer_wheel_t *tw;
+    apr_timer_t *timer;
+    apr_status_t rv;
+    void *val;
+    int i, n;
+
+    rv = apr_timer_wheel_create(&tw, RESOLUTION, start, p);
+    APR_ASSERT_SUCCESS(tc, "create timer wheel", rv);
+
+    for (i = 0; i < NUM_TIMERS; i++) {
+        times[i] = start + 1 + (apr_time_t)i * i * 100;
+        expired[i] = 0;
+        apr_timer_wheel_add(tw, times[i], &times[i], &timer);
+    }
+    /* the last one is cancelled directly */
+    ABTS_PTR_EQUAL(tc, &times[NUM_TIMERS - 1],
+                   apr_timer_wheel_cancel(tw, timer));
+    apr_timer_wheel_do(cancel_odd, tw, tw);
+    ABTS_INT_EQUAL(tc, NUM_TIMERS / 2, (int)apr_timer_wheel_count(tw));
+
+    /* a big leap (with timers beyond the top wheel) */
+    apr_timer_wheel_add(tw, start + (APR_INT64_C(1) << 50), &times[1], NULL);
+    ABTS_INT_EQUAL(tc, APR_EAGAIN,
+                   apr_timer_wheel_pop(tw, start + RESOLUTION - 1, &val));
+    for (n = 0; apr_timer_wheel_pop(tw, times[NUM_TIMERS - 1], &val)
+                == APR_SUCCESS; n++) {
+        i = (int)((apr_time_t *)val - times);
+        ABTS_INT_EQUAL(tc, 0, i % 2);
+        ABTS_INT_EQUAL(tc, 0, expired[i]);
+        expired[i]++;
+    }
+    ABTS_INT_EQUAL(tc, NUM_TIMERS / 2, n);
+    ABTS_INT_EQUAL(tc, 1, (int)apr_timer_wheel_count(tw));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_timer_wheel_pop(tw, start + (APR_INT64_C(1) << 50)
+                                           + RESOLUTION, &val));
+    ABTS_PTR_EQUAL(tc, &times[1], val);
+    ABTS_INT_EQUAL(tc, 0, (int)apr_timer_wheel_count(tw));
+}
+
+#if APR_HAS_THREADS
+
+#define NUM_TASKS 5
+
+static apr_thread_mutex_t *ran_mutex;
+static apr_time_t ran_times[NUM_TASKS];
+static int ran_count;
+
+static void * APR_THREAD_FUNC scheduled_task(apr_thread_t *thd, void *data)
+{
+    apr_thread_mutex_lock(ran_mutex);
+    ran_times[(apr_time_t *)data - times] = apr_time_now();
+    ran_count++;
+    apr_thread_mutex_unlock(ran_mutex);
+    return NULL;
+}
+
+static void thread_pool_schedule(abts_case *tc, void *data)
+{
+    apr_thread_pool_t *tp;
+    apr_time_t begin;
+    apr_status_t rv;
+    int i, owner;
+
+    rv = apr_thread_mutex_create(&ran_mutex, APR_THREAD_MUTEX_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "create mutex", rv);
+    rv = apr_thread_pool_create(&tp, 1, 1, p);
+    APR_ASSERT_SUCCESS(tc, "create thread pool", rv);
+
+    /* in reverse order, the last (owned) one being cancelled */
+    begin = apr_time_now();
+    for (i = 0; i < NUM_TASKS; i++) {
+        times[i] = apr_time_from_msec(20 * (NUM_TASKS - i));
+        rv = apr_thread_pool_schedule(tp, scheduled_task, &times[i],
+                                      times[i],
+                                      i == NUM_TASKS - 1 ? &owner : NULL);
+        APR_ASSERT_SUCCESS(tc, "schedule task", rv);
+    }
+    ABTS_INT_EQUAL(tc, NUM_TASKS,
+                   (int)apr_thread_pool_scheduled_tasks_count(tp));
+    apr_thread_pool_tasks_cancel(tp, &owner);
+    ABTS_INT_EQUAL(tc, NUM_TASKS - 1,
+                   (int)apr_thread_pool_scheduled_tasks_count(tp));
+
+    for (i = 0; i < 100 && apr_thread_pool_scheduled_tasks_count(tp); i++) {
+        apr_sleep(apr_time_from_msec(10));
+    }
+    apr_sleep(apr_time_from_msec(10));
+    apr_thread_pool_destroy(tp);
+
+    ABTS_INT_EQUAL(tc, NUM_TASKS - 1, ran_count);
+    for (i = 0; i < NUM_TASKS - 1; i++) {
+        ABTS_ASSERT(tc, "task run at its time",
+                    ran_times[i] - begin >= times[i]);
+        ABTS_ASSERT(tc, "tasks run in order",
+                    i == 0 || ran_times[i] <= ran_times[i - 1]);
+    }
+    ABTS_ASSERT(tc, "cancelled task not run", ran_times[NUM_TASKS - 1] == 0);
+}
+
+#endif /* APR_HAS_THREADS */
+
+abts_suite *testtimerwheel(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, timer_wheel_expire, NULL);
+    abts_run_test(suite, timer_wheel_cancel, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, thread_pool_schedule, NULL);
+#endif
+
+    return suite;
+}
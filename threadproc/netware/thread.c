@@ -64,6 +64,13 @@ APR_DECLARE(apr_status_t) apr_threadattr_guardsize_set(apr_threadattr_t *attr,
     return APR_ENOTIMPL;
 }
 
+APR_DECLARE(apr_status_t) apr_threadattr_affinity_set(apr_threadattr_t *attr,
+                                                      const apr_uint32_t *cpus,
+                                                      apr_size_t ncpus)
+{
+    return APR_ENOTIMPL;
+}
+
 static void *dummy_worker(void *opaque)
 {
     apr_thread_t *thd = (apr_thread_t *)opaque;
@@ -159,6 +166,25 @@ void apr_thread_yield()
     NXThreadYield();
 }
 
+APR_DECLARE(apr_status_t) apr_thread_affinity_set(apr_thread_t *thd,
+                                                  const apr_uint32_t *cpus,
+                                                  apr_size_t ncpus)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(apr_status_t) apr_thread_cpu_get(apr_uint32_t *cpu,
+                                             apr_uint32_t *node)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(apr_status_t) apr_cpu_node_get(apr_uint32_t cpu,
+                                           apr_uint32_t *node)
+{
+    return APR_ENOTIMPL;
+}
+
 apr_status_t apr_thread_exit(apr_thread_t *thd,
                              apr_status_t retval)
 {
@@ -16,8 +16,23 @@
 
 #include "apr.h"
 #include "apr_portable.h"
+#include "apr_strings.h"
+#include "apr_lib.h"
 #include "apr_arch_threadproc.h"
 
+#if APR_HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+#if APR_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
 #if APR_HAS_THREADS
 
 #if APR_HAVE_PTHREAD_H
@@ -136,6 +151,50 @@ APR_DECLARE(apr_status_t) apr_threadattr_guardsize_set(apr_threadattr_t *attr,
 #endif
 }
 
+#if defined(HAVE_PTHREAD_ATTR_SETAFFINITY_NP) \
+    || defined(HAVE_PTHREAD_SETAFFINITY_NP)
+static apr_status_t cpuset_make(cpu_set_t *set, const apr_uint32_t *cpus,
+                                apr_size_t ncpus)
+{
+    apr_size_t i;
+
+    CPU_ZERO(set);
+    for (i = 0; i < ncpus; i++) {
+        if (cpus[i] >= CPU_SETSIZE) {
+            return APR_EINVAL;
+        }
+        CPU_SET(cpus[i], set);
+    }
+    return APR_SUCCESS;
+}
+#endif
+
+APR_DECLARE(apr_status_t) apr_threadattr_affinity_set(apr_threadattr_t *attr,
+                                                      const apr_uint32_t *cpus,
+                                                      apr_size_t ncpus)
+{
+#ifdef HAVE_PTHREAD_ATTR_SETAFFINITY_NP
+    cpu_set_t set;
+    apr_status_t rv;
+
+    if (!ncpus) {
+        /* back to the default, any CPU */
+        int i;
+
+        CPU_ZERO(&set);
+        for (i = 0; i < CPU_SETSIZE; i++) {
+            CPU_SET(i, &set);
+        }
+    }
+    else if ((rv = cpuset_make(&set, cpus, ncpus)) != APR_SUCCESS) {
+        return rv;
+    }
+    return pthread_attr_setaffinity_np(&attr->attr, sizeof(set), &set);
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
 static void *dummy_worker(void *opaque)
 {
     apr_thread_t *thread = (apr_thread_t*)opaque;
@@ -268,6 +327,85 @@ APR_DECLARE(void) apr_thread_yield(void)
 #endif
 }
 
+APR_DECLARE(apr_status_t) apr_thread_affinity_set(apr_thread_t *thd,
+                                                  const apr_uint32_t *cpus,
+                                                  apr_size_t ncpus)
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    cpu_set_t set;
+    apr_status_t rv;
+
+    if (!ncpus) {
+        return APR_EINVAL;
+    }
+    if ((rv = cpuset_make(&set, cpus, ncpus)) != APR_SUCCESS) {
+        return rv;
+    }
+    return pthread_setaffinity_np(*thd->td, sizeof(set), &set);
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
+APR_DECLARE(apr_status_t) apr_cpu_node_get(apr_uint32_t cpu,
+                                           apr_uint32_t *node)
+{
+#if defined(__linux__) && APR_HAVE_DIRENT_H
+    /* the node of the CPU is linked in its sysfs directory */
+    char path[64];
+    struct dirent *ent;
+    DIR *dir;
+
+    apr_snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u",
+                 (unsigned int)cpu);
+    if (!(dir = opendir(path))) {
+        return APR_ENOENT;
+    }
+    *node = 0;
+    while ((ent = readdir(dir)) != NULL) {
+        if (!strncmp(ent->d_name, "node", 4)
+                && apr_isdigit(ent->d_name[4])) {
+            *node = (apr_uint32_t)atoi(ent->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
+APR_DECLARE(apr_status_t) apr_thread_cpu_get(apr_uint32_t *cpu,
+                                             apr_uint32_t *node)
+{
+#if defined(HAVE_SYS_SYSCALL_H) && defined(SYS_getcpu)
+    unsigned int c, n;
+
+    if (syscall(SYS_getcpu, &c, &n, NULL) != 0) {
+        return errno;
+    }
+    *cpu = c;
+    if (node) {
+        *node = n;
+    }
+    return APR_SUCCESS;
+#elif defined(HAVE_SCHED_GETCPU)
+    int c = sched_getcpu();
+
+    if (c < 0) {
+        return errno;
+    }
+    *cpu = (apr_uint32_t)c;
+    if (node && apr_cpu_node_get(*cpu, node) != APR_SUCCESS) {
+        *node = 0;
+    }
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
 APR_DECLARE(apr_status_t) apr_thread_data_get(void **data, const char *key,
                                               apr_thread_t *thread)
 {
@@ -41,6 +41,7 @@ APR_DECLARE(apr_status_t) apr_threadattr_create(apr_threadattr_t **new,
     (*new)->pool = pool;
     (*new)->detach = 0;
     (*new)->stacksize = 0;
+    (*new)->affinity = 0;
 
     return APR_SUCCESS;
 }
@@ -72,12 +73,32 @@ APR_DECLARE(apr_status_t) apr_threadattr_guardsize_set(apr_threadattr_t *attr,
     return APR_ENOTIMPL;
 }
 
+APR_DECLARE(apr_status_t) apr_threadattr_affinity_set(apr_threadattr_t *attr,
+                                                      const apr_uint32_t *cpus,
+                                                      apr_size_t ncpus)
+{
+    DWORD_PTR mask = 0;
+    apr_size_t i;
+
+    for (i = 0; i < ncpus; i++) {
+        if (cpus[i] >= sizeof(mask) * 8) {
+            return APR_EINVAL;
+        }
+        mask |= (DWORD_PTR)1 << cpus[i];
+    }
+    attr->affinity = mask;
+    return APR_SUCCESS;
+}
+
 static void *dummy_worker(void *opaque)
 {
     apr_thread_t *thd = (apr_thread_t *)opaque;
     void *ret;
 
     TlsSetValue(tls_apr_thread, thd->td);
+    if (thd->affinity) {
+        SetThreadAffinityMask(GetCurrentThread(), thd->affinity);
+    }
     apr_pool_owner_set(thd->pool, 0);
     ret = thd->func(thd, thd->data);
     apr_pool_destroy(thd->pool);
@@ -102,6 +123,7 @@ APR_DECLARE(apr_status_t) apr_thread_create(apr_thread_t **new,
     (*new)->data = data;
     (*new)->func = func;
     (*new)->td   = NULL;
+    (*new)->affinity = attr ? attr->affinity : 0;
     stat = apr_pool_create(&(*new)->pool, pool);
     if (stat != APR_SUCCESS) {
         return stat;
@@ -198,6 +220,60 @@ APR_DECLARE(void) apr_thread_yield()
 #endif
 }
 
+APR_DECLARE(apr_status_t) apr_thread_affinity_set(apr_thread_t *thd,
+                                                  const apr_uint32_t *cpus,
+                                                  apr_size_t ncpus)
+{
+    DWORD_PTR mask = 0;
+    apr_size_t i;
+
+    for (i = 0; i < ncpus; i++) {
+        if (cpus[i] >= sizeof(mask) * 8) {
+            return APR_EINVAL;
+        }
+        mask |= (DWORD_PTR)1 << cpus[i];
+    }
+    if (!mask || !thd->td) {
+        return APR_EINVAL;
+    }
+    if (!SetThreadAffinityMask(thd->td, mask)) {
+        return apr_get_os_error();
+    }
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_thread_cpu_get(apr_uint32_t *cpu,
+                                             apr_uint32_t *node)
+{
+#ifndef _WIN32_WCE
+    UCHAR n;
+
+    *cpu = GetCurrentProcessorNumber();
+    if (node) {
+        *node = GetNumaProcessorNode((UCHAR)*cpu, &n) ? n : 0;
+    }
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
+APR_DECLARE(apr_status_t) apr_cpu_node_get(apr_uint32_t cpu,
+                                           apr_uint32_t *node)
+{
+#ifndef _WIN32_WCE
+    UCHAR n;
+
+    if (cpu > 0xFF || !GetNumaProcessorNode((UCHAR)cpu, &n) || n == 0xFF) {
+        return APR_ENOENT;
+    }
+    *node = n;
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
 APR_DECLARE(apr_status_t) apr_thread_data_get(void **data, const char *key,
                                              apr_thread_t *thread)
 {
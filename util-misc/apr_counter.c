@@ -0,0 +1,167 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_private.h"
+
+#include "apr_general.h"
+#include "apr_atomic.h"
+#include "apr_counter.h"
+
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+#if APR_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SCHED_GETCPU
+#include <sched.h>
+#define COUNTER_PER_CPU 1
+#elif defined(WIN32) && defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0600
+#define COUNTER_PER_CPU 1
+#else
+#define COUNTER_PER_CPU 0
+#endif
+
+/*
+ * A counter is an array of slots, one per cache line, summed on read.
+ * Each update goes to the slot of the current CPU (or thread), so that
+ * concurrent updates mostly hit different cache lines; the addition is
+ * still atomic since a thread can migrate, or share its slot with others.
+ */
+
+#define COUNTER_CACHE_LINE  64
+#define COUNTER_MAX_SLOTS   1024
+#define COUNTER_DEF_SLOTS   16
+
+typedef struct counter_slot_t {
+    volatile apr_uint64_t   value;
+    char                    pad[COUNTER_CACHE_LINE - sizeof(apr_uint64_t)];
+} counter_slot_t;
+
+struct apr_counter_t {
+    counter_slot_t *slots;
+    apr_uint32_t mask;
+    int per_cpu;
+};
+
+static apr_uint32_t ncpus(void)
+{
+#if defined(WIN32)
+    SYSTEM_INFO si;
+
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_CONF)
+    long n = sysconf(_SC_NPROCESSORS_CONF);
+
+    return n > 0 ? (apr_uint32_t)n : COUNTER_DEF_SLOTS;
+#else
+    return COUNTER_DEF_SLOTS;
+#endif
+}
+
+APR_DECLARE(apr_status_t) apr_counter_create(apr_counter_t **counter,
+                                             apr_uint32_t slots,
+                                             apr_uint32_t flags,
+                                             apr_pool_t *pool)
+{
+    apr_counter_t *c;
+    apr_uint32_t n;
+
+    if (!slots) {
+        slots = ncpus();
+    }
+    for (n = 1; n < slots && n < COUNTER_MAX_SLOTS; n <<= 1)
+        ;
+
+    c = apr_palloc(pool, sizeof(*c));
+    c->slots = apr_palloc_aligned(pool, n * sizeof(counter_slot_t),
+                                  COUNTER_CACHE_LINE);
+    memset(c->slots, 0, n * sizeof(counter_slot_t));
+    c->mask = n - 1;
+    c->per_cpu = COUNTER_PER_CPU && !(flags & APR_COUNTER_PER_THREAD);
+
+    *counter = c;
+    return APR_SUCCESS;
+}
+
+static APR_INLINE counter_slot_t *counter_slot(apr_counter_t *c)
+{
+    apr_uint32_t h;
+    char here;
+
+    if (!c->mask) {
+        return c->slots;
+    }
+#if COUNTER_PER_CPU
+    if (c->per_cpu) {
+#ifdef HAVE_SCHED_GETCPU
+        int cpu = sched_getcpu();
+
+        if (cpu >= 0) {
+            return &c->slots[(apr_uint32_t)cpu & c->mask];
+        }
+#else
+        return &c->slots[GetCurrentProcessorNumber() & c->mask];
+#endif
+    }
+#endif
+    /* The threads' stacks are distinct and at least a few pages apart, so
+     * hash the page of a local variable; it costs less than getting a
+     * thread id, and any slot is correct anyway.
+     */
+    h = (apr_uint32_t)((apr_uintptr_t)&here >> 12) * 0x9E3779B1U;
+    return &c->slots[(h >> 16) & c->mask];
+}
+
+APR_DECLARE(void) apr_counter_add(apr_counter_t *counter, apr_uint64_t val)
+{
+    apr_atomic_add64_ex(&counter_slot(counter)->value, val,
+                        APR_ATOMIC_RELAXED);
+}
+
+APR_DECLARE(void) apr_counter_sub(apr_counter_t *counter, apr_uint64_t val)
+{
+    apr_atomic_add64_ex(&counter_slot(counter)->value, (apr_uint64_t)0 - val,
+                        APR_ATOMIC_RELAXED);
+}
+
+APR_DECLARE(void) apr_counter_inc(apr_counter_t *counter)
+{
+    apr_atomic_add64_ex(&counter_slot(counter)->value, 1, APR_ATOMIC_RELAXED);
+}
+
+APR_DECLARE(apr_uint64_t) apr_counter_read(apr_counter_t *counter)
+{
+    apr_uint64_t sum = 0;
+    apr_uint32_t i;
+
+    for (i = 0; i <= counter->mask; i++) {
+        sum += apr_atomic_read64_ex(&counter->slots[i].value,
+                                    APR_ATOMIC_RELAXED);
+    }
+    return sum;
+}
+
+APR_DECLARE(void) apr_counter_set(apr_counter_t *counter, apr_uint64_t val)
+{
+    apr_uint32_t i;
+
+    apr_atomic_set64_ex(&counter->slots[0].value, val, APR_ATOMIC_RELAXED);
+    for (i = 1; i <= counter->mask; i++) {
+        apr_atomic_set64_ex(&counter->slots[i].value, 0, APR_ATOMIC_RELAXED);
+    }
+}
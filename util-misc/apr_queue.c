@@ -25,6 +25,9 @@
 #if APR_HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
 
 #include "apu.h"
 #include "apr_portable.h"
@@ -32,6 +35,7 @@
 #include "apr_thread_cond.h"
 #include "apr_errno.h"
 #include "apr_queue.h"
+#include "apr_atomic_inline.h"
 
 #if APR_HAS_THREADS
 /* 
@@ -40,6 +44,51 @@
 #define QUEUE_DEBUG
  */
 
+/*
+ * The lock-free queue is Dmitry Vyukov's bounded MPMC queue: a ring of
+ * cells whose sequence number tells whether it's ready to be pushed to
+ * (equal to the enqueue position) or popped from (one more than the
+ * dequeue position), the positions being claimed with a compare and swap.
+ *
+ * The threads block on the queue's mutex and conditions only when the
+ * queue is empty or full, through an eventcount per side: a waiter
+ * registers itself and reads the epoch before trying once more, and
+ * sleeps until the epoch changes; the other side, after pushing or
+ * popping, bumps the epoch under the mutex only if there are waiters.
+ * The cells are released with sequentially consistent stores, so that
+ * either the waiter's last try sees the cell or the releaser sees the
+ * waiter.
+ *
+ * It needs the inline atomics, otherwise the queue is created with the
+ * mutex.
+ */
+#define LF_SUPPORTED APR_ATOMIC_INLINE
+
+#define LF_CACHE_LINE 64
+
+typedef struct lf_cell_t {
+    apr_size_t          seq;
+    void               *data;
+} lf_cell_t;
+
+typedef struct lf_event_t {
+    apr_uint32_t        waiters;
+    apr_uint32_t        epoch;     /**< bumped under the mutex */
+    apr_thread_cond_t  *cond;
+} lf_event_t;
+
+typedef struct lf_queue_t {
+    apr_size_t          enqueue_pos;
+    char                pad1[LF_CACHE_LINE - sizeof(apr_size_t)];
+    apr_size_t          dequeue_pos;
+    char                pad2[LF_CACHE_LINE - sizeof(apr_size_t)];
+    lf_cell_t          *cells;
+    apr_size_t          mask;
+    lf_event_t          not_empty;
+    lf_event_t          not_full;
+    apr_uint32_t        interrupts; /**< bumped under the mutex */
+} lf_queue_t;
+
 struct apr_queue_t {
     void              **data;
     unsigned int        nelts; /**< # elements */
@@ -52,6 +101,7 @@ struct apr_queue_t {
     apr_thread_cond_t  *not_empty;
     apr_thread_cond_t  *not_full;
     int                 terminated;
+    lf_queue_t         *lf;    /**< the lock-free ring, or NULL */
 };
 
 #ifdef QUEUE_DEBUG
@@ -95,12 +145,215 @@ static apr_status_t queue_destroy(void *data)
     return APR_SUCCESS;
 }
 
+#if LF_SUPPORTED
+
+static apr_status_t lf_create(apr_queue_t *queue, unsigned int capacity,
+                              apr_pool_t *a)
+{
+    lf_queue_t *lf;
+    apr_size_t i, size = 2;
+
+    while (size < capacity) {
+        size <<= 1;
+    }
+    lf = apr_palloc_aligned(a, sizeof(*lf), LF_CACHE_LINE);
+    if (!lf) {
+        return APR_ENOMEM;
+    }
+    memset(lf, 0, sizeof(*lf));
+    lf->cells = apr_palloc_aligned(a, size * sizeof(lf_cell_t),
+                                   LF_CACHE_LINE);
+    if (!lf->cells) {
+        return APR_ENOMEM;
+    }
+    for (i = 0; i < size; i++) {
+        lf->cells[i].seq = i;
+        lf->cells[i].data = NULL;
+    }
+    lf->mask = size - 1;
+    lf->not_empty.cond = queue->not_empty;
+    lf->not_full.cond = queue->not_full;
+    queue->bounds = (unsigned int)size;
+    queue->lf = lf;
+    return APR_SUCCESS;
+}
+
+static APR_INLINE int lf_trypush(lf_queue_t *lf, void *data)
+{
+    lf_cell_t *cell;
+    apr_size_t pos = apr__atomic_load(&lf->enqueue_pos, RELAXED);
+
+    for (;;) {
+        apr_ssize_t dif;
+
+        cell = &lf->cells[pos & lf->mask];
+        dif = (apr_ssize_t)(apr__atomic_load(&cell->seq, ACQUIRE) - pos);
+        if (dif == 0) {
+            if (apr__atomic_cas_weak(&lf->enqueue_pos, &pos, pos + 1,
+                                     RELAXED, RELAXED)) {
+                break;
+            }
+        }
+        else if (dif < 0) {
+            return 0; /* full */
+        }
+        else {
+            pos = apr__atomic_load(&lf->enqueue_pos, RELAXED);
+        }
+    }
+    cell->data = data;
+    apr__atomic_store(&cell->seq, pos + 1, SEQ_CST);
+    return 1;
+}
+
+static APR_INLINE int lf_trypop(lf_queue_t *lf, void **data)
+{
+    lf_cell_t *cell;
+    apr_size_t pos = apr__atomic_load(&lf->dequeue_pos, RELAXED);
+
+    for (;;) {
+        apr_ssize_t dif;
+
+        cell = &lf->cells[pos & lf->mask];
+        dif = (apr_ssize_t)(apr__atomic_load(&cell->seq, ACQUIRE) - (pos + 1));
+        if (dif == 0) {
+            if (apr__atomic_cas_weak(&lf->dequeue_pos, &pos, pos + 1,
+                                     RELAXED, RELAXED)) {
+                break;
+            }
+        }
+        else if (dif < 0) {
+            return 0; /* empty */
+        }
+        else {
+            pos = apr__atomic_load(&lf->dequeue_pos, RELAXED);
+        }
+    }
+    *data = cell->data;
+    apr__atomic_store(&cell->seq, pos + lf->mask + 1, SEQ_CST);
+    return 1;
+}
+
+/* Wake up a waiter of the other side (or all of them), if any */
+static void lf_notify(apr_queue_t *queue, lf_event_t *ev, int all)
+{
+    if (apr__atomic_load(&ev->waiters, SEQ_CST)) {
+        apr_thread_mutex_lock(queue->one_big_mutex);
+        apr__atomic_store(&ev->epoch, ev->epoch + 1, RELEASE);
+        if (all) {
+            apr_thread_cond_broadcast(ev->cond);
+        }
+        else {
+            apr_thread_cond_signal(ev->cond);
+        }
+        apr_thread_mutex_unlock(queue->one_big_mutex);
+    }
+}
+
+/*
+ * Push or pop up to n items, blocking until the queue is not full or empty
+ * anymore, or the timeout expires (infinitely if negative), or the queue
+ * is interrupted.
+ */
+static apr_status_t lf_push_pop(apr_queue_t *queue, int push, void **data,
+                                unsigned int n, unsigned int *count,
+                                apr_interval_time_t timeout)
+{
+    lf_queue_t *lf = queue->lf;
+    lf_event_t *ev = push ? &lf->not_full : &lf->not_empty;
+    apr_time_t deadline = 0;
+    apr_status_t rv = APR_SUCCESS;
+    unsigned int i;
+
+    if (apr__atomic_load(&queue->terminated, ACQUIRE)) {
+        return APR_EOF; /* no more elements ever again */
+    }
+
+    while (push ? !lf_trypush(lf, *data) : !lf_trypop(lf, data)) {
+        apr_uint32_t epoch, interrupts;
+        int done;
+
+        if (!timeout) {
+            return APR_EAGAIN;
+        }
+        if (timeout > 0 && !deadline) {
+            deadline = apr_time_now() + timeout;
+        }
+
+        /* register, then try once more before sleeping */
+        apr__atomic_add(&ev->waiters, 1, SEQ_CST);
+        apr__atomic_fence(SEQ_CST);
+        epoch = apr__atomic_load(&ev->epoch, ACQUIRE);
+        interrupts = apr__atomic_load(&lf->interrupts, ACQUIRE);
+        done = push ? lf_trypush(lf, *data) : lf_trypop(lf, data);
+        if (!done) {
+            apr_thread_mutex_lock(queue->one_big_mutex);
+            while (ev->epoch == epoch && lf->interrupts == interrupts) {
+                if (timeout > 0) {
+                    apr_interval_time_t left = deadline - apr_time_now();
+                    if (left <= 0) {
+                        rv = APR_TIMEUP;
+                        break;
+                    }
+                    apr_thread_cond_timedwait(ev->cond,
+                                              queue->one_big_mutex, left);
+                }
+                else {
+                    apr_thread_cond_wait(ev->cond, queue->one_big_mutex);
+                }
+            }
+            if (lf->interrupts != interrupts) {
+                rv = APR_EINTR;
+            }
+            apr_thread_mutex_unlock(queue->one_big_mutex);
+        }
+        apr__atomic_sub(&ev->waiters, 1, SEQ_CST);
+        if (done) {
+            break;
+        }
+
+        if (rv != APR_SUCCESS) {
+            /* a last chance */
+            if (push ? lf_trypush(lf, *data) : lf_trypop(lf, data)) {
+                rv = APR_SUCCESS;
+                break;
+            }
+            if (rv == APR_EINTR
+                    && apr__atomic_load(&queue->terminated, ACQUIRE)) {
+                return APR_EOF; /* no more elements ever again */
+            }
+            return rv;
+        }
+    }
+    for (i = 1; i < n; i++) {
+        if (push ? !lf_trypush(lf, data[i]) : !lf_trypop(lf, &data[i])) {
+            break;
+        }
+    }
+    if (count) {
+        *count = i;
+    }
+
+    lf_notify(queue, push ? &lf->not_empty : &lf->not_full, i > 1);
+    return APR_SUCCESS;
+}
+
+#endif /* LF_SUPPORTED */
+
 /**
  * Initialize the apr_queue_t.
  */
 APR_DECLARE(apr_status_t) apr_queue_create(apr_queue_t **q, 
                                            unsigned int queue_capacity, 
                                            apr_pool_t *a)
+{
+    return apr_queue_create_ex(q, queue_capacity, 0, a);
+}
+
+APR_DECLARE(apr_status_t) apr_queue_create_ex(apr_queue_t **q,
+                                              unsigned int queue_capacity,
+                                              apr_uint32_t flags,
+                                              apr_pool_t *a)
 {
     apr_status_t rv;
     apr_queue_t *queue;
@@ -125,8 +378,7 @@ APR_DECLARE(apr_status_t) apr_queue_create(apr_queue_t **q,
         return rv;
     }
 
-    /* Set all the data in the queue to NULL */
-    queue->data = apr_pcalloc(a, queue_capacity * sizeof(void*));
+    queue->data = NULL;
     queue->bounds = queue_capacity;
     queue->nelts = 0;
     queue->in = 0;
@@ -134,21 +386,48 @@ APR_DECLARE(apr_status_t) apr_queue_create(apr_queue_t **q,
     queue->terminated = 0;
     queue->full_waiters = 0;
     queue->empty_waiters = 0;
+    queue->lf = NULL;
 
     apr_pool_cleanup_register(a, queue, queue_destroy, apr_pool_cleanup_null);
 
+#if LF_SUPPORTED
+    if (flags & APR_QUEUE_LOCKFREE) {
+        /* The lock-free ring has its own cells, no data array */
+        return lf_create(queue, queue_capacity, a);
+    }
+#endif
+
+    /* Set all the data in the queue to NULL */
+    queue->data = apr_pcalloc(a, queue_capacity * sizeof(void*));
+
     return APR_SUCCESS;
 }
 
 /**
- * Push new data onto the queue. Blocks if the queue is full. Once
- * the push operation has completed, it signals other threads waiting
- * in apr_queue_pop() that they may continue consuming sockets.
+ * Push new data onto the queue, as many items as fit up to n. Blocks if
+ * the queue is full. Once the push operation has completed, it signals
+ * other threads waiting in apr_queue_pop() that they may continue
+ * consuming sockets.
  */
-static apr_status_t queue_push(apr_queue_t *queue, void *data,
+static apr_status_t queue_push(apr_queue_t *queue, void * const *data,
+                               unsigned int n, unsigned int *count,
                                apr_interval_time_t timeout)
 {
     apr_status_t rv;
+    unsigned int i;
+
+    if (count) {
+        *count = 0;
+    }
+    if (!n) {
+        return APR_SUCCESS;
+    }
+
+#if LF_SUPPORTED
+    if (queue->lf) {
+        return lf_push_pop(queue, 1, (void **)data, n, count, timeout);
+    }
+#endif
 
     if (queue->terminated) {
         return APR_EOF; /* no more elements ever again */
@@ -197,15 +476,25 @@ static apr_status_t queue_push(apr_queue_t *queue, void *data,
         }
     }
 
-    queue->data[queue->in] = data;
-    queue->in++;
-    if (queue->in >= queue->bounds)
-        queue->in -= queue->bounds;
-    queue->nelts++;
+    for (i = 0; i < n && !apr_queue_full(queue); i++) {
+        queue->data[queue->in] = data[i];
+        queue->in++;
+        if (queue->in >= queue->bounds)
+            queue->in -= queue->bounds;
+        queue->nelts++;
+    }
+    if (count) {
+        *count = i;
+    }
 
     if (queue->empty_waiters) {
         Q_DBG("sig !empty", queue);
-        rv = apr_thread_cond_signal(queue->not_empty);
+        if (i > 1) {
+            rv = apr_thread_cond_broadcast(queue->not_empty);
+        }
+        else {
+            rv = apr_thread_cond_signal(queue->not_empty);
+        }
         if (rv != APR_SUCCESS) {
             apr_thread_mutex_unlock(queue->one_big_mutex);
             return rv;
@@ -218,7 +507,7 @@ static apr_status_t queue_push(apr_queue_t *queue, void *data,
 
 APR_DECLARE(apr_status_t) apr_queue_push(apr_queue_t *queue, void *data)
 {
-    return queue_push(queue, data, -1);
+    return queue_push(queue, &data, 1, NULL, -1);
 }
 
 /**
@@ -228,33 +517,70 @@ APR_DECLARE(apr_status_t) apr_queue_push(apr_queue_t *queue, void *data)
  */
 APR_DECLARE(apr_status_t) apr_queue_trypush(apr_queue_t *queue, void *data)
 {
-    return queue_push(queue, data, 0);
+    return queue_push(queue, &data, 1, NULL, 0);
 }
 
 APR_DECLARE(apr_status_t) apr_queue_timedpush(apr_queue_t *queue, void *data,
                                               apr_interval_time_t timeout)
 {
-    return queue_push(queue, data, timeout);
+    return queue_push(queue, &data, 1, NULL, timeout);
+}
+
+APR_DECLARE(apr_status_t) apr_queue_push_n(apr_queue_t *queue,
+                                           void * const *data,
+                                           unsigned int n,
+                                           unsigned int *pushed,
+                                           apr_interval_time_t timeout)
+{
+    return queue_push(queue, data, n, pushed, timeout);
 }
 
 /**
  * not thread safe
  */
 APR_DECLARE(unsigned int) apr_queue_size(apr_queue_t *queue) {
+#if LF_SUPPORTED
+    if (queue->lf) {
+        apr_size_t out = apr__atomic_load(&queue->lf->dequeue_pos, RELAXED);
+        apr_size_t in = apr__atomic_load(&queue->lf->enqueue_pos, RELAXED);
+        apr_ssize_t n = (apr_ssize_t)(in - out);
+
+        if (n <= 0) {
+            return 0;
+        }
+        return (n < (apr_ssize_t)queue->bounds) ? (unsigned int)n
+                                                : queue->bounds;
+    }
+#endif
     return queue->nelts;
 }
 
 /**
- * Retrieves the next item from the queue. If there are no
- * items available, it will either return APR_EAGAIN (timeout = 0),
- * or block until one becomes available (infinitely with timeout < 0,
- * otherwise until the given timeout expires). Once retrieved, the
- * item is placed into the address specified by 'data'.
+ * Retrieves the next items from the queue, as many as available up to n.
+ * If there are no items available, it will either return APR_EAGAIN
+ * (timeout = 0), or block until one becomes available (infinitely with
+ * timeout < 0, otherwise until the given timeout expires). Once retrieved,
+ * the items are placed into the array specified by 'data'.
  */
 static apr_status_t queue_pop(apr_queue_t *queue, void **data,
+                              unsigned int n, unsigned int *count,
                               apr_interval_time_t timeout)
 {
     apr_status_t rv;
+    unsigned int i;
+
+    if (count) {
+        *count = 0;
+    }
+    if (!n) {
+        return APR_SUCCESS;
+    }
+
+#if LF_SUPPORTED
+    if (queue->lf) {
+        return lf_push_pop(queue, 0, data, n, count, timeout);
+    }
+#endif
 
     if (queue->terminated) {
         return APR_EOF; /* no more elements ever again */
@@ -304,15 +630,25 @@ static apr_status_t queue_pop(apr_queue_t *queue, void **data,
         }
     } 
 
-    *data = queue->data[queue->out];
-    queue->nelts--;
+    for (i = 0; i < n && !apr_queue_empty(queue); i++) {
+        data[i] = queue->data[queue->out];
+        queue->nelts--;
 
-    queue->out++;
-    if (queue->out >= queue->bounds)
-        queue->out -= queue->bounds;
+        queue->out++;
+        if (queue->out >= queue->bounds)
+            queue->out -= queue->bounds;
+    }
+    if (count) {
+        *count = i;
+    }
     if (queue->full_waiters) {
         Q_DBG("signal !full", queue);
-        rv = apr_thread_cond_signal(queue->not_full);
+        if (i > 1) {
+            rv = apr_thread_cond_broadcast(queue->not_full);
+        }
+        else {
+            rv = apr_thread_cond_signal(queue->not_full);
+        }
         if (rv != APR_SUCCESS) {
             apr_thread_mutex_unlock(queue->one_big_mutex);
             return rv;
@@ -325,18 +661,77 @@ static apr_status_t queue_pop(apr_queue_t *queue, void **data,
 
 APR_DECLARE(apr_status_t) apr_queue_pop(apr_queue_t *queue, void **data)
 {
-    return queue_pop(queue, data, -1);
+    return queue_pop(queue, data, 1, NULL, -1);
 }
 
 APR_DECLARE(apr_status_t) apr_queue_trypop(apr_queue_t *queue, void **data)
 {
-    return queue_pop(queue, data, 0);
+    return queue_pop(queue, data, 1, NULL, 0);
 }
 
 APR_DECLARE(apr_status_t) apr_queue_timedpop(apr_queue_t *queue, void **data,
                                              apr_interval_time_t timeout)
 {
-    return queue_pop(queue, data, timeout);
+    return queue_pop(queue, data, 1, NULL, timeout);
+}
+
+APR_DECLARE(apr_status_t) apr_queue_pop_n(apr_queue_t *queue, void **data,
+                                          unsigned int n,
+                                          unsigned int *popped,
+                                          apr_interval_time_t timeout)
+{
+    return queue_pop(queue, data, n, popped, timeout);
+}
+
+/**
+ * Retrieves all the items from the queue, even once terminated, without
+ * blocking.
+ */
+APR_DECLARE(apr_status_t) apr_queue_drain(apr_queue_t *queue,
+                                          apr_array_header_t *items)
+{
+    apr_status_t rv;
+    unsigned int n = 0;
+
+#if LF_SUPPORTED
+    if (queue->lf) {
+        void *data;
+
+        while (lf_trypop(queue->lf, &data)) {
+            *(void **)apr_array_push(items) = data;
+            n++;
+        }
+        if (n) {
+            lf_notify(queue, &queue->lf->not_full, n > 1);
+        }
+        return APR_SUCCESS;
+    }
+#endif
+
+    rv = apr_thread_mutex_lock(queue->one_big_mutex);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    while (!apr_queue_empty(queue)) {
+        *(void **)apr_array_push(items) = queue->data[queue->out];
+        queue->nelts--;
+
+        queue->out++;
+        if (queue->out >= queue->bounds)
+            queue->out -= queue->bounds;
+        n++;
+    }
+    if (n && queue->full_waiters) {
+        Q_DBG("broadcast !full", queue);
+        rv = apr_thread_cond_broadcast(queue->not_full);
+        if (rv != APR_SUCCESS) {
+            apr_thread_mutex_unlock(queue->one_big_mutex);
+            return rv;
+        }
+    }
+
+    rv = apr_thread_mutex_unlock(queue->one_big_mutex);
+    return rv;
 }
 
 APR_DECLARE(apr_status_t) apr_queue_interrupt_all(apr_queue_t *queue)
@@ -346,6 +741,12 @@ APR_DECLARE(apr_status_t) apr_queue_interrupt_all(apr_queue_t *queue)
     if ((rv = apr_thread_mutex_lock(queue->one_big_mutex)) != APR_SUCCESS) {
         return rv;
     }
+#if LF_SUPPORTED
+    if (queue->lf) {
+        apr__atomic_store(&queue->lf->interrupts, queue->lf->interrupts + 1,
+                          RELEASE);
+    }
+#endif
     apr_thread_cond_broadcast(queue->not_empty);
     apr_thread_cond_broadcast(queue->not_full);
 
@@ -368,7 +769,11 @@ APR_DECLARE(apr_status_t) apr_queue_term(apr_queue_t *queue)
      * we could end up setting it and waking everybody up just after a 
      * would-be popper checks it but right before they block
      */
+#if LF_SUPPORTED
+    apr__atomic_store(&queue->terminated, 1, RELEASE);
+#else
     queue->terminated = 1;
+#endif
     if ((rv = apr_thread_mutex_unlock(queue->one_big_mutex)) != APR_SUCCESS) {
         return rv;
     }
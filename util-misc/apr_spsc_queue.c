@@ -0,0 +1,494 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_private.h"
+
+#include "apr_general.h"
+#include "apr_atomic.h"
+#include "apr_file_io.h"
+#include "apr_portable.h"
+#include "apr_spsc_queue.h"
+
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+#if defined(HAVE_SYS_EVENTFD_H) && defined(HAVE_EVENTFD)
+#include <sys/eventfd.h>
+#define SPSC_EVENTFD 1
+#endif
+
+/*
+ * The queue is a ring of elements with a producer cursor (tail) and a
+ * consumer cursor (head), each written by its side only and kept in its own
+ * cache line.  Each side also caches the other side's cursor in the process
+ * local handle, and reads the shared one again only when its copy says that
+ * the queue is full (or empty), so a push or pop usually touches no cache
+ * line written by the other side but the element itself.  The cursors are
+ * free running 32-bit counters, masked to index the ring.
+ *
+ * Notifications: a waiting side arms its flag (after consuming its file's
+ * previous notification) and checks the queue once more, while the other
+ * side, after publishing its cursor, signals the file if it finds the flag
+ * armed.  Both are sequentially consistent, so that either the waiter sees
+ * the new cursor or the publisher sees the flag.  The flag is cleared with
+ * an exchange, so a file is signaled at most once per arming.
+ *
+ * The shared part (spsc_ring_t followed by the elements) contains no
+ * pointer, so it can live in shared memory at different addresses.
+ */
+
+#define SPSC_CACHE_LINE     64
+#define SPSC_MAGIC          0x53505343 /* "SPSC" */
+#define SPSC_MAX_CAPACITY   0x80000000U
+
+/* The shared part of the queue, followed by the elements */
+typedef struct spsc_ring_t {
+    apr_uint32_t            magic;
+    apr_uint32_t            capacity;
+    apr_uint32_t            elt_size;
+    apr_uint32_t            flags;
+    char                    pad0[SPSC_CACHE_LINE - 4 * sizeof(apr_uint32_t)];
+    volatile apr_uint32_t   tail;
+    char                    pad1[SPSC_CACHE_LINE - sizeof(apr_uint32_t)];
+    volatile apr_uint32_t   head;
+    char                    pad2[SPSC_CACHE_LINE - sizeof(apr_uint32_t)];
+    volatile apr_uint32_t   armed[2]; /* consumer, producer */
+    char                    pad3[SPSC_CACHE_LINE - 2 * sizeof(apr_uint32_t)];
+} spsc_ring_t;
+
+#define SPSC_READABLE 0 /* waited for by the consumer */
+#define SPSC_WRITABLE 1 /* waited for by the producer */
+
+typedef struct spsc_event_t {
+    apr_file_t     *rd;
+    apr_file_t     *wr;
+} spsc_event_t;
+
+struct apr_spsc_queue_t {
+    /* read-only */
+    spsc_ring_t    *ring;
+    char           *elts;
+    apr_size_t      elt_size;
+    apr_uint32_t    mask;
+    int             notify;
+    spsc_event_t    events[2];
+    apr_pool_t     *pool;
+    char            pad0[SPSC_CACHE_LINE];
+
+    /* producer's */
+    apr_uint32_t    tail;
+    apr_uint32_t    head_cache;
+    char            pad1[SPSC_CACHE_LINE - 2 * sizeof(apr_uint32_t)];
+
+    /* consumer's */
+    apr_uint32_t    head;
+    apr_uint32_t    tail_cache;
+    char            pad2[SPSC_CACHE_LINE - 2 * sizeof(apr_uint32_t)];
+};
+
+static apr_uint32_t spsc_capacity(apr_uint32_t capacity)
+{
+    apr_uint32_t n = 2;
+
+    if (capacity > SPSC_MAX_CAPACITY) {
+        return 0;
+    }
+    while (n < capacity) {
+        n <<= 1;
+    }
+    return n;
+}
+
+APR_DECLARE(apr_size_t) apr_spsc_queue_memsize(apr_uint32_t capacity,
+                                               apr_size_t elt_size)
+{
+    capacity = spsc_capacity(capacity);
+    if (!capacity || !elt_size || elt_size > APR_UINT32_MAX
+            || elt_size > (APR_SIZE_MAX - sizeof(spsc_ring_t)) / capacity) {
+        return 0;
+    }
+    return sizeof(spsc_ring_t) + capacity * elt_size;
+}
+
+static apr_status_t spsc_event_create(spsc_event_t *ev, apr_pool_t *p)
+{
+#if !APR_FILES_AS_SOCKETS
+    return APR_ENOTIMPL;
+#else
+#ifdef SPSC_EVENTFD
+    apr_os_file_t fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    apr_status_t rv;
+
+    if (fd < 0) {
+        return errno;
+    }
+    rv = apr_os_pipe_put_ex(&ev->rd, &fd, 1, p);
+    if (rv == APR_SUCCESS) {
+        rv = apr_file_pipe_timeout_set(ev->rd, 0);
+    }
+    ev->wr = ev->rd;
+    return rv;
+#else
+    return apr_file_pipe_create_ex(&ev->rd, &ev->wr, APR_FULL_NONBLOCK, p);
+#endif
+#endif
+}
+
+static void spsc_event_signal(spsc_event_t *ev)
+{
+    /* eventfds take 8 bytes, pipes do not care */
+    apr_uint64_t one = 1;
+    apr_size_t len = sizeof(one);
+
+    apr_file_write(ev->wr, &one, &len);
+}
+
+static void spsc_event_drain(spsc_event_t *ev)
+{
+    char buf[64];
+    apr_size_t len = sizeof(buf);
+
+    while (apr_file_read(ev->rd, buf, &len) == APR_SUCCESS
+           && len == sizeof(buf)) {
+        len = sizeof(buf);
+    }
+}
+
+static apr_status_t spsc_handle_make(apr_spsc_queue_t **queue,
+                                     spsc_ring_t *ring, apr_pool_t *p)
+{
+    apr_spsc_queue_t *q;
+    apr_status_t rv;
+
+    q = apr_palloc_aligned(p, sizeof(*q), SPSC_CACHE_LINE);
+    memset(q, 0, sizeof(*q));
+    q->ring = ring;
+    q->elts = (char *)ring + sizeof(spsc_ring_t);
+    q->elt_size = ring->elt_size;
+    q->mask = ring->capacity - 1;
+    q->pool = p;
+    q->tail = q->tail_cache = apr_atomic_read32_ex(&ring->tail,
+                                                   APR_ATOMIC_ACQUIRE);
+    q->head = q->head_cache = apr_atomic_read32_ex(&ring->head,
+                                                   APR_ATOMIC_ACQUIRE);
+
+    if (ring->flags & APR_SPSC_QUEUE_NOTIFY) {
+        q->notify = 1;
+        if ((rv = spsc_event_create(&q->events[SPSC_READABLE],
+                                    p)) != APR_SUCCESS
+                || (rv = spsc_event_create(&q->events[SPSC_WRITABLE],
+                                           p)) != APR_SUCCESS) {
+            return rv;
+        }
+    }
+
+    *queue = q;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_spsc_queue_create_at(apr_spsc_queue_t **queue,
+                                                   void *mem,
+                                                   apr_size_t memsize,
+                                                   apr_uint32_t capacity,
+                                                   apr_size_t elt_size,
+                                                   apr_uint32_t flags,
+                                                   apr_pool_t *pool)
+{
+    apr_size_t size = apr_spsc_queue_memsize(capacity, elt_size);
+    spsc_ring_t *ring = mem;
+
+    if (!size || memsize < size
+            || ((apr_uintptr_t)mem & (APR_ALIGN_DEFAULT(1) - 1))) {
+        return APR_EINVAL;
+    }
+
+    memset(ring, 0, sizeof(*ring));
+    ring->capacity = spsc_capacity(capacity);
+    ring->elt_size = (apr_uint32_t)elt_size;
+    ring->flags = flags & APR_SPSC_QUEUE_NOTIFY;
+    apr_atomic_set32_ex(&ring->magic, SPSC_MAGIC, APR_ATOMIC_SEQ_CST);
+
+    return spsc_handle_make(queue, ring, pool);
+}
+
+APR_DECLARE(apr_status_t) apr_spsc_queue_create(apr_spsc_queue_t **queue,
+                                                apr_uint32_t capacity,
+                                                apr_size_t elt_size,
+                                                apr_uint32_t flags,
+                                                apr_pool_t *pool)
+{
+    apr_size_t size = apr_spsc_queue_memsize(capacity, elt_size);
+    void *mem;
+
+    if (!size) {
+        return APR_EINVAL;
+    }
+    mem = apr_palloc_aligned(pool, size, SPSC_CACHE_LINE);
+    return apr_spsc_queue_create_at(queue, mem, size, capacity, elt_size,
+                                    flags, pool);
+}
+
+APR_DECLARE(apr_status_t) apr_spsc_queue_attach(apr_spsc_queue_t **queue,
+                                                void *mem,
+                                                apr_size_t memsize,
+                                                apr_pool_t *pool)
+{
+    spsc_ring_t *ring = mem;
+    apr_size_t size;
+
+    if (memsize < sizeof(spsc_ring_t)
+            || ((apr_uintptr_t)mem & (APR_ALIGN_DEFAULT(1) - 1))
+            || apr_atomic_read32_ex(&ring->magic,
+                                    APR_ATOMIC_ACQUIRE) != SPSC_MAGIC) {
+        return APR_EINVAL;
+    }
+    size = apr_spsc_queue_memsize(ring->capacity, ring->elt_size);
+    if (!size || memsize < size) {
+        return APR_EINVAL;
+    }
+    if (ring->flags & APR_SPSC_QUEUE_NOTIFY) {
+        return APR_ENOTIMPL;
+    }
+
+    return spsc_handle_make(queue, ring, pool);
+}
+
+/* Wake up the other side if it's waiting for what we just published */
+static APR_INLINE void spsc_publish(apr_spsc_queue_t *q,
+                                    volatile apr_uint32_t *cursor,
+                                    apr_uint32_t value, int which)
+{
+    if (!q->notify) {
+        apr_atomic_set32_ex(cursor, value, APR_ATOMIC_RELEASE);
+        return;
+    }
+    apr_atomic_set32_ex(cursor, value, APR_ATOMIC_SEQ_CST);
+    if (apr_atomic_read32_ex(&q->ring->armed[which], APR_ATOMIC_SEQ_CST)
+            && apr_atomic_xchg32(&q->ring->armed[which], 0)) {
+        spsc_event_signal(&q->events[which]);
+    }
+}
+
+APR_DECLARE(apr_status_t) apr_spsc_queue_push_n(apr_spsc_queue_t *q,
+                                                const void *elts,
+                                                apr_uint32_t n,
+                                                apr_uint32_t *pushed)
+{
+    const char *src = elts;
+    apr_uint32_t tail = q->tail, room, i;
+
+    if (!n) {
+        if (pushed) {
+            *pushed = 0;
+        }
+        return APR_SUCCESS;
+    }
+    room = q->mask + 1 - (tail - q->head_cache);
+    if (room < n) {
+        q->head_cache = apr_atomic_read32_ex(&q->ring->head,
+                                             APR_ATOMIC_ACQUIRE);
+        room = q->mask + 1 - (tail - q->head_cache);
+        if (n > room) {
+            n = room;
+        }
+    }
+    if (pushed) {
+        *pushed = n;
+    }
+    if (!n) {
+        return APR_EAGAIN;
+    }
+
+    for (i = 0; i < n; ++i, ++tail, src += q->elt_size) {
+        memcpy(q->elts + (tail & q->mask) * q->elt_size, src, q->elt_size);
+    }
+    q->tail = tail;
+    spsc_publish(q, &q->ring->tail, tail, SPSC_READABLE);
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_spsc_queue_push(apr_spsc_queue_t *q,
+                                              const void *elt)
+{
+    return apr_spsc_queue_push_n(q, elt, 1, NULL);
+}
+
+APR_DECLARE(apr_status_t) apr_spsc_queue_pop_n(apr_spsc_queue_t *q,
+                                               void *elts,
+                                               apr_uint32_t n,
+                                               apr_uint32_t *popped)
+{
+    char *dst = elts;
+    apr_uint32_t head = q->head, avail, i;
+
+    if (!n) {
+        if (popped) {
+            *popped = 0;
+        }
+        return APR_SUCCESS;
+    }
+    avail = q->tail_cache - head;
+    if (avail < n) {
+        q->tail_cache = apr_atomic_read32_ex(&q->ring->tail,
+                                             APR_ATOMIC_ACQUIRE);
+        avail = q->tail_cache - head;
+        if (n > avail) {
+            n = avail;
+        }
+    }
+    if (popped) {
+        *popped = n;
+    }
+    if (!n) {
+        return APR_EAGAIN;
+    }
+
+    for (i = 0; i < n; ++i, ++head, dst += q->elt_size) {
+        memcpy(dst, q->elts + (head & q->mask) * q->elt_size, q->elt_size);
+    }
+    q->head = head;
+    spsc_publish(q, &q->ring->head, head, SPSC_WRITABLE);
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_spsc_queue_pop(apr_spsc_queue_t *q, void *elt)
+{
+    return apr_spsc_queue_pop_n(q, elt, 1, NULL);
+}
+
+APR_DECLARE(apr_uint32_t) apr_spsc_queue_size(apr_spsc_queue_t *q)
+{
+    apr_uint32_t head = apr_atomic_read32_ex(&q->ring->head,
+                                             APR_ATOMIC_ACQUIRE);
+
+    return apr_atomic_read32_ex(&q->ring->tail, APR_ATOMIC_ACQUIRE) - head;
+}
+
+APR_DECLARE(apr_uint32_t) apr_spsc_queue_capacity(apr_spsc_queue_t *q)
+{
+    return q->mask + 1;
+}
+
+static apr_status_t spsc_which(apr_spsc_queue_t *q, apr_int16_t event,
+                               int *which)
+{
+    if (event == APR_POLLIN) {
+        *which = SPSC_READABLE;
+    }
+    else if (event == APR_POLLOUT) {
+        *which = SPSC_WRITABLE;
+    }
+    else {
+        return APR_EINVAL;
+    }
+    return q->notify ? APR_SUCCESS : APR_ENOTIMPL;
+}
+
+/*
+ * Arm the notification, returning non-zero if the queue is ready already
+ * (the flag being disarmed then).
+ */
+static int spsc_arm(apr_spsc_queue_t *q, int which)
+{
+    spsc_ring_t *ring = q->ring;
+    int ready;
+
+    spsc_event_drain(&q->events[which]);
+    apr_atomic_set32_ex(&ring->armed[which], 1, APR_ATOMIC_SEQ_CST);
+    if (which == SPSC_READABLE) {
+        q->tail_cache = apr_atomic_read32_ex(&ring->tail, APR_ATOMIC_SEQ_CST);
+        ready = (q->tail_cache != q->head);
+    }
+    else {
+        q->head_cache = apr_atomic_read32_ex(&ring->head, APR_ATOMIC_SEQ_CST);
+        ready = (q->tail - q->head_cache <= q->mask);
+    }
+    if (ready && !apr_atomic_xchg32(&ring->armed[which], 0)) {
+        /* signaled by the other side already, don't leave it pending */
+        spsc_event_drain(&q->events[which]);
+    }
+    return ready;
+}
+
+APR_DECLARE(apr_status_t) apr_spsc_queue_arm(apr_spsc_queue_t *q,
+                                             apr_int16_t event)
+{
+    apr_status_t rv;
+    int which;
+
+    if ((rv = spsc_which(q, event, &which)) != APR_SUCCESS) {
+        return rv;
+    }
+    if (spsc_arm(q, which)) {
+        spsc_event_signal(&q->events[which]);
+    }
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_spsc_queue_pollfd_get(apr_spsc_queue_t *q,
+                                                    apr_int16_t event,
+                                                    apr_pollfd_t *pfd)
+{
+    apr_status_t rv;
+    int which;
+
+    if ((rv = spsc_which(q, event, &which)) != APR_SUCCESS) {
+        return rv;
+    }
+    pfd->p = q->pool;
+    pfd->desc_type = APR_POLL_FILE;
+    pfd->reqevents = APR_POLLIN;
+    pfd->rtnevents = 0;
+    pfd->desc.f = q->events[which].rd;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_spsc_queue_wait(apr_spsc_queue_t *q,
+                                              apr_int16_t event,
+                                              apr_interval_time_t timeout)
+{
+    apr_time_t deadline = 0;
+    apr_pollfd_t pfd;
+    apr_int32_t nfds;
+    apr_status_t rv;
+    int which;
+
+    if ((rv = spsc_which(q, event, &which)) != APR_SUCCESS) {
+        return rv;
+    }
+    if (timeout > 0) {
+        deadline = apr_time_now() + timeout;
+    }
+    memset(&pfd, 0, sizeof(pfd));
+    apr_spsc_queue_pollfd_get(q, event, &pfd);
+
+    /* Notifications may be stale, so loop until the queue is ready */
+    while (!spsc_arm(q, which)) {
+        if (deadline) {
+            timeout = deadline - apr_time_now();
+            if (timeout <= 0) {
+                return APR_TIMEUP;
+            }
+        }
+        rv = apr_poll(&pfd, 1, &nfds, timeout);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+    return APR_SUCCESS;
+}
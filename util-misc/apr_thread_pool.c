@@ -17,16 +17,69 @@
  */
 
 #include <assert.h>
+#include <string.h>
 #include "apr_thread_pool.h"
 #include "apr_ring.h"
 #include "apr_thread_cond.h"
 #include "apr_portable.h"
+#include "apr_timer_wheel.h"
+#include "apr_counter.h"
+#include "apr_atomic_inline.h"
 
 #if APR_HAS_THREADS
 
+/* The granularity of the scheduled tasks' times */
+#define SCHEDULE_RESOLUTION 1000
+
 #define TASK_PRIORITY_SEGS 4
 #define TASK_PRIORITY_SEG(x) (((x)->dispatch.priority & 0xFF) / 64)
 
+/*
+ * In work stealing mode, each worker has a deque of tasks per priority
+ * segment, where it pushes the tasks it submits and pops them (LIFO)
+ * without locking, while the idle workers steal the oldest ones (FIFO)
+ * from random victims with compare and swap (Chase and Lev's deque).  The
+ * tasks submitted by other threads go to the inboxes of the workers, in
+ * turn, each protected by its own mutex.  The workers sleep on the pool's
+ * condition when there is nothing to run or steal, and are signaled only
+ * if some are sleeping.
+ *
+ * A queued task is cancelled by marking it taken (the generation of the
+ * task, bumped each time it's reused, makes sure that a stale pointer
+ * does not mark another task), and skipped by whoever pops it.
+ *
+ * Work stealing needs the inline atomics, otherwise the thread pool is
+ * created in the normal mode.
+ */
+#define WS_SUPPORTED APR_ATOMIC_INLINE
+
+#define WS_DEQUE_SIZE   256
+#define WS_CACHE_LINE   64
+#define WS_SPARE_BATCH  64
+#define WS_SPINS        2
+#define WS_IDLE_WAIT    apr_time_from_msec(100)
+
+/*
+ * The histograms count the times in buckets of a 12.5% precision: the
+ * times below 8 microseconds have their own bucket, the others are split
+ * by their highest bit set and the next 3 bits.  Each thread counts in its
+ * own histograms (under the pool's lock in the normal mode, alone in the
+ * work stealing mode), all are merged when read.
+ */
+#define HIST_SUB_BITS   3
+#define HIST_SUBS       (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS   40      /* some 12 days in microseconds */
+#define HIST_BUCKETS    ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUBS)
+
+typedef struct hist hist_t;
+
+struct hist
+{
+    hist_t *next;
+    /* by APR_THREAD_POOL_WAIT_TIME/RUN_TIME, priority segment and bucket */
+    apr_size_t counts[2][TASK_PRIORITY_SEGS][HIST_BUCKETS];
+};
+
 typedef struct apr_thread_pool_task
 {
     APR_RING_ENTRY(apr_thread_pool_task) link;
@@ -38,6 +91,9 @@ typedef struct apr_thread_pool_task
         apr_byte_t priority;
         apr_time_t time;
     } dispatch;
+    apr_thread_pool_group_t *group;
+    apr_uint32_t ws_state;      /* work stealing: generation << 1 | taken */
+    apr_time_t queued;          /* or scheduled to run */
 } apr_thread_pool_task_t;
 
 APR_RING_HEAD(apr_thread_pool_tasks, apr_thread_pool_task);
@@ -48,10 +104,51 @@ struct apr_thread_list_elt
     apr_thread_t *thd;
     volatile void *current_owner;
     volatile enum { TH_RUN, TH_STOP, TH_PROBATION } state;
+    apr_uint32_t cpus_gen;
+    hist_t *hist;
 };
 
 APR_RING_HEAD(apr_thread_list, apr_thread_list_elt);
 
+typedef struct ws_array
+{
+    apr_ssize_t mask;
+    apr_thread_pool_task_t *tasks[1];
+} ws_array_t;
+
+typedef struct ws_deque
+{
+    apr_ssize_t top;            /* stolen from */
+    apr_ssize_t bottom;         /* pushed to and popped from by the owner */
+    ws_array_t *array;
+} ws_deque_t;
+
+typedef struct ws_worker
+{
+    apr_thread_pool_t *me;
+    apr_thread_t *thd;
+    ws_deque_t deques[TASK_PRIORITY_SEGS];
+    void *current_owner;
+    apr_uint32_t takes;
+    /* owner only (read by the stats) */
+    struct apr_thread_pool_tasks free;
+    apr_size_t free_cnt;
+    apr_size_t pushed;
+    apr_size_t taken;
+    apr_size_t run;
+    apr_uint32_t seed;
+    apr_uint32_t polls;
+    apr_uint32_t cpus_gen;
+    hist_t *hist;
+    /* protected by the mutex */
+    apr_thread_mutex_t *mutex;
+    apr_pool_t *pool;
+    struct apr_thread_pool_tasks inbox[TASK_PRIORITY_SEGS];
+    struct apr_thread_pool_tasks spare;
+    apr_size_t inbox_cnt;
+    apr_size_t inbox_pushed;
+} ws_worker_t;
+
 struct apr_thread_pool
 {
     apr_pool_t *pool;
@@ -63,12 +160,12 @@ struct apr_thread_pool
     volatile apr_size_t task_cnt;
     volatile apr_size_t scheduled_task_cnt;
     volatile apr_size_t threshold;
-    volatile apr_size_t tasks_run;
+    apr_counter_t *tasks_run;   /* updated outside of the lock */
     volatile apr_size_t tasks_high;
     volatile apr_size_t thd_high;
     volatile apr_size_t thd_timed_out;
     struct apr_thread_pool_tasks *tasks;
-    struct apr_thread_pool_tasks *scheduled_tasks;
+    apr_timer_wheel_t *scheduled_tasks;
     struct apr_thread_list *busy_thds;
     struct apr_thread_list *idle_thds;
     apr_thread_mutex_t *lock;
@@ -77,8 +174,110 @@ struct apr_thread_pool
     struct apr_thread_pool_tasks *recycled_tasks;
     struct apr_thread_list *recycled_thds;
     apr_thread_pool_task_t *task_idx[TASK_PRIORITY_SEGS];
+    /* work stealing mode */
+    ws_worker_t *workers;
+    apr_size_t ws_cnt;
+    apr_size_t ws_stride;
+    apr_threadkey_t *ws_key;
+    apr_uint32_t ws_next;
+    apr_size_t ws_cancelled;
+    /* the CPUs the threads are pinned to, in turn */
+    apr_uint32_t *cpus;
+    apr_size_t cpus_cnt;
+    apr_size_t cpus_max;
+    apr_size_t cpus_next;
+    apr_uint32_t cpus_gen;
+    /* the histograms of all the threads, if kept */
+    int histograms;
+    hist_t *hists;
+};
+
+#define WS_WORKER(me, i) \
+    ((ws_worker_t *)((char *)(me)->workers + (i) * (me)->ws_stride))
+
+struct apr_thread_pool_group
+{
+    apr_size_t count;
+    apr_thread_mutex_t *lock;
+    apr_thread_cond_t *cond;
 };
 
+static void group_add(apr_thread_pool_group_t *group, apr_size_t n)
+{
+    apr_thread_mutex_lock(group->lock);
+    group->count += n;
+    apr_thread_mutex_unlock(group->lock);
+}
+
+/* The count is updated under the lock so that the waiter can't destroy
+ * the group before the last task is done with it.
+ */
+static void group_done(apr_thread_pool_group_t *group, apr_size_t n)
+{
+    apr_thread_mutex_lock(group->lock);
+    group->count -= n;
+    if (!group->count) {
+        apr_thread_cond_broadcast(group->cond);
+    }
+    apr_thread_mutex_unlock(group->lock);
+}
+
+static APR_INLINE int hist_bucket(apr_interval_time_t t)
+{
+    apr_uint64_t v = (t > 0) ? (apr_uint64_t)t : 0;
+    int msb;
+
+    if (v < HIST_SUBS) {
+        return (int)v;
+    }
+    if (v >> HIST_MAX_BITS) {
+        v = ((apr_uint64_t)1 << HIST_MAX_BITS) - 1;
+    }
+#if defined(__GNUC__)
+    msb = 63 - __builtin_clzll(v);
+#else
+    for (msb = HIST_SUB_BITS; v >> (msb + 1); msb++)
+        ;
+#endif
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUBS
+           + (int)((v >> (msb - HIST_SUB_BITS)) & (HIST_SUBS - 1));
+}
+
+/* The highest time of a bucket */
+static apr_interval_time_t hist_value(int b)
+{
+    int shift;
+
+    if (b < HIST_SUBS) {
+        return b;
+    }
+    shift = b / HIST_SUBS - 1;
+    return (((apr_interval_time_t)(HIST_SUBS + b % HIST_SUBS) + 1) << shift)
+           - 1;
+}
+
+static APR_INLINE void hist_add(hist_t *h, int which, int seg,
+                                apr_interval_time_t t)
+{
+    apr_size_t *count = &h->counts[which][seg][hist_bucket(t)];
+
+    apr__atomic_store(count, apr__atomic_load(count, RELAXED) + 1, RELAXED);
+}
+
+/*
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static hist_t *hist_new(apr_thread_pool_t *me)
+{
+    hist_t *h = apr_pcalloc(me->pool, sizeof(*h));
+
+    if (h) {
+        h->next = me->hists;
+        me->hists = h;
+    }
+    return h;
+}
+
 static apr_status_t thread_pool_construct(apr_thread_pool_t * me,
                                           apr_size_t init_threads,
                                           apr_size_t max_threads)
@@ -104,11 +303,13 @@ static apr_status_t thread_pool_construct(apr_thread_pool_t * me,
         goto CATCH_ENOMEM;
     }
     APR_RING_INIT(me->tasks, apr_thread_pool_task, link);
-    me->scheduled_tasks = apr_palloc(me->pool, sizeof(*me->scheduled_tasks));
-    if (!me->scheduled_tasks) {
+    if (apr_counter_create(&me->tasks_run, 0, 0, me->pool)) {
+        goto CATCH_ENOMEM;
+    }
+    if (apr_timer_wheel_create(&me->scheduled_tasks, SCHEDULE_RESOLUTION,
+                               apr_time_now(), me->pool)) {
         goto CATCH_ENOMEM;
     }
-    APR_RING_INIT(me->scheduled_tasks, apr_thread_pool_task, link);
     me->recycled_tasks = apr_palloc(me->pool, sizeof(*me->recycled_tasks));
     if (!me->recycled_tasks) {
         goto CATCH_ENOMEM;
@@ -130,7 +331,7 @@ static apr_status_t thread_pool_construct(apr_thread_pool_t * me,
     }
     APR_RING_INIT(me->recycled_thds, apr_thread_list_elt, link);
     me->thd_cnt = me->idle_cnt = me->task_cnt = me->scheduled_task_cnt = 0;
-    me->tasks_run = me->tasks_high = me->thd_high = me->thd_timed_out = 0;
+    me->tasks_high = me->thd_high = me->thd_timed_out = 0;
     me->idle_wait = 0;
     me->terminated = 0;
     for (i = 0; i < TASK_PRIORITY_SEGS; i++) {
@@ -153,17 +354,15 @@ static apr_thread_pool_task_t *pop_task(apr_thread_pool_t * me)
     apr_thread_pool_task_t *task = NULL;
     int seg;
 
-    /* check for scheduled tasks */
+    /* check for scheduled tasks, if it's time */
     if (me->scheduled_task_cnt > 0) {
-        task = APR_RING_FIRST(me->scheduled_tasks);
-        assert(task != NULL);
-        assert(task !=
-               APR_RING_SENTINEL(me->scheduled_tasks, apr_thread_pool_task,
-                                 link));
-        /* if it's time */
-        if (task->dispatch.time <= apr_time_now()) {
+        void *data;
+        if (apr_timer_wheel_pop(me->scheduled_tasks, apr_time_now(),
+                                &data) == APR_SUCCESS) {
             --me->scheduled_task_cnt;
-            APR_RING_REMOVE(task, link);
+            /* accounted with the lowest priorities, its time is done */
+            task = data;
+            task->dispatch.priority = 0;
             return task;
         }
     }
@@ -191,14 +390,13 @@ static apr_thread_pool_task_t *pop_task(apr_thread_pool_t * me)
 
 static apr_interval_time_t waiting_time(apr_thread_pool_t * me)
 {
-    apr_thread_pool_task_t *task = NULL;
+    apr_time_t when;
+    apr_status_t rv;
 
-    task = APR_RING_FIRST(me->scheduled_tasks);
-    assert(task != NULL);
-    assert(task !=
-           APR_RING_SENTINEL(me->scheduled_tasks, apr_thread_pool_task,
-                             link));
-    return task->dispatch.time - apr_time_now();
+    rv = apr_timer_wheel_next(me->scheduled_tasks, &when);
+    assert(rv == APR_SUCCESS);
+    when -= apr_time_now();
+    return (when > 0) ? when : 0;
 }
 
 /*
@@ -224,9 +422,27 @@ static struct apr_thread_list_elt *elt_new(apr_thread_pool_t * me,
     elt->thd = t;
     elt->current_owner = NULL;
     elt->state = TH_RUN;
+    elt->cpus_gen = 0;
+    if (me->histograms && !elt->hist) {
+        elt->hist = hist_new(me);
+    }
     return elt;
 }
 
+/*
+ * Pin the current thread to the CPU of the given turn, for the current
+ * generation of CPUs.
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static void place_thread(apr_thread_pool_t *me, apr_thread_t *t,
+                         apr_uint32_t *gen, apr_size_t turn)
+{
+    *gen = me->cpus_gen;
+    if (me->cpus_cnt) {
+        apr_thread_affinity_set(t, &me->cpus[turn % me->cpus_cnt], 1);
+    }
+}
+
 /*
  * The worker thread function. Take a task from the queue and perform it if
  * there is any. Otherwise, put itself into the idle thread list and waiting
@@ -241,6 +457,8 @@ static void *APR_THREAD_FUNC thread_pool_func(apr_thread_t * t, void *param)
     apr_thread_pool_task_t *task = NULL;
     apr_interval_time_t wait;
     struct apr_thread_list_elt *elt;
+    apr_time_t start = 0;
+    int seg = 0;
 
     apr_thread_mutex_lock(me->lock);
     apr_pool_owner_set(me->pool, 0);
@@ -251,6 +469,10 @@ static void *APR_THREAD_FUNC thread_pool_func(apr_thread_t * t, void *param)
     }
 
     while (!me->terminated && elt->state != TH_STOP) {
+        if (elt->cpus_gen != me->cpus_gen) {
+            place_thread(me, t, &elt->cpus_gen, me->cpus_next++);
+        }
+
         /* Test if not new element, it is awakened from idle */
         if (APR_RING_NEXT(elt, link) != elt) {
             --me->idle_cnt;
@@ -260,19 +482,35 @@ static void *APR_THREAD_FUNC thread_pool_func(apr_thread_t * t, void *param)
         APR_RING_INSERT_TAIL(me->busy_thds, elt, apr_thread_list_elt, link);
         task = pop_task(me);
         while (NULL != task && !me->terminated) {
-            ++me->tasks_run;
             elt->current_owner = task->owner;
+            if (elt->hist) {
+                start = apr_time_now();
+                seg = TASK_PRIORITY_SEG(task);
+                hist_add(elt->hist, APR_THREAD_POOL_WAIT_TIME, seg,
+                         start - task->queued);
+            }
             apr_thread_mutex_unlock(me->lock);
+            apr_counter_inc(me->tasks_run);
             apr_thread_data_set(task, "apr_thread_pool_task", NULL, t);
             task->func(t, task->param);
+            if (task->group) {
+                group_done(task->group, 1);
+            }
             apr_thread_mutex_lock(me->lock);
             apr_pool_owner_set(me->pool, 0);
+            if (elt->hist) {
+                hist_add(elt->hist, APR_THREAD_POOL_RUN_TIME, seg,
+                         apr_time_now() - start);
+            }
             APR_RING_INSERT_TAIL(me->recycled_tasks, task,
                                  apr_thread_pool_task, link);
             elt->current_owner = NULL;
             if (TH_STOP == elt->state) {
                 break;
             }
+            if (elt->cpus_gen != me->cpus_gen) {
+                place_thread(me, t, &elt->cpus_gen, me->cpus_next++);
+            }
             task = pop_task(me);
         }
         assert(NULL == elt->current_owner);
@@ -295,47 +533,697 @@ static void *APR_THREAD_FUNC thread_pool_func(apr_thread_t * t, void *param)
             return NULL;        /* should not be here, safe net */
         }
 
-        /* busy thread become idle */
-        ++me->idle_cnt;
-        APR_RING_INSERT_TAIL(me->idle_thds, elt, apr_thread_list_elt, link);
+        /* busy thread become idle */
+        ++me->idle_cnt;
+        APR_RING_INSERT_TAIL(me->idle_thds, elt, apr_thread_list_elt, link);
+
+        /* 
+         * If there is a scheduled task, always scheduled to perform that task.
+         * Since there is no guarantee that current idle threads are scheduled
+         * for next scheduled task.
+         */
+        if (me->scheduled_task_cnt)
+            wait = waiting_time(me);
+        else if (me->idle_cnt > me->idle_max) {
+            wait = me->idle_wait;
+            elt->state = TH_PROBATION;
+        }
+        else
+            wait = -1;
+
+        if (wait >= 0) {
+            apr_thread_cond_timedwait(me->cond, me->lock, wait);
+        }
+        else {
+            apr_thread_cond_wait(me->cond, me->lock);
+        }
+    }
+
+    /* idle thread been asked to stop, will be joined */
+    --me->thd_cnt;
+    apr_thread_mutex_unlock(me->lock);
+    apr_thread_exit(t, APR_SUCCESS);
+    return NULL;                /* should not be here, safe net */
+}
+
+#if WS_SUPPORTED
+
+/* The current_owner of the workers not running a task, and of those
+ * looking for one (which cancelling waits for).
+ */
+static char ws_idle, ws_taking;
+
+static APR_INLINE apr_uint32_t ws_random(ws_worker_t *w)
+{
+    apr_uint32_t x = w->seed;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return w->seed = x;
+}
+
+/* Mark a queued task taken, or fail if it's been cancelled. */
+static APR_INLINE int ws_claim(apr_thread_pool_task_t *t)
+{
+    apr_uint32_t state = apr__atomic_load(&t->ws_state, ACQUIRE);
+
+    return !(state & 1) && apr__atomic_cas(&t->ws_state, &state, state | 1,
+                                           SEQ_CST, RELAXED);
+}
+
+/* Initialize a task not queued, marking it queued for its new generation
+ * (the task's fields are written before, see ws_claim()).
+ */
+static void ws_task_init(apr_thread_pool_task_t *t, apr_thread_start_t func,
+                         void *param, apr_byte_t priority, void *owner,
+                         apr_thread_pool_group_t *group)
+{
+    apr_uint32_t state = apr__atomic_load(&t->ws_state, RELAXED);
+
+    APR_RING_ELEM_INIT(t, link);
+    t->func = func;
+    t->param = param;
+    apr__atomic_store(&t->owner, owner, RELAXED);
+    apr__atomic_store(&t->group, group, RELAXED);
+    t->dispatch.priority = priority;
+    apr__atomic_store(&t->ws_state, (state | 1) + 1, RELEASE);
+}
+
+/*
+ * NOTE: This function is not thread safe by itself. Caller should hold the
+ * worker's mutex
+ */
+static apr_thread_pool_task_t *ws_task_alloc(ws_worker_t *w)
+{
+    apr_thread_pool_task_t *t;
+
+    if (APR_RING_EMPTY(&w->spare, apr_thread_pool_task, link)) {
+        apr_pool_owner_set(w->pool, 0);
+        return apr_pcalloc(w->pool, sizeof(*t));
+    }
+    t = APR_RING_FIRST(&w->spare);
+    APR_RING_REMOVE(t, link);
+    return t;
+}
+
+/* Recycle a task taken by the worker, giving a batch of its free tasks
+ * back to the pushers from other threads when it has too many.
+ */
+static void ws_recycle(ws_worker_t *w, apr_thread_pool_task_t *t)
+{
+    APR_RING_INSERT_HEAD(&w->free, t, apr_thread_pool_task, link);
+    if (++w->free_cnt > 2 * WS_SPARE_BATCH) {
+        apr_thread_mutex_lock(w->mutex);
+        while (w->free_cnt > WS_SPARE_BATCH) {
+            t = APR_RING_LAST(&w->free);
+            APR_RING_REMOVE(t, link);
+            APR_RING_INSERT_HEAD(&w->spare, t, apr_thread_pool_task, link);
+            --w->free_cnt;
+        }
+        apr_thread_mutex_unlock(w->mutex);
+    }
+}
+
+/* Push to the bottom of a deque, by its owner only */
+static apr_status_t ws_push(ws_worker_t *w, ws_deque_t *d,
+                            apr_thread_pool_task_t *t)
+{
+    apr_ssize_t b = apr__atomic_load(&d->bottom, RELAXED);
+    apr_ssize_t top = apr__atomic_load(&d->top, ACQUIRE);
+    ws_array_t *a = apr__atomic_load(&d->array, RELAXED);
+
+    if (b - top > a->mask) {
+        ws_array_t *grown;
+        apr_ssize_t i;
+
+        apr_thread_mutex_lock(w->mutex);
+        apr_pool_owner_set(w->pool, 0);
+        grown = apr_palloc(w->pool, APR_OFFSETOF(ws_array_t, tasks)
+                                    + (a->mask + 1) * 2 * sizeof(t));
+        apr_thread_mutex_unlock(w->mutex);
+        if (!grown) {
+            return APR_ENOMEM;
+        }
+        grown->mask = (a->mask + 1) * 2 - 1;
+        for (i = top; i < b; i++) {
+            grown->tasks[i & grown->mask] =
+                apr__atomic_load(&a->tasks[i & a->mask], RELAXED);
+        }
+        /* the old array is left to the stealers still reading it */
+        apr__atomic_store(&d->array, grown, RELEASE);
+        a = grown;
+    }
+    apr__atomic_store(&a->tasks[b & a->mask], t, RELAXED);
+    apr__atomic_fence(RELEASE);
+    apr__atomic_store(&d->bottom, b + 1, RELAXED);
+    return APR_SUCCESS;
+}
+
+/* Pop from the bottom of a deque, by its owner only */
+static apr_thread_pool_task_t *ws_take(ws_deque_t *d)
+{
+    apr_thread_pool_task_t *t = NULL;
+    apr_ssize_t b = apr__atomic_load(&d->bottom, RELAXED) - 1;
+    ws_array_t *a = apr__atomic_load(&d->array, RELAXED);
+    apr_ssize_t top;
+
+    apr__atomic_store(&d->bottom, b, RELAXED);
+    apr__atomic_fence(SEQ_CST);
+    top = apr__atomic_load(&d->top, RELAXED);
+    if (top <= b) {
+        t = apr__atomic_load(&a->tasks[b & a->mask], RELAXED);
+        if (top == b) {
+            /* the last one, race with the stealers */
+            if (!apr__atomic_cas(&d->top, &top, top + 1, SEQ_CST, RELAXED)) {
+                t = NULL;
+            }
+            apr__atomic_store(&d->bottom, b + 1, RELAXED);
+        }
+    }
+    else {
+        apr__atomic_store(&d->bottom, b + 1, RELAXED);
+    }
+    return t;
+}
+
+/* Pop from the top of a deque, by any thread */
+static apr_thread_pool_task_t *ws_steal(ws_deque_t *d)
+{
+    apr_ssize_t top = apr__atomic_load(&d->top, ACQUIRE);
+    apr_ssize_t b;
+
+    apr__atomic_fence(SEQ_CST);
+    b = apr__atomic_load(&d->bottom, ACQUIRE);
+    if (top < b) {
+        ws_array_t *a = apr__atomic_load(&d->array, ACQUIRE);
+        apr_thread_pool_task_t *t = apr__atomic_load(&a->tasks[top & a->mask],
+                                                     RELAXED);
+        if (apr__atomic_cas(&d->top, &top, top + 1, SEQ_CST, RELAXED)) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+/* Pop the first task of the highest priority inbox of a worker */
+static apr_thread_pool_task_t *ws_inbox_pop(ws_worker_t *w, int wait)
+{
+    apr_thread_pool_task_t *t = NULL;
+    int seg;
+
+    if (!apr__atomic_load(&w->inbox_cnt, RELAXED)) {
+        return NULL;
+    }
+    if (wait) {
+        apr_thread_mutex_lock(w->mutex);
+    }
+    else if (apr_thread_mutex_trylock(w->mutex) != APR_SUCCESS) {
+        return NULL;
+    }
+    for (seg = TASK_PRIORITY_SEGS - 1; seg >= 0; seg--) {
+        if (!APR_RING_EMPTY(&w->inbox[seg], apr_thread_pool_task, link)) {
+            t = APR_RING_FIRST(&w->inbox[seg]);
+            APR_RING_REMOVE(t, link);
+            apr__atomic_store(&w->inbox_cnt, w->inbox_cnt - 1, RELAXED);
+            break;
+        }
+    }
+    apr_thread_mutex_unlock(w->mutex);
+    return t;
+}
+
+/* Claim a task popped by the worker, or recycle it if cancelled */
+static apr_thread_pool_task_t *ws_claim_popped(ws_worker_t *w,
+                                               apr_thread_pool_task_t *t)
+{
+    if (ws_claim(t)) {
+        apr__atomic_store(&w->taken, w->taken + 1, RELAXED);
+        return t;
+    }
+    ws_recycle(w, t);
+    return NULL;
+}
+
+static apr_thread_pool_task_t *ws_scheduled_pop(apr_thread_pool_t *me)
+{
+    apr_thread_pool_task_t *t = NULL;
+
+    if (apr__atomic_load(&me->scheduled_task_cnt, RELAXED)) {
+        apr_thread_mutex_lock(me->lock);
+        apr_pool_owner_set(me->pool, 0);
+        t = pop_task(me);
+        apr_thread_mutex_unlock(me->lock);
+    }
+    return t;
+}
+
+/*
+ * Find the next task to run: from the worker's own deques then inbox, the
+ * scheduled tasks, and finally the deques or inboxes of random victims.
+ * The inbox and scheduled tasks are looked at first from time to time, so
+ * that the tasks spawning others do not starve them.
+ */
+static apr_thread_pool_task_t *ws_next_task(ws_worker_t *w, int *scheduled)
+{
+    apr_thread_pool_t *me = w->me;
+    apr_thread_pool_task_t *t;
+    apr_size_t i;
+    int seg;
+
+    if (!(++w->polls % 64)) {
+        if ((t = ws_scheduled_pop(me))) {
+            *scheduled = 1;
+            return t;
+        }
+        while ((t = ws_inbox_pop(w, 1))) {
+            if (ws_claim_popped(w, t)) {
+                return t;
+            }
+        }
+    }
+    for (seg = TASK_PRIORITY_SEGS - 1; seg >= 0; seg--) {
+        while ((t = ws_take(&w->deques[seg]))) {
+            if (ws_claim_popped(w, t)) {
+                return t;
+            }
+        }
+    }
+    while ((t = ws_inbox_pop(w, 1))) {
+        if (ws_claim_popped(w, t)) {
+            return t;
+        }
+    }
+    if ((t = ws_scheduled_pop(me))) {
+        *scheduled = 1;
+        return t;
+    }
+    for (i = 0; me->ws_cnt > 1 && i < 2 * me->ws_cnt; i++) {
+        ws_worker_t *v = WS_WORKER(me, ws_random(w) % me->ws_cnt);
+        if (v == w) {
+            continue;
+        }
+        for (seg = TASK_PRIORITY_SEGS - 1; seg >= 0; seg--) {
+            if ((t = ws_steal(&v->deques[seg]))
+                    && (t = ws_claim_popped(w, t))) {
+                return t;
+            }
+        }
+        if ((t = ws_inbox_pop(v, 0)) && (t = ws_claim_popped(w, t))) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static int ws_has_work(apr_thread_pool_t *me)
+{
+    apr_size_t i;
+    int seg;
+
+    if (me->terminated
+            || (me->scheduled_task_cnt && waiting_time(me) == 0)) {
+        return 1;
+    }
+    for (i = 0; i < me->ws_cnt; i++) {
+        ws_worker_t *w = WS_WORKER(me, i);
+        if (apr__atomic_load(&w->inbox_cnt, RELAXED)) {
+            return 1;
+        }
+        for (seg = 0; seg < TASK_PRIORITY_SEGS; seg++) {
+            if (apr__atomic_load(&w->deques[seg].bottom, ACQUIRE)
+                    > apr__atomic_load(&w->deques[seg].top, ACQUIRE)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Sleep until some work is pushed (or scheduled) */
+static void ws_wait(ws_worker_t *w)
+{
+    apr_thread_pool_t *me = w->me;
+
+    apr_thread_mutex_lock(me->lock);
+    /* pairs with the fence in ws_wake() */
+    apr__atomic_add(&me->idle_cnt, 1, SEQ_CST);
+    if (!ws_has_work(me)) {
+        apr_interval_time_t wait = WS_IDLE_WAIT;
+        if (me->scheduled_task_cnt) {
+            apr_interval_time_t next = waiting_time(me);
+            if (next < wait) {
+                wait = next;
+            }
+        }
+        apr_thread_cond_timedwait(me->cond, me->lock, wait);
+    }
+    apr__atomic_sub(&me->idle_cnt, 1, SEQ_CST);
+    apr_thread_mutex_unlock(me->lock);
+}
+
+/* Wake up sleeping workers, if any, after pushing n tasks */
+static void ws_wake(apr_thread_pool_t *me, apr_size_t n)
+{
+    apr__atomic_fence(SEQ_CST);
+    if (apr__atomic_load(&me->idle_cnt, RELAXED)) {
+        apr_thread_mutex_lock(me->lock);
+        if (n > 1) {
+            apr_thread_cond_broadcast(me->cond);
+        }
+        else {
+            apr_thread_cond_signal(me->cond);
+        }
+        apr_thread_mutex_unlock(me->lock);
+    }
+}
+
+static void *APR_THREAD_FUNC ws_thread_func(apr_thread_t *thd, void *param)
+{
+    ws_worker_t *w = param;
+    apr_thread_pool_t *me = w->me;
+    apr_thread_pool_task_t *task;
+    apr_time_t start = 0;
+    int spins = 0, seg = 0;
+
+    apr_threadkey_private_set(w, me->ws_key);
+    while (!apr__atomic_load(&me->terminated, ACQUIRE)) {
+        int scheduled = 0;
+
+        if (w->cpus_gen != apr__atomic_load(&me->cpus_gen, ACQUIRE)) {
+            apr_thread_mutex_lock(me->lock);
+            place_thread(me, thd, &w->cpus_gen,
+                         ((char *)w - (char *)me->workers) / me->ws_stride);
+            apr_thread_mutex_unlock(me->lock);
+        }
+
+        apr__atomic_store(&w->current_owner, &ws_taking, SEQ_CST);
+        task = ws_next_task(w, &scheduled);
+        if (!task) {
+            apr__atomic_store(&w->current_owner, &ws_idle, SEQ_CST);
+            apr__atomic_store(&w->takes, w->takes + 1, RELEASE);
+            if (spins++ < WS_SPINS) {
+                apr_thread_yield();
+            }
+            else {
+                ws_wait(w);
+                spins = 0;
+            }
+            continue;
+        }
+        spins = 0;
+        apr__atomic_store(&w->current_owner,
+                          apr__atomic_load(&task->owner, RELAXED), SEQ_CST);
+        apr__atomic_store(&w->takes, w->takes + 1, RELEASE);
+        if (w->hist) {
+            start = apr_time_now();
+            seg = TASK_PRIORITY_SEG(task);
+            hist_add(w->hist, APR_THREAD_POOL_WAIT_TIME, seg,
+                     start - task->queued);
+        }
+
+        apr_thread_data_set(task, "apr_thread_pool_task", NULL, thd);
+        task->func(thd, task->param);
+        if (task->group) {
+            group_done(task->group, 1);
+        }
+        if (w->hist) {
+            hist_add(w->hist, APR_THREAD_POOL_RUN_TIME, seg,
+                     apr_time_now() - start);
+        }
+
+        apr__atomic_store(&w->current_owner, &ws_idle, SEQ_CST);
+        apr__atomic_store(&w->run, w->run + 1, RELAXED);
+        if (scheduled) {
+            apr_thread_mutex_lock(me->lock);
+            APR_RING_INSERT_TAIL(me->recycled_tasks, task,
+                                 apr_thread_pool_task, link);
+            apr_thread_mutex_unlock(me->lock);
+        }
+        else {
+            ws_recycle(w, task);
+        }
+    }
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;                /* should not be here, safe net */
+}
+
+/*
+ * Push tasks to the deque of the current worker, or to the inbox of the
+ * next worker in turn when called from another thread (the other workers
+ * stealing them from there).
+ */
+static apr_status_t ws_add_tasks(apr_thread_pool_t *me,
+                                 apr_thread_start_t func,
+                                 void * const *params, apr_size_t n,
+                                 apr_byte_t priority, int push, void *owner,
+                                 apr_thread_pool_group_t *group)
+{
+    apr_thread_pool_task_t *t;
+    ws_worker_t *w = NULL;
+    apr_status_t rv = APR_SUCCESS;
+    apr_size_t i;
+    int seg = (priority & 0xFF) / 64;
+    apr_time_t queued = me->histograms ? apr_time_now() : 0;
+
+    apr_threadkey_private_get((void **)&w, me->ws_key);
+    if (w) {
+        for (i = 0; i < n; i++) {
+            if (APR_RING_EMPTY(&w->free, apr_thread_pool_task, link)) {
+                apr_thread_mutex_lock(w->mutex);
+                t = ws_task_alloc(w);
+                apr_thread_mutex_unlock(w->mutex);
+                if (!t) {
+                    rv = APR_ENOMEM;
+                    break;
+                }
+            }
+            else {
+                t = APR_RING_FIRST(&w->free);
+                APR_RING_REMOVE(t, link);
+                --w->free_cnt;
+            }
+            ws_task_init(t, func, params[i], priority, owner, group);
+            t->queued = queued;
+            rv = ws_push(w, &w->deques[seg], t);
+            if (rv != APR_SUCCESS) {
+                apr__atomic_store(&t->ws_state, t->ws_state | 1, RELEASE);
+                ws_recycle(w, t);
+                break;
+            }
+            apr__atomic_store(&w->pushed, w->pushed + 1, RELAXED);
+        }
+    }
+    else {
+        w = WS_WORKER(me, apr__atomic_add(&me->ws_next, 1, SEQ_CST)
+                          % me->ws_cnt);
+        apr_thread_mutex_lock(w->mutex);
+        for (i = 0; i < n; i++) {
+            t = ws_task_alloc(w);
+            if (!t) {
+                rv = APR_ENOMEM;
+                break;
+            }
+            ws_task_init(t, func, params[i], priority, owner, group);
+            t->queued = queued;
+            if (push) {
+                APR_RING_INSERT_TAIL(&w->inbox[seg], t, apr_thread_pool_task,
+                                     link);
+            }
+            else {
+                APR_RING_INSERT_HEAD(&w->inbox[seg], t, apr_thread_pool_task,
+                                     link);
+            }
+        }
+        apr__atomic_store(&w->inbox_cnt, w->inbox_cnt + i, RELAXED);
+        apr__atomic_store(&w->inbox_pushed, w->inbox_pushed + i, RELAXED);
+        apr_thread_mutex_unlock(w->mutex);
+    }
+    if (i < n && group) {
+        group_done(group, n - i);
+    }
+    if (i) {
+        ws_wake(me, i);
+    }
+    return rv;
+}
+
+static void ws_cancel_task(apr_thread_pool_t *me, apr_thread_pool_task_t *t,
+                           void *owner)
+{
+    apr_thread_pool_group_t *group;
+    apr_uint32_t state;
+
+    /* the task may be reused meanwhile, but not with the same state */
+    if (t && !((state = apr__atomic_load(&t->ws_state, ACQUIRE)) & 1)
+            && apr__atomic_load(&t->owner, RELAXED) == owner) {
+        group = apr__atomic_load(&t->group, RELAXED);
+        if (apr__atomic_cas(&t->ws_state, &state, state | 1,
+                            SEQ_CST, RELAXED)) {
+            apr__atomic_add(&me->ws_cancelled, 1, SEQ_CST);
+            if (group) {
+                group_done(group, 1);
+            }
+        }
+    }
+}
+
+/*
+ * Mark the queued tasks of the owner taken, then wait for the workers
+ * running or about to run one of them.
+ */
+static void ws_remove_tasks(apr_thread_pool_t *me, void *owner)
+{
+    apr_thread_pool_task_t *t;
+    apr_size_t i;
+    int seg;
+
+    for (i = 0; i < me->ws_cnt; i++) {
+        ws_worker_t *w = WS_WORKER(me, i);
+        for (seg = 0; seg < TASK_PRIORITY_SEGS; seg++) {
+            ws_deque_t *d = &w->deques[seg];
+            apr_ssize_t top = apr__atomic_load(&d->top, ACQUIRE);
+            apr_ssize_t b = apr__atomic_load(&d->bottom, ACQUIRE);
+            ws_array_t *a = apr__atomic_load(&d->array, ACQUIRE);
+            for (; top < b; top++) {
+                ws_cancel_task(me,
+                               apr__atomic_load(&a->tasks[top & a->mask],
+                                                RELAXED),
+                               owner);
+            }
+        }
+        apr_thread_mutex_lock(w->mutex);
+        for (seg = 0; seg < TASK_PRIORITY_SEGS; seg++) {
+            for (t = APR_RING_FIRST(&w->inbox[seg]);
+                 t != APR_RING_SENTINEL(&w->inbox[seg],
+                                        apr_thread_pool_task, link);
+                 t = APR_RING_NEXT(t, link)) {
+                ws_cancel_task(me, t, owner);
+            }
+        }
+        apr_thread_mutex_unlock(w->mutex);
+    }
+
+    for (i = 0; i < me->ws_cnt; i++) {
+        ws_worker_t *w = WS_WORKER(me, i);
+        apr_uint32_t takes = apr__atomic_load(&w->takes, ACQUIRE);
+
+#ifndef NDEBUG
+        /* make sure the worker is not the one calling tasks_cancel */
+        {
+            void *self = NULL;
+            apr_threadkey_private_get(&self, me->ws_key);
+            assert(self != w);
+        }
+#endif
+        while (apr__atomic_load(&w->current_owner, SEQ_CST) == &ws_taking
+               && apr__atomic_load(&w->takes, ACQUIRE) == takes) {
+            apr_thread_yield();
+        }
+        while (apr__atomic_load(&w->current_owner, SEQ_CST) == owner) {
+            apr_sleep(1000);
+        }
+    }
+}
+
+static apr_status_t ws_thread_pool_cleanup(apr_thread_pool_t *me)
+{
+    apr_status_t rv;
+    apr_size_t i;
 
-        /* 
-         * If there is a scheduled task, always scheduled to perform that task.
-         * Since there is no guarantee that current idle threads are scheduled
-         * for next scheduled task.
-         */
-        if (me->scheduled_task_cnt)
-            wait = waiting_time(me);
-        else if (me->idle_cnt > me->idle_max) {
-            wait = me->idle_wait;
-            elt->state = TH_PROBATION;
+    apr__atomic_store(&me->terminated, 1, SEQ_CST);
+    apr_thread_mutex_lock(me->lock);
+    apr_thread_cond_broadcast(me->cond);
+    apr_thread_mutex_unlock(me->lock);
+    for (i = 0; i < me->ws_cnt; i++) {
+        ws_worker_t *w = WS_WORKER(me, i);
+        if (w->thd) {
+            apr_thread_join(&rv, w->thd);
         }
-        else
-            wait = -1;
+    }
+    me->thd_cnt = 0;
+    apr_threadkey_private_delete(me->ws_key);
+    return APR_SUCCESS;
+}
 
-        if (wait >= 0) {
-            apr_thread_cond_timedwait(me->cond, me->lock, wait);
+static apr_status_t ws_thread_pool_construct(apr_thread_pool_t *me,
+                                             apr_size_t n)
+{
+    apr_status_t rv;
+    apr_size_t i;
+    int seg;
+
+    me->ws_stride = APR_ALIGN(sizeof(ws_worker_t), WS_CACHE_LINE);
+    me->workers = apr_palloc_aligned(me->pool, n * me->ws_stride,
+                                     WS_CACHE_LINE);
+    if (!me->workers) {
+        return APR_ENOMEM;
+    }
+    memset(me->workers, 0, n * me->ws_stride);
+    rv = apr_threadkey_private_create(&me->ws_key, NULL, me->pool);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    for (i = 0; i < n; i++) {
+        ws_worker_t *w = WS_WORKER(me, i);
+
+        w->me = me;
+        w->current_owner = &ws_idle;
+        if (me->histograms && !(w->hist = hist_new(me))) {
+            return APR_ENOMEM;
         }
-        else {
-            apr_thread_cond_wait(me->cond, me->lock);
+        w->seed = (apr_uint32_t)(i * 2654435761U) | 1;
+        APR_RING_INIT(&w->free, apr_thread_pool_task, link);
+        APR_RING_INIT(&w->spare, apr_thread_pool_task, link);
+        rv = apr_pool_create(&w->pool, me->pool);
+        if (rv == APR_SUCCESS) {
+            rv = apr_thread_mutex_create(&w->mutex, APR_THREAD_MUTEX_DEFAULT,
+                                         w->pool);
+        }
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        for (seg = 0; seg < TASK_PRIORITY_SEGS; seg++) {
+            ws_array_t *a;
+
+            APR_RING_INIT(&w->inbox[seg], apr_thread_pool_task, link);
+            a = apr_pcalloc(w->pool, APR_OFFSETOF(ws_array_t, tasks)
+                                     + WS_DEQUE_SIZE
+                                       * sizeof(apr_thread_pool_task_t *));
+            if (!a) {
+                return APR_ENOMEM;
+            }
+            a->mask = WS_DEQUE_SIZE - 1;
+            w->deques[seg].array = a;
         }
     }
-
-    /* idle thread been asked to stop, will be joined */
-    --me->thd_cnt;
-    apr_thread_mutex_unlock(me->lock);
-    apr_thread_exit(t, APR_SUCCESS);
-    return NULL;                /* should not be here, safe net */
+    me->ws_cnt = n;
+    me->thd_max = me->idle_max = n;
+    return APR_SUCCESS;
 }
 
+#endif /* WS_SUPPORTED */
+
 static apr_status_t thread_pool_cleanup(void *me)
 {
     apr_thread_pool_t *_myself = me;
 
-    _myself->terminated = 1;
-    apr_thread_pool_idle_max_set(_myself, 0);
-    while (_myself->thd_cnt) {
-        apr_sleep(20 * 1000);   /* spin lock with 20 ms */
+#if WS_SUPPORTED
+    if (_myself->workers) {
+        ws_thread_pool_cleanup(_myself);
+    }
+    else
+#endif
+    {
+        _myself->terminated = 1;
+        apr_thread_pool_idle_max_set(_myself, 0);
+        while (_myself->thd_cnt) {
+            apr_sleep(20 * 1000);   /* spin lock with 20 ms */
+        }
     }
     apr_pool_owner_set(_myself->pool, 0);
     apr_thread_mutex_destroy(_myself->lock);
@@ -347,6 +1235,15 @@ APR_DECLARE(apr_status_t) apr_thread_pool_create(apr_thread_pool_t ** me,
                                                  apr_size_t init_threads,
                                                  apr_size_t max_threads,
                                                  apr_pool_t * pool)
+{
+    return apr_thread_pool_create_ex(me, init_threads, max_threads, 0, pool);
+}
+
+APR_DECLARE(apr_status_t) apr_thread_pool_create_ex(apr_thread_pool_t ** me,
+                                                    apr_size_t init_threads,
+                                                    apr_size_t max_threads,
+                                                    apr_uint32_t flags,
+                                                    apr_pool_t * pool)
 {
     apr_thread_t *t;
     apr_status_t rv = APR_SUCCESS;
@@ -354,6 +1251,7 @@ APR_DECLARE(apr_status_t) apr_thread_pool_create(apr_thread_pool_t ** me,
 
     *me = NULL;
     tp = apr_pcalloc(pool, sizeof(apr_thread_pool_t));
+    tp->histograms = (flags & APR_THREAD_POOL_HISTOGRAMS) != 0;
 
     /*
      * This pool will be used by different threads. As we cannot ensure that
@@ -368,6 +1266,29 @@ APR_DECLARE(apr_status_t) apr_thread_pool_create(apr_thread_pool_t ** me,
         return rv;
     apr_pool_pre_cleanup_register(tp->pool, tp, thread_pool_cleanup);
 
+#if WS_SUPPORTED
+    if (flags & APR_THREAD_POOL_WORK_STEALING) {
+        apr_size_t i, n = (max_threads > init_threads) ? max_threads
+                                                       : init_threads;
+
+        rv = ws_thread_pool_construct(tp, n ? n : 1);
+        /* a fixed set of workers, all created upfront */
+        for (i = 0; rv == APR_SUCCESS && i < tp->ws_cnt; i++) {
+            ws_worker_t *w = WS_WORKER(tp, i);
+
+            apr_thread_mutex_lock(tp->lock);
+            apr_pool_owner_set(tp->pool, 0);
+            rv = apr_thread_create(&w->thd, NULL, ws_thread_func, w,
+                                   tp->pool);
+            apr_thread_mutex_unlock(tp->lock);
+            if (APR_SUCCESS == rv) {
+                tp->thd_cnt = tp->thd_high = i + 1;
+            }
+        }
+        init_threads = 0;
+    }
+#endif
+
     while (init_threads) {
         /* Grab the mutex as apr_thread_create() and thread_pool_func() will 
          * allocate from (*me)->pool. This is dangerous if there are multiple 
@@ -425,6 +1346,7 @@ static apr_thread_pool_task_t *task_new(apr_thread_pool_t * me,
     t->func = func;
     t->param = param;
     t->owner = owner;
+    t->group = NULL;
     if (time > 0) {
         t->dispatch.time = apr_time_now() + time;
     }
@@ -477,15 +1399,15 @@ static apr_thread_pool_task_t *add_if_empty(apr_thread_pool_t * me,
 }
 
 /*
-*   schedule a task to run in "time" microseconds. Find the spot in the ring where
-*   the time fits. Adjust the short_time so the thread wakes up when the time is reached.
+*   schedule a task to run in "time" microseconds. Add it to the timer wheel
+*   at its time, in O(1). Adjust the short_time so the thread wakes up when
+*   the time is reached.
 */
 static apr_status_t schedule_task(apr_thread_pool_t *me,
                                   apr_thread_start_t func, void *param,
                                   void *owner, apr_interval_time_t time)
 {
     apr_thread_pool_task_t *t;
-    apr_thread_pool_task_t *t_loc;
     apr_thread_t *thd;
     apr_status_t rv = APR_SUCCESS;
     apr_thread_mutex_lock(me->lock);
@@ -496,26 +1418,14 @@ static apr_status_t schedule_task(apr_thread_pool_t *me,
         apr_thread_mutex_unlock(me->lock);
         return APR_ENOMEM;
     }
-    t_loc = APR_RING_FIRST(me->scheduled_tasks);
-    while (NULL != t_loc) {
-        /* if the time is less than the entry insert ahead of it */
-        if (t->dispatch.time < t_loc->dispatch.time) {
-            ++me->scheduled_task_cnt;
-            APR_RING_INSERT_BEFORE(t_loc, t, link);
-            break;
-        }
-        else {
-            t_loc = APR_RING_NEXT(t_loc, link);
-            if (t_loc ==
-                APR_RING_SENTINEL(me->scheduled_tasks, apr_thread_pool_task,
-                                  link)) {
-                ++me->scheduled_task_cnt;
-                APR_RING_INSERT_TAIL(me->scheduled_tasks, t,
-                                     apr_thread_pool_task, link);
-                break;
-            }
-        }
+    t->queued = (time > 0) ? t->dispatch.time : apr_time_now();
+    if (apr_timer_wheel_add(me->scheduled_tasks, t->queued, t, NULL)) {
+        APR_RING_INSERT_TAIL(me->recycled_tasks, t,
+                             apr_thread_pool_task, link);
+        apr_thread_mutex_unlock(me->lock);
+        return APR_ENOMEM;
     }
+    ++me->scheduled_task_cnt;
     /* there should be at least one thread for scheduled tasks */
     if (0 == me->thd_cnt) {
         rv = apr_thread_create(&thd, NULL, thread_pool_func, me, me->pool);
@@ -530,27 +1440,17 @@ static apr_status_t schedule_task(apr_thread_pool_t *me,
     return rv;
 }
 
-static apr_status_t add_task(apr_thread_pool_t *me, apr_thread_start_t func,
-                             void *param, apr_byte_t priority, int push,
-                             void *owner)
+/*
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static void insert_task(apr_thread_pool_t *me, apr_thread_pool_task_t *t,
+                        int push)
 {
-    apr_thread_pool_task_t *t;
     apr_thread_pool_task_t *t_loc;
-    apr_thread_t *thd;
-    apr_status_t rv = APR_SUCCESS;
-
-    apr_thread_mutex_lock(me->lock);
-    apr_pool_owner_set(me->pool, 0);
-
-    t = task_new(me, func, param, priority, owner, 0);
-    if (NULL == t) {
-        apr_thread_mutex_unlock(me->lock);
-        return APR_ENOMEM;
-    }
 
     t_loc = add_if_empty(me, t);
     if (NULL == t_loc) {
-        goto FINAL_EXIT;
+        return;
     }
 
     if (push) {
@@ -565,22 +1465,79 @@ static apr_status_t add_task(apr_thread_pool_t *me, apr_thread_start_t func,
             me->task_idx[TASK_PRIORITY_SEG(t)] = t;
         }
     }
+}
+
+static apr_status_t add_tasks(apr_thread_pool_t *me, apr_thread_start_t func,
+                              void * const *params, apr_size_t n,
+                              apr_byte_t priority, int push, void *owner,
+                              apr_thread_pool_group_t *group)
+{
+    apr_thread_pool_task_t *t;
+    apr_thread_t *thd;
+    apr_status_t rv = APR_SUCCESS;
+    apr_size_t i, created = 0;
+    apr_time_t queued;
+
+    if (group) {
+        group_add(group, n);
+    }
+
+#if WS_SUPPORTED
+    if (me->workers) {
+        return ws_add_tasks(me, func, params, n, priority, push, owner,
+                            group);
+    }
+#endif
+
+    queued = me->histograms ? apr_time_now() : 0;
+    apr_thread_mutex_lock(me->lock);
+    apr_pool_owner_set(me->pool, 0);
+
+    for (i = 0; i < n; i++) {
+        t = task_new(me, func, params[i], priority, owner, 0);
+        if (NULL == t) {
+            rv = APR_ENOMEM;
+            break;
+        }
+        t->group = group;
+        t->queued = queued;
+        insert_task(me, t, push);
+        me->task_cnt++;
+    }
+    if (i < n && group) {
+        group_done(group, n - i);
+    }
+    if (0 == i) {
+        apr_thread_mutex_unlock(me->lock);
+        return rv;
+    }
 
-  FINAL_EXIT:
-    me->task_cnt++;
     if (me->task_cnt > me->tasks_high)
         me->tasks_high = me->task_cnt;
-    if (0 == me->thd_cnt || (0 == me->idle_cnt && me->thd_cnt < me->thd_max &&
-                             me->task_cnt > me->threshold)) {
-        rv = apr_thread_create(&thd, NULL, thread_pool_func, me, me->pool);
-        if (APR_SUCCESS == rv) {
-            ++me->thd_cnt;
-            if (me->thd_cnt > me->thd_high)
-                me->thd_high = me->thd_cnt;
+    /* as many new threads as the tasks not taken by the idle ones */
+    while (0 == me->thd_cnt
+           || (me->idle_cnt + created < i && me->thd_cnt < me->thd_max
+               && me->task_cnt > me->threshold)) {
+        apr_status_t rv_thd;
+
+        rv_thd = apr_thread_create(&thd, NULL, thread_pool_func, me,
+                                   me->pool);
+        if (APR_SUCCESS != rv_thd) {
+            rv = rv_thd;
+            break;
         }
+        ++created;
+        ++me->thd_cnt;
+        if (me->thd_cnt > me->thd_high)
+            me->thd_high = me->thd_cnt;
     }
 
-    apr_thread_cond_signal(me->cond);
+    if (i > 1) {
+        apr_thread_cond_broadcast(me->cond);
+    }
+    else {
+        apr_thread_cond_signal(me->cond);
+    }
     apr_thread_mutex_unlock(me->lock);
 
     return rv;
@@ -592,7 +1549,20 @@ APR_DECLARE(apr_status_t) apr_thread_pool_push(apr_thread_pool_t *me,
                                                apr_byte_t priority,
                                                void *owner)
 {
-    return add_task(me, func, param, priority, 1, owner);
+    return add_tasks(me, func, &param, 1, priority, 1, owner, NULL);
+}
+
+APR_DECLARE(apr_status_t)
+    apr_thread_pool_push_batch(apr_thread_pool_t *me,
+                               apr_thread_start_t func,
+                               void * const *params, apr_size_t n,
+                               apr_byte_t priority, void *owner,
+                               apr_thread_pool_group_t *group)
+{
+    if (!n) {
+        return APR_SUCCESS;
+    }
+    return add_tasks(me, func, params, n, priority, 1, owner, group);
 }
 
 APR_DECLARE(apr_status_t) apr_thread_pool_schedule(apr_thread_pool_t *me,
@@ -610,27 +1580,35 @@ APR_DECLARE(apr_status_t) apr_thread_pool_top(apr_thread_pool_t *me,
                                               apr_byte_t priority,
                                               void *owner)
 {
-    return add_task(me, func, param, priority, 0, owner);
+    return add_tasks(me, func, &param, 1, priority, 0, owner, NULL);
+}
+
+struct remove_scheduled_ctx {
+    apr_thread_pool_t *me;
+    void *owner;
+};
+
+static int remove_scheduled_task(void *rec, apr_timer_t *timer, void *data)
+{
+    struct remove_scheduled_ctx *ctx = rec;
+    apr_thread_pool_task_t *t_loc = data;
+
+    /* if this is the owner remove it */
+    if (t_loc->owner == ctx->owner) {
+        --ctx->me->scheduled_task_cnt;
+        apr_timer_wheel_cancel(ctx->me->scheduled_tasks, timer);
+    }
+    return 1;
 }
 
 static apr_status_t remove_scheduled_tasks(apr_thread_pool_t *me,
                                            void *owner)
 {
-    apr_thread_pool_task_t *t_loc;
-    apr_thread_pool_task_t *next;
+    struct remove_scheduled_ctx ctx;
 
-    t_loc = APR_RING_FIRST(me->scheduled_tasks);
-    while (t_loc !=
-           APR_RING_SENTINEL(me->scheduled_tasks, apr_thread_pool_task,
-                             link)) {
-        next = APR_RING_NEXT(t_loc, link);
-        /* if this is the owner remove it */
-        if (t_loc->owner == owner) {
-            --me->scheduled_task_cnt;
-            APR_RING_REMOVE(t_loc, link);
-        }
-        t_loc = next;
-    }
+    ctx.me = me;
+    ctx.owner = owner;
+    apr_timer_wheel_do(remove_scheduled_task, &ctx, me->scheduled_tasks);
     return APR_SUCCESS;
 }
 
@@ -656,6 +1634,11 @@ static apr_status_t remove_tasks(apr_thread_pool_t *me, void *owner)
                 }
             }
             APR_RING_REMOVE(t_loc, link);
+            if (t_loc->group) {
+                group_done(t_loc->group, 1);
+            }
+            APR_RING_INSERT_TAIL(me->recycled_tasks, t_loc,
+                                 apr_thread_pool_task, link);
         }
         t_loc = next;
     }
@@ -710,6 +1693,12 @@ APR_DECLARE(apr_status_t) apr_thread_pool_tasks_cancel(apr_thread_pool_t *me,
         rv = remove_scheduled_tasks(me, owner);
     }
     apr_thread_mutex_unlock(me->lock);
+#if WS_SUPPORTED
+    if (me->workers) {
+        ws_remove_tasks(me, owner);
+        return rv;
+    }
+#endif
     wait_on_busy_threads(me, owner);
 
     return rv;
@@ -717,6 +1706,20 @@ APR_DECLARE(apr_status_t) apr_thread_pool_tasks_cancel(apr_thread_pool_t *me,
 
 APR_DECLARE(apr_size_t) apr_thread_pool_tasks_count(apr_thread_pool_t *me)
 {
+#if WS_SUPPORTED
+    if (me->workers) {
+        apr_size_t i, pushed = 0;
+        apr_size_t taken = apr__atomic_load(&me->ws_cancelled, ACQUIRE);
+
+        for (i = 0; i < me->ws_cnt; i++) {
+            ws_worker_t *w = WS_WORKER(me, i);
+            pushed += apr__atomic_load(&w->pushed, RELAXED)
+                      + apr__atomic_load(&w->inbox_pushed, RELAXED);
+            taken += apr__atomic_load(&w->taken, RELAXED);
+        }
+        return (pushed > taken) ? pushed - taken : 0;
+    }
+#endif
     return me->task_cnt;
 }
 
@@ -744,7 +1747,17 @@ APR_DECLARE(apr_size_t) apr_thread_pool_idle_count(apr_thread_pool_t *me)
 APR_DECLARE(apr_size_t)
     apr_thread_pool_tasks_run_count(apr_thread_pool_t * me)
 {
-    return me->tasks_run;
+#if WS_SUPPORTED
+    if (me->workers) {
+        apr_size_t i, run = 0;
+
+        for (i = 0; i < me->ws_cnt; i++) {
+            run += apr__atomic_load(&WS_WORKER(me, i)->run, RELAXED);
+        }
+        return run;
+    }
+#endif
+    return (apr_size_t)apr_counter_read(me->tasks_run);
 }
 
 APR_DECLARE(apr_size_t)
@@ -875,6 +1888,9 @@ static apr_size_t trim_busy_threads(apr_thread_pool_t *me, apr_size_t cnt)
 APR_DECLARE(apr_size_t) apr_thread_pool_idle_max_set(apr_thread_pool_t *me,
                                                      apr_size_t cnt)
 {
+    if (me->workers) {
+        return 0;
+    }
     me->idle_max = cnt;
     cnt = trim_idle_threads(me, cnt);
     return cnt;
@@ -906,6 +1922,9 @@ APR_DECLARE(apr_size_t) apr_thread_pool_thread_max_set(apr_thread_pool_t *me,
 {
     unsigned int n;
 
+    if (me->workers) {
+        return 0;
+    }
     me->thd_max = cnt;
     if (0 == cnt || me->thd_cnt <= cnt) {
         return 0;
@@ -937,6 +1956,234 @@ APR_DECLARE(apr_size_t) apr_thread_pool_threshold_set(apr_thread_pool_t *me,
     return ov;
 }
 
+typedef struct cpu_place
+{
+    apr_uint32_t cpu;
+    apr_uint32_t node;
+    apr_size_t rank;            /* in its node */
+} cpu_place_t;
+
+/* Stable insertion sort, by node or by rank then node */
+static void sort_cpus(cpu_place_t *places, apr_size_t n, int by_rank)
+{
+    apr_size_t i, j;
+
+    for (i = 1; i < n; i++) {
+        cpu_place_t p = places[i];
+
+        for (j = i; j > 0; j--) {
+            cpu_place_t *q = &places[j - 1];
+            if (by_rank ? (q->rank < p.rank
+                           || (q->rank == p.rank && q->node <= p.node))
+                        : q->node <= p.node) {
+                break;
+            }
+            places[j] = *q;
+        }
+        places[j] = p;
+    }
+}
+
+APR_DECLARE(apr_status_t)
+    apr_thread_pool_affinity_set(apr_thread_pool_t *me,
+                                 const apr_uint32_t *cpus, apr_size_t ncpus,
+                                 int placement)
+{
+    apr_pool_t *ptemp;
+    apr_threadattr_t *attr;
+    cpu_place_t *places;
+    apr_status_t rv;
+    apr_size_t i;
+
+    if (placement != APR_THREAD_POOL_AFFINITY_COMPACT
+            && placement != APR_THREAD_POOL_AFFINITY_SPREAD) {
+        return APR_EINVAL;
+    }
+
+    apr_thread_mutex_lock(me->lock);
+    apr_pool_owner_set(me->pool, 0);
+    if (!ncpus) {
+        me->cpus_cnt = 0;
+        goto NEW_GEN;
+    }
+
+    rv = apr_pool_create(&ptemp, me->pool);
+    if (APR_SUCCESS != rv) {
+        apr_thread_mutex_unlock(me->lock);
+        return rv;
+    }
+    /* checks the support and the CPUs */
+    rv = apr_threadattr_create(&attr, ptemp);
+    if (APR_SUCCESS == rv) {
+        rv = apr_threadattr_affinity_set(attr, cpus, ncpus);
+    }
+    if (APR_SUCCESS == rv && ncpus > me->cpus_max) {
+        me->cpus = apr_palloc(me->pool, ncpus * sizeof(*me->cpus));
+        me->cpus_max = ncpus;
+    }
+    if (APR_SUCCESS != rv) {
+        apr_pool_destroy(ptemp);
+        apr_thread_mutex_unlock(me->lock);
+        return rv;
+    }
+
+    /* the CPUs whose node is unknown are on the first one */
+    places = apr_palloc(ptemp, ncpus * sizeof(*places));
+    for (i = 0; i < ncpus; i++) {
+        places[i].cpu = cpus[i];
+        if (APR_SUCCESS != apr_cpu_node_get(cpus[i], &places[i].node)) {
+            places[i].node = 0;
+        }
+    }
+    sort_cpus(places, ncpus, 0);
+    if (APR_THREAD_POOL_AFFINITY_SPREAD == placement) {
+        for (i = 0; i < ncpus; i++) {
+            places[i].rank = (i && places[i].node == places[i - 1].node)
+                             ? places[i - 1].rank + 1 : 0;
+        }
+        sort_cpus(places, ncpus, 1);
+    }
+    for (i = 0; i < ncpus; i++) {
+        me->cpus[i] = places[i].cpu;
+    }
+    me->cpus_cnt = ncpus;
+    apr_pool_destroy(ptemp);
+
+  NEW_GEN:
+    me->cpus_next = 0;
+#if WS_SUPPORTED
+    apr__atomic_store(&me->cpus_gen, me->cpus_gen + 1, RELEASE);
+#else
+    me->cpus_gen++;
+#endif
+    apr_thread_mutex_unlock(me->lock);
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t)
+    apr_thread_pool_group_create(apr_thread_pool_group_t **group,
+                                 apr_pool_t *pool)
+{
+    apr_thread_pool_group_t *g;
+    apr_status_t rv;
+
+    *group = NULL;
+    g = apr_pcalloc(pool, sizeof(*g));
+    rv = apr_thread_mutex_create(&g->lock, APR_THREAD_MUTEX_DEFAULT, pool);
+    if (APR_SUCCESS != rv) {
+        return rv;
+    }
+    rv = apr_thread_cond_create(&g->cond, pool);
+    if (APR_SUCCESS != rv) {
+        apr_thread_mutex_destroy(g->lock);
+        return rv;
+    }
+    *group = g;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t)
+    apr_thread_pool_group_wait(apr_thread_pool_group_t *group,
+                               apr_interval_time_t timeout)
+{
+    apr_status_t rv = APR_SUCCESS;
+    apr_time_t deadline = 0;
+
+    if (timeout > 0) {
+        deadline = apr_time_now() + timeout;
+    }
+    apr_thread_mutex_lock(group->lock);
+    while (group->count && APR_SUCCESS == rv) {
+        if (timeout < 0) {
+            rv = apr_thread_cond_wait(group->cond, group->lock);
+        }
+        else {
+            apr_interval_time_t left = deadline - apr_time_now();
+            if (left <= 0) {
+                rv = APR_TIMEUP;
+                break;
+            }
+            rv = apr_thread_cond_timedwait(group->cond, group->lock, left);
+            if (APR_STATUS_IS_TIMEUP(rv)) {
+                /* checked against the deadline */
+                rv = APR_SUCCESS;
+            }
+        }
+    }
+    apr_thread_mutex_unlock(group->lock);
+    return rv;
+}
+
+APR_DECLARE(apr_size_t)
+    apr_thread_pool_group_count(apr_thread_pool_group_t *group)
+{
+    apr_size_t count;
+
+    apr_thread_mutex_lock(group->lock);
+    count = group->count;
+    apr_thread_mutex_unlock(group->lock);
+    return count;
+}
+
+APR_DECLARE(apr_status_t)
+    apr_thread_pool_latency_get(apr_thread_pool_t *me, int which,
+                                int priority, double percentile,
+                                apr_interval_time_t *latency,
+                                apr_uint64_t *count)
+{
+    apr_uint64_t merged[HIST_BUCKETS], total = 0, rank;
+    double r;
+    hist_t *h;
+    int seg, b;
+
+    if ((which != APR_THREAD_POOL_WAIT_TIME
+         && which != APR_THREAD_POOL_RUN_TIME)
+            || priority < APR_THREAD_POOL_ALL_PRIORITIES || priority > 255
+            || !(percentile >= 0 && percentile <= 100)) {
+        return APR_EINVAL;
+    }
+
+    memset(merged, 0, sizeof(merged));
+    apr_thread_mutex_lock(me->lock);
+    for (h = me->hists; h; h = h->next) {
+        for (seg = 0; seg < TASK_PRIORITY_SEGS; seg++) {
+            if (priority >= 0 && seg != priority / 64) {
+                continue;
+            }
+            for (b = 0; b < HIST_BUCKETS; b++) {
+                merged[b] += apr__atomic_load(&h->counts[which][seg][b],
+                                              RELAXED);
+            }
+        }
+    }
+    apr_thread_mutex_unlock(me->lock);
+
+    for (b = 0; b < HIST_BUCKETS; b++) {
+        total += merged[b];
+    }
+    if (count) {
+        *count = total;
+    }
+    if (!total) {
+        return APR_ENOENT;
+    }
+
+    /* the rank of the percentile, rounded up, from 1 to total */
+    r = percentile / 100 * (double)total;
+    rank = (apr_uint64_t)r;
+    if ((double)rank < r || !rank) {
+        rank++;
+    }
+    for (b = 0; b < HIST_BUCKETS - 1; b++) {
+        if (merged[b] >= rank) {
+            break;
+        }
+        rank -= merged[b];
+    }
+    *latency = hist_value(b);
+    return APR_SUCCESS;
+}
+
 APR_DECLARE(apr_status_t) apr_thread_pool_task_owner_get(apr_thread_t *thd,
                                                          void **owner)
 {
@@ -0,0 +1,349 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_timer_wheel.h"
+#include "apr_ring.h"
+
+/*
+ * The time is counted in ticks of the resolution.  The wheel of level l
+ * has 64 slots for the ticks whose l-th group of 6 bits is the slot's
+ * index, and whose higher bits are those of the current tick: a timer is
+ * placed at the lowest level where its tick shares the higher bits with
+ * the current tick.  When the current tick reaches the start of a slot,
+ * the timers of the slot are placed again, at lower levels or in the
+ * expired list for those of the current tick.
+ *
+ * The timers beyond the top wheel (more than 2^36 ticks away) wait in an
+ * overflow slot until the current tick reaches the next 2^36 boundary.
+ */
+#define TW_BITS     6
+#define TW_SLOTS    (1 << TW_BITS)
+#define TW_MASK     (TW_SLOTS - 1)
+#define TW_LEVELS   6
+#define TW_OVERFLOW (TW_LEVELS * TW_SLOTS)
+#define TW_EXPIRED  (-1)
+
+struct apr_timer_t {
+    APR_RING_ENTRY(apr_timer_t) link;
+    apr_uint64_t tick;
+    void *data;
+    int slot;
+};
+
+APR_RING_HEAD(apr_timer_list_t, apr_timer_t);
+
+struct apr_timer_wheel_t {
+    apr_pool_t *pool;
+    apr_interval_time_t resolution;
+    apr_uint64_t now;
+    apr_size_t count;
+    /* the non-empty slots of each level */
+    apr_uint64_t used[TW_LEVELS];
+    struct apr_timer_list_t slots[TW_LEVELS * TW_SLOTS + 1];
+    struct apr_timer_list_t expired;
+    struct apr_timer_list_t recycled;
+    /* the timers of the slot being cascaded */
+    struct apr_timer_list_t cascade;
+};
+
+/* The index of the lowest bit set in bits (non-zero) */
+static APR_INLINE int tw_first_bit(apr_uint64_t bits)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#else
+    int i = 0;
+
+    while (!(bits & 1)) {
+        bits >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+static APR_INLINE apr_uint64_t tw_tick(apr_timer_wheel_t *tw, apr_time_t t,
+                                       int round_up)
+{
+    if (t <= 0) {
+        return 0;
+    }
+    if (round_up) {
+        t += tw->resolution - 1;
+    }
+    return (apr_uint64_t)t / (apr_uint64_t)tw->resolution;
+}
+
+static void tw_place(apr_timer_wheel_t *tw, apr_timer_t *t)
+{
+    apr_uint64_t diff;
+    int level, idx;
+
+    if (t->tick <= tw->now) {
+        t->slot = TW_EXPIRED;
+        APR_RING_INSERT_TAIL(&tw->expired, t, apr_timer_t, link);
+        return;
+    }
+
+    diff = t->tick ^ tw->now;
+    for (level = 0; level < TW_LEVELS; level++) {
+        if (!(diff >> ((level + 1) * TW_BITS))) {
+            break;
+        }
+    }
+    if (level < TW_LEVELS) {
+        idx = (int)(t->tick >> (level * TW_BITS)) & TW_MASK;
+        t->slot = level * TW_SLOTS + idx;
+        tw->used[level] |= (apr_uint64_t)1 << idx;
+    }
+    else {
+        t->slot = TW_OVERFLOW;
+    }
+    APR_RING_INSERT_TAIL(&tw->slots[t->slot], t, apr_timer_t, link);
+}
+
+/* Find the next slot to process after the current tick, the lowest level
+ * one with a timer since the higher levels' start after a whole turn of
+ * the lower ones.
+ */
+static int tw_next_slot(apr_timer_wheel_t *tw, apr_uint64_t *tick)
+{
+    int level;
+
+    for (level = 0; level < TW_LEVELS; level++) {
+        int shift = level * TW_BITS;
+        int cur = (int)(tw->now >> shift) & TW_MASK;
+        /* the slots after the current one (none after the last) */
+        apr_uint64_t ahead = tw->used[level]
+                             & ~(((apr_uint64_t)2 << cur) - 1);
+        if (ahead) {
+            int idx = tw_first_bit(ahead);
+            *tick = ((tw->now >> (shift + TW_BITS)) << (shift + TW_BITS))
+                    | ((apr_uint64_t)idx << shift);
+            return level * TW_SLOTS + idx;
+        }
+    }
+    if (!APR_RING_EMPTY(&tw->slots[TW_OVERFLOW], apr_timer_t, link)) {
+        *tick = ((tw->now >> (TW_LEVELS * TW_BITS)) + 1)
+                << (TW_LEVELS * TW_BITS);
+        return TW_OVERFLOW;
+    }
+    return TW_EXPIRED;
+}
+
+static void tw_advance(apr_timer_wheel_t *tw, apr_uint64_t target)
+{
+    while (tw->now < target) {
+        apr_uint64_t tick;
+        int slot;
+
+        slot = tw_next_slot(tw, &tick);
+        if (slot == TW_EXPIRED || tick > target) {
+            tw->now = target;
+            break;
+        }
+        tw->now = tick;
+
+        /* cascade the slot */
+        APR_RING_CONCAT(&tw->cascade, &tw->slots[slot], apr_timer_t, link);
+        if (slot != TW_OVERFLOW) {
+            tw->used[slot / TW_SLOTS] &= ~((apr_uint64_t)1
+                                           << (slot % TW_SLOTS));
+        }
+        while (!APR_RING_EMPTY(&tw->cascade, apr_timer_t, link)) {
+            apr_timer_t *t = APR_RING_FIRST(&tw->cascade);
+            APR_RING_REMOVE(t, link);
+            tw_place(tw, t);
+        }
+    }
+}
+
+static void tw_recycle(apr_timer_wheel_t *tw, apr_timer_t *t)
+{
+    t->data = NULL;
+    APR_RING_INSERT_TAIL(&tw->recycled, t, apr_timer_t, link);
+}
+
+APR_DECLARE(apr_status_t) apr_timer_wheel_create(apr_timer_wheel_t **tw,
+                                                 apr_interval_time_t resolution,
+                                                 apr_time_t now,
+                                                 apr_pool_t *pool)
+{
+    apr_timer_wheel_t *w;
+    int i;
+
+    *tw = w = apr_pcalloc(pool, sizeof(*w));
+    if (!w) {
+        return APR_ENOMEM;
+    }
+    w->pool = pool;
+    w->resolution = (resolution > 0) ? resolution : 1000;
+    w->now = tw_tick(w, now, 0);
+    for (i = 0; i <= TW_OVERFLOW; i++) {
+        APR_RING_INIT(&w->slots[i], apr_timer_t, link);
+    }
+    APR_RING_INIT(&w->expired, apr_timer_t, link);
+    APR_RING_INIT(&w->recycled, apr_timer_t, link);
+    APR_RING_INIT(&w->cascade, apr_timer_t, link);
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_timer_wheel_add(apr_timer_wheel_t *tw,
+                                              apr_time_t when, void *data,
+                                              apr_timer_t **timer)
+{
+    apr_timer_t *t;
+
+    if (APR_RING_EMPTY(&tw->recycled, apr_timer_t, link)) {
+        t = apr_palloc(tw->pool, sizeof(*t));
+        if (!t) {
+            return APR_ENOMEM;
+        }
+    }
+    else {
+        t = APR_RING_FIRST(&tw->recycled);
+        APR_RING_REMOVE(t, link);
+    }
+    APR_RING_ELEM_INIT(t, link);
+    t->tick = tw_tick(tw, when, 1);
+    t->data = data;
+    tw_place(tw, t);
+    tw->count++;
+
+    if (timer) {
+        *timer = t;
+    }
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void *) apr_timer_wheel_cancel(apr_timer_wheel_t *tw,
+                                           apr_timer_t *timer)
+{
+    void *data = timer->data;
+
+    APR_RING_REMOVE(timer, link);
+    if (timer->slot != TW_EXPIRED && timer->slot != TW_OVERFLOW
+            && APR_RING_EMPTY(&tw->slots[timer->slot], apr_timer_t, link)) {
+        tw->used[timer->slot / TW_SLOTS] &= ~((apr_uint64_t)1
+                                              << (timer->slot % TW_SLOTS));
+    }
+    tw->count--;
+    tw_recycle(tw, timer);
+    return data;
+}
+
+APR_DECLARE(apr_size_t) apr_timer_wheel_expire(apr_timer_wheel_t *tw,
+                                               apr_time_t now,
+                                               apr_timer_callback_fn_t *func,
+                                               void *rec)
+{
+    apr_size_t n = 0;
+
+    tw_advance(tw, tw_tick(tw, now, 0));
+    while (!APR_RING_EMPTY(&tw->expired, apr_timer_t, link)) {
+        apr_timer_t *t = APR_RING_FIRST(&tw->expired);
+        int rv;
+
+        APR_RING_REMOVE(t, link);
+        tw->count--;
+        n++;
+        rv = func(rec, t, t->data);
+        tw_recycle(tw, t);
+        if (!rv) {
+            break;
+        }
+    }
+    return n;
+}
+
+APR_DECLARE(apr_status_t) apr_timer_wheel_pop(apr_timer_wheel_t *tw,
+                                              apr_time_t now, void **data)
+{
+    apr_timer_t *t;
+
+    tw_advance(tw, tw_tick(tw, now, 0));
+    if (APR_RING_EMPTY(&tw->expired, apr_timer_t, link)) {
+        return APR_EAGAIN;
+    }
+    t = APR_RING_FIRST(&tw->expired);
+    APR_RING_REMOVE(t, link);
+    tw->count--;
+    *data = t->data;
+    tw_recycle(tw, t);
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_timer_wheel_next(apr_timer_wheel_t *tw,
+                                               apr_time_t *when)
+{
+    apr_uint64_t tick;
+
+    if (!tw->count) {
+        return APR_EAGAIN;
+    }
+    if (!APR_RING_EMPTY(&tw->expired, apr_timer_t, link)) {
+        tick = tw->now;
+    }
+    else if (tw_next_slot(tw, &tick) == TW_EXPIRED) {
+        return APR_EAGAIN;
+    }
+    *when = (apr_time_t)(tick * (apr_uint64_t)tw->resolution);
+    return APR_SUCCESS;
+}
+
+static int tw_do_list(apr_timer_callback_fn_t *func, void *rec,
+                      struct apr_timer_list_t *list)
+{
+    apr_timer_t *t, *next;
+
+    for (t = APR_RING_FIRST(list);
+         t != APR_RING_SENTINEL(list, apr_timer_t, link);
+         t = next) {
+        /* the timer may be cancelled */
+        next = APR_RING_NEXT(t, link);
+        if (!func(rec, t, t->data)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+APR_DECLARE(int) apr_timer_wheel_do(apr_timer_callback_fn_t *func,
+                                    void *rec, apr_timer_wheel_t *tw)
+{
+    int level;
+
+    if (!tw_do_list(func, rec, &tw->expired)) {
+        return FALSE;
+    }
+    for (level = 0; level < TW_LEVELS; level++) {
+        apr_uint64_t used = tw->used[level];
+        while (used) {
+            int idx = tw_first_bit(used);
+            used &= used - 1;
+            if (!tw_do_list(func, rec,
+                            &tw->slots[level * TW_SLOTS + idx])) {
+                return FALSE;
+            }
+        }
+    }
+    return tw_do_list(func, rec, &tw->slots[TW_OVERFLOW]);
+}
+
+APR_DECLARE(apr_size_t) apr_timer_wheel_count(apr_timer_wheel_t *tw)
+{
+    return tw->count;
+}